@@ -1,4 +1,4 @@
-/* btree.c -- btree implementation. 
+/* btree.c -- btree implementation.
 
    Copyright 2015 Jonathan Sacramento.
 
@@ -13,11 +13,13 @@
    GNU General Public License for more details.
 
    You should have received a copy of the GNU General Public License
-   along with this program.  If not, see <http://www.gnu.org/licenses/>.  
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "btree.h"
 
+
+
 /************************************************
  ************************************************
  **                                           **
@@ -28,7 +30,7 @@
 
 
 
-/** 
+/**
  ** Allocates memory for a BTree
  **/
 BTree* btreeAlloc(void) {
@@ -42,470 +44,362 @@ BTree* btreeAlloc(void) {
         return NULL;
     }
 
-    /* When a btree is allocated, so is the root node */
-    btree->root = btreeNodeAlloc();
+    /* When a btree is allocated, so is the root node (a leaf until it is split) */
+    btree->root = btreeNodeAlloc(btree, LEAF_TRUE);
     assert(btree->root != NULL);
 
-    btree->numNodes = 1;
+    btree->firstLeaf = btree->root;
     btree->numKeys = 0;
-    btree->rootNodeOffset = 0;
-    //btree->nextFreeNodeOffset = 0;
-    
+
     return btree;
 
 }
 
 
 
-/** 
- ** Allocates memory for a BTreeNode
+/**
+ ** Allocates a BTreeNode from the slabs of a BTree
  **/
-BTreeNode* btreeNodeAlloc(void) {
-    
-    BTreeNode* node;   
- 
-    /* Allocate memory for the btree root node */
-    debug_print("btreeNodeAlloc: Allocating memory for btree node...\n");
-    if((node = malloc(sizeof(BTreeNode))) == NULL ) {
-        printf("btreeNodeAlloc: malloc error\n");
-        return NULL;
-    }
-
-    node->numKeys = 0;
-    node->isLeaf = LEAF_TRUE;
-    
-    return node;
-
-}
-
+BTreeNode* btreeNodeAlloc(
+    BTree* btree
+    ,unsigned int isLeaf
+) {
 
+    BTreeNode* node;
+    void* slab;
+    unsigned int i;
+
+    /* Start a new slab when the last one is used up */
+    if(btree->numSlabs == 0 || btree->slabNodesUsed == BTREE_SLAB_NODES) {
+        if(btree->numSlabs == btree->maxSlabs) {
+            btree->maxSlabs = btree->maxSlabs ? btree->maxSlabs * 2 : 8;
+            if((btree->slabs = realloc(btree->slabs, btree->maxSlabs * sizeof(BTreeNode*))) == NULL) {
+                printf("btreeNodeAlloc: malloc error\n");
+                return NULL;
+            }
+        }
 
-/** 
- ** Allocates memory for a BTreeKey
- **/
-BTreeKey* btreeKeyAlloc(void) {
-    
-    BTreeKey* key;   
- 
-    /* Allocate memory for the btree root node */
-    debug_print("btreeKeyAlloc: Allocating memory for a btree key...\n");
-    if((key = calloc(1, sizeof(BTreeKey))) == NULL ) {
-        printf("btreeKeyAlloc: calloc error\n");
-        return NULL;
+        debug_print("btreeNodeAlloc: Allocating memory for %u btree nodes...\n", BTREE_SLAB_NODES);
+        if(posix_memalign(&slab, BTREE_NODE_ALIGNMENT, BTREE_SLAB_NODES * sizeof(BTreeNode)) != 0) {
+            printf("btreeNodeAlloc: malloc error\n");
+            return NULL;
+        }
+        btree->slabs[btree->numSlabs++] = (BTreeNode*) slab;
+        btree->slabNodesUsed = 0;
     }
 
-    key->isUnlinked = 0;
-    key->keyValue = 0;
-    key->dataOffset = 0;
-    key->dataLength = 0;
-    
-    return key;
+    node = &(btree->slabs[btree->numSlabs - 1][btree->slabNodesUsed++]);
+    memset(node, 0, sizeof(BTreeNode));
+    for(i = 0; i < BTREE_MAX_KEYS; i++)
+        node->keys[i] = BTREE_KEY_PADDING;
+    node->isLeaf = isLeaf;
+    btree->numNodes++;
+
+    return node;
 
 }
 
 
 
-/** 
- ** Allocates memory for a BTreeQueue
+/**
+ ** Free memory for a given BTree (all nodes go with their slabs)
  **/
-BTreeQueue* btreeQueueAlloc(BTree* btree) {
+void btreeFree(
+    BTree** btreePtr
+) {
 
-    BTreeQueue* btreeQueue;
+    unsigned int i;
 
-    /* Allocate memory for the btreeQueue */
-    debug_print("btreeQueueAlloc: Allocating memory for queue...\n");
-    if((btreeQueue = calloc(1, sizeof(BTreeQueue))) == NULL ) {
-        printf("btreeQueueAlloc: malloc error\n");
-        return NULL;
-    }
+    debug_print("btreeFree: Freeing btree memory...\n");
 
-    /* When a BTreeQueue is allocated, so are the first 100 BTreeQueueNodes */
-    btreeQueue->queue = btreeQueueNodeAlloc(btree);
-    assert(btreeQueue->queue != NULL);
+    if(*btreePtr == NULL)
+        return;
 
-    btreeQueue->btree = btree;
-    btreeQueue->size = 0;
-    
-    return btreeQueue;
+    for(i = 0; i < (*btreePtr)->numSlabs; i++)
+        free((*btreePtr)->slabs[i]);
+    free((*btreePtr)->slabs);
 
-}
+    free(*btreePtr);
+    *btreePtr = NULL;
 
+    assert(*btreePtr == NULL);
+    debug_print("btreeFree: btree has been freed!\n");
 
+}
 
-/** 
- ** Initial memory allocation for a BTreeQueueNode array
- **/
-BTreeQueueNode* btreeQueueNodeAlloc(BTree* btree) {
-    
-    BTreeQueueNode* qnode;   
-    unsigned int qnodeArraySize = btree->numNodes;
- 
-    debug_print("btreeQueueNodeAlloc: Allocating memory (%lu bytes) for %u BTreeQueueNodes...\n", qnodeArraySize*sizeof(BTreeQueueNode)
-                                                                                                , qnodeArraySize);
-    if((qnode = malloc(qnodeArraySize*sizeof(BTreeQueueNode))) == NULL ) {
-        printf("btreeQueueNodeAlloc: malloc error\n");
-        return NULL;
-    }
 
-    return qnode;
 
-}
+/************************************************
+ ************************************************
+ **                                           **
+ **             BTree Operations              **
+ **                                           **
+ ************************************************
+ ************************************************/
 
 
 
-/** 
- ** Free memory for a given BTree
+/**
+ ** Returns the number of keys of a node below keyValue
+ ** All BTREE_MAX_KEYS are compared without branching (unused keys are
+ ** padded), so the compiler can turn the loop into vector compares
  **/
-void btreeFree(
-    BTree** btreePtr
+static inline unsigned int btreeKeysBelow(
+    const BTreeNode* node
+    ,off_t keyValue
 ) {
 
-    debug_print("btreeFree: Freeing btree memory...\n");
+    unsigned int position = 0;
+    unsigned int i;
 
-    if((*btreePtr)->root != NULL) {
-        btreeForEach(*btreePtr, btreeCBFreeNode); /* Free all btree nodes */
-        (*btreePtr)->root = NULL;
-    }
-    
-    assert((*btreePtr)->root == NULL);
-    debug_print("btreeFree: btree nodes have been freed!\n");
+    for(i = 0; i < BTREE_MAX_KEYS; i++)
+        position += node->keys[i] < keyValue;
 
-    if(*btreePtr != NULL) {
-        free(*btreePtr);
-        *btreePtr = NULL;
-    }
+    return position;
 
-    assert(*btreePtr == NULL);
-    debug_print("btreeFree: btree has been freed!\n");
-    
 }
 
 
 
-/** 
- ** Free memory for a BTreeNode
+/**
+ ** Returns the child of an inner node that holds keyValue
+ ** (children[i] holds the keys from keys[i - 1] up to, but not including, keys[i])
  **/
-void btreeNodeFree(
-    BTreeNode** node
+static inline unsigned int btreeChildPosition(
+    const BTreeNode* node
+    ,off_t keyValue
 ) {
 
-    if(*node != NULL) {
-        free(*node);
-        *node = NULL;
-    }
+    unsigned int position = 0;
+    unsigned int i;
 
-    assert(*node == NULL);
-    debug_print("btreeNodeFree: node has been freed!\n");
+    for(i = 0; i < BTREE_MAX_KEYS; i++)
+        position += node->keys[i] <= keyValue;
+
+    /* Padding can only match a key equal to BTREE_KEY_PADDING */
+    return position > node->numKeys ? node->numKeys : position;
 
 }
 
 
 
-/** 
- ** Free memory for a BTreeKey
+/**
+ ** Search for a BTreeKey in a BTree, starting at node (usually btree->root)
+ ** Returns NULL if the key is not found (or has been deleted)
  **/
-void btreeKeyFree(
-    BTreeKey** key
+BTreeKey* btreeSearch(
+    BTree* btree
+    ,BTreeNode* node
+    ,off_t keyValue
 ) {
 
-    if(*key != NULL) {
-        free(*key);
-        *key = NULL;
-    }
-
-    assert(*key == NULL);
-
-}
-
+    unsigned int position;
 
+    /* Check if btree is empty */
+    if(!btree->numKeys)
+        return NULL;
 
-/** 
- ** Free memory for a given BTreeQueue
- **/
-void btreeQueueFree(
-    BTreeQueue** btreeQueuePtr
-) {
-
-    debug_print("btreeQueueFree: Freeing BTreeQueue memory...\n");
+    while(!node->isLeaf)
+        node = node->children[btreeChildPosition(node, keyValue)];
 
-    /* Free root node */
-    if((*btreeQueuePtr)->queue != NULL)
-        btreeQueueNodeFree(&(*btreeQueuePtr)->queue);
-    assert((*btreeQueuePtr)->queue == NULL);
-    //debug_print("btreeQueueFree: BTreeQueue queue has been freed!\n");
+    position = btreeKeysBelow(node, keyValue);
+    if(position < node->numKeys && node->keys[position] == keyValue && !node->leaf.entries[position].isUnlinked)
+        return &(node->leaf.entries[position]);
 
-    if(*btreeQueuePtr != NULL) {
-        free(*btreeQueuePtr);
-        *btreeQueuePtr = NULL;
-    }
+    return NULL;
 
-    assert(*btreeQueuePtr == NULL);
-    debug_print("btreeQueueFree: BTreeQueue has been freed!\n");
-    
 }
 
 
 
-/** 
- ** Free memory for a BTreeQueueNode array
+/**
+ ** Insert a key into a leaf, splitting it if it is full
+ ** Returns the new (right) leaf if it was split, NULL otherwise
  **/
-void btreeQueueNodeFree(
-    BTreeQueueNode** qnode
+static BTreeNode* btreeInsertLeaf(
+    BTree* btree
+    ,BTreeNode* node
+    ,BTreeKey* key
 ) {
 
-    if(*qnode != NULL) {
-        free(*qnode);
-        *qnode = NULL;
-    }
-
-    assert(*qnode == NULL);
-    debug_print("btreeQueueNodeFree: BTreeQueueNodes have been freed!\n");
-
-}
+    off_t keys[BTREE_MAX_KEYS + 1];
+    BTreeKey entries[BTREE_MAX_KEYS + 1];
+    unsigned int position = btreeKeysBelow(node, key->keyValue);
+    unsigned int i;
+    BTreeNode* right;
 
+    /* Existing keys are overwritten */
+    if(position < node->numKeys && node->keys[position] == key->keyValue) {
+        node->leaf.entries[position] = *key;
+        return NULL;
+    }
+    btree->numKeys++;
 
+    if(!nodeIsFull(node)) {
+        for(i = node->numKeys; i > position; i--) {
+            node->keys[i] = node->keys[i - 1];
+            node->leaf.entries[i] = node->leaf.entries[i - 1];
+        }
+        node->keys[position] = key->keyValue;
+        node->leaf.entries[position] = *key;
+        node->numKeys++;
+        return NULL;
+    }
 
-/************************************************
- ************************************************
- **                                           **
- **             BTree Operations              **
- **                                           **
- ************************************************
- ************************************************/
+    /* Split: the lower keys stay, the upper keys go to a new leaf on the right */
+    for(i = 0; i < BTREE_MAX_KEYS + 1; i++) {
+        keys[i] = (i < position) ? node->keys[i] : (i == position) ? key->keyValue : node->keys[i - 1];
+        entries[i] = (i < position) ? node->leaf.entries[i] : (i == position) ? *key : node->leaf.entries[i - 1];
+    }
 
+    if((right = btreeNodeAlloc(btree, LEAF_TRUE)) == NULL)
+        return NULL;
 
+    for(i = 0; i < BTREE_MAX_KEYS + 1; i++) {
+        if(i < BTREE_SPLIT_KEYS) {
+            node->keys[i] = keys[i];
+            node->leaf.entries[i] = entries[i];
+        }
+        else {
+            right->keys[i - BTREE_SPLIT_KEYS] = keys[i];
+            right->leaf.entries[i - BTREE_SPLIT_KEYS] = entries[i];
+            if(i < BTREE_MAX_KEYS)
+                node->keys[i] = BTREE_KEY_PADDING;
+        }
+    }
+    node->numKeys = BTREE_SPLIT_KEYS;
+    right->numKeys = BTREE_MAX_KEYS + 1 - BTREE_SPLIT_KEYS;
 
-/** 
- ** Search for a BTreeKey in a BTree (returns values via passed BTreeKey)
- **/
-BTreeKey* btreeSearch(
-   BTree* btree
-   ,BTreeNode* node
-   ,off_t keyValue
-) {
+    right->leaf.next = node->leaf.next;
+    node->leaf.next = right;
 
-	// Check if btree is empty
-	if(!btree->numKeys)
-		return NULL;
-
-   int i;
-   debug_print("btreeSearch: node->numkeys = %u\n", node->numKeys);
-   for(i = 0; (i <= node->numKeys - 1) && (keyValue > node->key[i].keyValue ); i++);
-   debug_print("btreeSearch: i = %d\n", i);
-   if((i <= node->numKeys - 1) && (keyValue == node->key[i].keyValue) && (!node->key[i].isUnlinked)) {
-      debug_print("btreeSearch: key found\n");
-      return (BTreeKey*) &node->key[i];
-   }
-
-   debug_print("btreeSearch: key not found this iteration\n");
-   if(node->isLeaf)
-      return NULL;
-   else 
-      return btreeSearch(btree, (BTreeNode*) node->childPtr[i], keyValue); /* TODO: Add function to read corresponding child node from disk */
+    return right;
 
 }
 
 
 
-/** 
- ** Insert a BTreeKey into a BTree
- ** Returns 0 if OK, -1 if error
+/**
+ ** Insert a key below node
+ ** Returns the new right sibling of node if it was split (its lowest key,
+ ** to be added to the parent, is set in splitKey), NULL otherwise
  **/
-int btreeInsert(
+static BTreeNode* btreeInsertNode(
     BTree* btree
+    ,BTreeNode* node
     ,BTreeKey* key
+    ,off_t* splitKey
 ) {
 
-    /*TODO DEBUG
-    printf("btreeInsert: key = %lu\n", key->key);
-    printf("btreeInsert: dataOffset = %lu\n", key->dataOffset);
-    printf("btreeInsert: dataLength = %lu\n", key->dataLength);
-    printf("btreeInsert: btree->root->numKeys = %u\n", btree->root->numKeys);
-    printf("btreeInsert: nodeIsFull(btree->root) = %u\n", nodeIsFull(btree->root));*/
-    
-    if(nodeIsFull(btree->root)) {
-        debug_print("btreeInsert: root node full!\n");
-        BTreeNode* x;
-        x = btreeNodeAlloc();
-
-        BTreeNode* y;
-        y = btreeNodeAlloc();
-
-        y = btree->root;
-        btree->root = x;
-        x->isLeaf = LEAF_FALSE;
-        x->numKeys = 0;
-        x->child[0] = btree->rootNodeOffset;
-        x->childPtr[0] = (BTreeNode*)y;
-    
-        btreeSplitChild(btree, x, 0, y);
-        btree->numNodes += 2; // if root is split we always add two new nodes
-        btreeInsertNonFull(btree, x, key);
-        //printf("btreeInsert: number of nodes after insert = %u\n", btree->numNodes);
-        
+    off_t keys[BTREE_MAX_KEYS + 1];
+    BTreeNode* children[BTREE_MAX_KEYS + 2];
+    unsigned int position;
+    unsigned int i;
+    off_t childSplitKey;
+    BTreeNode* child;
+    BTreeNode* right;
+
+    if(node->isLeaf) {
+        if((right = btreeInsertLeaf(btree, node, key)) != NULL)
+            *splitKey = right->keys[0];
+        return right;
     }
-    else {
-        debug_print("btreeInsert: node not full... \n");
-        btreeInsertNonFull(btree, btree->root, key);
-        //printf("btreeInsert: number of nodes after insert = %u\n", btree->numNodes);
+
+    position = btreeChildPosition(node, key->keyValue);
+    if((child = btreeInsertNode(btree, node->children[position], key, &childSplitKey)) == NULL)
+        return NULL;
+
+    /* The child was split: add its new sibling after it */
+    if(!nodeIsFull(node)) {
+        for(i = node->numKeys; i > position; i--) {
+            node->keys[i] = node->keys[i - 1];
+            node->children[i + 1] = node->children[i];
+        }
+        node->keys[position] = childSplitKey;
+        node->children[position + 1] = child;
+        node->numKeys++;
+        return NULL;
     }
 
-    return 0;
+    /* Split: the middle key moves up to the parent */
+    for(i = 0; i < BTREE_MAX_KEYS + 1; i++)
+        keys[i] = (i < position) ? node->keys[i] : (i == position) ? childSplitKey : node->keys[i - 1];
+    for(i = 0; i < BTREE_MAX_KEYS + 2; i++)
+        children[i] = (i <= position) ? node->children[i] : (i == position + 1) ? child : node->children[i - 1];
 
-}
+    if((right = btreeNodeAlloc(btree, LEAF_FALSE)) == NULL)
+        return NULL;
 
+    for(i = 0; i < BTREE_MAX_KEYS; i++)
+        node->keys[i] = (i < BTREE_SPLIT_KEYS) ? keys[i] : BTREE_KEY_PADDING;
+    for(i = 0; i <= BTREE_SPLIT_KEYS; i++)
+        node->children[i] = children[i];
+    node->numKeys = BTREE_SPLIT_KEYS;
 
+    *splitKey = keys[BTREE_SPLIT_KEYS];
 
-/** 
- ** Insert key into non-full node
- **/
-int btreeInsertNonFull(
-    BTree* btree
-    ,BTreeNode* x
-    ,BTreeKey* key
-) {
-    
-    int i = x->numKeys - 1;
-    if(x->isLeaf) {
-        debug_print("btreeInsertNonFull: node is a leaf!\n");
-        
-        while (i>=0 && key->keyValue < x->key[i].keyValue) {
-            x->key[i+1] = x->key[i];
-            i--;
-        }
-        
-        x->key[i+1] = *key;
-        x->numKeys++, btree->numKeys++;
-        
-        return 0;
-    }
-    else {
-        debug_print("btreeInsertNonFull: node is not a leaf...inserting into child!\n");
-        /* Find correct index to insert key */
-        while (i>=0 && key->keyValue < x->key[i].keyValue)
-            i--;
-        i++;
-        
-        
-        BTreeNode* child = (BTreeNode*) x->childPtr[i];
-
-        if(child->numKeys == MAX_KEYS) {
-            debug_print("btreeInsertNonFull: child is full, splitting child...\n");
-            btreeSplitChild(btree, x, i, child);
-            btree->numNodes++; // only increment one in this case
-
-            if(key->keyValue > x->key[i].keyValue) {
-                i++;
-                child = x->childPtr[i];
-            }
-        }
+    for(i = BTREE_SPLIT_KEYS + 1; i < BTREE_MAX_KEYS + 1; i++)
+        right->keys[i - BTREE_SPLIT_KEYS - 1] = keys[i];
+    for(i = BTREE_SPLIT_KEYS + 1; i < BTREE_MAX_KEYS + 2; i++)
+        right->children[i - BTREE_SPLIT_KEYS - 1] = children[i];
+    right->numKeys = BTREE_MAX_KEYS - BTREE_SPLIT_KEYS;
+
+    return right;
 
-        return btreeInsertNonFull(btree, child, key);
-    }
 }
 
 
 
-/** 
- ** Split the ith child (y), of BTreeNode x
+/**
+ ** Insert a BTreeKey into a BTree (the entry of an existing key is overwritten)
+ ** Returns 0 if OK, -1 if error
  **/
-int btreeSplitChild(
+int btreeInsert(
     BTree* btree
-    ,BTreeNode* x
-    ,const unsigned int i
-    ,BTreeNode* y
+    ,BTreeKey* key
 ) {
 
-    debug_print("btreeSplitChild: Splitting node!\n");
-    BTreeNode* z;
-    z = btreeNodeAlloc();
-    
-    z->isLeaf = y->isLeaf;
-    z->numKeys = MIN_KEYS;
-
-    /* copy keys from node z to node z after the median key */
-    int ctr = 0;
-    for(ctr = 0; ctr <= MIN_KEYS-1; ctr++) {
-        z->key[ctr] = y->key[ctr + MIN_DEGREE];
-        /* Clear the keys being moved to node z */
-        y->key[ctr + MIN_DEGREE].keyValue = 0, y->key[ctr + MIN_DEGREE].dataOffset = 0, y->key[ctr + MIN_DEGREE].dataLength = 0;
-    }
-    /* if node y is not a leaf, copy children from y to node z */
-    if(!y->isLeaf) {
-        for(ctr = 0; ctr <= MIN_DEGREE-1; ctr++) {
-            z->child[ctr] = y->child[ctr + MIN_DEGREE];
-            z->childPtr[ctr] = y->childPtr[ctr + MIN_DEGREE];
-        }
-    }
-
-    /* update y node's key count to what it will be after the split */
-    y->numKeys = MIN_DEGREE - 1; 
-    /* move up each child of node x by one position, to make room for new child node */
-    for(ctr = x->numKeys; ctr >= i+1; ctr--) {
-        x->child[ctr + 1] = x->child[ctr];
-        x->childPtr[ctr + 1] = x->childPtr[ctr];
-    }
-    /* set new child value to next free offset in disk (where z will be stored) */
-    //x->child[i+1] = btree->nextFreeNodeOffset; //TODO: set to btree->nextFreeNodeOffset as z will be written at that postiion
-    x->childPtr[i+1] = (BTreeNode*)z; 
-    
-    /* move up each key of node x by one position, to make room for new key */
-    for(ctr = x->numKeys; ctr >= i+1; ctr--) {
-        x->key[ctr] = x->key[ctr-1];
-    }
-    /* set new key to middle key in node y */
-    x->key[i] = y->key[MIN_DEGREE - 1];
-    /* increment number of keys in node x */
-    x->numKeys++;
+    BTreeNode* right;
+    BTreeNode* root;
+    off_t splitKey;
 
+    if((right = btreeInsertNode(btree, btree->root, key, &splitKey)) == NULL)
+        return 0;
 
+    /* The root was split: the tree grows a level */
+    debug_print("btreeInsert: root node split!\n");
+    if((root = btreeNodeAlloc(btree, LEAF_FALSE)) == NULL)
+        return -1;
 
-
-        /* Uncomment to print child splitting steps */
-        /*printf("btreeSplitChild: x = [");
-        int lo;
-        for(lo=0; lo<x->numKeys; lo++) {
-            printf("%lu,", x->key[lo].keyValue);
-        }
-        printf("]\n");
-
-        printf("btreeSplitChild: y = [");
-        for(lo=0; lo<y->numKeys; lo++) {
-            printf("%lu,", y->key[lo].keyValue);
-        }
-        printf("]\n");
-
-        printf("btreeSplitChild: z = [");
-        for(lo=0; lo<z->numKeys; lo++) {
-            printf("%lu,", z->key[lo].keyValue);
-        }
-        printf("]\n"); */
-
-    //btreeWriteNode(y);
-    //btreeWriteNode(z);
-    //btreeWriteNode(x);
+    root->keys[0] = splitKey;
+    root->children[0] = btree->root;
+    root->children[1] = right;
+    root->numKeys = 1;
+    btree->root = root;
 
     return 0;
+
 }
 
 
 
-/** 
- ** Deletes key from BTree
+/**
+ ** Deletes key from BTree (the key is only marked as unlinked)
+ ** Returns 1 if the key was found, 0 otherwise
  **/
 int btreeDelete(
     BTree* btree
     ,off_t key
 ) {
 
-	printf("btreeDelete: KEY DELETED\n");
-   BTreeKey* deleteKey;
-   if((deleteKey = btreeSearch(btree, btree->root, key)) != NULL) {
-      deleteKey->isUnlinked = 1; /* Mark key as unlinked */
-      return 1;
-   }
-   else
-      return 0;
+    BTreeKey* deleteKey;
+
+    if((deleteKey = btreeSearch(btree, btree->root, key)) != NULL) {
+        deleteKey->isUnlinked = 1; /* Mark key as unlinked */
+        return 1;
+    }
+    else
+        return 0;
 
 }
 
@@ -521,130 +415,51 @@ int btreeDelete(
 
 
 
-/** 
- ** Traverses btree nodes and executes callback function on each in turn
+/**
+ ** Starts an in-order traversal of the keys of a BTree
  **/
-void btreeForEach(
+void btreeIteratorStart(
     BTree* btree
-    ,queueNodeCallback callbackPtr
+    ,BTreeIterator* iterator
 ) {
-    
-    BTreeQueue* btreeQueue = populateBTreeQueueBFS(btree); 
 
-    /* Iterate BTreeQueue and call callback function for each node */
-    unsigned int j;
-    for(j=0; j<btreeQueue->size; j++) {
-        callbackPtr((btreeQueue->queue)+j);
-    }
-
-    btreeQueueFree(&btreeQueue);
+    iterator->node = btree->firstLeaf;
+    iterator->position = 0;
 
 }
 
 
 
-/** 
- ** Returns a populated BTreeQueue* using BFS (Breadth-First Search)
+/**
+ ** Returns the next key of an in-order traversal (skipping deleted keys),
+ ** or NULL once all keys have been returned
+ ** The btree must not change during the traversal
  **/
-BTreeQueue* populateBTreeQueueBFS(
-    BTree* btree
+BTreeKey* btreeIteratorNext(
+    BTreeIterator* iterator
 ) {
 
-    unsigned int curLevel = 0; /* Distance from root node in btree */
-    unsigned int i, j;
-
-    BTreeQueue* btreeQueue = btreeQueueAlloc(btree);
-
-    BTreeQueueNode curNode;
-    setQueueNode(&curNode, btree->root, NULL, curLevel, 0);
-    curNode.visited = 1;
-    addQueueNode(btreeQueue, &curNode); /* Set root as first item in queue */
+    BTreeKey* key;
 
-    BTreeQueueNode childNode;
-restart:
-    if( btreeQueue->size < btreeQueue->btree->numNodes) {
-
-        /* Add children of current node to queue */
-        for(i=0; i<curNode.nodePtr->numKeys+1; i++) {
-
-            if(curNode.nodePtr->childPtr[i]) {
-                setQueueNode(&childNode, curNode.nodePtr->childPtr[i], curNode.nodePtr, curLevel + 1, 0);
-                addQueueNode(btreeQueue, &childNode);
-                debug_print("i=%u\n", i);
-            }
-
-        }
-        
-        if( btreeQueue->size < btreeQueue->btree->numNodes) { /* If all nodes are under the root, queueSize = numNodes after above loop */
-            for(j=0; j<btreeQueue->size; j++) { /* Iterate queue and set curNode to next unvisited node in current level */
-                debug_print("Determining next unvisited node...\n");
-                btreePrintNode(btreeQueue->queue[j].nodePtr, "check_queueNode", btreeQueue->queue[j].visited);
-                
-                if(btreeQueue->queue[j].visited == 0) { /* If QueueNode not visited, set as curNode */
-                    debug_print("Found next unvisited node at queue index %u\n", j);
-                    btreePrintNode(btreeQueue->queue[j].nodePtr, "found_queueNode", btreeQueue->queue[j].visited);
-                    btreeQueue->queue[j].visited = 1; /* Mark node as visited so it's not selected next time */
-                    setQueueNode(&curNode, btreeQueue->queue[j].nodePtr
-                                        ,btreeQueue->queue[j].parentPtr
-                                        ,btreeQueue->queue[j].nodeLevel
-                                        ,btreeQueue->queue[j].visited);
-
-                    if(curNode.nodeLevel == curLevel + 1)
-                        curLevel++;
-
-                    goto restart;
-                }
-            }
+    while(iterator->node != NULL) {
+        if(iterator->position == iterator->node->numKeys) {
+            iterator->node = iterator->node->leaf.next;
+            iterator->position = 0;
+            continue;
         }
-        
-    }
-
-    return btreeQueue;
-
-}
-
-
 
-/** 
- ** Set BTreeQueueNode variables
- **/
-void setQueueNode(
-    BTreeQueueNode* qNode
-    ,BTreeNode* nodePtr
-    ,BTreeNode* nodeParentPtr
-    ,unsigned int nodeLevel
-    ,unsigned int visited
-) {
-    
-    qNode->nodePtr = nodePtr;
-    qNode->parentPtr = nodeParentPtr;
-    qNode->nodeLevel = nodeLevel;
-    qNode->visited = visited;
-
-}
-
-
-
-/** 
- ** Add a BTreeQueueNode to the BTreeQueue
- **/
-void addQueueNode(
-    BTreeQueue* btreeQueue
-    ,BTreeQueueNode* qnode
-) {
+        key = &(iterator->node->leaf.entries[iterator->position++]);
+        if(!key->isUnlinked)
+            return key;
+    }
 
-    btreeQueue->queue[btreeQueue->size] = *qnode;
-    btreeQueue->size++;
-    debug_print("\nBTreeQueueNode added at index %u! New btreeQueue->size = %u\n", btreeQueue->size-1, btreeQueue->size);
-    debug_print("BTreeQueue->size = %u and BTree->numNodes = %u\n", btreeQueue->size, btreeQueue->btree->numNodes);
-    debug_print("addQueueNode():");
-    btreePrintNode(qnode->nodePtr, "node", qnode->visited);
+    return NULL;
 
 }
 
 
 
-/** 
+/**
  ** Set the value of a BTreeKey object
  **/
 void btreeSetKeyValue(
@@ -653,7 +468,7 @@ void btreeSetKeyValue(
     ,off_t dataOffset
     ,off_t dataLength
 ) {
-    
+
     key->keyValue = keyValue;
     assert(key->keyValue == keyValue);
 
@@ -667,7 +482,7 @@ void btreeSetKeyValue(
 
 
 
-/** 
+/**
  ** Print key values of a btree node
  **/
 void btreePrintNode(
@@ -677,9 +492,9 @@ void btreePrintNode(
 ) {
 
     debug_print("%s = [", label);
-    int i;
+    unsigned int i;
     for(i=0; i<node->numKeys; i++) {
-        debug_print("%lu,", node->key[i].keyValue);
+        debug_print("%ld,", (long) node->keys[i]);
     }
     if(visited){
         debug_print("] | visited = %u\n", visited);
@@ -689,46 +504,3 @@ void btreePrintNode(
     }
 
 }
-
-
-
-/** 
- ** Print key values of a BTreeQueueNode
- ** + callback to btreeForEach
- **/
-void btreeCBPrintNode(
-    BTreeQueueNode* qnode
-) {
-
-    unsigned int k;
-
-    printf("Level %u: node = [",qnode->nodeLevel);
-    for(k=0; k<qnode->nodePtr->numKeys; k++) {
-        if(!qnode->nodePtr->key[k].isUnlinked)
-            printf("%lu,", qnode->nodePtr->key[k].keyValue);
-        else
-            printf("*%lu,", qnode->nodePtr->key[k].keyValue); /* mark unlinked nodes with * */
-    }
-    printf("]\n");
-
-}
-
-
-
-/** 
- ** Free BTreeNode 
- ** + callback to btreeForEach
- **/
-void btreeCBFreeNode(
-    BTreeQueueNode* qnode
-) {
-
-    btreeNodeFree(&qnode->nodePtr);
-    assert(qnode->nodePtr == NULL);
-
-}
-
-
-
-
-
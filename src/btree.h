@@ -1,4 +1,4 @@
-/* btree.h -- btree interface. 
+/* btree.h -- btree interface.
 
    Copyright 2015 Jonathan Sacramento.
 
@@ -13,7 +13,7 @@
    GNU General Public License for more details.
 
    You should have received a copy of the GNU General Public License
-   along with this program.  If not, see <http://www.gnu.org/licenses/>.  
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 
@@ -26,9 +26,9 @@
 #include<stdio.h>
 #include<stdlib.h>
 #include<stdarg.h>
+#include<stdint.h>
 #include<errno.h>
 #include<string.h>
-#include<sys/uio.h> /* struct iovec */
 #include<assert.h>
 
 #include "system.h"
@@ -38,13 +38,11 @@
 /**
  ** Implementation limits
  **/
-#define MIN_DEGREE 6 /* defines the upper and lower bounds of a btree (see p434 Intro to Algorithms, Cormen et al.) */
-#define MIN_KEYS MIN_DEGREE-1
-#define MAX_KEYS (2*MIN_DEGREE)-1
-#define MIN_CHILDREN MIN_DEGREE
-#define MAX_CHILDREN 2*MIN_DEGREE
-
-#define BTREE_NODE_SIZE 456 /* Given MIN_DEGREE=6: (BTreeKey * 11) + (off_t * 12) + (unsigned int * 2) */
+#define BTREE_MAX_KEYS 16 /* keys of a node (16 x off_t = two cache lines, compared in one pass) */
+#define BTREE_SPLIT_KEYS (BTREE_MAX_KEYS / 2) /* keys left in a node when it is split */
+#define BTREE_KEY_PADDING INT64_MAX /* value of unused keys, so they are never below the key searched for */
+#define BTREE_NODE_ALIGNMENT 64 /* nodes start on a cache line */
+#define BTREE_SLAB_NODES 64 /* nodes allocated at a time */
 
 #define LEAF_TRUE 1
 #define LEAF_FALSE 0
@@ -52,7 +50,7 @@
 
 
 /**
- ** Btree key 
+ ** Btree key
  **/
 typedef struct {
     unsigned int isUnlinked; /* marks key as deleted in data set */
@@ -65,15 +63,22 @@ typedef struct {
 
 /**
  ** Btree node
+ ** B+tree node: keys are kept together (sorted, then padded), ahead of the
+ ** children of an inner node, or the entries of a leaf. Leaves hold every
+ ** key, and are linked in key order
  **/
-typedef struct {
-    BTreeKey key[MAX_KEYS];
-    off_t child[MAX_CHILDREN];
-    void* childPtr[MAX_CHILDREN];
-
+typedef struct BTreeNode {
+    off_t keys[BTREE_MAX_KEYS];
     unsigned int numKeys;
     unsigned int isLeaf;
-} BTreeNode;
+    union {
+        struct BTreeNode* children[BTREE_MAX_KEYS + 1]; /* inner node: children[i] holds the keys below keys[i] */
+        struct {
+            BTreeKey entries[BTREE_MAX_KEYS];
+            struct BTreeNode* next; /* next leaf (in key order) */
+        } leaf;
+    };
+} __attribute__((aligned(BTREE_NODE_ALIGNMENT))) BTreeNode;
 
 
 
@@ -82,76 +87,48 @@ typedef struct {
  **/
 typedef struct {
     BTreeNode* root;
+    BTreeNode* firstLeaf; /* leaf with the lowest keys (a B+tree never splits it to the left) */
 
-    off_t rootNodeOffset;
-    unsigned int numNodes; 
-    unsigned int numKeys; 
-} BTree;
-
-
+    BTreeNode** slabs; /* nodes are carved out of slabs of BTREE_SLAB_NODES */
+    unsigned int numSlabs;
+    unsigned int maxSlabs;
+    unsigned int slabNodesUsed; /* nodes used in the last slab */
 
-/**
- ** BTreeQueueNode
- **/
-typedef struct {
-    BTreeNode* nodePtr;
-    BTreeNode* parentPtr;
-    unsigned int nodeLevel;
-    unsigned int visited;
-} BTreeQueueNode;
+    unsigned int numNodes;
+    unsigned int numKeys;
+} BTree;
 
 
 
 /**
- ** BTreeQueue
+ ** BTreeIterator
+ ** Position in an in-order traversal of the leaves
  **/
 typedef struct {
-    BTree* btree;
-    BTreeQueueNode* queue;
-    unsigned int size;
-} BTreeQueue;
-
+    BTreeNode* node;
+    unsigned int position;
+} BTreeIterator;
 
 
-/* btree callbacks  */
-typedef void (*queueNodeCallback) (BTreeQueueNode* qnode);
-    void btreeCBPrintNode(BTreeQueueNode* qnode);
-    void btreeCBFreeNode(BTreeQueueNode* qnode);
 
 /* btree memory */
 BTree* btreeAlloc(void);
-BTreeNode* btreeNodeAlloc(void);
-BTreeKey* btreeKeyAlloc(void);
-BTreeQueue* btreeQueueAlloc(BTree* btree);
-BTreeQueueNode* btreeQueueNodeAlloc(BTree* btree);
+BTreeNode* btreeNodeAlloc(BTree* btree, unsigned int isLeaf);
 void btreeFree(BTree** btree);
-void btreeNodeFree(BTreeNode** node);
-void btreeKeyFree(BTreeKey** key);
-void btreeQueueFree(BTreeQueue** queue);
-void btreeQueueNodeFree(BTreeQueueNode** queueNode);
 
 /* btree operations */
 BTreeKey* btreeSearch(BTree* btree, BTreeNode* node, off_t key);
 int btreeInsert(BTree* btree, BTreeKey* key);
-int btreeInsertNonFull(BTree* btree, BTreeNode* node, BTreeKey* key);
-int btreeSplitChild(BTree* btree, BTreeNode* x, const unsigned int i, BTreeNode* y);
 int btreeDelete(BTree* btree, off_t key);
 
 /* btree utils */
-void btreeForEach(BTree* btree, queueNodeCallback callbackPtr);
-BTreeQueue* populateBTreeQueueBFS(BTree* btree);
-void setQueueNode(BTreeQueueNode*, BTreeNode*, BTreeNode*, unsigned int, unsigned int);
-void addQueueNode(BTreeQueue*, BTreeQueueNode*);
+void btreeIteratorStart(BTree* btree, BTreeIterator* iterator);
+BTreeKey* btreeIteratorNext(BTreeIterator* iterator);
 void btreeSetKeyValue(BTreeKey* key, off_t keyValue, off_t dataOffset, off_t dataLength);
 void btreePrintNode(BTreeNode* node, const char* label, const unsigned int visited);
 
 /* btree macros */
-#define nodeIsFull(node) ((node)->numKeys == MAX_KEYS)
-#define isRoot(tree) ((tree)->numNodes == 1) /* jms: wrong - rethink or remove */
-#define btreegetSize(tree) ((tree)->size)
+#define nodeIsFull(node) ((node)->numKeys == BTREE_MAX_KEYS)
 #define btreeGetRoot(tree) ((tree)->root)
-#define btreeIsEob(tree) ((node)==NULL)
-#define btreeIsLeaf(tree) ((node)->left == NULL && (node)->right == NULL)
-#define btreeGetKey(node) ((node)->key)
 
 #endif
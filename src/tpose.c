@@ -17,18 +17,45 @@
 */
 
 #include "system.h"
+#include <glob.h>
+#include <limits.h>
 #include "util.h"
 #include "tpose.h"
 #include "tpose_io.h"
+#include "tpose_cache.h"
+#include "tpose_columnar.h"
+#include "tpose_state.h"
+#include "tpose_spill.h"
 
 
 
 /* Commandline Options */
-static const char* shortopts = "d:iPp:s:a:I:G:N:hv";
+enum {
+	BUILD_INDEX_OPTION = CHAR_MAX + 1 // Long-only options
+	,CONVERT_OPTION
+	,INCREMENTAL_OPTION
+	,CHANGED_ONLY_OPTION
+	,CHECKPOINT_OPTION
+	,RESUME_OPTION
+	,BYTE_RANGE_OPTION
+	,EMIT_STATE_OPTION
+	,FOLLOW_OPTION
+	,HLL_PRECISION_OPTION
+	,DECIMALS_OPTION
+	,REPRODUCIBLE_OPTION
+	,SORT_GROUPS_OPTION
+	,MAX_MEMORY_OPTION
+	,FLOAT32_OPTION
+};
+
+static const char* shortopts = "d:iPCF:o:p:s:a:I:G:N:hv";
 static const struct option longopts[] = {
 	{"delimiter", required_argument, NULL, 'd'}
 	,{"indexed", no_argument, NULL, 'i'}
 	,{"parallel", no_argument, NULL, 'P'}
+	,{"cache", no_argument, NULL, 'C'}
+	,{"prefetch", required_argument, NULL, 'F'}
+	,{"output", required_argument, NULL, 'o'}
 	,{"prefix", required_argument, NULL, 'p'}
 	,{"suffix", required_argument, NULL, 's'}
 	,{"aggregate", required_argument, NULL, 'a'}
@@ -36,6 +63,21 @@ static const struct option longopts[] = {
 	,{"id", required_argument, NULL, 'I'}
 	,{"group", required_argument, NULL, 'G'}
 	,{"numeric", required_argument, NULL, 'N'}
+	,{"build-index", no_argument, NULL, BUILD_INDEX_OPTION}
+	,{"convert", no_argument, NULL, CONVERT_OPTION}
+	,{"incremental", no_argument, NULL, INCREMENTAL_OPTION}
+	,{"changed-only", no_argument, NULL, CHANGED_ONLY_OPTION}
+	,{"checkpoint", required_argument, NULL, CHECKPOINT_OPTION}
+	,{"resume", no_argument, NULL, RESUME_OPTION}
+	,{"byte-range", required_argument, NULL, BYTE_RANGE_OPTION}
+	,{"emit-state", required_argument, NULL, EMIT_STATE_OPTION}
+	,{"follow", optional_argument, NULL, FOLLOW_OPTION}
+	,{"hll-precision", required_argument, NULL, HLL_PRECISION_OPTION}
+	,{"decimals", optional_argument, NULL, DECIMALS_OPTION}
+	,{"reproducible", no_argument, NULL, REPRODUCIBLE_OPTION}
+	,{"sort-groups", no_argument, NULL, SORT_GROUPS_OPTION}
+	,{"max-memory", required_argument, NULL, MAX_MEMORY_OPTION}
+	,{"float32", no_argument, NULL, FLOAT32_OPTION}
 	,{"help", no_argument, NULL, 'h'}
 	,{"version", no_argument, NULL, 'v'}
 	,{NULL, 0, NULL, 0}
@@ -67,6 +109,22 @@ int main(
 	int delimiterFlag = 0;
 	int indexedFlag = 0;
 	int parallelFlag = 0;
+	int cacheFlag = 0;
+	int buildIndexFlag = 0;
+	int convertFlag = 0;
+	int incrementalFlag = 0;
+	int changedOnlyFlag = 0;
+	int checkpointFlag = 0;
+	int resumeFlag = 0;
+	int byteRangeFlag = 0;
+	int emitStateFlag = 0;
+	int mergeFlag = 0;
+	int followFlag = 0;
+	int hllPrecisionFlag = 0;
+	int decimalsFlag = 0;
+	int maxMemoryFlag = 0;
+	int indexedInput = 0;
+	int prefetchFlag = 0;
 	int prefixFlag = 0;
 	int suffixFlag = 0;
 	int aggregateFlag = 0;
@@ -76,6 +134,18 @@ int main(
 	int helpFlag = 0;
 	int versionFlag = 0;
 	char* delimiterArg = NULL;
+	char* prefetchArg = NULL;
+	char* checkpointArg = NULL;
+	char* byteRangeArg = NULL;
+	char* emitStateArg = NULL;
+	off_t byteRangeStart = -1;
+	off_t byteRangeEnd = -1;
+	char* followArg = NULL;
+	unsigned int followInterval = TPOSE_STATE_FOLLOW_INTERVAL;
+	char* hllPrecisionArg = NULL;
+	char* decimalsArg = NULL;
+	char* maxMemoryArg = NULL;
+	size_t maxMemory = 0;
 	char* prefixArg = NULL;
 	char* suffixArg = NULL;
 	char* aggregateArg = NULL;
@@ -84,16 +154,21 @@ int main(
 	char* numericArg = NULL;
 	int idIndexedArg = -1;
 	int groupIndexedArg = -1;
-	int numericIndexedArg = -1;
+	int numericIndexedArgs[TPOSE_IO_MAX_NUMERICS];
+	unsigned int numNumericIndexedArgs = 0;
 
 	bool delimiterSpecified = false;
 
-	char* inputFilePath = NULL;
 	char* outputFilePath = NULL;
+	glob_t inputGlob;
+	int globFlags = GLOB_NOMAGIC; // Patterns without wildcards are passed through as-is
+	unsigned int numInputFiles;
+	unsigned int fileCtr;
+	off_t totalFileSize = 0;
 
 	int curArg;	
 	int iArg;
-	int fileArg = 0;
+	int lastInputArg;
 
 	opterr = 0; // Sets getopt error flag to zero
 
@@ -109,6 +184,16 @@ int main(
 			case 'P':
 				parallelFlag = 1;
 				break;
+			case 'C':
+				cacheFlag = 1;
+				break;
+			case 'F':
+				prefetchFlag = 1;
+				prefetchArg = optarg;
+				break;
+			case 'o':
+				outputFilePath = optarg;
+				break;
 			case 'p':
 				prefixFlag = 1;
 				prefixArg = optarg;
@@ -133,6 +218,58 @@ int main(
 				numericFlag = 1;
 				numericArg = strdup(optarg);
 				break;
+			case BUILD_INDEX_OPTION:
+				buildIndexFlag = 1;
+				break;
+			case CONVERT_OPTION:
+				convertFlag = 1;
+				break;
+			case INCREMENTAL_OPTION:
+				incrementalFlag = 1;
+				break;
+			case CHANGED_ONLY_OPTION:
+				changedOnlyFlag = 1;
+				break;
+			case CHECKPOINT_OPTION:
+				checkpointFlag = 1;
+				checkpointArg = optarg;
+				break;
+			case RESUME_OPTION:
+				resumeFlag = 1;
+				break;
+			case BYTE_RANGE_OPTION:
+				byteRangeFlag = 1;
+				byteRangeArg = optarg;
+				break;
+			case EMIT_STATE_OPTION:
+				emitStateFlag = 1;
+				emitStateArg = optarg;
+				break;
+			case FOLLOW_OPTION:
+				followFlag = 1;
+				followArg = optarg;
+				break;
+			case HLL_PRECISION_OPTION:
+				hllPrecisionFlag = 1;
+				hllPrecisionArg = optarg;
+				break;
+			case DECIMALS_OPTION:
+				decimalsFlag = 1;
+				decimalsArg = optarg;
+				break;
+			case REPRODUCIBLE_OPTION:
+				reproducibleGlobal = 1;
+				break;
+			case SORT_GROUPS_OPTION:
+				sortGroupsGlobal = 1;
+				break;
+			case MAX_MEMORY_OPTION:
+				maxMemoryFlag = 1;
+				maxMemoryArg = optarg;
+				break;
+			case FLOAT32_OPTION:
+				float32Global = 1;
+				break;
 			case 'h':
 				printHelp(0);
 				helpFlag = 1;
@@ -153,29 +290,45 @@ int main(
 		}
 	}
 
-	/* Get input/output file */
-	if(optind < argc) {
-		for (iArg = optind; iArg < argc; ++iArg) {
-
-			if(fileArg == 0)
-				inputFilePath = argv[iArg];
-			else if(fileArg == 1)
-				outputFilePath = argv[iArg];
-			else {
-				fprintf(stderr, "Too many files specified!\n");
-				printHelp(1);
-				exit(EXIT_FAILURE);
-			}
-			
-			++fileArg;
-		}
+	// 'tpose merge' combines state files (see --emit-state) instead of reading input files
+	if(optind < argc && !strcmp(argv[optind], "merge")) {
+		mergeFlag = 1;
+		++optind;
 	}
-	else {
+
+	/* Get input/output files */
+	if(optind >= argc) {
 		fprintf(stderr, "Missing input file.\n");
 		printHelp(1);
 		exit(EXIT_FAILURE);
 	}
 
+	// Without --output, a second file argument is the output file
+	lastInputArg = argc;
+	if(!outputFilePath && (argc - optind) == 2) {
+		outputFilePath = argv[argc - 1];
+		lastInputArg = argc - 1;
+	}
+	else if(!outputFilePath && (argc - optind) > 2) {
+		fprintf(stderr, "Too many files specified! Use --output to read multiple input files.\n");
+		printHelp(1);
+		exit(EXIT_FAILURE);
+	}
+
+	// Expand input file patterns (e.g. 'data/part-*.txt')
+	for(iArg = optind; iArg < lastInputArg; ++iArg) {
+		if(glob(argv[iArg], globFlags, NULL, &inputGlob) != 0) {
+			fprintf(stderr, "No input files match '%s'\n", argv[iArg]);
+			exit(EXIT_FAILURE);
+		}
+		globFlags |= GLOB_APPEND;
+	}
+
+	if((numInputFiles = inputGlob.gl_pathc) > TPOSE_IO_MAX_INPUT_FILES) {
+		fprintf(stderr, "Too many input files (maximum is %d)\n", TPOSE_IO_MAX_INPUT_FILES);
+		exit(EXIT_FAILURE);
+	}
+
 
 
 	/* Run checks on option arguments */
@@ -218,14 +371,42 @@ int main(
 			exit(EXIT_FAILURE);
 		}
 
-		if( numericFlag && ((numericIndexedArg = stringToInteger(numericArg)) == -1)) {
-			fprintf(stderr, "--indexed option requires a postive integer value for numeric option\n");
-			printHelp(1);
-			exit(EXIT_FAILURE);
+		if(numericFlag) {
+			char* savePtr;
+			char* numericToken;
+			for(numericToken = strtok_r(numericArg, ",", &savePtr); numericToken != NULL; numericToken = strtok_r(NULL, ",", &savePtr)) {
+				if(numNumericIndexedArgs == TPOSE_IO_MAX_NUMERICS || (numericIndexedArgs[numNumericIndexedArgs++] = stringToInteger(numericToken)) == -1) {
+					fprintf(stderr, "--indexed option requires a list of at most %d positive integer values for numeric option\n", TPOSE_IO_MAX_NUMERICS);
+					printHelp(1);
+					exit(EXIT_FAILURE);
+				}
+			}
 		}
 		
 	}
 	
+	// Check prefetch window (in MB)
+	if(prefetchFlag) {
+		int prefetchMegabytes;
+		if((prefetchMegabytes = stringToInteger(prefetchArg)) <= 0) {
+			fprintf(stderr, "-F or --prefetch option requires a positive number of megabytes\n");
+			printHelp(1);
+			exit(EXIT_FAILURE);
+		}
+		prefetchWindow = (off_t) prefetchMegabytes * 1048576;
+	}
+
+	// Check memory budget of group mode (in MB)
+	if(maxMemoryFlag) {
+		int maxMemoryMegabytes;
+		if((maxMemoryMegabytes = stringToInteger(maxMemoryArg)) <= 0) {
+			fprintf(stderr, "--max-memory option requires a positive number of megabytes\n");
+			printHelp(1);
+			exit(EXIT_FAILURE);
+		}
+		maxMemory = (size_t) maxMemoryMegabytes * 1048576;
+	}
+
 	// Set prefix/suffix
 	if(prefixFlag) { 
 		prefixGlobal = prefixArg;
@@ -237,16 +418,95 @@ int main(
 	
 	// Check aggregation type
 	if(aggregateFlag) {
-		if(strcmp("sum", tposeIOLowerCase(aggregateArg)) && strcmp("count", tposeIOLowerCase(aggregateArg)) && strcmp("avg", tposeIOLowerCase(aggregateArg))) {
-			fprintf(stderr, "-a or --aggregate option requires either 'sum', 'count', or 'avg' to be passed\n");
+		unsigned int aggregateTypes[TPOSE_IO_MAX_AGGREGATES];
+		double aggregateQuantiles[TPOSE_IO_MAX_AGGREGATES];
+		if(tposeIOParseAggregateTypes(aggregateArg, aggregateTypes, aggregateQuantiles) == -1) {
+			fprintf(stderr, "-a or --aggregate option requires 'sum', 'count', 'avg', 'min', 'max', 'var', 'stddev', 'distinct', 'median' or 'p<percent>' (or a comma-separated list of up to %d) to be passed\n", TPOSE_IO_MAX_AGGREGATES);
 			printHelp(1);
 			exit(EXIT_FAILURE);
 		}
 	}
 	else
 		aggregateArg = strdup("sum"); // Default
+
+	// Check distinct sketch precision (2^bits registers per cell)
+	if(hllPrecisionFlag) {
+		int precision = stringToInteger(hllPrecisionArg);
+		if(precision < TPOSE_SKETCH_HLL_MIN_PRECISION || precision > TPOSE_SKETCH_HLL_MAX_PRECISION) {
+			fprintf(stderr, "--hll-precision option requires a number of bits from %d to %d\n", TPOSE_SKETCH_HLL_MIN_PRECISION, TPOSE_SKETCH_HLL_MAX_PRECISION);
+			printHelp(1);
+			exit(EXIT_FAILURE);
+		}
+		hllPrecisionGlobal = precision;
+	}
+
+	// Check exact sum decimals (detected from the input if not given)
+	if(decimalsFlag) {
+		int decimals = (decimalsArg == NULL || !strcmp(decimalsArg, "auto")) ? TPOSE_IO_DECIMALS_AUTO : stringToInteger(decimalsArg);
+		if(decimals != TPOSE_IO_DECIMALS_AUTO && (decimals < 0 || decimals > TPOSE_IO_MAX_DECIMALS)) {
+			fprintf(stderr, "--decimals option requires a number of digits from 0 to %d (or 'auto')\n", TPOSE_IO_MAX_DECIMALS);
+			printHelp(1);
+			exit(EXIT_FAILURE);
+		}
+		decimalsGlobal = decimals;
+	}
 		
 
+	// Merge state files into the final output
+	if(mergeFlag) {
+		TposeState* state = tposeStateAlloc();
+		for(fileCtr = 0; fileCtr < numInputFiles; fileCtr++) {
+			TposeState* shardState = tposeStateAlloc();
+			if(tposeStateRead(NULL, shardState, inputGlob.gl_pathv[fileCtr]) == -1) {
+				fprintf(stderr, "Error: Can not open state file %s\n", inputGlob.gl_pathv[fileCtr]);
+				exit(EXIT_FAILURE);
+			}
+			if(tposeStateMerge(state, shardState) == -1) {
+				fprintf(stderr, "State file %s was saved by a different query than %s\n", inputGlob.gl_pathv[fileCtr], inputGlob.gl_pathv[0]);
+				exit(EXIT_FAILURE);
+			}
+			tposeStateFree(&shardState);
+		}
+
+		TposeInputFile* stateInputFile = tposeStateInputFileAlloc(state);
+		TposeOutputFile* outputFile;
+		if((outputFile = tposeIOOpenOutputFile(outputFilePath ? outputFilePath : "stdout", "wa", state->delimiter)) == NULL) {
+			exit(EXIT_FAILURE);
+		}
+		int stateNumerics[TPOSE_IO_MAX_NUMERICS];
+		unsigned int numericCtr;
+		for(numericCtr = 0; numericCtr < state->numNumerics; numericCtr++)
+			stateNumerics[numericCtr] = state->fields[2 + numericCtr] + 1;
+		TposeQuery* tposeQuery = tposeIOQueryIndexedAlloc(&stateInputFile, 1, outputFile, state->fields[0] + (state->fields[0] != -1), state->fields[1] + 1, stateNumerics, state->numNumerics, aggregateArg);
+		if(state->numIds && (tposeQuery->aggregateStats & ~(state->stats))) {
+			fprintf(stderr, "State files do not keep the values needed for --aggregate=%s (save them with the same --aggregate option)\n", aggregateArg);
+			exit(EXIT_FAILURE);
+		}
+		tposeStatePrint(tposeQuery, state, 0);
+
+		tposeIOInputFileFree(&stateInputFile);
+		tposeIOCloseOutputFile(outputFile);
+		tposeIOQueryFree(&tposeQuery);
+		tposeStateFree(&state);
+		globfree(&inputGlob);
+		exit(EXIT_SUCCESS);
+	}
+
+	// Check byte range (START:END bytes from the start of the input file)
+	if(byteRangeFlag) {
+		char* tail;
+		errno = 0;
+		byteRangeStart = strtoll(byteRangeArg, &tail, 10);
+		if(!errno && *tail == ':')
+			byteRangeEnd = strtoll(tail + 1, &tail, 10);
+		if(errno || *tail != '\0' || byteRangeStart < 0 || byteRangeEnd < byteRangeStart) {
+			fprintf(stderr, "--byte-range option requires START:END byte offsets (e.g. 0:1073741824)\n");
+			printHelp(1);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+
 
 	// Check that option dependencies have been specified
 	if(groupFlag && !numericFlag) {
@@ -261,6 +521,69 @@ int main(
 		exit(EXIT_FAILURE);
 	}
 	
+	if(incrementalFlag && (!groupFlag || !numericFlag)) {
+		fprintf(stderr, "--incremental requires GROUP and NUMERIC fields (see --group, and --numeric options)\n");
+		printHelp(1);
+		exit(EXIT_FAILURE);
+	}
+
+	if(checkpointFlag && (!groupFlag || !numericFlag || incrementalFlag)) {
+		fprintf(stderr, "--checkpoint requires GROUP and NUMERIC fields, and can not be used with --incremental\n");
+		printHelp(1);
+		exit(EXIT_FAILURE);
+	}
+
+	if((byteRangeFlag || emitStateFlag) && (!groupFlag || !numericFlag || incrementalFlag)) {
+		fprintf(stderr, "--byte-range and --emit-state require GROUP and NUMERIC fields, and can not be used with --incremental\n");
+		printHelp(1);
+		exit(EXIT_FAILURE);
+	}
+
+	if(byteRangeFlag && checkpointFlag) {
+		fprintf(stderr, "--byte-range can not be used with --checkpoint\n");
+		printHelp(1);
+		exit(EXIT_FAILURE);
+	}
+
+	if(followFlag) {
+		char* tail = NULL;
+		if(followArg != NULL)
+			followInterval = (unsigned int) strtoul(followArg, &tail, 10);
+		if(followArg != NULL && (*tail != '\0' || followInterval == 0)) {
+			fprintf(stderr, "--follow option requires a number of seconds (e.g. --follow=60)\n");
+			printHelp(1);
+			exit(EXIT_FAILURE);
+		}
+		if(!groupFlag || !numericFlag || incrementalFlag || checkpointFlag || byteRangeFlag || emitStateFlag) {
+			fprintf(stderr, "--follow requires GROUP and NUMERIC fields, and can not be used with --incremental, --checkpoint, --byte-range or --emit-state\n");
+			printHelp(1);
+			exit(EXIT_FAILURE);
+		}
+		if(!outputFilePath) {
+			fprintf(stderr, "--follow requires an output file\n");
+			printHelp(1);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if(maxMemoryFlag && (!groupFlag || !numericFlag || idFlag || incrementalFlag || checkpointFlag || byteRangeFlag || emitStateFlag || followFlag || sortGroupsGlobal)) {
+		fprintf(stderr, "--max-memory requires GROUP and NUMERIC fields, and can not be used with --id, --incremental, --checkpoint, --byte-range, --emit-state, --follow or --sort-groups\n");
+		printHelp(1);
+		exit(EXIT_FAILURE);
+	}
+
+	if(resumeFlag && !checkpointFlag) {
+		fprintf(stderr, "--resume requires --checkpoint\n");
+		printHelp(1);
+		exit(EXIT_FAILURE);
+	}
+
+	if(changedOnlyFlag && !incrementalFlag) {
+		fprintf(stderr, "--changed-only requires --incremental\n");
+		printHelp(1);
+		exit(EXIT_FAILURE);
+	}
+
 	// Check output file (if empty, use stdout)
 	if(!outputFilePath) {
 		outputFilePath = "stdout";
@@ -272,82 +595,192 @@ int main(
 	
 
 	/* Core */
-	TposeInputFile* inputFile;
-	if((inputFile = tposeIOOpenInputFile(inputFilePath, delimiter, mutateHeader)) == NULL) {
+	TposeInputFile** inputFiles;
+	if((inputFiles = (TposeInputFile**) calloc(numInputFiles, sizeof(TposeInputFile*))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate input file memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// All input files are read as one dataset, so must share the same header
+	for(fileCtr = 0; fileCtr < numInputFiles; fileCtr++) {
+		if((inputFiles[fileCtr] = tposeIOOpenInputFile(inputGlob.gl_pathv[fileCtr], delimiter, (fileCtr == 0) ? mutateHeader : TPOSE_IO_NO_MODIFY_HEADER)) == NULL) {
+			exit(EXIT_FAILURE);
+		}
+		if(inputFiles[fileCtr]->columnar != NULL && numInputFiles > 1) {
+			fprintf(stderr, "Columnar input file %s must be the only input file\n", inputGlob.gl_pathv[fileCtr]);
+			exit(EXIT_FAILURE);
+		}
+		if(fileCtr > 0 && tposeIOCompareInputHeaders(inputFiles[0], inputFiles[fileCtr]) == -1) {
+			fprintf(stderr, "Header of input file %s does not match %s\n", inputGlob.gl_pathv[fileCtr], inputGlob.gl_pathv[0]);
 			exit(EXIT_FAILURE);
+		}
+		totalFileSize += inputFiles[fileCtr]->fileSize;
 	}
+	if(inputFiles[0]->columnar != NULL)
+		delimiter = inputFiles[0]->fieldDelimiter; // Columnar files keep the delimiter of their source file
+
 	TposeOutputFile* outputFile;
-	if((outputFile = tposeIOOpenOutputFile(outputFilePath, "wa", delimiter)) == NULL) {
+	if((outputFile = tposeIOOpenOutputFile(followFlag ? "stdout" : outputFilePath, "wa", delimiter)) == NULL) { // --follow replaces the output file with each snapshot
 			exit(EXIT_FAILURE);
 	}
 
 	// Create query
 	TposeQuery* tposeQuery;
 	if(!indexedFlag) {
-		if((tposeQuery = tposeIOQueryAlloc(inputFile, outputFile, idArg, groupArg, numericArg, aggregateArg)) == NULL) {
+		if((tposeQuery = tposeIOQueryAlloc(inputFiles, numInputFiles, outputFile, idArg, groupArg, numericArg, aggregateArg)) == NULL) {
 			fprintf(stderr, "--id, --group, or --numeric parameters do not match input fields\n");
 			printHelp(1);
 			exit(EXIT_FAILURE);
 		}
 	}
 	else {
-		if((tposeQuery = tposeIOQueryIndexedAlloc(inputFile, outputFile, idIndexedArg, groupIndexedArg, numericIndexedArg, aggregateArg)) == NULL) {
+		if((tposeQuery = tposeIOQueryIndexedAlloc(inputFiles, numInputFiles, outputFile, idIndexedArg, groupIndexedArg, numericIndexedArgs, numNumericIndexedArgs, aggregateArg)) == NULL) {
 			fprintf(stderr, "--id, --group, or --numeric parameters do not match input fields\n");
 			printHelp(1);
 			exit(EXIT_FAILURE);
 		}
 	}
 
+	// Convert each input file to a columnar cache, build its row index, or use an existing one
+	for(fileCtr = 0; fileCtr < numInputFiles; fileCtr++) {
+		if(convertFlag) {
+			if(tposeColumnarConvert(inputFiles[fileCtr]) == -1)
+				exit(EXIT_FAILURE);
+		}
+		else if(inputFiles[fileCtr]->columnar != NULL) {
+			if(buildIndexFlag) {
+				fprintf(stderr, "Columnar input file %s does not need a row index\n", inputGlob.gl_pathv[fileCtr]);
+				exit(EXIT_FAILURE);
+			}
+			indexedInput = 1; // Row boundaries are known, so can always be split evenly
+		}
+		else if(buildIndexFlag) {
+			if(tposeCacheBuildIndex(tposeQuery, inputFiles[fileCtr]) == -1)
+				exit(EXIT_FAILURE);
+		}
+		else if(groupFlag && tposeCacheReadIndex(tposeQuery, inputFiles[fileCtr]) == 0)
+			indexedInput = 1;
+	}
+
 	// Transpose Simple
-	if(!groupFlag && !numericFlag && !idFlag) {
+	if(!groupFlag && !numericFlag && !idFlag && !buildIndexFlag && !convertFlag && !incrementalFlag && !checkpointFlag && !byteRangeFlag && !emitStateFlag && !followFlag) {
 		tposeIOTransposeSimple(tposeQuery);
 	}
 	// Transpose Group
-	if(groupFlag && numericFlag && !idFlag) {
-		if((inputFile->fileSize >= TPOSE_IO_CHUNK_SIZE) && parallelFlag) {	
+	if(groupFlag && numericFlag && !idFlag && !buildIndexFlag && !convertFlag && !incrementalFlag && !checkpointFlag && !byteRangeFlag && !emitStateFlag && !followFlag) {
+		if(maxMemoryFlag) {
+			// Bounded memory (single-threaded, GROUP values found once the budget is used are spilled to disk)
+			tposeSpillTransposeGroup(tposeQuery, maxMemory);
+		}
+		else if(((totalFileSize >= 2 * TPOSE_IO_MIN_CHUNK_SIZE) || (numInputFiles > 1) || indexedInput) && parallelFlag) {
 			// Multi-threaded
 			btreeGlobal = btreeAlloc(); // Needs to persist between computing unique groups, and aggregating values
 			if(tposeIOBuildPartitions(tposeQuery, TPOSE_IO_PARTITION_GROUP) == -1) {
 				fprintf(stderr, "Error reading input file! Make sure it is correctly formed.\n");
 				exit(EXIT_FAILURE);
 			}
-			tposeIOUniqueGroupsParallel(tposeQuery);
+			if(!cacheFlag || tposeCacheReadGroups(tposeQuery, btreeGlobal) == -1) {
+				tposeIOUniqueGroupsParallel(tposeQuery);
+				if(cacheFlag) tposeCacheWriteGroups(tposeQuery);
+			}
 			tposeIOTransposeGroupParallel(tposeQuery);
 			btreeFree(&btreeGlobal);
 		}
 		else {
 			// Single-threaded
 			BTree* btree = btreeAlloc(); // Needs to persist between computing unique groups, and aggregating values
-			tposeIOUniqueGroups(tposeQuery, btree);
+			if(!cacheFlag || tposeCacheReadGroups(tposeQuery, btree) == -1) {
+				tposeIOUniqueGroups(tposeQuery, btree);
+				if(cacheFlag) tposeCacheWriteGroups(tposeQuery);
+			}
 			tposeIOTransposeGroup(tposeQuery, btree);
 			btreeFree(&btree);
 		}
 	}
 	
 	// Transpose Group Id
-	if(groupFlag && numericFlag && idFlag) {
-		if((inputFile->fileSize >= TPOSE_IO_CHUNK_SIZE) && parallelFlag) {	
+	if(groupFlag && numericFlag && idFlag && !buildIndexFlag && !convertFlag && !incrementalFlag && !checkpointFlag && !byteRangeFlag && !emitStateFlag && !followFlag) {
+		if(((totalFileSize >= 2 * TPOSE_IO_MIN_CHUNK_SIZE) || (numInputFiles > 1) || indexedInput) && parallelFlag) {
 			// Multi-threaded
 			btreeGlobal = btreeAlloc(); // Needs to persist between computing unique groups, and aggregating values
 			if(tposeIOBuildPartitions(tposeQuery, TPOSE_IO_PARTITION_ID) == -1) {
 				fprintf(stderr, "Error reading input file! Make sure it is correctly formed.\n");
 				exit(EXIT_FAILURE);
 			}
-			tposeIOUniqueGroupsParallel(tposeQuery);
+			if(!cacheFlag || tposeCacheReadGroups(tposeQuery, btreeGlobal) == -1) {
+				tposeIOUniqueGroupsParallel(tposeQuery);
+				if(cacheFlag) tposeCacheWriteGroups(tposeQuery);
+			}
 			tposeIOTransposeGroupIdParallel(tposeQuery);
 			btreeFree(&btreeGlobal);
 		}
 		else {
 			// Single-threaded
 			BTree* btree = btreeAlloc(); // Needs to persist between computing unique groups, and aggregating values
-			tposeIOUniqueGroups(tposeQuery, btree);
+			if(!cacheFlag || tposeCacheReadGroups(tposeQuery, btree) == -1) {
+				tposeIOUniqueGroups(tposeQuery, btree);
+				if(cacheFlag) tposeCacheWriteGroups(tposeQuery);
+			}
 			tposeIOTransposeGroupId(tposeQuery, btree);
 			btreeFree(&btree);
 		}
 	}
 	
+	// Transpose Incremental (carries on from the state saved by the last run)
+	if(incrementalFlag && !buildIndexFlag && !convertFlag) {
+		TposeState* state = tposeStateAlloc();
+		char* statePath = tposeStatePath(tposeQuery);
+		tposeStateRead(tposeQuery, state, statePath);
+		if(tposeStateUpdate(tposeQuery, state) == -1 || tposeStateWrite(tposeQuery, state, statePath) == -1)
+			exit(EXIT_FAILURE);
+		tposeStatePrint(tposeQuery, state, changedOnlyFlag);
+		tposeStateFree(&state);
+		free(statePath);
+	}
+
+	// Transpose Checkpointed (partial aggregates are saved as each partition is scanned)
+	if(checkpointFlag && !buildIndexFlag && !convertFlag) {
+		TposeState* state = tposeStateAlloc();
+		if(tposeStateCheckpoint(tposeQuery, state, checkpointArg, resumeFlag, parallelFlag) == -1) {
+			fprintf(stderr, "Error reading input file! Make sure it is correctly formed.\n");
+			exit(EXIT_FAILURE);
+		}
+		if(emitStateFlag) {
+			if(tposeStateWrite(tposeQuery, state, emitStateArg) == -1)
+				exit(EXIT_FAILURE);
+		}
+		else
+			tposeStatePrint(tposeQuery, state, 0);
+		tposeStateFree(&state);
+	}
+
+	// Transpose Shard (a byte range of the input, and/or saved as state to be merged later)
+	if((byteRangeFlag || emitStateFlag) && !checkpointFlag && !buildIndexFlag && !convertFlag) {
+		TposeState* state = tposeStateAlloc();
+		if(tposeStateScanRange(tposeQuery, state, byteRangeStart, byteRangeEnd) == -1)
+			exit(EXIT_FAILURE);
+		if(emitStateFlag) {
+			if(tposeStateWrite(tposeQuery, state, emitStateArg) == -1)
+				exit(EXIT_FAILURE);
+		}
+		else
+			tposeStatePrint(tposeQuery, state, 0);
+		tposeStateFree(&state);
+	}
+
+	// Transpose Follow (keeps aggregating rows as they are appended to the input)
+	if(followFlag && !buildIndexFlag && !convertFlag) {
+		TposeState* state = tposeStateAlloc();
+		if(tposeStateFollow(tposeQuery, state, outputFilePath, followInterval) == -1)
+			exit(EXIT_FAILURE);
+		tposeStateFree(&state);
+	}
+
 	//Clean-up
-	tposeIOCloseInputFile(inputFile);
+	for(fileCtr = 0; fileCtr < numInputFiles; fileCtr++)
+		tposeIOCloseInputFile(inputFiles[fileCtr]);
+	free(inputFiles);
+	globfree(&inputGlob);
 	tposeIOCloseOutputFile(outputFile);
 	tposeIOQueryFree(&tposeQuery);
 	
@@ -365,12 +798,21 @@ static void printHelp
 	FILE *out = status ? stderr : stdout;
 
   fprintf(out, "\n\
-Usage: %s input-file [output-file] [--options] \n\n", program_name);
+Usage: %s input-file [output-file] [--options] \n\
+       %s input-file... --output=<output-file> [--options] \n\
+       %s merge state-file... --output=<output-file> [--options] \n\n", program_name, program_name, program_name);
 
   fprintf(out, "  -d<char>, --delimiter=<char>\
 \tspecify field delimiter used to read input file\n");
   fprintf(out, "  -P, --parallel\
-\t\tmulti-threaded transpose (files > 1GB)\n");
+\t\tmulti-threaded transpose (input > 2MB, or multiple files)\n");
+  fprintf(out, "  -C, --cache\
+\t\t\treuse GROUP values found by a previous run (saved to\n\
+\t\t\t\t<input-file>.tpgroups)\n");
+  fprintf(out, "  -F<MB>, --prefetch=<MB>\
+\tread ahead <MB> of each scan in a background thread\n");
+  fprintf(out, "  -o<file>, --output=<file>\
+\twrite output to file (allows multiple input files or patterns)\n");
   fprintf(out, "  -i, --indexed\
 \t\t\tuse field indexes (e.g. 1,2,...) instead of names\n");
   fprintf(out, "  -I<field>, --id=<field>\
@@ -378,14 +820,62 @@ Usage: %s input-file [output-file] [--options] \n\n", program_name);
   fprintf(out, "  -G<field>, --group=<field>\
 \tdefines GROUP field in input (requires --numeric)\n");
   fprintf(out, "  -N<field>, --numeric=<field>\
-\tdefines NUMERIC field in input. Aggregated with --aggregate\n");
+\tdefines NUMERIC field in input. Aggregated with --aggregate\n\
+\t\t\t\tCan be a list (e.g. 'amount,tax'), all read in one pass\n");
   fprintf(out, "  -p<string>, --prefix=<string>\
 \tprefix transposed fields with string\n");
   fprintf(out, "  -s<string>, --suffix=<string>\
 \tsuffix transposed fields with string\n");
   fprintf(out, "  -a<type>, --aggregate=<type>\
-\taggregate NUMERIC values. Can be 'sum', 'count', or 'avg'.\n\
+\taggregate NUMERIC values. Can be 'sum', 'count', 'avg',\n\
+\t\t\t\t'min', 'max', 'var', 'stddev' (sample variance and\n\
+\t\t\t\tstandard deviation), 'distinct' (approximate number of\n\
+\t\t\t\tdifferent values), 'p<percent>' (approximate quantile,\n\
+\t\t\t\te.g. 'p95', within 1%%; 'median' is 'p50'), or a list\n\
+\t\t\t\t(e.g. 'sum,count,max').\n\
 \t\t\t\tRequires --numeric to be specified (Default = 'sum')\n");
+  fprintf(out, "      --hll-precision=<bits>\
+\tregisters (2^<bits> bytes) of each 'distinct' sketch, from 4\n\
+\t\t\t\tto 18. Error is about 1.04 / sqrt(2^<bits>) (Default = 12)\n");
+  fprintf(out, "      --decimals[=<digits>]\
+\tsum NUMERIC values exactly, as integers of 10^-<digits>\n\
+\t\t\t\t(e.g. 2 for cents; further decimals are rounded). Without\n\
+\t\t\t\t<digits>, they are found in the first rows of the input\n");
+  fprintf(out, "      --reproducible\
+\t\tkeep exact sums, so sum, avg, var and stddev do not depend\n\
+\t\t\t\ton how rows are split (-P, checkpoints, merged states)\n");
+  fprintf(out, "      --sort-groups\
+\t\tprint GROUP columns sorted by value, instead of in the\n\
+\t\t\t\torder they are found in the input\n");
+  fprintf(out, "      --max-memory=<MB>\
+\taggregate GROUP values (without --id) in about <MB> of memory,\n\
+\t\t\t\tspilling the rest to $TMPDIR. Allows any number of groups\n");
+  fprintf(out, "      --float32\
+\t\tkeep sums, mins and maxs as 4-byte floats (about 7 digits),\n\
+\t\t\t\thalving the memory of large --id x --group outputs\n");
+  fprintf(out, "      --build-index\
+\t\twrite a row index of each input file (<input-file>.tpidx),\n\
+\t\t\t\tincluding the --id, --group and --numeric fields\n");
+  fprintf(out, "      --convert\
+\t\t\twrite a columnar copy of each input file (<input-file>.tpcol),\n\
+\t\t\t\twhich can be used as input instead of the original\n");
+  fprintf(out, "      --incremental\
+\t\tonly aggregate rows added since the last --incremental run\n\
+\t\t\t\t(state is saved to <input-file>.tpstate)\n");
+  fprintf(out, "      --changed-only\
+\t\twith --incremental, only output IDs with new rows\n");
+  fprintf(out, "      --checkpoint=<dir>\
+\tsave the progress of each partition to <dir> as it is scanned\n");
+  fprintf(out, "      --resume\
+\t\t\twith --checkpoint, carry on from the saved progress\n");
+  fprintf(out, "      --byte-range=<start:end>\
+\tonly aggregate the rows starting in this byte range of the input file\n");
+  fprintf(out, "      --emit-state=<file>\
+\tsave the aggregates to <file> instead of writing output\n\
+\t\t\t\t(state files are combined with 'tpose merge')\n");
+  fprintf(out, "      --follow[=<seconds>]\
+\tkeep aggregating rows appended to the input, and rewrite the\n\
+\t\t\t\toutput file every <seconds> (Default = 60)\n");
   fprintf(out, "  -h, --help\
 \t\t\tdisplay this help and exit\n");
   fprintf(out, "  -v, --version\
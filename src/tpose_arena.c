@@ -0,0 +1,141 @@
+/* tpose_arena.c -- arena allocator implementation.
+
+   Copyright 2015 Jonathan Sacramento.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tpose_arena.h"
+
+
+
+/**
+ ** Rounds a size up to the arena alignment
+ **/
+#define tposeArenaAlign(size) (((size) + TPOSE_ARENA_ALIGNMENT - 1) & ~((size_t) TPOSE_ARENA_ALIGNMENT - 1))
+
+
+
+/**
+ ** Allocates an empty arena (no memory is taken until the first allocation)
+ **/
+TposeArena* tposeArenaAlloc(
+	void
+) {
+
+	TposeArena* arena;
+
+	if((arena = (TposeArena*) calloc(1, sizeof(TposeArena))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate arena memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return arena;
+
+}
+
+
+
+/**
+ ** Returns size bytes from the arena (uninitialised, aligned to TPOSE_ARENA_ALIGNMENT)
+ ** The memory cannot be freed on its own, only with the whole arena
+ **/
+void* tposeArenaMalloc(
+	TposeArena* arena
+	,size_t size
+) {
+
+	TposeArenaChunk* chunk = arena->chunks;
+	size_t chunkSize;
+	void* result;
+
+	size = tposeArenaAlign(size ? size : 1);
+
+	if(chunk == NULL || chunk->size - chunk->used < size) {
+
+		chunkSize = size > TPOSE_ARENA_CHUNK_SIZE ? size : TPOSE_ARENA_CHUNK_SIZE;
+		if((chunk = (TposeArenaChunk*) malloc(tposeArenaAlign(sizeof(TposeArenaChunk)) + chunkSize)) == NULL) {
+			fprintf(stderr, "Error: Cannot allocate arena memory\n");
+			exit(EXIT_FAILURE);
+		}
+		chunk->size = chunkSize;
+		chunk->used = 0;
+
+		// An oversized request fills its chunk, so keep filling the current one
+		if(size > TPOSE_ARENA_CHUNK_SIZE && arena->chunks != NULL) {
+			chunk->next = (arena->chunks)->next;
+			(arena->chunks)->next = chunk;
+		}
+		else {
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+		}
+	}
+
+	result = (char*) chunk + tposeArenaAlign(sizeof(TposeArenaChunk)) + chunk->used;
+	chunk->used += size;
+	arena->numBytes += size;
+
+	return result;
+
+}
+
+
+
+/**
+ ** Copies length characters of a string into the arena (always NUL terminated)
+ **/
+char* tposeArenaStrndup(
+	TposeArena* arena
+	,const char* string
+	,size_t length
+) {
+
+	char* copy = (char*) tposeArenaMalloc(arena, length + 1);
+
+	memcpy(copy, string, length);
+	copy[length] = '\0';
+
+	return copy;
+
+}
+
+
+
+/**
+ ** Frees an arena and everything allocated from it
+ **/
+void tposeArenaFree(
+	TposeArena** arenaPtr
+) {
+
+	TposeArenaChunk* chunk;
+	TposeArenaChunk* next;
+
+	if(*arenaPtr == NULL)
+		return;
+
+	for(chunk = (*arenaPtr)->chunks; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+
+	free(*arenaPtr);
+	*arenaPtr = NULL;
+
+}
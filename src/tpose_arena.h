@@ -0,0 +1,63 @@
+/* tpose_arena.h: arena allocator interface;
+
+   Copyright 2015 Jonathan Sacramento.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TPOSE_ARENA_H_
+#define _TPOSE_ARENA_H_
+
+	#include <stddef.h>
+
+	#include "system.h"
+
+
+	/**
+	 ** Implementation defs & limits
+	 **/
+	#define TPOSE_ARENA_CHUNK_SIZE (1 << 20) // Bytes carved out of each chunk (larger requests get a chunk of their own)
+	#define TPOSE_ARENA_ALIGNMENT 16 // Every allocation starts on this boundary
+
+
+	/**
+	 ** TposeArenaChunk
+	 ** Block of memory handed out front to back (chunks are linked newest first)
+	 **/
+	typedef struct TposeArenaChunk {
+		struct TposeArenaChunk* next;
+		size_t size; // Bytes after the chunk header
+		size_t used;
+	} TposeArenaChunk;
+
+
+	/**
+	 ** TposeArena
+	 ** Allocations that live as long as each other (the strings of a header,
+	 ** the IDs of a state) and are all released at once by tposeArenaFree
+	 ** Not locked: each thread fills its own arena
+	 **/
+	typedef struct {
+		TposeArenaChunk* chunks; // Newest (the one being filled) first
+		size_t numBytes; // Bytes handed out
+	} TposeArena;
+
+
+	/* arena memory */
+	TposeArena* tposeArenaAlloc(void);
+	void* tposeArenaMalloc(TposeArena* arena, size_t size);
+	char* tposeArenaStrndup(TposeArena* arena, const char* string, size_t length);
+	void tposeArenaFree(TposeArena** arenaPtr);
+
+#endif
@@ -0,0 +1,494 @@
+/* tpose_cache.c -- sidecar cache (group dictionary, row index) implementation.
+
+   Copyright 2015 Jonathan Sacramento.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tpose_cache.h"
+
+
+
+/**
+ ** Returns the path of the group cache (sits next to the first input file)
+ **/
+char* tposeCacheGroupsPath(
+	TposeQuery* tposeQuery
+) {
+
+	char* filePath = (tposeQuery->inputFile)->filePath;
+	char* cachePath;
+
+	if((cachePath = (char*) malloc(strlen(filePath) + strlen(TPOSE_CACHE_GROUPS_EXT) + 1)) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate cache path memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	strcpy(cachePath, filePath);
+	strcat(cachePath, TPOSE_CACHE_GROUPS_EXT);
+
+	return cachePath;
+
+}
+
+
+
+/**
+ ** Fills the fingerprint of an input file (device, inode, size and mtime)
+ **/
+void tposeCacheFingerprint(
+	TposeInputFile* inputFile
+	,TposeCacheFingerprint* fingerprint
+) {
+
+	memset(fingerprint, 0, sizeof(TposeCacheFingerprint));
+	fingerprint->device = (uint64_t) (inputFile->fileStat).st_dev;
+	fingerprint->inode = (uint64_t) (inputFile->fileStat).st_ino;
+	fingerprint->size = (int64_t) (inputFile->fileStat).st_size;
+	fingerprint->mtimeSec = (int64_t) (inputFile->fileStat).st_mtim.tv_sec;
+	fingerprint->mtimeNsec = (int64_t) (inputFile->fileStat).st_mtim.tv_nsec;
+
+}
+
+
+
+/**
+ ** Loads the unique GROUP values from the group cache
+ ** Returns 0 if loaded, -1 if the cache is missing or stale
+ **/
+int tposeCacheReadGroups(
+	TposeQuery* tposeQuery
+	,BTree* btree
+) {
+
+	FILE* fd;
+	char* cachePath = tposeCacheGroupsPath(tposeQuery);
+	char* groupColumn = ((tposeQuery->inputFile)->fileHeader)->fields[tposeQuery->group];
+	char* groupString;
+	char magic[8];
+	uint32_t version;
+	uint32_t numFiles;
+	uint32_t groupIndex;
+	uint32_t length;
+	uint32_t numGroups;
+	int64_t hashValue;
+	unsigned char delimiter;
+	unsigned int fileCtr;
+	unsigned int groupCtr;
+	TposeCacheFingerprint fingerprint;
+	TposeCacheFingerprint cachedFingerprint;
+	TposeHeader* header;
+	BTreeKey key;
+
+	if((fd = fopen(cachePath, "rb")) == NULL) {
+		free(cachePath);
+		return -1;
+	}
+
+	// Check cache was built from the same files and GROUP field
+	if(fread(magic, sizeof(magic), 1, fd) != 1 || memcmp(magic, TPOSE_CACHE_GROUPS_MAGIC, sizeof(magic))
+		|| fread(&version, sizeof(version), 1, fd) != 1 || version != TPOSE_CACHE_GROUPS_VERSION
+		|| fread(&numFiles, sizeof(numFiles), 1, fd) != 1 || numFiles != tposeQuery->numInputFiles)
+		goto stale;
+
+	for(fileCtr = 0; fileCtr < numFiles; fileCtr++) {
+		tposeCacheFingerprint(tposeQuery->inputFiles[fileCtr], &fingerprint);
+		if(fread(&cachedFingerprint, sizeof(cachedFingerprint), 1, fd) != 1 || memcmp(&fingerprint, &cachedFingerprint, sizeof(fingerprint)))
+			goto stale;
+	}
+
+	if(fread(&delimiter, sizeof(delimiter), 1, fd) != 1 || delimiter != (tposeQuery->inputFile)->fieldDelimiter
+		|| fread(&groupIndex, sizeof(groupIndex), 1, fd) != 1 || groupIndex != tposeQuery->group
+		|| fread(&length, sizeof(length), 1, fd) != 1 || length != strlen(groupColumn))
+		goto stale;
+
+	if((groupString = (char*) malloc(length + 1)) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate cache memory\n");
+		exit(EXIT_FAILURE);
+	}
+	if(fread(groupString, 1, length, fd) != length || memcmp(groupString, groupColumn, length)) {
+		free(groupString);
+		goto stale;
+	}
+	free(groupString);
+
+	if(fread(&numGroups, sizeof(numGroups), 1, fd) != 1 || numGroups > TPOSE_IO_MAX_FIELDS)
+		goto stale;
+
+	// Read groups (in order of discovery)
+	header = tposeIOHeaderAlloc(TPOSE_IO_MAX_FIELDS, TPOSE_IO_MODIFY_HEADER);
+	for(groupCtr = 0; groupCtr < numGroups; groupCtr++) {
+
+		if(fread(&hashValue, sizeof(hashValue), 1, fd) != 1
+			|| fread(&length, sizeof(length), 1, fd) != 1 || length >= TPOSE_IO_MAX_FIELD_WIDTH
+			|| fread((groupString = (char*) tposeArenaMalloc(header->arena, length + 1)), 1, length, fd) != length
+			|| hashValue != (int64_t) tposeIOHash(groupString, length)) {
+			fprintf(stderr, "Warning: Ignoring corrupt group cache %s\n", cachePath);
+			tposeIOHeaderFree(&header);
+			goto stale;
+		}
+
+		groupString[length] = '\0';
+		header->fields[header->numFields++] = groupString;
+	}
+
+	// Only populate the btree once the whole cache has been read
+	for(groupCtr = 0; groupCtr < header->numFields; groupCtr++) {
+		btreeSetKeyValue(&key, tposeIOHash(header->fields[groupCtr], strlen(header->fields[groupCtr])), groupCtr, 0);
+		key.isUnlinked = 0;
+		if(btreeInsert(btree, &key) == -1)
+			fprintf(stderr, "Error: Cannot insert value into btree\n");
+	}
+
+	debug_print("tposeCacheReadGroups(): loaded %u groups from %s\n", header->numFields, cachePath);
+
+	(tposeQuery->outputFile)->fileGroupHeader = header;
+
+	fclose(fd);
+	free(cachePath);
+	return 0;
+
+stale:
+	debug_print("tposeCacheReadGroups(): %s is stale\n", cachePath);
+	fclose(fd);
+	free(cachePath);
+	return -1;
+
+}
+
+
+
+/**
+ ** Saves the unique GROUP values to the group cache
+ ** Written to a temp file first, so readers never see a partial cache
+ **/
+int tposeCacheWriteGroups(
+	TposeQuery* tposeQuery
+) {
+
+	FILE* fd;
+	char* cachePath = tposeCacheGroupsPath(tposeQuery);
+	char* tempPath;
+	char* groupColumn = ((tposeQuery->inputFile)->fileHeader)->fields[tposeQuery->group];
+	TposeHeader* header = (tposeQuery->outputFile)->fileGroupHeader;
+	uint32_t version = TPOSE_CACHE_GROUPS_VERSION;
+	uint32_t numFiles = tposeQuery->numInputFiles;
+	uint32_t groupIndex = tposeQuery->group;
+	uint32_t length;
+	uint32_t numGroups = header->numFields;
+	int64_t hashValue;
+	unsigned char delimiter = (tposeQuery->inputFile)->fieldDelimiter;
+	unsigned int fileCtr;
+	unsigned int groupCtr;
+	int writeError = 0;
+	TposeCacheFingerprint fingerprint;
+
+	if((tempPath = (char*) malloc(strlen(cachePath) + 5)) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate cache path memory\n");
+		exit(EXIT_FAILURE);
+	}
+	sprintf(tempPath, "%s.tmp", cachePath);
+
+	if((fd = fopen(tempPath, "wb")) == NULL) {
+		fprintf(stderr, "Warning: Cannot write group cache %s\n", cachePath);
+		free(tempPath);
+		free(cachePath);
+		return -1;
+	}
+
+	// Files and GROUP field the cache was built from
+	writeError |= fwrite(TPOSE_CACHE_GROUPS_MAGIC, 8, 1, fd) != 1;
+	writeError |= fwrite(&version, sizeof(version), 1, fd) != 1;
+	writeError |= fwrite(&numFiles, sizeof(numFiles), 1, fd) != 1;
+	for(fileCtr = 0; fileCtr < numFiles; fileCtr++) {
+		tposeCacheFingerprint(tposeQuery->inputFiles[fileCtr], &fingerprint);
+		writeError |= fwrite(&fingerprint, sizeof(fingerprint), 1, fd) != 1;
+	}
+	length = strlen(groupColumn);
+	writeError |= fwrite(&delimiter, sizeof(delimiter), 1, fd) != 1;
+	writeError |= fwrite(&groupIndex, sizeof(groupIndex), 1, fd) != 1;
+	writeError |= fwrite(&length, sizeof(length), 1, fd) != 1;
+	writeError |= fwrite(groupColumn, 1, length, fd) != length;
+
+	// Groups (in order of discovery)
+	writeError |= fwrite(&numGroups, sizeof(numGroups), 1, fd) != 1;
+	for(groupCtr = 0; groupCtr < numGroups; groupCtr++) {
+		length = strlen(header->fields[groupCtr]);
+		hashValue = tposeIOHash(header->fields[groupCtr], length);
+		writeError |= fwrite(&hashValue, sizeof(hashValue), 1, fd) != 1;
+		writeError |= fwrite(&length, sizeof(length), 1, fd) != 1;
+		writeError |= fwrite(header->fields[groupCtr], 1, length, fd) != length;
+	}
+
+	writeError |= fclose(fd) != 0;
+
+	if(writeError || rename(tempPath, cachePath) == -1) {
+		fprintf(stderr, "Warning: Cannot write group cache %s\n", cachePath);
+		remove(tempPath);
+		free(tempPath);
+		free(cachePath);
+		return -1;
+	}
+
+	free(tempPath);
+	free(cachePath);
+	return 0;
+
+}
+
+
+
+/**
+ ** Returns the path of the row index of an input file
+ **/
+char* tposeCacheIndexPath(
+	TposeInputFile* inputFile
+) {
+
+	char* indexPath;
+
+	if((indexPath = (char*) malloc(strlen(inputFile->filePath) + strlen(TPOSE_CACHE_INDEX_EXT) + 1)) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate cache path memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	strcpy(indexPath, inputFile->filePath);
+	strcat(indexPath, TPOSE_CACHE_INDEX_EXT);
+
+	return indexPath;
+
+}
+
+
+
+/**
+ ** Writes the row index of an input file (see --build-index)
+ ** Indexes the ID, GROUP and NUMERIC fields of the query (if any)
+ **/
+int tposeCacheBuildIndex(
+	TposeQuery* tposeQuery
+	,TposeInputFile* inputFile
+) {
+
+	FILE* fd;
+	char* indexPath = tposeCacheIndexPath(inputFile);
+	char* tempPath;
+	char* record;
+	char* rowPtr = inputFile->dataAddr;
+	char* rowEnd;
+	char* fieldPtr;
+	char* endPtr = inputFile->dataAddr + inputFile->dataSize;
+	uint64_t* samples;
+	uint64_t nextSample = 0;
+	uint32_t* fieldOffsets;
+	uint64_t rowOffset;
+	unsigned int fieldCount;
+	unsigned int columnCtr;
+	unsigned int lastColumn = 0;
+	int queryFields[2 + TPOSE_IO_MAX_NUMERICS] = {tposeQuery->id, tposeQuery->group};
+	unsigned int numQueryFields = 2;
+	int writeError = 0;
+	TposeCacheIndexHeader header;
+
+	for(columnCtr = 0; columnCtr < tposeQuery->numNumerics; columnCtr++)
+		queryFields[numQueryFields++] = tposeQuery->numerics[columnCtr];
+
+	// Index each query field once
+	memset(&header, 0, sizeof(header));
+	for(columnCtr = 0; columnCtr < numQueryFields; columnCtr++) {
+		unsigned int seenCtr;
+		if(queryFields[columnCtr] == -1)
+			continue;
+		for(seenCtr = 0; seenCtr < header.numColumns && header.columns[seenCtr] != queryFields[columnCtr]; seenCtr++);
+		if(seenCtr == header.numColumns)
+			header.columns[header.numColumns++] = queryFields[columnCtr];
+		if(queryFields[columnCtr] > lastColumn)
+			lastColumn = queryFields[columnCtr];
+	}
+
+	memcpy(header.magic, TPOSE_CACHE_INDEX_MAGIC, sizeof(header.magic));
+	header.version = TPOSE_CACHE_INDEX_VERSION;
+	tposeCacheFingerprint(inputFile, &(header.fingerprint));
+	header.sampleInterval = TPOSE_CACHE_INDEX_SAMPLE;
+	header.numSamples = (inputFile->dataSize + TPOSE_CACHE_INDEX_SAMPLE - 1) / TPOSE_CACHE_INDEX_SAMPLE;
+	header.recordSize = header.numColumns ? ((sizeof(uint64_t) + header.numColumns * sizeof(uint32_t) + 7) & ~((uint64_t) 7)) : 0;
+	header.dataOffset = inputFile->dataAddr - inputFile->fileAddr;
+	header.delimiter = inputFile->fieldDelimiter;
+
+	if((samples = (uint64_t*) calloc(header.numSamples + 1, sizeof(uint64_t))) == NULL
+		|| (record = (char*) calloc(1, header.recordSize + sizeof(uint64_t))) == NULL
+		|| (tempPath = (char*) malloc(strlen(indexPath) + 5)) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate index memory\n");
+		exit(EXIT_FAILURE);
+	}
+	fieldOffsets = (uint32_t*) (record + sizeof(uint64_t));
+	sprintf(tempPath, "%s.tmp", indexPath);
+
+	if((fd = fopen(tempPath, "wb")) == NULL) {
+		fprintf(stderr, "Error: Cannot write index file %s\n", indexPath);
+		free(samples); free(record); free(tempPath); free(indexPath);
+		return -1;
+	}
+
+	// Header is rewritten once the number of rows is known
+	writeError |= fwrite(&header, sizeof(header), 1, fd) != 1;
+
+	while(rowPtr < endPtr) {
+
+		rowOffset = rowPtr - inputFile->dataAddr;
+		while(nextSample < header.numSamples && nextSample * header.sampleInterval <= rowOffset)
+			samples[nextSample++] = rowOffset;
+
+		if((rowEnd = memchr(rowPtr, rowDelimiter, endPtr - rowPtr)) == NULL)
+			rowEnd = endPtr;
+
+		// Offsets of the indexed fields within the row
+		if(header.numColumns) {
+			*((uint64_t*) record) = rowOffset;
+			for(columnCtr = 0; columnCtr < header.numColumns; columnCtr++)
+				fieldOffsets[columnCtr] = TPOSE_IO_INDEX_MISSING;
+
+			for(fieldPtr = rowPtr, fieldCount = 0; fieldCount <= lastColumn && (fieldPtr - rowPtr) < TPOSE_IO_INDEX_MISSING; fieldCount++) {
+				for(columnCtr = 0; columnCtr < header.numColumns; columnCtr++) {
+					if(header.columns[columnCtr] == fieldCount)
+						fieldOffsets[columnCtr] = fieldPtr - rowPtr;
+				}
+				if((fieldPtr = memchr(fieldPtr, inputFile->fieldDelimiter, rowEnd - fieldPtr)) == NULL)
+					break;
+				++fieldPtr;
+			}
+
+			writeError |= fwrite(record, header.recordSize, 1, fd) != 1;
+		}
+
+		++header.numRows;
+		rowPtr = rowEnd + 1;
+	}
+
+	// Samples past the last row point at the end of the data
+	while(nextSample < header.numSamples)
+		samples[nextSample++] = inputFile->dataSize;
+
+	writeError |= fwrite(samples, sizeof(uint64_t), header.numSamples, fd) != header.numSamples;
+	writeError |= fseek(fd, 0, SEEK_SET) != 0;
+	writeError |= fwrite(&header, sizeof(header), 1, fd) != 1;
+	writeError |= fclose(fd) != 0;
+
+	if(writeError || rename(tempPath, indexPath) == -1) {
+		fprintf(stderr, "Error: Cannot write index file %s\n", indexPath);
+		remove(tempPath);
+		writeError = 1;
+	}
+
+	free(samples);
+	free(record);
+	free(tempPath);
+	free(indexPath);
+
+	return writeError ? -1 : 0;
+
+}
+
+
+
+/**
+ ** Maps the row index of an input file (if there is one)
+ ** Returns 0 if the index can be used, -1 if it is missing or stale
+ **/
+int tposeCacheReadIndex(
+	TposeQuery* tposeQuery
+	,TposeInputFile* inputFile
+) {
+
+	int fd;
+	char* indexPath = tposeCacheIndexPath(inputFile);
+	char* mapAddr;
+	struct stat statBuffer;
+	TposeCacheIndexHeader* header;
+	TposeCacheFingerprint fingerprint;
+	TposeIndex* index;
+	unsigned int columnCtr;
+	unsigned int numericCtr;
+
+	if((fd = open(indexPath, O_RDONLY)) < 0) {
+		free(indexPath);
+		return -1;
+	}
+
+	if(fstat(fd, &statBuffer) < 0 || statBuffer.st_size < sizeof(TposeCacheIndexHeader)
+		|| (mapAddr = mmap(0, statBuffer.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		free(indexPath);
+		return -1;
+	}
+	close(fd);
+
+	// Check the index was built from this file
+	header = (TposeCacheIndexHeader*) mapAddr;
+	tposeCacheFingerprint(inputFile, &fingerprint);
+	if(memcmp(header->magic, TPOSE_CACHE_INDEX_MAGIC, sizeof(header->magic))
+		|| header->version != TPOSE_CACHE_INDEX_VERSION
+		|| memcmp(&(header->fingerprint), &fingerprint, sizeof(fingerprint))
+		|| header->delimiter != inputFile->fieldDelimiter
+		|| header->dataOffset != (inputFile->dataAddr - inputFile->fileAddr)
+		|| header->numColumns > TPOSE_CACHE_INDEX_MAX_COLUMNS
+		|| header->sampleInterval == 0
+		|| statBuffer.st_size != sizeof(TposeCacheIndexHeader) + header->numRows * header->recordSize + header->numSamples * sizeof(uint64_t)) {
+		debug_print("tposeCacheReadIndex(): %s is stale\n", indexPath);
+		munmap(mapAddr, statBuffer.st_size);
+		free(indexPath);
+		return -1;
+	}
+
+	if((index = (TposeIndex*) calloc(1, sizeof(TposeIndex))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate index memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	index->mapAddr = mapAddr;
+	index->mapSize = statBuffer.st_size;
+	index->records = mapAddr + sizeof(TposeCacheIndexHeader);
+	index->numRows = header->numRows;
+	index->recordSize = header->recordSize;
+	index->samples = (uint64_t*) (index->records + header->numRows * header->recordSize);
+	index->numSamples = header->numSamples;
+	index->sampleInterval = header->sampleInterval;
+	index->numColumns = header->numColumns;
+	index->columns = header->columns;
+
+	// Find where the query fields are in each record
+	index->idSlot = -1;
+	index->groupSlot = -1;
+	for(numericCtr = 0; numericCtr < TPOSE_IO_MAX_NUMERICS; numericCtr++)
+		index->numericSlots[numericCtr] = -1;
+	for(columnCtr = 0; columnCtr < index->numColumns; columnCtr++) {
+		if(index->columns[columnCtr] == tposeQuery->id) index->idSlot = columnCtr;
+		if(index->columns[columnCtr] == tposeQuery->group) index->groupSlot = columnCtr;
+		for(numericCtr = 0; numericCtr < tposeQuery->numNumerics; numericCtr++) {
+			if(index->columns[columnCtr] == tposeQuery->numerics[numericCtr]) index->numericSlots[numericCtr] = columnCtr;
+		}
+	}
+	index->fieldsIndexed = index->recordSize > 0
+		&& (tposeQuery->id == -1 || index->idSlot != -1)
+		&& (tposeQuery->group == -1 || index->groupSlot != -1);
+	for(numericCtr = 0; numericCtr < tposeQuery->numNumerics; numericCtr++)
+		index->fieldsIndexed &= index->numericSlots[numericCtr] != -1;
+
+	debug_print("tposeCacheReadIndex(): %s rows=%lu samples=%lu fieldsIndexed=%u\n", indexPath, (unsigned long) index->numRows, (unsigned long) index->numSamples, index->fieldsIndexed);
+
+	inputFile->index = index;
+	free(indexPath);
+	return 0;
+
+}
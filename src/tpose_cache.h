@@ -0,0 +1,87 @@
+/* tpose_cache.h: sidecar cache (group dictionary, row index) interface;
+
+   Copyright 2015 Jonathan Sacramento.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TPOSE_CACHE_H_
+#define _TPOSE_CACHE_H_
+
+	#include <stdint.h>
+
+	#include "system.h"
+	#include "btree.h"
+	#include "tpose_io.h"
+
+
+	/**
+	 ** Implementation defs & limits
+	 **/
+	#define TPOSE_CACHE_GROUPS_MAGIC "TPGROUPS"
+	#define TPOSE_CACHE_GROUPS_VERSION 2
+	#define TPOSE_CACHE_GROUPS_EXT ".tpgroups"
+
+	#define TPOSE_CACHE_INDEX_MAGIC "TPIDX\0\0\0"
+	#define TPOSE_CACHE_INDEX_VERSION 1
+	#define TPOSE_CACHE_INDEX_EXT ".tpidx"
+	#define TPOSE_CACHE_INDEX_SAMPLE 1048576 // Bytes between sampled row offsets
+	#define TPOSE_CACHE_INDEX_MAX_COLUMNS 16
+
+
+	/**
+	 ** TposeCacheFingerprint
+	 ** Identifies an input file on disk (stored for every input file)
+	 **/
+	typedef struct {
+		uint64_t device;
+		uint64_t inode;
+		int64_t size;
+		int64_t mtimeSec;
+		int64_t mtimeNsec;
+	} TposeCacheFingerprint;
+
+	/**
+	 ** TposeCacheIndexHeader
+	 ** Start of a .tpidx file. Followed by numRows records of recordSize bytes
+	 ** (row offset, then the offset of each indexed field within the row),
+	 ** then numSamples row offsets (one every sampleInterval bytes)
+	 **/
+	typedef struct {
+		char magic[8];
+		uint32_t version;
+		uint32_t numColumns;
+		TposeCacheFingerprint fingerprint;
+		uint64_t sampleInterval;
+		uint64_t numSamples;
+		uint64_t numRows;
+		uint64_t recordSize;
+		uint64_t dataOffset; // Length of the header row (offsets are relative to the data)
+		uint32_t columns[TPOSE_CACHE_INDEX_MAX_COLUMNS];
+		unsigned char delimiter;
+		unsigned char padding[7];
+	} TposeCacheIndexHeader;
+
+
+	char* tposeCacheGroupsPath(TposeQuery* tposeQuery);
+	void tposeCacheFingerprint(TposeInputFile* inputFile, TposeCacheFingerprint* fingerprint);
+
+	int tposeCacheReadGroups(TposeQuery* tposeQuery, BTree* btree);
+	int tposeCacheWriteGroups(TposeQuery* tposeQuery);
+
+	char* tposeCacheIndexPath(TposeInputFile* inputFile);
+	int tposeCacheBuildIndex(TposeQuery* tposeQuery, TposeInputFile* inputFile);
+	int tposeCacheReadIndex(TposeQuery* tposeQuery, TposeInputFile* inputFile);
+
+#endif /* TPOSE_CACHE_H */
@@ -0,0 +1,719 @@
+/* tpose_columnar.c -- columnar cache (.tpcol) implementation.
+
+   Copyright 2015 Jonathan Sacramento.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tpose_columnar.h"
+
+
+
+/**
+ ** Returns 1 if addr points at a .tpcol file, 0 otherwise
+ **/
+unsigned int tposeColumnarDetect(
+	const char* addr
+	,off_t size
+) {
+
+	if(size < sizeof(TposeColumnarFileHeader))
+		return 0;
+
+	return !memcmp(addr, TPOSE_COLUMNAR_MAGIC, 8);
+
+}
+
+
+
+/**
+ ** Returns 1 if count items of itemSize bytes at offset fit in a file of fileSize bytes
+ **/
+static unsigned int tposeColumnarFits(
+	uint64_t offset
+	,uint64_t count
+	,uint64_t itemSize
+	,off_t fileSize
+) {
+
+	return offset <= (uint64_t) fileSize && count <= ((uint64_t) fileSize - offset) / itemSize;
+
+}
+
+
+
+/**
+ ** Checks the dictionary and codes of a STRING column lie within the file:
+ ** string offsets must be in order and point past the offsets themselves,
+ ** and every code must index the dictionary
+ ** Returns 0 if OK, -1 otherwise
+ **/
+static int tposeColumnarCheckStrings(
+	TposeInputFile* inputFile
+	,TposeColumnarFileColumn* column
+	,uint64_t numRows
+) {
+
+	uint64_t* dictOffsets;
+	uint32_t* codes;
+	uint64_t ctr;
+
+	if(column->dictCount >= UINT32_MAX || !tposeColumnarFits(column->dictOffset, column->dictCount + 1, sizeof(uint64_t), inputFile->fileSize)
+		|| column->dictOffset % sizeof(uint64_t) || column->dataOffset % sizeof(uint32_t))
+		return -1;
+
+	dictOffsets = (uint64_t*) (inputFile->fileAddr + column->dictOffset);
+	if(dictOffsets[0] < column->dictOffset + (column->dictCount + 1) * sizeof(uint64_t) || dictOffsets[column->dictCount] > (uint64_t) inputFile->fileSize)
+		return -1;
+	for(ctr = 0; ctr < column->dictCount; ctr++) {
+		if(dictOffsets[ctr + 1] < dictOffsets[ctr])
+			return -1;
+	}
+
+	codes = (uint32_t*) (inputFile->fileAddr + column->dataOffset);
+	for(ctr = 0; ctr < numRows; ctr++) {
+		if(codes[ctr] >= column->dictCount)
+			return -1;
+	}
+
+	return 0;
+
+}
+
+
+
+/**
+ ** Sets up a mapped .tpcol file for reading
+ ** Returns 0 if OK, -1 if the file is not a valid columnar cache
+ **/
+int tposeColumnarOpen(
+	TposeInputFile* inputFile
+) {
+
+	TposeColumnar* columnar;
+	TposeColumnarFileHeader* header = (TposeColumnarFileHeader*) inputFile->fileAddr;
+	TposeColumnarFileColumn* column;
+	uint64_t* dictOffsets;
+	unsigned int columnCtr;
+	uint64_t dictCtr;
+
+	if(header->version != TPOSE_COLUMNAR_VERSION || header->numColumns == 0 || header->numColumns > TPOSE_IO_MAX_FIELDS
+		|| sizeof(TposeColumnarFileHeader) + header->numColumns * sizeof(TposeColumnarFileColumn) > inputFile->fileSize
+		|| !tposeColumnarFits(header->headerOffset, header->headerLength, 1, inputFile->fileSize)) {
+		fprintf(stderr, "Error: Unsupported or corrupt columnar file %s\n", inputFile->filePath);
+		return -1;
+	}
+
+	// Every column's data (and dictionary) must lie within the file before anything is read
+	for(columnCtr = 0; columnCtr < header->numColumns; columnCtr++) {
+		column = (TposeColumnarFileColumn*) (inputFile->fileAddr + sizeof(TposeColumnarFileHeader)) + columnCtr;
+		if(column->type == TPOSE_COLUMNAR_STRING
+			? !tposeColumnarFits(column->dataOffset, header->numRows, sizeof(uint32_t), inputFile->fileSize) || tposeColumnarCheckStrings(inputFile, column, header->numRows) == -1
+			: column->type > TPOSE_COLUMNAR_STRING || !tposeColumnarFits(column->dataOffset, header->numRows, sizeof(uint64_t), inputFile->fileSize)) {
+			fprintf(stderr, "Error: Unsupported or corrupt columnar file %s (convert the original file again)\n", inputFile->filePath);
+			return -1;
+		}
+	}
+
+	if((columnar = (TposeColumnar*) calloc(1, sizeof(TposeColumnar))) == NULL
+		|| (columnar->dictHashes = (off_t**) calloc(header->numColumns, sizeof(off_t*))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate columnar memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	columnar->mapAddr = inputFile->fileAddr;
+	columnar->mapSize = inputFile->fileSize;
+	columnar->header = header;
+	columnar->columns = (TposeColumnarFileColumn*) (inputFile->fileAddr + sizeof(TposeColumnarFileHeader));
+
+	for(columnCtr = 0; columnCtr < header->numColumns; columnCtr++) {
+
+		column = &(columnar->columns[columnCtr]);
+		if(column->type != TPOSE_COLUMNAR_STRING)
+			continue;
+
+		// Hash dictionary strings up-front (GROUP values never need hashing per row)
+		if((columnar->dictHashes[columnCtr] = (off_t*) malloc((column->dictCount + 1) * sizeof(off_t))) == NULL) {
+			fprintf(stderr, "Error: Cannot allocate columnar memory\n");
+			exit(EXIT_FAILURE);
+		}
+		dictOffsets = (uint64_t*) (inputFile->fileAddr + column->dictOffset);
+		for(dictCtr = 0; dictCtr < column->dictCount; dictCtr++)
+			columnar->dictHashes[columnCtr][dictCtr] = tposeIOHash(inputFile->fileAddr + dictOffsets[dictCtr], dictOffsets[dictCtr + 1] - dictOffsets[dictCtr]);
+	}
+
+	inputFile->columnar = columnar;
+
+	return 0;
+
+}
+
+
+
+/**
+ ** Frees the columnar state of an input file (the mapping itself
+ ** is unmapped with the input file)
+ **/
+void tposeColumnarClose(
+	TposeInputFile* inputFile
+) {
+
+	TposeColumnar* columnar = inputFile->columnar;
+	unsigned int columnCtr;
+
+	if(columnar == NULL)
+		return;
+
+	for(columnCtr = 0; columnCtr < (columnar->header)->numColumns; columnCtr++)
+		free(columnar->dictHashes[columnCtr]);
+	free(columnar->dictHashes);
+	free(columnar);
+
+	inputFile->columnar = NULL;
+
+}
+
+
+
+/**
+ ** Returns the text of a field (in buffer for numeric columns)
+ ** Returns the length of the text
+ **/
+unsigned int tposeColumnarField(
+	TposeColumnar* columnar
+	,unsigned int column
+	,uint64_t rowNumber
+	,char** fieldPtr
+	,char* buffer
+) {
+
+	TposeColumnarFileColumn* columnInfo = &(columnar->columns[column]);
+	char* dataAddr = columnar->mapAddr + columnInfo->dataOffset;
+	uint64_t* dictOffsets;
+	uint32_t code;
+
+	switch(columnInfo->type) {
+
+		case TPOSE_COLUMNAR_INT64:
+			*fieldPtr = buffer;
+			return sprintf(buffer, "%lld", (long long) ((int64_t*) dataAddr)[rowNumber]);
+
+		case TPOSE_COLUMNAR_FLOAT64:
+			*fieldPtr = buffer;
+			return sprintf(buffer, TPOSE_COLUMNAR_FLOAT_FORMAT, ((double*) dataAddr)[rowNumber]);
+
+		default:
+			code = ((uint32_t*) dataAddr)[rowNumber];
+			dictOffsets = (uint64_t*) (columnar->mapAddr + columnInfo->dictOffset);
+			*fieldPtr = columnar->mapAddr + dictOffsets[code];
+			return dictOffsets[code + 1] - dictOffsets[code];
+	}
+
+}
+
+
+
+/**
+ ** Reads the ID, GROUP and NUMERIC fields of a row of a columnar file
+ ** Rows are addressed as dataAddr + row number
+ ** Returns a pointer to the next row
+ **/
+char* tposeColumnarReadRow(
+	TposeQuery* tposeQuery
+	,TposeInputFile* inputFile
+	,char* rowPtr
+	,char* endPtr
+	,TposeRow* row
+) {
+
+	TposeColumnar* columnar = inputFile->columnar;
+	TposeColumnarFileColumn* column;
+	uint64_t rowNumber = rowPtr - inputFile->dataAddr;
+	char* dataAddr;
+	uint32_t code;
+	unsigned int numericCtr;
+	int numeric;
+
+	tposeIORowReset(tposeQuery, row);
+
+	if(tposeQuery->id != -1) {
+		row->idLength = tposeColumnarField(columnar, tposeQuery->id, rowNumber, &(row->id), row->idBuffer);
+		if(row->idLength == 0)
+			row->id = NULL; // Empty fields are ignored
+	}
+
+	if(tposeQuery->group != -1) {
+		row->groupLength = tposeColumnarField(columnar, tposeQuery->group, rowNumber, &(row->group), row->groupBuffer);
+		column = &(columnar->columns[tposeQuery->group]);
+		if(row->groupLength == 0) {
+			row->group = NULL; // Empty fields are ignored
+		}
+		else if(column->type == TPOSE_COLUMNAR_STRING) {
+			code = ((uint32_t*) (columnar->mapAddr + column->dataOffset))[rowNumber];
+			row->groupHash = columnar->dictHashes[tposeQuery->group][code];
+			row->groupHashed = 1;
+		}
+	}
+
+	for(numericCtr = 0; numericCtr < tposeQuery->numNumerics; numericCtr++) {
+		numeric = tposeQuery->numerics[numericCtr];
+		column = &(columnar->columns[numeric]);
+		dataAddr = columnar->mapAddr + column->dataOffset;
+
+		// Distinct sketches hash the text of values (as for the source file)
+		switch((tposeQuery->aggregateStats & TPOSE_IO_STATS_DISTINCT) ? TPOSE_COLUMNAR_STRING : column->type) {
+
+			case TPOSE_COLUMNAR_INT64:
+				row->numerics[numericCtr] = dataAddr + rowNumber * sizeof(int64_t);
+				row->numericValues[numericCtr] = (double) ((int64_t*) dataAddr)[rowNumber];
+				row->numericsParsed |= 1u << numericCtr;
+				break;
+
+			case TPOSE_COLUMNAR_FLOAT64:
+				row->numerics[numericCtr] = dataAddr + rowNumber * sizeof(double);
+				row->numericValues[numericCtr] = ((double*) dataAddr)[rowNumber];
+				row->numericsParsed |= 1u << numericCtr;
+				break;
+
+			default:
+				row->numericLengths[numericCtr] = tposeColumnarField(columnar, numeric, rowNumber, &(row->numerics[numericCtr]), row->numericBuffers[numericCtr]);
+				if(row->numericLengths[numericCtr] == 0)
+					row->numerics[numericCtr] = NULL; // Empty fields are ignored
+		}
+
+		if(row->numerics[numericCtr] != NULL)
+			row->numNumerics++;
+	}
+
+	return rowPtr + 1;
+
+}
+
+
+
+/**
+ ** "Simple" tranpose of rows-to-columns of a columnar file
+ **/
+void tposeColumnarTransposeSimple(
+	TposeQuery* tposeQuery
+	,TposeInputFile* inputFile
+) {
+
+	TposeColumnar* columnar = inputFile->columnar;
+	TposeColumnarFileHeader* header = columnar->header;
+	unsigned char fieldDelimiter = inputFile->fieldDelimiter;
+	FILE* fd = (tposeQuery->outputFile)->fd;
+	char* headerPtr = columnar->mapAddr + header->headerOffset;
+	char* headerEnd = headerPtr + header->headerLength;
+	char* fieldEnd;
+	char* fieldPtr;
+	char buffer[TPOSE_IO_MAX_NUMERIC_WIDTH];
+	unsigned int fieldLength;
+	unsigned int columnCtr;
+	uint64_t rowCtr;
+
+	for(columnCtr = 0; columnCtr < header->numColumns; columnCtr++) {
+
+		// Field name (from the source header row)
+		for(fieldEnd = headerPtr; fieldEnd < headerEnd && *fieldEnd != header->delimiter; ++fieldEnd);
+		fprintf(fd, "%.*s%c", (int) (fieldEnd - headerPtr), headerPtr, fieldDelimiter);
+		headerPtr = fieldEnd + 1;
+
+		for(rowCtr = 0; rowCtr < header->numRows; rowCtr++) {
+			fieldLength = tposeColumnarField(columnar, columnCtr, rowCtr, &fieldPtr, buffer);
+			fprintf(fd, "%.*s%c", fieldLength, fieldPtr, fieldDelimiter);
+		}
+
+		fprintf(fd, "%c", rowDelimiter); // Output a new line after each iteration
+		fflush(fd);
+	}
+
+}
+
+
+
+/**
+ ** Returns the type a text value can be stored as, given the
+ ** type of the column so far (only if it converts back to the same text)
+ **/
+static unsigned int tposeColumnarValueType(
+	char* field
+	,unsigned int length
+	,unsigned int columnType
+) {
+
+	char text[TPOSE_IO_MAX_NUMERIC_WIDTH];
+	char buffer[TPOSE_IO_MAX_NUMERIC_WIDTH];
+	char* tail;
+
+	if(columnType == TPOSE_COLUMNAR_STRING || length == 0 || length >= TPOSE_IO_MAX_NUMERIC_WIDTH)
+		return TPOSE_COLUMNAR_STRING;
+
+	memcpy(text, field, length);
+	text[length] = '\0';
+
+	if(columnType == TPOSE_COLUMNAR_INT64) {
+		errno = 0;
+		long long intValue = strtoll(text, &tail, 10);
+		if(!errno && *tail == '\0' && sprintf(buffer, "%lld", intValue) == length && !memcmp(buffer, text, length))
+			return TPOSE_COLUMNAR_INT64;
+	}
+
+	double floatValue = strtod(text, &tail);
+	if(*tail == '\0' && isfinite(floatValue) && sprintf(buffer, TPOSE_COLUMNAR_FLOAT_FORMAT, floatValue) == length && !memcmp(buffer, text, length))
+		return TPOSE_COLUMNAR_FLOAT64;
+
+	return TPOSE_COLUMNAR_STRING;
+
+}
+
+
+
+/**
+ ** TposeColumnarDict
+ ** Dictionary of a string column being converted
+ **/
+typedef struct {
+	char* bytes;
+	uint64_t numBytes;
+	uint64_t maxBytes;
+	uint64_t* offsets; // count + 1 offsets into bytes
+	uint64_t count;
+	uint64_t maxCount;
+	uint32_t* slots; // Open-addressing hash table of codes (UINT32_MAX if empty)
+	uint64_t numSlots;
+} TposeColumnarDict;
+
+
+
+/**
+ ** Returns the dictionary code of a string (added if new)
+ **/
+static uint32_t tposeColumnarDictCode(
+	TposeColumnarDict* dict
+	,char* field
+	,unsigned int length
+) {
+
+	uint64_t slot;
+	uint64_t slotCtr;
+	uint32_t code;
+
+	// Keep the hash table at most half full
+	if(dict->count * 2 >= dict->numSlots) {
+		uint64_t newNumSlots = dict->numSlots ? dict->numSlots * 2 : 1024;
+		if((dict->slots = (uint32_t*) realloc(dict->slots, newNumSlots * sizeof(uint32_t))) == NULL) {
+			fprintf(stderr, "Error: Cannot allocate dictionary memory\n");
+			exit(EXIT_FAILURE);
+		}
+		memset(dict->slots, 0xFF, newNumSlots * sizeof(uint32_t));
+		dict->numSlots = newNumSlots;
+		for(code = 0; code < dict->count; code++) {
+			slot = (uint64_t) tposeIOHash(dict->bytes + dict->offsets[code], dict->offsets[code + 1] - dict->offsets[code]) & (dict->numSlots - 1);
+			while(dict->slots[slot] != UINT32_MAX)
+				slot = (slot + 1) & (dict->numSlots - 1);
+			dict->slots[slot] = code;
+		}
+	}
+
+	slot = (uint64_t) tposeIOHash(field, length) & (dict->numSlots - 1);
+	for(slotCtr = 0; dict->slots[slot] != UINT32_MAX; slotCtr++) {
+		code = dict->slots[slot];
+		if(dict->offsets[code + 1] - dict->offsets[code] == length && !memcmp(dict->bytes + dict->offsets[code], field, length))
+			return code;
+		slot = (slot + 1) & (dict->numSlots - 1);
+	}
+
+	// New string
+	if(dict->count + 2 > dict->maxCount) {
+		dict->maxCount = dict->maxCount ? dict->maxCount * 2 : 1024;
+		if((dict->offsets = (uint64_t*) realloc(dict->offsets, dict->maxCount * sizeof(uint64_t))) == NULL) {
+			fprintf(stderr, "Error: Cannot allocate dictionary memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	if(dict->numBytes + length > dict->maxBytes) {
+		while(dict->numBytes + length > dict->maxBytes)
+			dict->maxBytes = dict->maxBytes ? dict->maxBytes * 2 : 65536;
+		if((dict->bytes = (char*) realloc(dict->bytes, dict->maxBytes)) == NULL) {
+			fprintf(stderr, "Error: Cannot allocate dictionary memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if(dict->count == 0)
+		dict->offsets[0] = 0;
+	memcpy(dict->bytes + dict->numBytes, field, length);
+	dict->numBytes += length;
+	code = dict->count++;
+	dict->offsets[dict->count] = dict->numBytes;
+	dict->slots[slot] = code;
+
+	return code;
+
+}
+
+
+
+/**
+ ** Writes bytes to the columnar file, padded to 8 bytes
+ ** Returns the offset they were written at (-1 on error)
+ **/
+static off_t tposeColumnarWrite(
+	FILE* fd
+	,const void* data
+	,uint64_t size
+) {
+
+	static const char padding[8] = {0};
+	off_t offset = ftello(fd);
+
+	if((size && fwrite(data, 1, size, fd) != size) || ((size % 8) && fwrite(padding, 1, 8 - (size % 8), fd) != 8 - (size % 8)))
+		return -1;
+
+	return offset;
+
+}
+
+
+
+/**
+ ** Converts a delimited text file to a columnar cache (<input>.tpcol)
+ ** Every row must have the same number of fields as the header
+ **/
+int tposeColumnarConvert(
+	TposeInputFile* inputFile
+) {
+
+	unsigned char fieldDelimiter = inputFile->fieldDelimiter;
+	char* rowPtr;
+	char* rowEnd;
+	char* fieldPtr;
+	char* fieldEnd;
+	char* endPtr = inputFile->dataAddr + inputFile->dataSize;
+	char* columnarPath;
+	char* tempPath;
+	unsigned int numColumns = 1;
+	unsigned int columnCtr;
+	uint64_t numRows = 0;
+	uint64_t rowCtr;
+	uint64_t rowGroupCtr;
+	unsigned int* types;
+	void** data;
+	TposeColumnarValue* stats;
+	TposeColumnarDict* dicts;
+	TposeColumnarFileHeader header;
+	TposeColumnarFileColumn* columns;
+	FILE* fd;
+	int writeError = 0;
+	off_t offset;
+
+	if(inputFile->columnar != NULL) {
+		fprintf(stderr, "Error: %s is already a columnar file\n", inputFile->filePath);
+		return -1;
+	}
+
+	for(fieldPtr = inputFile->fileAddr; fieldPtr < inputFile->dataAddr; ++fieldPtr) {
+		if(*fieldPtr == fieldDelimiter) ++numColumns;
+	}
+
+	if((types = (unsigned int*) calloc(numColumns, sizeof(unsigned int))) == NULL
+		|| (data = (void**) calloc(numColumns, sizeof(void*))) == NULL
+		|| (dicts = (TposeColumnarDict*) calloc(numColumns, sizeof(TposeColumnarDict))) == NULL
+		|| (columns = (TposeColumnarFileColumn*) calloc(numColumns, sizeof(TposeColumnarFileColumn))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate columnar memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Pass 1: count rows, and find the narrowest type of each column
+	for(rowPtr = inputFile->dataAddr; rowPtr < endPtr; rowPtr = rowEnd + 1) {
+
+		if((rowEnd = memchr(rowPtr, rowDelimiter, endPtr - rowPtr)) == NULL)
+			rowEnd = endPtr;
+
+		for(fieldPtr = rowPtr, columnCtr = 0; ; fieldPtr = fieldEnd + 1, columnCtr++) {
+			if((fieldEnd = memchr(fieldPtr, fieldDelimiter, rowEnd - fieldPtr)) == NULL)
+				fieldEnd = rowEnd;
+			if(columnCtr < numColumns)
+				types[columnCtr] = tposeColumnarValueType(fieldPtr, fieldEnd - fieldPtr, types[columnCtr]);
+			if(fieldEnd == rowEnd)
+				break;
+		}
+
+		if(columnCtr + 1 != numColumns) {
+			fprintf(stderr, "Error: Row %llu has %u fields, expected %u (cannot convert)\n", (unsigned long long) numRows + 1, columnCtr + 1, numColumns);
+			return -1;
+		}
+
+		++numRows;
+	}
+
+	if(numRows > UINT32_MAX) {
+		fprintf(stderr, "Error: Too many rows to convert\n");
+		return -1;
+	}
+
+	for(columnCtr = 0; columnCtr < numColumns; columnCtr++) {
+		if((data[columnCtr] = malloc((numRows ? numRows : 1) * sizeof(uint64_t))) == NULL) {
+			fprintf(stderr, "Error: Cannot allocate columnar memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// Pass 2: encode values
+	for(rowPtr = inputFile->dataAddr, rowCtr = 0; rowPtr < endPtr; rowPtr = rowEnd + 1, rowCtr++) {
+
+		if((rowEnd = memchr(rowPtr, rowDelimiter, endPtr - rowPtr)) == NULL)
+			rowEnd = endPtr;
+
+		for(fieldPtr = rowPtr, columnCtr = 0; columnCtr < numColumns; fieldPtr = fieldEnd + 1, columnCtr++) {
+			if((fieldEnd = memchr(fieldPtr, fieldDelimiter, rowEnd - fieldPtr)) == NULL)
+				fieldEnd = rowEnd;
+
+			if(types[columnCtr] == TPOSE_COLUMNAR_STRING) {
+				((uint32_t*) data[columnCtr])[rowCtr] = tposeColumnarDictCode(&dicts[columnCtr], fieldPtr, fieldEnd - fieldPtr);
+			}
+			else {
+				char text[TPOSE_IO_MAX_NUMERIC_WIDTH];
+				memcpy(text, fieldPtr, fieldEnd - fieldPtr);
+				text[fieldEnd - fieldPtr] = '\0';
+				if(types[columnCtr] == TPOSE_COLUMNAR_INT64)
+					((int64_t*) data[columnCtr])[rowCtr] = strtoll(text, NULL, 10);
+				else
+					((double*) data[columnCtr])[rowCtr] = strtod(text, NULL);
+			}
+		}
+	}
+
+	// Write file (header and column descriptors are rewritten at the end)
+	columnarPath = (char*) malloc(strlen(inputFile->filePath) + strlen(TPOSE_COLUMNAR_EXT) + 1);
+	tempPath = (char*) malloc(strlen(inputFile->filePath) + strlen(TPOSE_COLUMNAR_EXT) + 5);
+	if(columnarPath == NULL || tempPath == NULL) {
+		fprintf(stderr, "Error: Cannot allocate columnar memory\n");
+		exit(EXIT_FAILURE);
+	}
+	sprintf(columnarPath, "%s%s", inputFile->filePath, TPOSE_COLUMNAR_EXT);
+	sprintf(tempPath, "%s.tmp", columnarPath);
+
+	if((fd = fopen(tempPath, "wb")) == NULL) {
+		fprintf(stderr, "Error: Cannot write columnar file %s\n", columnarPath);
+		return -1;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TPOSE_COLUMNAR_MAGIC, sizeof(header.magic));
+	header.version = TPOSE_COLUMNAR_VERSION;
+	header.numColumns = numColumns;
+	header.numRows = numRows;
+	header.rowGroupSize = TPOSE_COLUMNAR_ROW_GROUP;
+	header.numRowGroups = (numRows + TPOSE_COLUMNAR_ROW_GROUP - 1) / TPOSE_COLUMNAR_ROW_GROUP;
+	header.delimiter = fieldDelimiter;
+
+	writeError |= tposeColumnarWrite(fd, &header, sizeof(header)) == -1;
+	writeError |= tposeColumnarWrite(fd, columns, numColumns * sizeof(TposeColumnarFileColumn)) == -1;
+
+	// Source header row (field names)
+	header.headerLength = inputFile->dataAddr - inputFile->fileAddr;
+	if(header.headerLength && *(inputFile->dataAddr - 1) == rowDelimiter)
+		--header.headerLength;
+	writeError |= (offset = tposeColumnarWrite(fd, inputFile->fileAddr, header.headerLength)) == -1;
+	header.headerOffset = offset;
+
+	if((stats = (TposeColumnarValue*) malloc((header.numRowGroups * 2 + 1) * sizeof(TposeColumnarValue))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate columnar memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for(columnCtr = 0; columnCtr < numColumns; columnCtr++) {
+
+		unsigned int valueSize = (types[columnCtr] == TPOSE_COLUMNAR_STRING) ? sizeof(uint32_t) : sizeof(uint64_t);
+		columns[columnCtr].type = types[columnCtr];
+
+		writeError |= (offset = tposeColumnarWrite(fd, data[columnCtr], numRows * valueSize)) == -1;
+		columns[columnCtr].dataOffset = offset;
+
+		// Min/max of each row group
+		for(rowGroupCtr = 0; rowGroupCtr < header.numRowGroups; rowGroupCtr++) {
+
+			TposeColumnarValue* minValue = &stats[rowGroupCtr * 2];
+			TposeColumnarValue* maxValue = &stats[rowGroupCtr * 2 + 1];
+			uint64_t lastRow = (rowGroupCtr + 1) * TPOSE_COLUMNAR_ROW_GROUP;
+			if(lastRow > numRows) lastRow = numRows;
+
+			for(rowCtr = rowGroupCtr * TPOSE_COLUMNAR_ROW_GROUP; rowCtr < lastRow; rowCtr++) {
+				int first = (rowCtr == rowGroupCtr * TPOSE_COLUMNAR_ROW_GROUP);
+				if(types[columnCtr] == TPOSE_COLUMNAR_FLOAT64) {
+					double value = ((double*) data[columnCtr])[rowCtr];
+					if(first || value < minValue->f) minValue->f = value;
+					if(first || value > maxValue->f) maxValue->f = value;
+				}
+				else {
+					int64_t value = (types[columnCtr] == TPOSE_COLUMNAR_INT64) ? ((int64_t*) data[columnCtr])[rowCtr] : ((uint32_t*) data[columnCtr])[rowCtr];
+					if(first || value < minValue->i) minValue->i = value;
+					if(first || value > maxValue->i) maxValue->i = value;
+				}
+			}
+		}
+		writeError |= (offset = tposeColumnarWrite(fd, stats, header.numRowGroups * 2 * sizeof(TposeColumnarValue))) == -1;
+		columns[columnCtr].statsOffset = offset;
+
+		// Dictionary (string offsets are rebased to the start of the file)
+		if(types[columnCtr] == TPOSE_COLUMNAR_STRING) {
+			TposeColumnarDict* dict = &dicts[columnCtr];
+			uint64_t dictCtr;
+			off_t bytesOffset = ftello(fd) + (dict->count + 1) * sizeof(uint64_t);
+			if(dict->count == 0) {
+				if((dict->offsets = (uint64_t*) calloc(1, sizeof(uint64_t))) == NULL) {
+					fprintf(stderr, "Error: Cannot allocate dictionary memory\n");
+					exit(EXIT_FAILURE);
+				}
+			}
+			for(dictCtr = 0; dictCtr <= dict->count; dictCtr++)
+				dict->offsets[dictCtr] += bytesOffset;
+			writeError |= (offset = tposeColumnarWrite(fd, dict->offsets, (dict->count + 1) * sizeof(uint64_t))) == -1;
+			writeError |= tposeColumnarWrite(fd, dict->bytes, dict->numBytes) == -1;
+			columns[columnCtr].dictOffset = offset;
+			columns[columnCtr].dictCount = dict->count;
+		}
+	}
+
+	writeError |= fseeko(fd, 0, SEEK_SET) != 0;
+	writeError |= tposeColumnarWrite(fd, &header, sizeof(header)) == -1;
+	writeError |= tposeColumnarWrite(fd, columns, numColumns * sizeof(TposeColumnarFileColumn)) == -1;
+	writeError |= fclose(fd) != 0;
+
+	if(writeError || rename(tempPath, columnarPath) == -1) {
+		fprintf(stderr, "Error: Cannot write columnar file %s\n", columnarPath);
+		remove(tempPath);
+		writeError = 1;
+	}
+
+	// Clean-up
+	for(columnCtr = 0; columnCtr < numColumns; columnCtr++) {
+		free(data[columnCtr]);
+		free(dicts[columnCtr].bytes);
+		free(dicts[columnCtr].offsets);
+		free(dicts[columnCtr].slots);
+	}
+	free(types);
+	free(data);
+	free(dicts);
+	free(columns);
+	free(stats);
+	free(columnarPath);
+	free(tempPath);
+
+	return writeError ? -1 : 0;
+
+}
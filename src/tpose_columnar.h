@@ -0,0 +1,104 @@
+/* tpose_columnar.h: columnar cache (.tpcol) interface;
+
+   Copyright 2015 Jonathan Sacramento.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TPOSE_COLUMNAR_H_
+#define _TPOSE_COLUMNAR_H_
+
+	#include <stdint.h>
+	#include <math.h>
+
+	#include "system.h"
+	#include "tpose_io.h"
+
+
+	/**
+	 ** Implementation defs & limits
+	 **/
+	#define TPOSE_COLUMNAR_MAGIC "TPCOL\0\0\0"
+	#define TPOSE_COLUMNAR_VERSION 1
+	#define TPOSE_COLUMNAR_EXT ".tpcol"
+	#define TPOSE_COLUMNAR_ROW_GROUP 65536 // Rows per row group (min/max stats are kept per row group)
+
+	#define TPOSE_COLUMNAR_INT64 0
+	#define TPOSE_COLUMNAR_FLOAT64 1
+	#define TPOSE_COLUMNAR_STRING 2 // Dictionary-encoded (uint32_t codes)
+
+	#define TPOSE_COLUMNAR_FLOAT_FORMAT "%.15g" // Text of float64 values (only used if every value round-trips)
+
+
+	/**
+	 ** TposeColumnarValue
+	 **/
+	typedef union {
+		int64_t i;
+		double f;
+	} TposeColumnarValue;
+
+	/**
+	 ** TposeColumnarFileHeader
+	 ** Start of a .tpcol file. Offsets are from the start of the file
+	 **/
+	typedef struct {
+		char magic[8];
+		uint32_t version;
+		uint32_t numColumns;
+		uint64_t numRows;
+		uint64_t rowGroupSize;
+		uint64_t numRowGroups;
+		uint64_t headerOffset; // Header row of the source file (field names)
+		uint64_t headerLength;
+		unsigned char delimiter;
+		unsigned char padding[7];
+	} TposeColumnarFileHeader;
+
+	/**
+	 ** TposeColumnarFileColumn
+	 ** Column descriptors follow the file header (one per column)
+	 **/
+	typedef struct {
+		uint32_t type;
+		uint32_t padding;
+		uint64_t dataOffset; // numRows values (int64_t, double, or uint32_t dictionary codes)
+		uint64_t statsOffset; // numRowGroups min/max pairs (TposeColumnarValue; codes for strings)
+		uint64_t dictOffset; // dictCount + 1 string offsets (uint64_t), followed by the string bytes
+		uint64_t dictCount;
+	} TposeColumnarFileColumn;
+
+	/**
+	 ** TposeColumnar
+	 ** A mapped .tpcol file
+	 **/
+	typedef struct TposeColumnar {
+		char* mapAddr;
+		off_t mapSize;
+		TposeColumnarFileHeader* header;
+		TposeColumnarFileColumn* columns;
+		off_t** dictHashes; // Hash of each dictionary string (string columns only)
+	} TposeColumnar;
+
+
+	unsigned int tposeColumnarDetect(const char* addr, off_t size);
+	int tposeColumnarOpen(TposeInputFile* inputFile);
+	void tposeColumnarClose(TposeInputFile* inputFile);
+	int tposeColumnarConvert(TposeInputFile* inputFile);
+
+	char* tposeColumnarReadRow(TposeQuery* tposeQuery, TposeInputFile* inputFile, char* rowPtr, char* endPtr, TposeRow* row);
+	unsigned int tposeColumnarField(TposeColumnar* columnar, unsigned int column, uint64_t rowNumber, char** fieldPtr, char* buffer);
+	void tposeColumnarTransposeSimple(TposeQuery* tposeQuery, TposeInputFile* inputFile);
+
+#endif /* TPOSE_COLUMNAR_H */
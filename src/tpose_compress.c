@@ -0,0 +1,734 @@
+/* tpose_compress.c -- compressed input implementation.
+
+   Copyright 2015 Jonathan Sacramento.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tpose_compress.h"
+
+#ifdef TPOSE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef TPOSE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef TPOSE_LZ4
+#include <lz4frame.h>
+#endif
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+
+
+/**
+ ** Returns the compression format of an input file (checks magic number)
+ **/
+unsigned int tposeCompressDetect(
+	const char* addr
+	,off_t size
+) {
+
+	const unsigned char* magic = (const unsigned char*) addr;
+
+	if(size >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+		return TPOSE_COMPRESS_GZIP;
+
+	if(size >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+		return TPOSE_COMPRESS_ZSTD;
+
+	if(size >= 4 && magic[0] == 0x04 && magic[1] == 0x22 && magic[2] == 0x4d && magic[3] == 0x18)
+		return TPOSE_COMPRESS_LZ4;
+
+	return TPOSE_COMPRESS_NONE;
+
+}
+
+
+
+/**
+ ** Returns the name of a compression format (for messages)
+ **/
+const char* tposeCompressName(
+	unsigned int format
+) {
+
+	switch(format) {
+		case TPOSE_COMPRESS_GZIP:
+			return "gzip";
+		case TPOSE_COMPRESS_ZSTD:
+			return "zstd";
+		case TPOSE_COMPRESS_LZ4:
+			return "lz4";
+		default:
+			return "uncompressed";
+	}
+
+}
+
+
+
+/**
+ ** Decompresses a mapped input file into an anonymous memory map
+ ** Returns the address of the decompressed data, or NULL if error
+ ** (dstSize is set to the data size, mapSize to the size to munmap)
+ **/
+char* tposeCompressInflate(
+	unsigned int format
+	,const char* srcAddr
+	,off_t srcSize
+	,off_t* dstSize
+	,off_t* mapSize
+) {
+
+	TposeCompressBuffer buffer;
+	TposeCompressBlock* blocks = NULL;
+	unsigned int numBlocks = 0;
+	int status = -1;
+
+	buffer.addr = NULL;
+	buffer.size = 0;
+	buffer.capacity = 0;
+
+	// Blocks with known sizes (bgzf, multi-frame zstd) are decompressed in parallel
+	// (only if the codec is built in, otherwise the stream path reports it is not supported)
+#ifdef TPOSE_ZLIB
+	if(format == TPOSE_COMPRESS_GZIP && tposeCompressIndexBgzf(srcAddr, srcSize, &blocks, &numBlocks) == 0 && numBlocks > 1)
+		status = tposeCompressInflateParallel(format, blocks, numBlocks, &buffer);
+#endif
+#ifdef TPOSE_ZSTD
+	if(format == TPOSE_COMPRESS_ZSTD && tposeCompressIndexZstd(srcAddr, srcSize, &blocks, &numBlocks) == 0 && numBlocks > 1)
+		status = tposeCompressInflateParallel(format, blocks, numBlocks, &buffer);
+#endif
+	if(numBlocks <= 1) {
+		switch(format) {
+			case TPOSE_COMPRESS_GZIP:
+				status = tposeCompressInflateGzip(srcAddr, srcSize, &buffer);
+				break;
+			case TPOSE_COMPRESS_ZSTD:
+				status = tposeCompressInflateZstd(srcAddr, srcSize, &buffer);
+				break;
+			case TPOSE_COMPRESS_LZ4:
+				status = tposeCompressInflateLz4(srcAddr, srcSize, &buffer);
+				break;
+		}
+	}
+
+	free(blocks);
+
+	if(status == -1) {
+		tposeCompressBufferFree(&buffer);
+		return NULL;
+	}
+
+	// Decoders may use unwritten output as scratch space, so re-zero what follows the data
+	memset(buffer.addr + buffer.size, 0, (buffer.capacity - buffer.size < TPOSE_COMPRESS_SLACK) ? buffer.capacity - buffer.size : TPOSE_COMPRESS_SLACK);
+
+	debug_print("tposeCompressInflate(): %s input = %ld bytes, output = %ld bytes\n", tposeCompressName(format), (long) srcSize, (long) buffer.size);
+
+	*dstSize = buffer.size;
+	*mapSize = buffer.capacity + TPOSE_COMPRESS_SLACK;
+
+	return buffer.addr;
+
+}
+
+
+
+/**
+ ** Maps an anonymous (zeroed) output buffer
+ ** Returns 0 if OK, -1 if error
+ **/
+int tposeCompressBufferAlloc(
+	TposeCompressBuffer* buffer
+	,off_t capacity
+) {
+
+	if((buffer->addr = mmap(0, capacity + TPOSE_COMPRESS_SLACK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+		fprintf(stderr, "Error: Cannot allocate decompression memory\n");
+		buffer->addr = NULL;
+		return -1;
+	}
+
+	buffer->size = 0;
+	buffer->capacity = capacity;
+
+	return 0;
+
+}
+
+
+
+/**
+ ** Grows an output buffer (at least doubling it) preserving its contents
+ ** Returns 0 if OK, -1 if error
+ **/
+int tposeCompressBufferGrow(
+	TposeCompressBuffer* buffer
+	,off_t minCapacity
+) {
+
+	char* addr;
+	off_t capacity = buffer->capacity * 2;
+
+	if(capacity < minCapacity)
+		capacity = minCapacity;
+
+#ifdef MREMAP_MAYMOVE
+	if((addr = mremap(buffer->addr, buffer->capacity + TPOSE_COMPRESS_SLACK, capacity + TPOSE_COMPRESS_SLACK, MREMAP_MAYMOVE)) == MAP_FAILED) {
+		fprintf(stderr, "Error: Cannot allocate decompression memory\n");
+		return -1;
+	}
+#else
+	if((addr = mmap(0, capacity + TPOSE_COMPRESS_SLACK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+		fprintf(stderr, "Error: Cannot allocate decompression memory\n");
+		return -1;
+	}
+	memcpy(addr, buffer->addr, buffer->size);
+	munmap(buffer->addr, buffer->capacity + TPOSE_COMPRESS_SLACK);
+#endif
+
+	buffer->addr = addr;
+	buffer->capacity = capacity;
+
+	return 0;
+
+}
+
+
+
+/**
+ ** Unmaps an output buffer
+ **/
+void tposeCompressBufferFree(
+	TposeCompressBuffer* buffer
+) {
+
+	if(buffer->addr != NULL) {
+		munmap(buffer->addr, buffer->capacity + TPOSE_COMPRESS_SLACK);
+		buffer->addr = NULL;
+	}
+
+	assert(buffer->addr == NULL);
+
+}
+
+
+
+/**
+ ** Splits a bgzf file (gzip members carrying their size in a 'BC' extra field)
+ ** into blocks. Returns 0 if every member is a bgzf block, -1 otherwise
+ **/
+int tposeCompressIndexBgzf(
+	const char* srcAddr
+	,off_t srcSize
+	,TposeCompressBlock** blocksPtr
+	,unsigned int* numBlocks
+) {
+
+	const unsigned char* member;
+	TposeCompressBlock* blocks = NULL;
+	unsigned int maxBlocks = 0;
+	unsigned int blockCtr = 0;
+	unsigned int extraLength, subfieldLength, memberSize, pos;
+	off_t offset = 0;
+
+	while(offset < srcSize) {
+
+		member = (const unsigned char*) srcAddr + offset;
+
+		// Header (18 bytes) must have FEXTRA set
+		if(srcSize - offset < 18 || member[0] != 0x1f || member[1] != 0x8b || member[2] != 8 || !(member[3] & 4))
+			goto notBgzf;
+
+		// Find 'BC' subfield holding the member size (extra field and subfields must fit)
+		memberSize = 0;
+		extraLength = member[10] | (member[11] << 8);
+		if(12 + extraLength > srcSize - offset)
+			goto notBgzf;
+		for(pos = 12; pos + 4 <= 12 + extraLength; pos += 4 + subfieldLength) {
+			subfieldLength = member[pos+2] | (member[pos+3] << 8);
+			if(pos + 4 + subfieldLength > 12 + extraLength)
+				goto notBgzf;
+			if(member[pos] == 'B' && member[pos+1] == 'C' && subfieldLength == 2) {
+				memberSize = (member[pos+4] | (member[pos+5] << 8)) + 1;
+				break;
+			}
+		}
+
+		// Member holds its header, extra field and 8-byte trailer
+		if(memberSize < 12 + extraLength + 8 || memberSize > srcSize - offset)
+			goto notBgzf;
+
+		if(blockCtr == maxBlocks) {
+			maxBlocks = maxBlocks ? maxBlocks * 2 : 1024;
+			if((blocks = (TposeCompressBlock*) realloc(blocks, maxBlocks * sizeof(TposeCompressBlock))) == NULL) {
+				fprintf(stderr, "Error: Cannot allocate decompression memory\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+
+		// ISIZE (uncompressed size) is stored in the last 4 bytes of the member
+		member += memberSize - 4;
+		blocks[blockCtr].src = srcAddr + offset;
+		blocks[blockCtr].srcSize = memberSize;
+		blocks[blockCtr].dst = NULL;
+		blocks[blockCtr].dstSize = (off_t) member[0] | ((off_t) member[1] << 8) | ((off_t) member[2] << 16) | ((off_t) member[3] << 24);
+		++blockCtr;
+
+		offset += memberSize;
+	}
+
+	*blocksPtr = blocks;
+	*numBlocks = blockCtr;
+
+	return 0;
+
+notBgzf:
+	free(blocks);
+	*blocksPtr = NULL;
+	*numBlocks = 0;
+
+	return -1;
+
+}
+
+
+
+/**
+ ** Splits a zstd file into frames
+ ** Returns 0 if the content size of every frame is known, -1 otherwise
+ **/
+int tposeCompressIndexZstd(
+	const char* srcAddr
+	,off_t srcSize
+	,TposeCompressBlock** blocksPtr
+	,unsigned int* numBlocks
+) {
+
+#ifdef TPOSE_ZSTD
+	TposeCompressBlock* blocks = NULL;
+	unsigned int maxBlocks = 0;
+	unsigned int blockCtr = 0;
+	unsigned long long contentSize;
+	size_t frameSize;
+	off_t offset = 0;
+
+	while(offset < srcSize) {
+
+		frameSize = ZSTD_findFrameCompressedSize(srcAddr + offset, srcSize - offset);
+		if(ZSTD_isError(frameSize))
+			goto unknownSize;
+
+		contentSize = ZSTD_getFrameContentSize(srcAddr + offset, frameSize);
+		if(contentSize == ZSTD_CONTENTSIZE_UNKNOWN || contentSize == ZSTD_CONTENTSIZE_ERROR)
+			goto unknownSize;
+
+		if(blockCtr == maxBlocks) {
+			maxBlocks = maxBlocks ? maxBlocks * 2 : 1024;
+			if((blocks = (TposeCompressBlock*) realloc(blocks, maxBlocks * sizeof(TposeCompressBlock))) == NULL) {
+				fprintf(stderr, "Error: Cannot allocate decompression memory\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+
+		blocks[blockCtr].src = srcAddr + offset;
+		blocks[blockCtr].srcSize = frameSize;
+		blocks[blockCtr].dst = NULL;
+		blocks[blockCtr].dstSize = contentSize;
+		++blockCtr;
+
+		offset += frameSize;
+	}
+
+	*blocksPtr = blocks;
+	*numBlocks = blockCtr;
+
+	return 0;
+
+unknownSize:
+	free(blocks);
+#endif
+
+	*blocksPtr = NULL;
+	*numBlocks = 0;
+
+	return -1;
+
+}
+
+
+
+/**
+ ** Decompresses independent blocks in parallel
+ ** Coordinator for multi-threaded version
+ **/
+int tposeCompressInflateParallel(
+	unsigned int format
+	,TposeCompressBlock* blocks
+	,unsigned int numBlocks
+	,TposeCompressBuffer* buffer
+) {
+
+	TposeCompressThread threadArgs[TPOSE_COMPRESS_MAX_THREADS];
+	pthread_t threads[TPOSE_COMPRESS_MAX_THREADS];
+	unsigned int numThreads;
+	unsigned int threadCtr, blockCtr;
+	off_t totalSize = 0;
+	long cpus;
+	int status = 0;
+
+	// Each block is written at its final offset in the output
+	for(blockCtr = 0; blockCtr < numBlocks; blockCtr++)
+		totalSize += blocks[blockCtr].dstSize;
+
+	if(tposeCompressBufferAlloc(buffer, totalSize > 0 ? totalSize : 1) == -1)
+		return -1;
+
+	totalSize = 0;
+	for(blockCtr = 0; blockCtr < numBlocks; blockCtr++) {
+		blocks[blockCtr].dst = buffer->addr + totalSize;
+		totalSize += blocks[blockCtr].dstSize;
+	}
+	buffer->size = totalSize;
+
+	// One thread per online CPU
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	numThreads = (cpus < 1) ? 1 : (unsigned int) cpus;
+	if(numThreads > TPOSE_COMPRESS_MAX_THREADS) numThreads = TPOSE_COMPRESS_MAX_THREADS;
+	if(numThreads > numBlocks) numThreads = numBlocks;
+
+	// Assign contiguous runs of blocks to each thread
+	for(threadCtr = 0; threadCtr < numThreads; threadCtr++) {
+		threadArgs[threadCtr].format = format;
+		threadArgs[threadCtr].blocks = blocks;
+		threadArgs[threadCtr].firstBlock = (unsigned int) (((unsigned long long) numBlocks * threadCtr) / numThreads);
+		threadArgs[threadCtr].lastBlock = (unsigned int) (((unsigned long long) numBlocks * (threadCtr + 1)) / numThreads);
+		threadArgs[threadCtr].status = 0;
+
+		if(pthread_create(&threads[threadCtr], NULL, tposeCompressInflateMap, (void *) &threadArgs[threadCtr])) {
+			fprintf(stderr, "Error: Cannot create decompression thread\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// Sync threads
+	for(threadCtr = 0; threadCtr < numThreads; threadCtr++) {
+		(void) pthread_join(threads[threadCtr], NULL);
+		if(threadArgs[threadCtr].status == -1)
+			status = -1;
+	}
+
+	if(status == -1)
+		fprintf(stderr, "Error: Corrupt %s input\n", tposeCompressName(format));
+
+	return status;
+
+}
+
+
+
+/**
+ ** Decompresses a run of blocks
+ ** Maps blocks to each thread
+ **/
+void* tposeCompressInflateMap(
+	void* threadArg
+) {
+
+	TposeCompressThread* thread = (TposeCompressThread*) threadArg;
+	TposeCompressBlock* block;
+	unsigned int blockCtr;
+
+#ifdef TPOSE_ZLIB
+	z_stream stream;
+	int streamInit = 0;
+#endif
+#ifdef TPOSE_ZSTD
+	ZSTD_DCtx* dctx = NULL;
+	size_t result;
+#endif
+
+	for(blockCtr = thread->firstBlock; blockCtr < thread->lastBlock; blockCtr++) {
+
+		block = &thread->blocks[blockCtr];
+		if(block->dstSize == 0)
+			continue; // e.g. bgzf EOF marker, zstd skippable frames
+
+#ifdef TPOSE_ZLIB
+		if(thread->format == TPOSE_COMPRESS_GZIP) {
+
+			if(!streamInit) {
+				memset(&stream, 0, sizeof(z_stream));
+				if(inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+					thread->status = -1;
+					break;
+				}
+				streamInit = 1;
+			}
+			else
+				inflateReset(&stream);
+
+			stream.next_in = (Bytef*) block->src;
+			stream.avail_in = (uInt) block->srcSize;
+			stream.next_out = (Bytef*) block->dst;
+			stream.avail_out = (uInt) block->dstSize;
+
+			if(inflate(&stream, Z_FINISH) != Z_STREAM_END || stream.total_out != block->dstSize) {
+				thread->status = -1;
+				break;
+			}
+		}
+#endif
+
+#ifdef TPOSE_ZSTD
+		if(thread->format == TPOSE_COMPRESS_ZSTD) {
+
+			if(dctx == NULL && (dctx = ZSTD_createDCtx()) == NULL) {
+				thread->status = -1;
+				break;
+			}
+
+			result = ZSTD_decompressDCtx(dctx, block->dst, block->dstSize, block->src, block->srcSize);
+			if(ZSTD_isError(result) || result != block->dstSize) {
+				thread->status = -1;
+				break;
+			}
+		}
+#endif
+
+	}
+
+	// Clean-up
+#ifdef TPOSE_ZLIB
+	if(streamInit)
+		inflateEnd(&stream);
+#endif
+#ifdef TPOSE_ZSTD
+	if(dctx != NULL)
+		ZSTD_freeDCtx(dctx);
+#endif
+
+	return NULL;
+
+}
+
+
+
+/**
+ ** Stream-decompresses gzip input (any number of members)
+ ** Returns 0 if OK, -1 if error
+ **/
+int tposeCompressInflateGzip(
+	const char* srcAddr
+	,off_t srcSize
+	,TposeCompressBuffer* buffer
+) {
+
+#ifdef TPOSE_ZLIB
+	z_stream stream;
+	uInt chunkIn, chunkOut;
+	int result = Z_OK;
+
+	if(tposeCompressBufferAlloc(buffer, (srcSize * 4 > TPOSE_COMPRESS_MIN_CAPACITY) ? srcSize * 4 : TPOSE_COMPRESS_MIN_CAPACITY) == -1)
+		return -1;
+
+	memset(&stream, 0, sizeof(z_stream));
+	if(inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+		fprintf(stderr, "Error: Cannot initialise gzip decompression\n");
+		return -1;
+	}
+
+	for(;;) {
+
+		// zlib counts are 32-bit, so feed large inputs in pieces
+		if(stream.avail_in == 0 && srcSize > 0) {
+			chunkIn = (srcSize > 1073741824) ? 1073741824 : (uInt) srcSize;
+			stream.next_in = (Bytef*) srcAddr;
+			stream.avail_in = chunkIn;
+			srcAddr += chunkIn;
+			srcSize -= chunkIn;
+		}
+
+		if(buffer->size == buffer->capacity && tposeCompressBufferGrow(buffer, 0) == -1)
+			break;
+
+		stream.next_out = (Bytef*) (buffer->addr + buffer->size);
+		stream.avail_out = (buffer->capacity - buffer->size > 1073741824) ? 1073741824 : (uInt) (buffer->capacity - buffer->size);
+		chunkOut = stream.avail_out;
+
+		result = inflate(&stream, Z_NO_FLUSH);
+		chunkOut -= stream.avail_out;
+		buffer->size += chunkOut;
+
+		if(result == Z_STREAM_END) {
+			// Concatenated members
+			if(stream.avail_in == 0 && srcSize == 0)
+				break;
+			inflateReset(&stream);
+			continue;
+		}
+
+		if(result != Z_OK && result != Z_BUF_ERROR)
+			break;
+
+		// Input exhausted mid-member (truncated)
+		if(chunkOut == 0 && stream.avail_in == 0 && srcSize == 0)
+			break;
+	}
+
+	inflateEnd(&stream);
+
+	if(result != Z_STREAM_END) {
+		fprintf(stderr, "Error: Corrupt or truncated gzip input\n");
+		return -1;
+	}
+
+	return 0;
+#else
+	fprintf(stderr, "Error: gzip input is not supported by this build of tpose (see Makefile)\n");
+	return -1;
+#endif
+
+}
+
+
+
+/**
+ ** Stream-decompresses zstd input (any number of frames)
+ ** Returns 0 if OK, -1 if error
+ **/
+int tposeCompressInflateZstd(
+	const char* srcAddr
+	,off_t srcSize
+	,TposeCompressBuffer* buffer
+) {
+
+#ifdef TPOSE_ZSTD
+	ZSTD_DStream* dstream;
+	ZSTD_inBuffer input;
+	ZSTD_outBuffer output;
+	size_t result = 0;
+
+	if(tposeCompressBufferAlloc(buffer, (srcSize * 4 > TPOSE_COMPRESS_MIN_CAPACITY) ? srcSize * 4 : TPOSE_COMPRESS_MIN_CAPACITY) == -1)
+		return -1;
+
+	if((dstream = ZSTD_createDStream()) == NULL) {
+		fprintf(stderr, "Error: Cannot initialise zstd decompression\n");
+		return -1;
+	}
+
+	input.src = srcAddr;
+	input.size = srcSize;
+	input.pos = 0;
+
+	do {
+
+		if(buffer->size == buffer->capacity && tposeCompressBufferGrow(buffer, 0) == -1) {
+			ZSTD_freeDStream(dstream);
+			return -1;
+		}
+
+		output.dst = buffer->addr + buffer->size;
+		output.size = buffer->capacity - buffer->size;
+		output.pos = 0;
+
+		result = ZSTD_decompressStream(dstream, &output, &input);
+		buffer->size += output.pos;
+
+		if(ZSTD_isError(result))
+			break;
+
+	} while(input.pos < input.size || (result != 0 && output.pos > 0)); // Flush buffered output
+
+	ZSTD_freeDStream(dstream);
+
+	// A non-zero hint at the end of input means the last frame is incomplete
+	if(ZSTD_isError(result) || result != 0) {
+		fprintf(stderr, "Error: Corrupt or truncated zstd input\n");
+		return -1;
+	}
+
+	return 0;
+#else
+	fprintf(stderr, "Error: zstd input is not supported by this build of tpose (see Makefile)\n");
+	return -1;
+#endif
+
+}
+
+
+
+/**
+ ** Stream-decompresses lz4 (frame format) input
+ ** Returns 0 if OK, -1 if error
+ **/
+int tposeCompressInflateLz4(
+	const char* srcAddr
+	,off_t srcSize
+	,TposeCompressBuffer* buffer
+) {
+
+#ifdef TPOSE_LZ4
+	LZ4F_dctx* dctx;
+	size_t result = 0;
+	size_t srcChunk, dstChunk;
+
+	if(tposeCompressBufferAlloc(buffer, (srcSize * 4 > TPOSE_COMPRESS_MIN_CAPACITY) ? srcSize * 4 : TPOSE_COMPRESS_MIN_CAPACITY) == -1)
+		return -1;
+
+	if(LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION))) {
+		fprintf(stderr, "Error: Cannot initialise lz4 decompression\n");
+		return -1;
+	}
+
+	do {
+
+		if(buffer->size == buffer->capacity && tposeCompressBufferGrow(buffer, 0) == -1) {
+			LZ4F_freeDecompressionContext(dctx);
+			return -1;
+		}
+
+		srcChunk = srcSize;
+		dstChunk = buffer->capacity - buffer->size;
+
+		result = LZ4F_decompress(dctx, buffer->addr + buffer->size, &dstChunk, srcAddr, &srcChunk, NULL);
+		if(LZ4F_isError(result))
+			break;
+
+		buffer->size += dstChunk;
+		srcAddr += srcChunk;
+		srcSize -= srcChunk;
+
+	} while(srcSize > 0 || (result != 0 && dstChunk > 0)); // Flush buffered output
+
+	LZ4F_freeDecompressionContext(dctx);
+
+	// A non-zero hint at the end of input means the last frame is incomplete
+	if(LZ4F_isError(result) || result != 0) {
+		fprintf(stderr, "Error: Corrupt or truncated lz4 input\n");
+		return -1;
+	}
+
+	return 0;
+#else
+	fprintf(stderr, "Error: lz4 input is not supported by this build of tpose (see Makefile)\n");
+	return -1;
+#endif
+
+}
@@ -0,0 +1,90 @@
+/* tpose_compress.h: compressed input interface;
+
+   Copyright 2015 Jonathan Sacramento.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TPOSE_COMPRESS_H_
+#define _TPOSE_COMPRESS_H_
+
+	#include <sys/types.h>
+	#include <sys/mman.h>
+
+	#include "system.h"
+
+
+	/**
+	 ** Implementation defs & limits
+	 **/
+	#define TPOSE_COMPRESS_NONE 0
+	#define TPOSE_COMPRESS_GZIP 1
+	#define TPOSE_COMPRESS_ZSTD 2
+	#define TPOSE_COMPRESS_LZ4 3
+
+	#define TPOSE_COMPRESS_MAX_THREADS 64
+	#define TPOSE_COMPRESS_MIN_CAPACITY 1048576 // Initial size of streamed output buffers
+	#define TPOSE_COMPRESS_SLACK 1048576 // Zeroed bytes kept after the data (scanners read past the end, as with page-padded mmaps)
+
+
+	/**
+	 ** TposeCompressBuffer
+	 **/
+	typedef struct {
+		char* addr;
+		off_t size; // Number of decompressed bytes written
+		off_t capacity; // Number of bytes mapped (excluding slack)
+	} TposeCompressBuffer;
+
+	/**
+	 ** TposeCompressBlock
+	 ** Independently decompressible unit (bgzf block, zstd frame)
+	 **/
+	typedef struct {
+		const char* src;
+		off_t srcSize;
+		char* dst;
+		off_t dstSize;
+	} TposeCompressBlock;
+
+	/**
+	 ** TposeCompressThread
+	 **/
+	typedef struct {
+		unsigned int format;
+		TposeCompressBlock* blocks;
+		unsigned int firstBlock;
+		unsigned int lastBlock; // Exclusive
+		int status; // 0 if OK, -1 if error
+	} TposeCompressThread;
+
+
+	unsigned int tposeCompressDetect(const char* addr, off_t size);
+	const char* tposeCompressName(unsigned int format);
+	char* tposeCompressInflate(unsigned int format, const char* srcAddr, off_t srcSize, off_t* dstSize, off_t* mapSize);
+
+	int tposeCompressBufferAlloc(TposeCompressBuffer* buffer, off_t capacity);
+	int tposeCompressBufferGrow(TposeCompressBuffer* buffer, off_t minCapacity);
+	void tposeCompressBufferFree(TposeCompressBuffer* buffer);
+
+	int tposeCompressIndexBgzf(const char* srcAddr, off_t srcSize, TposeCompressBlock** blocksPtr, unsigned int* numBlocks);
+	int tposeCompressIndexZstd(const char* srcAddr, off_t srcSize, TposeCompressBlock** blocksPtr, unsigned int* numBlocks);
+	int tposeCompressInflateParallel(unsigned int format, TposeCompressBlock* blocks, unsigned int numBlocks, TposeCompressBuffer* buffer);
+	void* tposeCompressInflateMap(void* threadArg);
+
+	int tposeCompressInflateGzip(const char* srcAddr, off_t srcSize, TposeCompressBuffer* buffer);
+	int tposeCompressInflateZstd(const char* srcAddr, off_t srcSize, TposeCompressBuffer* buffer);
+	int tposeCompressInflateLz4(const char* srcAddr, off_t srcSize, TposeCompressBuffer* buffer);
+
+#endif /* TPOSE_COMPRESS_H */
@@ -0,0 +1,209 @@
+/* tpose_exact.c -- exact (order-independent) sum implementation.
+
+   Copyright 2015 Jonathan Sacramento.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tpose_exact.h"
+
+
+
+/**
+ ** Adds (or subtracts) a 192-bit number to a sum, exiting if the sum overflows
+ **/
+static void tposeExactAddLimbs(
+	TposeExactSum* sum
+	,const uint64_t* limbs
+	,unsigned int subtract
+) {
+
+	uint64_t carry = 0;
+	uint64_t limb;
+	int64_t top;
+	unsigned int ctr;
+
+	for(ctr = 0; ctr < TPOSE_EXACT_LIMBS - 1; ctr++) {
+		if(subtract) {
+			carry = __builtin_sub_overflow(sum->limbs[ctr], limbs[ctr], &limb) | __builtin_sub_overflow(limb, carry, &limb);
+		}
+		else {
+			carry = __builtin_add_overflow(sum->limbs[ctr], limbs[ctr], &limb) | __builtin_add_overflow(limb, carry, &limb);
+		}
+		sum->limbs[ctr] = limb;
+	}
+
+	// Signed top limb (limbs added are below 2^62, so limb + carry cannot wrap)
+	if(subtract ? __builtin_sub_overflow((int64_t) sum->limbs[ctr], (int64_t) (limbs[ctr] + carry), &top)
+		: __builtin_add_overflow((int64_t) sum->limbs[ctr], (int64_t) (limbs[ctr] + carry), &top)) {
+		fprintf(stderr, "Error: Sum is too large for --reproducible\n");
+		exit(EXIT_FAILURE);
+	}
+	sum->limbs[ctr] = (uint64_t) top;
+
+}
+
+
+
+/**
+ ** Adds a value to an exact sum (bits below 2^MIN_EXPONENT are dropped,
+ ** which only depends on the value, so the sum stays order-independent)
+ **/
+void tposeExactAdd(
+	TposeExactSum* sum
+	,double value
+) {
+
+	uint64_t limbs[TPOSE_EXACT_LIMBS] = {0};
+	uint64_t mantissa;
+	int exponent;
+	int shift;
+
+	if(value == 0)
+		return;
+
+	if(!(fabs(value) < ldexp(1, TPOSE_EXACT_MAX_EXPONENT))) {
+		fprintf(stderr, "Error: NUMERIC value %g is too large for --reproducible\n", value);
+		exit(EXIT_FAILURE);
+	}
+
+	// value = mantissa * 2^(exponent - 53), placed at bit shift of the sum
+	mantissa = (uint64_t) ldexp(frexp(fabs(value), &exponent), 53);
+	shift = exponent - 53 - TPOSE_EXACT_MIN_EXPONENT;
+	if(shift < 0) {
+		if(shift <= -64)
+			return;
+		mantissa >>= -shift;
+		shift = 0;
+	}
+
+	limbs[shift / 64] = mantissa << (shift % 64);
+	if(shift % 64 && shift / 64 < TPOSE_EXACT_LIMBS - 1)
+		limbs[shift / 64 + 1] = mantissa >> (64 - shift % 64);
+
+	tposeExactAddLimbs(sum, limbs, value < 0);
+
+}
+
+
+
+/**
+ ** Adds the square of a value to an exact sum (the square is split into
+ ** two doubles that add up to it exactly)
+ **/
+void tposeExactAddSquare(
+	TposeExactSum* sum
+	,double value
+) {
+
+	double square = value * value;
+
+	tposeExactAdd(sum, square);
+	tposeExactAdd(sum, fma(value, value, -square));
+
+}
+
+
+
+/**
+ ** Adds another exact sum to a sum
+ **/
+void tposeExactMerge(
+	TposeExactSum* sum
+	,const TposeExactSum* otherSum
+) {
+
+	tposeExactAddLimbs(sum, otherSum->limbs, 0);
+
+}
+
+
+
+/**
+ ** Returns an exact sum as a double (the rounding only depends on the sum)
+ **/
+double tposeExactValue(
+	const TposeExactSum* sum
+) {
+
+	uint64_t limbs[TPOSE_EXACT_LIMBS];
+	unsigned int negative = (int64_t) sum->limbs[TPOSE_EXACT_LIMBS - 1] < 0;
+	unsigned int carry = 1;
+	unsigned int ctr;
+	double value;
+
+	// Magnitude (two's complement negation of negative sums)
+	for(ctr = 0; ctr < TPOSE_EXACT_LIMBS; ctr++) {
+		limbs[ctr] = negative ? ~(sum->limbs[ctr]) + carry : sum->limbs[ctr];
+		carry = negative && carry && limbs[ctr] == 0;
+	}
+
+	value = ldexp((double) limbs[2], 64) + ((double) limbs[1] + ldexp((double) limbs[0], TPOSE_EXACT_MIN_EXPONENT));
+
+	return negative ? -value : value;
+
+}
+
+
+
+/**
+ ** Returns an exact sum as a double, and the rest of the sum (sum - value)
+ ** as another double, so value + rest holds about 106 bits of the sum
+ **/
+static double tposeExactValueSplit(
+	const TposeExactSum* sum
+	,double* rest
+) {
+
+	TposeExactSum restSum = *sum;
+	double value = tposeExactValue(sum);
+
+	tposeExactAdd(&restSum, -value);
+	*rest = tposeExactValue(&restSum);
+
+	return value;
+
+}
+
+
+
+/**
+ ** Returns the sample variance of count values from the exact sums of the
+ ** values and of their squares. (sum of squares - sum^2 / count) is worked out
+ ** with about 106 bits, so it does not lose the variance of values far from 0
+ **/
+double tposeExactVariance(
+	const TposeExactSum* sum
+	,const TposeExactSum* squares
+	,double count
+) {
+
+	double sumRest;
+	double squaresRest;
+	double sumValue = tposeExactValueSplit(sum, &sumRest);
+	double squaresValue = tposeExactValueSplit(squares, &squaresRest);
+	double product = sumValue * sumValue;
+	double productRest = fma(sumValue, sumValue, -product) + 2 * sumValue * sumRest;
+	double quotient = product / count;
+	double quotientRest = (fma(-quotient, count, product) + productRest) / count;
+	double variance;
+
+	if(count < 2)
+		return 0;
+
+	variance = ((squaresValue - quotient) + (squaresRest - quotientRest)) / (count - 1);
+
+	return (variance > 0) ? variance : 0;
+
+}
@@ -0,0 +1,53 @@
+/* tpose_exact.h: exact (order-independent) sum interface;
+
+   Copyright 2015 Jonathan Sacramento.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TPOSE_EXACT_H_
+#define _TPOSE_EXACT_H_
+
+	#include <stdint.h>
+	#include <math.h>
+
+	#include "system.h"
+
+
+	/**
+	 ** Implementation defs & limits
+	 **/
+	#define TPOSE_EXACT_LIMBS 3
+	#define TPOSE_EXACT_MIN_EXPONENT -64 // Bits of values below 2^MIN_EXPONENT are dropped
+	#define TPOSE_EXACT_MAX_EXPONENT 126 // Values (and sums) must stay below 2^MAX_EXPONENT
+
+
+	/**
+	 ** TposeExactSum
+	 ** Sum of doubles as a 192-bit two's complement fixed-point number (64
+	 ** fraction bits). Each value is added with integer adds, so the sum is
+	 ** the same whatever the order values (or partial sums) are added in
+	 **/
+	typedef struct {
+		uint64_t limbs[TPOSE_EXACT_LIMBS]; // Least significant first (limbs[0] holds 2^-64 to 2^-1)
+	} TposeExactSum;
+
+
+	void tposeExactAdd(TposeExactSum* sum, double value);
+	void tposeExactAddSquare(TposeExactSum* sum, double value);
+	void tposeExactMerge(TposeExactSum* sum, const TposeExactSum* otherSum);
+	double tposeExactValue(const TposeExactSum* sum);
+	double tposeExactVariance(const TposeExactSum* sum, const TposeExactSum* squares, double count);
+
+#endif /* TPOSE_EXACT_H */
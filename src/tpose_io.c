@@ -17,12 +17,34 @@
 */
 
 #include "tpose_io.h"
+#include "tpose_columnar.h"
 
 unsigned char rowDelimiter = '\n';
-char* prefixGlobal;
-char* suffixGlobal;
+int decimalsGlobal = TPOSE_IO_DECIMALS_OFF;
+unsigned int reproducibleGlobal = 0;
+unsigned int sortGroupsGlobal = 0;
+unsigned int float32Global = 0;
+
+BTree* btreeGlobal;
+TposeThreadData** threadDataArray;
+TposeThreadData* threadData;
+TposeThreadAggregator** threadAggregatorArray;
+TposeThreadAggregator* threadAggregator;
+unsigned int fileChunks;
+TposePartition partitions[TPOSE_IO_MAX_PARTITIONS];
+unsigned int numWorkers;
+unsigned int nextPartition;
+TposeOutputFile* tempFileArray[TPOSE_IO_MAX_PARTITIONS];
+off_t prefetchWindow = 0;
+TposePrefetcher* prefetcherGlobal = NULL;
+
 extern int errno;
 
+static const int64_t tposeIOFixedScales[TPOSE_IO_MAX_DECIMALS + 1] = {
+	1LL, 10LL, 100LL, 1000LL, 10000LL, 100000LL, 1000000LL, 10000000LL, 100000000LL, 1000000000LL
+	,10000000000LL, 100000000000LL, 1000000000000LL, 10000000000000LL, 100000000000000LL, 1000000000000000LL
+};
+
 	
 
 /** 
@@ -108,8 +130,14 @@ TposeInputFile* tposeIOInputFileAlloc(
 	inputFile->fd = fd;
 	inputFile->fileAddr = fileAddr;
 	inputFile->fileSize = fileSize;
+	inputFile->mapSize = fileSize;
+	inputFile->compression = TPOSE_COMPRESS_NONE;
+	inputFile->filePath = NULL;
+	inputFile->index = NULL;
+	inputFile->columnar = NULL;
 	inputFile->fieldDelimiter = fieldDelimiter;
 	inputFile->fileHeader = NULL;
+	inputFile->idLeadEnd = 0;
 	
 	assert(inputFile->fd > 0);
 	assert(inputFile->fileAddr != NULL);
@@ -129,6 +157,7 @@ void tposeIOInputFileFree(
 ) {
 
 	tposeIOHeaderFree(&((*inputFilePtr)->fileHeader));
+	free((*inputFilePtr)->filePath);
     
    if(*inputFilePtr != NULL) {
        free(*inputFilePtr);
@@ -211,13 +240,15 @@ TposeHeader* tposeIOHeaderAlloc(
 	}
 
 	if(mutateHeader) {
-		if((tposeHeader->fields = (char**) malloc(maxFields * sizeof(char*))) == NULL ) {
+		if((tposeHeader->fields = (char**) calloc(maxFields, sizeof(char*))) == NULL ) {
 			fprintf(stderr, "Error: Cannot allocate header fields memory\n");
 			return NULL;
 		}
+		tposeHeader->arena = tposeArenaAlloc();
 	}
 	else {
 		tposeHeader->fields = NULL;
+		tposeHeader->arena = NULL;
 	}
 
 	tposeHeader->maxFields = maxFields;
@@ -244,13 +275,9 @@ void tposeIOHeaderFree(
     TposeHeader** tposeHeaderPtr
 ) {
 
-	// Free all unique groups first
-	int field;
+	// Free all unique groups first (in one go, they are all in the arena)
 	if((*tposeHeaderPtr)->fields != NULL) {
-		for(field = 0; field < (*tposeHeaderPtr)->maxFields; field++) {
-			free((*tposeHeaderPtr)->fields[field]);
-		} 
-
+		tposeArenaFree(&((*tposeHeaderPtr)->arena));
 		free((*tposeHeaderPtr)->fields);
 		(*tposeHeaderPtr)->fields = NULL;
 	}
@@ -268,11 +295,15 @@ void tposeIOHeaderFree(
 
 
 
-/** 
- ** Aggregator for each group/id 
+/**
+ ** Allocates memory for a TposeAggregator
+ ** Arrays of the statistics not asked for (see TPOSE_IO_STATS_*) are not allocated,
+ ** so each update only touches the arrays it needs
  **/
-TposeAggregator* tposeIOAggregatorAlloc(unsigned int numFields)
-{
+TposeAggregator* tposeIOAggregatorAlloc(
+	unsigned int numFields
+	,unsigned int stats
+) {
 
 	TposeAggregator* tposeAggregator;
 
@@ -282,26 +313,12 @@ TposeAggregator* tposeIOAggregatorAlloc(unsigned int numFields)
 		return NULL;
 	}
 
-	if((tposeAggregator->aggregates = (double*) calloc(numFields, sizeof(double))) == NULL ) {
-		fprintf(stderr, "Error: Cannot allocate aggregator memory\n");
-		return NULL;
-	}
-
-	if((tposeAggregator->counts = (double*) calloc(numFields, sizeof(double))) == NULL ) {
-		fprintf(stderr, "Error: Cannot allocate aggregator memory\n");
-		return NULL;
-	}
-
-	if((tposeAggregator->avgs = (double*) calloc(numFields, sizeof(double))) == NULL ) {
-		fprintf(stderr, "Error: Cannot allocate aggregator memory\n");
-		return NULL;
-	}
+	tposeAggregator->stats = stats;
+	tposeAggregator->precision = hllPrecisionGlobal;
+	tposeAggregator->decimals = (decimalsGlobal > 0) ? decimalsGlobal : 0;
+	tposeIOAggregatorGrow(tposeAggregator, numFields);
 
-	tposeAggregator->numFields = numFields;
-	
-	assert(tposeAggregator->aggregates != NULL);
 	assert(tposeAggregator->counts != NULL);
-	assert(tposeAggregator->avgs != NULL);
 	assert(tposeAggregator->numFields != 0);
 
 	return tposeAggregator;
@@ -317,23 +334,35 @@ void tposeIOAggregatorFree(
     TposeAggregator** tposeAggregatorPtr
 ) {
 
-	int value;
-	if((*tposeAggregatorPtr)->aggregates != NULL) {
-		free((*tposeAggregatorPtr)->aggregates);
-		(*tposeAggregatorPtr)->aggregates = NULL;
-	}
+	unsigned int ctr;
+
 	if((*tposeAggregatorPtr)->counts != NULL) {
 		free((*tposeAggregatorPtr)->counts);
 		(*tposeAggregatorPtr)->counts = NULL;
 	}
-	if((*tposeAggregatorPtr)->avgs != NULL) {
-		free((*tposeAggregatorPtr)->avgs);
-		(*tposeAggregatorPtr)->avgs = NULL;
+	free((*tposeAggregatorPtr)->aggregates);
+	free((*tposeAggregatorPtr)->mins);
+	free((*tposeAggregatorPtr)->maxs);
+	free((*tposeAggregatorPtr)->floatAggregates);
+	free((*tposeAggregatorPtr)->floatMins);
+	free((*tposeAggregatorPtr)->floatMaxs);
+	free((*tposeAggregatorPtr)->means);
+	free((*tposeAggregatorPtr)->m2s);
+	if((*tposeAggregatorPtr)->sketches != NULL) {
+		for(ctr = 0; ctr < (*tposeAggregatorPtr)->numFields; ctr++)
+			tposeSketchHllFree(&((*tposeAggregatorPtr)->sketches[ctr]));
+		free((*tposeAggregatorPtr)->sketches);
 	}
+	if((*tposeAggregatorPtr)->quantiles != NULL) {
+		for(ctr = 0; ctr < (*tposeAggregatorPtr)->numFields; ctr++)
+			tposeSketchQuantileFree(&((*tposeAggregatorPtr)->quantiles[ctr]));
+		free((*tposeAggregatorPtr)->quantiles);
+	}
+	free((*tposeAggregatorPtr)->fixedSums);
+	free((*tposeAggregatorPtr)->exactSums);
+	free((*tposeAggregatorPtr)->exactSquares);
     
-    assert((*tposeAggregatorPtr)->aggregates == NULL);
     assert((*tposeAggregatorPtr)->counts == NULL);
-    assert((*tposeAggregatorPtr)->avgs == NULL);
 
     if(*tposeAggregatorPtr != NULL) {
         free(*tposeAggregatorPtr);
@@ -346,339 +375,2049 @@ void tposeIOAggregatorFree(
 
 
 
-/** 
- ** Allocates memory for the transpose parameters
- ** Note: Matches field names
+/**
+ ** Resizes one array of a TposeAggregator, setting any new fields to value
  **/
-TposeQuery* tposeIOQueryAlloc(
-	TposeInputFile* inputFile
-	,TposeOutputFile* outputFile
-	,char* idVar
-	,char* groupVar
-	,char* numericVar
-	,char* aggregateType
+static double* tposeIOAggregatorArray(
+	double* array
+	,unsigned int numFields
+	,unsigned int newNumFields
+	,double value
 ) {
 
-	// Check parameters passed
-	if((idVar != NULL) && (tposeIOGetFieldIndex(inputFile->fileHeader, idVar) == -1)) return NULL;
-	if((groupVar != NULL) && (tposeIOGetFieldIndex(inputFile->fileHeader, groupVar) == -1)) return NULL;
-	if((numericVar != NULL) && (tposeIOGetFieldIndex(inputFile->fileHeader, numericVar) == -1)) return NULL;
-
-	TposeQuery* tposeQuery;
+	unsigned int ctr;
 
-	// Allocate memory for the query parameters
-	if((tposeQuery = (TposeQuery*) malloc(sizeof(TposeQuery))) == NULL ) {
-		fprintf(stderr, "Error: Cannot allocate memory for query\n");
+	if((array = (double*) realloc(array, (newNumFields ? newNumFields : 1) * sizeof(double))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate aggregator memory\n");
 		exit(EXIT_FAILURE);
 	}
-	
-	tposeQuery->inputFile = inputFile;
-	tposeQuery->outputFile = outputFile;
-	tposeQuery->aggregator = NULL;
-	tposeQuery->id = -1;
-	tposeQuery->group = -1;
-	tposeQuery->numeric = -1;
-	tposeQuery->aggregateType = 0;
-	if(idVar != NULL) tposeQuery->id = tposeIOGetFieldIndex(inputFile->fileHeader, idVar);
-	if(groupVar != NULL) tposeQuery->group = tposeIOGetFieldIndex(inputFile->fileHeader, groupVar);
-	if(numericVar != NULL) tposeQuery->numeric = tposeIOGetFieldIndex(inputFile->fileHeader, numericVar);
-	if(aggregateType != NULL) {
-		if(!strcmp("sum", tposeIOLowerCase(aggregateType)))
-			tposeQuery->aggregateType = 0; //TPOSE_IO_AGGREGATION_SUM;
-
-		if(!strcmp("count", tposeIOLowerCase(aggregateType)))
-			tposeQuery->aggregateType = TPOSE_IO_AGGREGATION_COUNT;
 
-		if(!strcmp("avg", tposeIOLowerCase(aggregateType)))
-			tposeQuery->aggregateType = TPOSE_IO_AGGREGATION_AVG;
-	}
+	for(ctr = numFields; ctr < newNumFields; ctr++)
+		array[ctr] = value;
 
-	debug_print("tposeIOQueryAlloc(): id = %d\n", tposeQuery->id);
-	debug_print("tposeIOQueryAlloc(): group = %d\n", tposeQuery->group);
-	debug_print("tposeIOQueryAlloc(): numeric = %d\n", tposeQuery->numeric);
-	assert(tposeQuery->aggregateType >= TPOSE_IO_AGGREGATION_SUM && tposeQuery->aggregateType <= TPOSE_IO_AGGREGATION_AVG);
+	return array;
 
-	return tposeQuery;
-	
 }
 
 
 
-/** 
- ** Allocates memory for the transpose parameters
- ** Note: Matches field indexes
+/**
+ ** Resizes one float array of a TposeAggregator (see TPOSE_IO_STATS_FLOAT32),
+ ** setting any new fields to value
  **/
-TposeQuery* tposeIOQueryIndexedAlloc(
-	TposeInputFile* inputFile
-	,TposeOutputFile* outputFile
-	,int idVar
-	,int groupVar
-	,int numericVar
-	,char* aggregateType
+static float* tposeIOAggregatorFloatArray(
+	float* array
+	,unsigned int numFields
+	,unsigned int newNumFields
+	,float value
 ) {
 
-	// Correct field indexes so they're zero-based
-	if(idVar != -1) --idVar;
-	if(groupVar != -1) --groupVar;
-	if(numericVar != -1) --numericVar;
+	unsigned int ctr;
 
-	int minIndex = 0;
-	int maxIndex;
-	if(!((inputFile->fileHeader)->numFields))
-		maxIndex = (inputFile->fileHeader)->maxFields - 1;
-	else
-		maxIndex = (inputFile->fileHeader)->numFields - 1;
+	if((array = (float*) realloc(array, (newNumFields ? newNumFields : 1) * sizeof(float))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate aggregator memory\n");
+		exit(EXIT_FAILURE);
+	}
 
-	debug_print("tposeIOQueryIndexedAlloc(): idArg = %d\n", idVar);
-	debug_print("tposeIOQueryIndexedAlloc(): groupArg = %d\n", idVar);
-	debug_print("tposeIOQueryIndexedAlloc(): numericArg = %d\n", idVar);
+	for(ctr = numFields; ctr < newNumFields; ctr++)
+		array[ctr] = value;
 
-	// Check parameters passed
-	if( (idVar != -1) && ((idVar < minIndex) || (idVar > maxIndex) )) return NULL;
-	if( (groupVar != -1) && ((groupVar < minIndex) || (groupVar > maxIndex) )) return NULL;
-	if( (numericVar != -1) && ((numericVar < minIndex) || (numericVar > maxIndex) )) return NULL;
+	return array;
 
-	// Allocate memory for the query parameters
-	TposeQuery* tposeQuery;
-	if((tposeQuery = (TposeQuery*) malloc(sizeof(TposeQuery))) == NULL ) {
-		fprintf(stderr, "Error: Cannot allocate memory for query\n");
-		exit(EXIT_FAILURE);
-	}
-	
-	tposeQuery->inputFile = inputFile;
-	tposeQuery->outputFile = outputFile;
-	tposeQuery->aggregator = NULL;
-	if(idVar != -1) tposeQuery->id = idVar;
-	if(groupVar != -1) tposeQuery->group = groupVar;
-	if(numericVar != -1) tposeQuery->numeric = numericVar;
-	if(aggregateType != NULL) {
-		if(!strcmp("sum", tposeIOLowerCase(aggregateType)))
-			tposeQuery->aggregateType = TPOSE_IO_AGGREGATION_SUM;
+}
 
-		if(!strcmp("count", tposeIOLowerCase(aggregateType)))
-			tposeQuery->aggregateType = TPOSE_IO_AGGREGATION_COUNT;
 
-		if(!strcmp("avg", tposeIOLowerCase(aggregateType)))
-			tposeQuery->aggregateType = TPOSE_IO_AGGREGATION_AVG;
+
+/**
+ ** Resizes an array of exact sums of a TposeAggregator (new sums are zero)
+ **/
+static TposeExactSum* tposeIOAggregatorExactArray(
+	TposeExactSum* array
+	,unsigned int numFields
+	,unsigned int newNumFields
+) {
+
+	if((array = (TposeExactSum*) realloc(array, (newNumFields ? newNumFields : 1) * sizeof(TposeExactSum))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate aggregator memory\n");
+		exit(EXIT_FAILURE);
 	}
-	assert(tposeQuery->aggregateType >= TPOSE_IO_AGGREGATION_SUM && tposeQuery->aggregateType <= TPOSE_IO_AGGREGATION_AVG);
+	memset(array + numFields, 0, (newNumFields - numFields) * sizeof(TposeExactSum));
+
+	return array;
 
-	return tposeQuery;
-	
 }
 
 
 
-/** 
- ** Free memory for a TposeQuery 
+/**
+ ** Resizes an array of counts or fixed sums of a TposeAggregator (new fields are zero)
  **/
-void tposeIOQueryFree(
-    TposeQuery** tposeQueryPtr
+static int64_t* tposeIOAggregatorIntArray(
+	int64_t* array
+	,unsigned int numFields
+	,unsigned int newNumFields
 ) {
 
-	if((*tposeQueryPtr)->aggregator != NULL) tposeIOAggregatorFree( &((*tposeQueryPtr)->aggregator) );
-    
-	// No need to free the inputFile/outputFile,
-	// as this is done in the tposeIOCloseFile() call
-   if(*tposeQueryPtr != NULL) { 
-       free(*tposeQueryPtr);
-       *tposeQueryPtr = NULL;
-   }
+	if((array = (int64_t*) realloc(array, (newNumFields ? newNumFields : 1) * sizeof(int64_t))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate aggregator memory\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(array + numFields, 0, (newNumFields - numFields) * sizeof(int64_t));
 
-   assert(*tposeQueryPtr == NULL);
+	return array;
 
 }
 
 
 
-/** 
- ** Open input file
+/**
+ ** Makes room for numFields fields in a TposeAggregator (new fields are empty)
  **/
-TposeInputFile* tposeIOOpenInputFile(
-	char* filePath
-	,unsigned char fieldDelimiter
-	,unsigned int mutateHeader
+void tposeIOAggregatorGrow(
+	TposeAggregator* tposeAggregator
+	,unsigned int numFields
 ) {
 
-	int fd;
-	char* fileAddr;
-	off_t fileSize;
-	struct stat statBuffer;
+	unsigned int oldNumFields = tposeAggregator->numFields;
 
-	if((fd = open(filePath, O_RDONLY)) < 0) {
-		fprintf(stderr, "Error: Can not open input file %s\n", filePath);
-		return NULL;
-	}
+	if(numFields <= oldNumFields && tposeAggregator->counts != NULL)
+		return;
 
-	if(fstat(fd, &statBuffer) < 0) {
-		fprintf(stderr, "Error: Can not stat input file %s\n", filePath);
-		return NULL;
-	}
+	tposeAggregator->counts = tposeIOAggregatorIntArray(tposeAggregator->counts, oldNumFields, numFields);
 
-	if((fileSize = statBuffer.st_size) == 0) {
-		fprintf(stderr, "Error: No data found in input file %s\n", filePath);
-		return NULL;
+	if(tposeAggregator->stats & TPOSE_IO_STATS_FLOAT32) {
+		if(tposeAggregator->stats & TPOSE_IO_STATS_SUM)
+			tposeAggregator->floatAggregates = tposeIOAggregatorFloatArray(tposeAggregator->floatAggregates, oldNumFields, numFields, 0);
+		if(tposeAggregator->stats & TPOSE_IO_STATS_MINMAX) {
+			tposeAggregator->floatMins = tposeIOAggregatorFloatArray(tposeAggregator->floatMins, oldNumFields, numFields, INFINITY);
+			tposeAggregator->floatMaxs = tposeIOAggregatorFloatArray(tposeAggregator->floatMaxs, oldNumFields, numFields, -INFINITY);
+		}
 	}
-	
-
-	if((fileAddr = mmap(0, statBuffer.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)) == MAP_FAILED ) {
-		fprintf(stderr, "Error: Can not map input file %s\n", filePath);
-		return NULL;
+	else {
+		if(tposeAggregator->stats & TPOSE_IO_STATS_SUM)
+			tposeAggregator->aggregates = tposeIOAggregatorArray(tposeAggregator->aggregates, oldNumFields, numFields, 0);
+		if(tposeAggregator->stats & TPOSE_IO_STATS_MINMAX) {
+			tposeAggregator->mins = tposeIOAggregatorArray(tposeAggregator->mins, oldNumFields, numFields, INFINITY);
+			tposeAggregator->maxs = tposeIOAggregatorArray(tposeAggregator->maxs, oldNumFields, numFields, -INFINITY);
+		}
 	}
-
-	// Might speed-up via aggressive read-ahead caching
-	if(madvise(fileAddr, fileSize, MADV_SEQUENTIAL) == -1) {
-		fprintf(stderr, "Warning: Cannot advise kernel on file %s\n", filePath);
+	if(tposeAggregator->stats & TPOSE_IO_STATS_VARIANCE) {
+		tposeAggregator->means = tposeIOAggregatorArray(tposeAggregator->means, oldNumFields, numFields, 0);
+		tposeAggregator->m2s = tposeIOAggregatorArray(tposeAggregator->m2s, oldNumFields, numFields, 0);
+	}
+	if(tposeAggregator->stats & TPOSE_IO_STATS_DISTINCT) {
+		if((tposeAggregator->sketches = (TposeSketchHll*) realloc(tposeAggregator->sketches, (numFields ? numFields : 1) * sizeof(TposeSketchHll))) == NULL) {
+			fprintf(stderr, "Error: Cannot allocate aggregator memory\n");
+			exit(EXIT_FAILURE);
+		}
+		memset(tposeAggregator->sketches + oldNumFields, 0, (numFields - oldNumFields) * sizeof(TposeSketchHll));
+	}
+	if(tposeAggregator->stats & TPOSE_IO_STATS_QUANTILE) {
+		if((tposeAggregator->quantiles = (TposeSketchQuantile*) realloc(tposeAggregator->quantiles, (numFields ? numFields : 1) * sizeof(TposeSketchQuantile))) == NULL) {
+			fprintf(stderr, "Error: Cannot allocate aggregator memory\n");
+			exit(EXIT_FAILURE);
+		}
+		memset(tposeAggregator->quantiles + oldNumFields, 0, (numFields - oldNumFields) * sizeof(TposeSketchQuantile));
+	}
+	if(tposeAggregator->stats & TPOSE_IO_STATS_FIXED) {
+		tposeAggregator->fixedSums = tposeIOAggregatorIntArray(tposeAggregator->fixedSums, oldNumFields, numFields);
+	}
+	if(tposeAggregator->stats & TPOSE_IO_STATS_EXACT) {
+		tposeAggregator->exactSums = tposeIOAggregatorExactArray(tposeAggregator->exactSums, oldNumFields, numFields);
+		if(tposeAggregator->stats & TPOSE_IO_STATS_VARIANCE)
+			tposeAggregator->exactSquares = tposeIOAggregatorExactArray(tposeAggregator->exactSquares, oldNumFields, numFields);
 	}
 
-	TposeInputFile* inputFile = tposeIOInputFileAlloc(fd, fileAddr, fileSize, fieldDelimiter); // Creates the file handle 
-	inputFile->fileHeader = tposeIOReadInputHeader(inputFile, mutateHeader); // Opening a file also creates the TposeHeader struct
-
-	return inputFile;
+	tposeAggregator->numFields = numFields;
 
 }
 
 
 
-/** 
- ** Close an input file and unmap any memory
+/**
+ ** Returns the bytes taken by each field of a TposeAggregator with these stats
+ ** (distinct and quantile sketches are counted at the most they can grow to)
  **/
-int tposeIOCloseInputFile(
-	TposeInputFile* inputFile
+size_t tposeIOAggregatorFieldSize(
+	unsigned int stats
 ) {
 
-   if((munmap(inputFile->fileAddr, inputFile->fileSize)) < 0) {
-       fprintf(stderr, "Error: can not unmap input file\n");
-       return -1;
-   }
+	size_t size = sizeof(int64_t); // counts
+	size_t valueSize = (stats & TPOSE_IO_STATS_FLOAT32) ? sizeof(float) : sizeof(double);
+
+	if(stats & TPOSE_IO_STATS_SUM)
+		size += valueSize;
+	if(stats & TPOSE_IO_STATS_MINMAX)
+		size += 2 * valueSize;
+	if(stats & TPOSE_IO_STATS_VARIANCE)
+		size += 2 * sizeof(double);
+	if(stats & TPOSE_IO_STATS_DISTINCT)
+		size += sizeof(TposeSketchHll) + ((size_t) 1 << hllPrecisionGlobal);
+	if(stats & TPOSE_IO_STATS_QUANTILE)
+		size += sizeof(TposeSketchQuantile) + (TPOSE_SKETCH_QUANTILE_MAX_BINS + 1) * sizeof(TposeSketchBin);
+	if(stats & TPOSE_IO_STATS_FIXED)
+		size += sizeof(int64_t);
+	if(stats & TPOSE_IO_STATS_EXACT)
+		size += ((stats & TPOSE_IO_STATS_VARIANCE) ? 2 : 1) * sizeof(TposeExactSum);
+
+	return size;
 
-   if(close(inputFile->fd) < 0) {
-       fprintf(stderr, "Error: can not close input file\n");
-       return -1;
-   }
+}
 
-	tposeIOInputFileFree(&inputFile);
 
-	return 0;
+
+/**
+ ** Resets all aggregates of a TposeAggregator to zero
+ **/
+void tposeIOAggregatorReset(
+	TposeAggregator* tposeAggregator
+) {
+
+	unsigned int ctr;
+
+	memset(tposeAggregator->counts, 0, tposeAggregator->numFields * sizeof(int64_t));
+
+	if(tposeAggregator->stats & TPOSE_IO_STATS_SUM) {
+		if(tposeAggregator->stats & TPOSE_IO_STATS_FLOAT32)
+			memset(tposeAggregator->floatAggregates, 0, tposeAggregator->numFields * sizeof(float));
+		else
+			memset(tposeAggregator->aggregates, 0, tposeAggregator->numFields * sizeof(double));
+	}
+	if(tposeAggregator->stats & TPOSE_IO_STATS_MINMAX) {
+		for(ctr = 0; ctr < tposeAggregator->numFields; ++ctr) {
+			if(tposeAggregator->stats & TPOSE_IO_STATS_FLOAT32) {
+				tposeAggregator->floatMins[ctr] = INFINITY;
+				tposeAggregator->floatMaxs[ctr] = -INFINITY;
+			}
+			else {
+				tposeAggregator->mins[ctr] = INFINITY;
+				tposeAggregator->maxs[ctr] = -INFINITY;
+			}
+		}
+	}
+	if(tposeAggregator->stats & TPOSE_IO_STATS_VARIANCE) {
+		memset(tposeAggregator->means, 0, tposeAggregator->numFields * sizeof(double));
+		memset(tposeAggregator->m2s, 0, tposeAggregator->numFields * sizeof(double));
+	}
+	if(tposeAggregator->stats & TPOSE_IO_STATS_DISTINCT) {
+		for(ctr = 0; ctr < tposeAggregator->numFields; ++ctr)
+			tposeSketchHllReset(&(tposeAggregator->sketches[ctr]));
+	}
+	if(tposeAggregator->stats & TPOSE_IO_STATS_QUANTILE) {
+		for(ctr = 0; ctr < tposeAggregator->numFields; ++ctr)
+			tposeSketchQuantileReset(&(tposeAggregator->quantiles[ctr]));
+	}
+	if(tposeAggregator->stats & TPOSE_IO_STATS_FIXED) {
+		memset(tposeAggregator->fixedSums, 0, tposeAggregator->numFields * sizeof(int64_t));
+	}
+	if(tposeAggregator->stats & TPOSE_IO_STATS_EXACT) {
+		memset(tposeAggregator->exactSums, 0, tposeAggregator->numFields * sizeof(TposeExactSum));
+		if(tposeAggregator->stats & TPOSE_IO_STATS_VARIANCE)
+			memset(tposeAggregator->exactSquares, 0, tposeAggregator->numFields * sizeof(TposeExactSum));
+	}
 
 }
 
 
 
-/** 
- ** Open output file
+/**
+ ** Adds a NUMERIC value to a field of a TposeAggregator
  **/
-TposeOutputFile* tposeIOOpenOutputFile(
-	char* filePath
-	,const char* mode
-	,unsigned char fieldDelimiter
+void tposeIOAggregatorUpdate(
+	TposeAggregator* tposeAggregator
+	,unsigned int field
+	,double value
 ) {
 
-	FILE* fd;
-	if(strcmp(filePath, "stdout")) {
-		if((fd = fopen(filePath, mode)) == NULL) {
-			fprintf(stderr, "Error: Can not open output file %s\n", filePath);
-			return NULL;
+	double delta;
+
+	tposeAggregator->counts[field]++;
+
+	if(tposeAggregator->stats & TPOSE_IO_STATS_SUM) {
+		if(tposeAggregator->stats & TPOSE_IO_STATS_FLOAT32)
+			tposeAggregator->floatAggregates[field] += value;
+		else
+			tposeAggregator->aggregates[field] += value;
+	}
+
+	// Select rather than branch on the comparison (compiles to min/max instructions)
+	if(tposeAggregator->stats & TPOSE_IO_STATS_MINMAX) {
+		if(tposeAggregator->stats & TPOSE_IO_STATS_FLOAT32) {
+			tposeAggregator->floatMins[field] = (value < tposeAggregator->floatMins[field]) ? value : tposeAggregator->floatMins[field];
+			tposeAggregator->floatMaxs[field] = (value > tposeAggregator->floatMaxs[field]) ? value : tposeAggregator->floatMaxs[field];
+		}
+		else {
+			tposeAggregator->mins[field] = (value < tposeAggregator->mins[field]) ? value : tposeAggregator->mins[field];
+			tposeAggregator->maxs[field] = (value > tposeAggregator->maxs[field]) ? value : tposeAggregator->maxs[field];
 		}
 	}
-	else
-		fd = stdout; // If no output file is passed, print to std output
 
-	return tposeIOOutputFileAlloc(fd, fieldDelimiter); // Creates the file handle 
+	// Welford's algorithm (no loss of precision from subtracting large sums of squares)
+	if(tposeAggregator->stats & TPOSE_IO_STATS_VARIANCE) {
+		delta = value - tposeAggregator->means[field];
+		tposeAggregator->means[field] += delta / tposeAggregator->counts[field];
+		tposeAggregator->m2s[field] += delta * (value - tposeAggregator->means[field]);
+	}
+
+	if(tposeAggregator->stats & TPOSE_IO_STATS_QUANTILE) {
+		tposeSketchQuantileAdd(&(tposeAggregator->quantiles[field]), value);
+	}
+
+	if(tposeAggregator->stats & TPOSE_IO_STATS_EXACT) {
+		tposeExactAdd(&(tposeAggregator->exactSums[field]), value);
+		if(tposeAggregator->stats & TPOSE_IO_STATS_VARIANCE)
+			tposeExactAddSquare(&(tposeAggregator->exactSquares[field]), value);
+	}
 
 }
 
 
 
-/** 
- ** Close an output file
+/**
+ ** Adds value units to an exact sum (exits if the sum overflows)
  **/
-int tposeIOCloseOutputFile(
-	TposeOutputFile* outputFile
+static void tposeIOAggregatorAddFixed(
+	int64_t* fixedSum
+	,int64_t value
+	,unsigned int decimals
 ) {
-	
-	// Close if not standard output
-	if(outputFile->fd != stdout) {  
-		if(ferror(outputFile->fd))
-			fprintf(stderr, "Error: Output file closed with errors - check data (Error number = %d - %s)\n", errno, strerror(errno));
-		fclose(outputFile->fd);
-	}
 
-	// Free TposeOutputFile memory
-	tposeIOOutputFileFree(&outputFile);
-
-	return 0;
+	if(__builtin_add_overflow(*fixedSum, value, fixedSum)) {
+		fprintf(stderr, "Error: Sum is too large for --decimals=%u\n", decimals);
+		exit(EXIT_FAILURE);
+	}
 
 }
 
 
 
-/** 
- ** Reads the first line (header) of an input file
- ** tpose only accepts data files with column headers on first line
+/**
+ ** Adds a NUMERIC value of a row to a field of a TposeAggregator
+ ** (the text of the value is also added to the distinct sketch, if kept,
+ ** and parsed straight to units of the exact sum with --decimals)
  **/
-TposeHeader* tposeIOReadInputHeader(
-	TposeInputFile* inputFile
-	,unsigned int mutateHeader
+void tposeIOAggregatorUpdateRow(
+	TposeAggregator* tposeAggregator
+	,unsigned int field
+	,TposeRow* row
+	,unsigned int numericCtr
 ) {
-    
-	char* rowtok;
-	char* fieldtok;
-	char* fieldSavePtr;
-	
-	char* tempString;
 
-	unsigned int fieldCount = 0;
-	unsigned int length = 0;
-	unsigned int curField = 0;
+	int64_t fixed;
 
-	// Test if we have a good TposeInputFile*
+	if(tposeAggregator->stats & TPOSE_IO_STATS_DISTINCT) {
+		tposeSketchHllAdd(&(tposeAggregator->sketches[field]), tposeAggregator->precision
+			,tposeSketchHash(row->numerics[numericCtr], row->numericLengths[numericCtr]));
+	}
+
+	if(tposeAggregator->stats & TPOSE_IO_STATS_FIXED) {
+		fixed = tposeIORowFixed(row, numericCtr, tposeAggregator->decimals);
+		tposeIOAggregatorAddFixed(&(tposeAggregator->fixedSums[field]), fixed, tposeAggregator->decimals);
+		tposeIOAggregatorUpdate(tposeAggregator, field, (double) fixed / tposeIOFixedScales[tposeAggregator->decimals]);
+		return;
+	}
+
+	tposeIOAggregatorUpdate(tposeAggregator, field, tposeIORowNumeric(row, numericCtr));
+
+}
+
+
+
+/**
+ ** Adds the values of a batch to their fields of a TposeAggregator, and empties the batch.
+ ** Values are added in batch order, so sums are the same as with tposeIOAggregatorUpdate
+ **/
+void tposeIOAggregatorUpdateBatch(
+	TposeAggregator* tposeAggregator
+	,TposeBatch* batch
+) {
+
+	unsigned int* fields = batch->fields;
+	double* values = batch->values;
+	unsigned int numValues = batch->numValues;
+	unsigned int ctr = 0;
+	unsigned int runCtr;
+	unsigned int runEnd;
+	unsigned int field;
+	double sum;
+	double min;
+	double max;
+
+	batch->numValues = 0;
+
+	// Other statistics (and floats) are updated one value at a time
+	if(tposeAggregator->stats & ~(TPOSE_IO_STATS_SUM | TPOSE_IO_STATS_MINMAX)) {
+		for(; ctr < numValues; ctr++)
+			tposeIOAggregatorUpdate(tposeAggregator, fields[ctr], values[ctr]);
+		return;
+	}
+
+	// Each run of values of the same field is folded in registers
+	while(ctr < numValues) {
+		field = fields[ctr];
+		for(runEnd = ctr + 1; runEnd < numValues && fields[runEnd] == field; runEnd++);
+
+		tposeAggregator->counts[field] += runEnd - ctr;
+
+		if(tposeAggregator->stats & TPOSE_IO_STATS_MINMAX) {
+			min = tposeAggregator->mins[field];
+			max = tposeAggregator->maxs[field];
+			for(runCtr = ctr; runCtr < runEnd; runCtr++) {
+				min = (values[runCtr] < min) ? values[runCtr] : min;
+				max = (values[runCtr] > max) ? values[runCtr] : max;
+			}
+			tposeAggregator->mins[field] = min;
+			tposeAggregator->maxs[field] = max;
+		}
+
+		if(tposeAggregator->stats & TPOSE_IO_STATS_SUM) {
+			sum = tposeAggregator->aggregates[field];
+			for(runCtr = ctr; runCtr < runEnd; runCtr++)
+				sum += values[runCtr];
+			tposeAggregator->aggregates[field] = sum;
+		}
+
+		ctr = runEnd;
+	}
+
+}
+
+
+
+/**
+ ** Adds a NUMERIC value of a row to a batch for a field of a TposeAggregator
+ ** (adding up the batch once it is full)
+ **/
+void tposeIOBatchAdd(
+	TposeAggregator* tposeAggregator
+	,TposeBatch* batch
+	,unsigned int field
+	,TposeRow* row
+	,unsigned int numericCtr
+) {
+
+	// Distinct sketches and exact sums read the text of values
+	if(tposeAggregator->stats & (TPOSE_IO_STATS_DISTINCT | TPOSE_IO_STATS_FIXED)) {
+		tposeIOAggregatorUpdateRow(tposeAggregator, field, row, numericCtr);
+		return;
+	}
+
+	batch->fields[batch->numValues] = field;
+	batch->values[batch->numValues] = tposeIORowNumeric(row, numericCtr);
+	if(++(batch->numValues) == TPOSE_IO_BATCH_SIZE)
+		tposeIOAggregatorUpdateBatch(tposeAggregator, batch);
+
+}
+
+
+
+/**
+ ** Adds a field of another TposeAggregator (with the same stats) to a field
+ **/
+void tposeIOAggregatorMerge(
+	TposeAggregator* tposeAggregator
+	,unsigned int field
+	,TposeAggregator* otherAggregator
+	,unsigned int otherField
+) {
+
+	double count = tposeAggregator->counts[field];
+	double otherCount = otherAggregator->counts[otherField];
+	double delta;
+
+	if(otherCount == 0)
+		return;
+
+	tposeAggregator->counts[field] += otherAggregator->counts[otherField];
+
+	if(tposeAggregator->stats & TPOSE_IO_STATS_SUM) {
+		if(tposeAggregator->stats & TPOSE_IO_STATS_FLOAT32)
+			tposeAggregator->floatAggregates[field] += otherAggregator->floatAggregates[otherField];
+		else
+			tposeAggregator->aggregates[field] += otherAggregator->aggregates[otherField];
+	}
+
+	if(tposeAggregator->stats & TPOSE_IO_STATS_MINMAX) {
+		if(tposeAggregator->stats & TPOSE_IO_STATS_FLOAT32) {
+			if(otherAggregator->floatMins[otherField] < tposeAggregator->floatMins[field])
+				tposeAggregator->floatMins[field] = otherAggregator->floatMins[otherField];
+			if(otherAggregator->floatMaxs[otherField] > tposeAggregator->floatMaxs[field])
+				tposeAggregator->floatMaxs[field] = otherAggregator->floatMaxs[otherField];
+		}
+		else {
+			if(otherAggregator->mins[otherField] < tposeAggregator->mins[field])
+				tposeAggregator->mins[field] = otherAggregator->mins[otherField];
+			if(otherAggregator->maxs[otherField] > tposeAggregator->maxs[field])
+				tposeAggregator->maxs[field] = otherAggregator->maxs[otherField];
+		}
+	}
+
+	// Chan et al.'s formula for combining the means and m2s of two sets of values
+	if(tposeAggregator->stats & TPOSE_IO_STATS_VARIANCE) {
+		delta = otherAggregator->means[otherField] - tposeAggregator->means[field];
+		tposeAggregator->means[field] += delta * otherCount / (count + otherCount);
+		tposeAggregator->m2s[field] += otherAggregator->m2s[otherField] + delta * delta * count * otherCount / (count + otherCount);
+	}
+
+	if(tposeAggregator->stats & TPOSE_IO_STATS_DISTINCT) {
+		tposeSketchHllMerge(&(tposeAggregator->sketches[field]), &(otherAggregator->sketches[otherField]), tposeAggregator->precision);
+	}
+
+	if(tposeAggregator->stats & TPOSE_IO_STATS_QUANTILE) {
+		tposeSketchQuantileMerge(&(tposeAggregator->quantiles[field]), &(otherAggregator->quantiles[otherField]));
+	}
+
+	if(tposeAggregator->stats & TPOSE_IO_STATS_FIXED) {
+		tposeIOAggregatorAddFixed(&(tposeAggregator->fixedSums[field]), otherAggregator->fixedSums[otherField], tposeAggregator->decimals);
+	}
+
+	if(tposeAggregator->stats & TPOSE_IO_STATS_EXACT) {
+		tposeExactMerge(&(tposeAggregator->exactSums[field]), &(otherAggregator->exactSums[otherField]));
+		if(tposeAggregator->stats & TPOSE_IO_STATS_VARIANCE)
+			tposeExactMerge(&(tposeAggregator->exactSquares[field]), &(otherAggregator->exactSquares[otherField]));
+	}
+
+}
+
+
+
+/**
+ ** Copies the fields of another TposeAggregator (with the same stats) over the first fields
+ **/
+void tposeIOAggregatorCopy(
+	TposeAggregator* tposeAggregator
+	,TposeAggregator* otherAggregator
+) {
+
+	size_t size = otherAggregator->numFields * sizeof(double);
+	size_t floatSize = otherAggregator->numFields * sizeof(float);
+	unsigned int ctr;
+
+	assert(otherAggregator->numFields <= tposeAggregator->numFields);
+
+	memcpy(tposeAggregator->counts, otherAggregator->counts, otherAggregator->numFields * sizeof(int64_t));
+
+	if(tposeAggregator->stats & TPOSE_IO_STATS_FLOAT32) {
+		if(tposeAggregator->stats & TPOSE_IO_STATS_SUM)
+			memcpy(tposeAggregator->floatAggregates, otherAggregator->floatAggregates, floatSize);
+		if(tposeAggregator->stats & TPOSE_IO_STATS_MINMAX) {
+			memcpy(tposeAggregator->floatMins, otherAggregator->floatMins, floatSize);
+			memcpy(tposeAggregator->floatMaxs, otherAggregator->floatMaxs, floatSize);
+		}
+	}
+	else {
+		if(tposeAggregator->stats & TPOSE_IO_STATS_SUM)
+			memcpy(tposeAggregator->aggregates, otherAggregator->aggregates, size);
+		if(tposeAggregator->stats & TPOSE_IO_STATS_MINMAX) {
+			memcpy(tposeAggregator->mins, otherAggregator->mins, size);
+			memcpy(tposeAggregator->maxs, otherAggregator->maxs, size);
+		}
+	}
+	if(tposeAggregator->stats & TPOSE_IO_STATS_VARIANCE) {
+		memcpy(tposeAggregator->means, otherAggregator->means, size);
+		memcpy(tposeAggregator->m2s, otherAggregator->m2s, size);
+	}
+	if(tposeAggregator->stats & TPOSE_IO_STATS_DISTINCT) {
+		for(ctr = 0; ctr < otherAggregator->numFields; ++ctr)
+			tposeSketchHllCopy(&(tposeAggregator->sketches[ctr]), &(otherAggregator->sketches[ctr]), tposeAggregator->precision);
+	}
+	if(tposeAggregator->stats & TPOSE_IO_STATS_QUANTILE) {
+		for(ctr = 0; ctr < otherAggregator->numFields; ++ctr)
+			tposeSketchQuantileCopy(&(tposeAggregator->quantiles[ctr]), &(otherAggregator->quantiles[ctr]));
+	}
+	if(tposeAggregator->stats & TPOSE_IO_STATS_FIXED) {
+		memcpy(tposeAggregator->fixedSums, otherAggregator->fixedSums, otherAggregator->numFields * sizeof(int64_t));
+	}
+	if(tposeAggregator->stats & TPOSE_IO_STATS_EXACT) {
+		memcpy(tposeAggregator->exactSums, otherAggregator->exactSums, otherAggregator->numFields * sizeof(TposeExactSum));
+		if(tposeAggregator->stats & TPOSE_IO_STATS_VARIANCE)
+			memcpy(tposeAggregator->exactSquares, otherAggregator->exactSquares, otherAggregator->numFields * sizeof(TposeExactSum));
+	}
+
+}
+
+
+
+/**
+ ** Returns the sum of a field, from whichever sums the aggregator keeps
+ **/
+double tposeIOAggregatorSum(
+	TposeAggregator* tposeAggregator
+	,unsigned int field
+) {
+
+	// Exact sums are kept without the rounding of double sums
+	if(tposeAggregator->stats & TPOSE_IO_STATS_FIXED)
+		return (double) tposeAggregator->fixedSums[field] / tposeIOFixedScales[tposeAggregator->decimals];
+	if(tposeAggregator->stats & TPOSE_IO_STATS_EXACT)
+		return tposeExactValue(&(tposeAggregator->exactSums[field]));
+	if(tposeAggregator->stats & TPOSE_IO_STATS_FLOAT32)
+		return tposeAggregator->floatAggregates[field];
+
+	return tposeAggregator->aggregates[field];
+
+}
+
+
+
+/**
+ ** Returns the average of a field (computed when printed, rather than kept)
+ **/
+double tposeIOAggregatorAverage(
+	TposeAggregator* tposeAggregator
+	,unsigned int field
+) {
+
+	return tposeIOAggregatorSum(tposeAggregator, field) / tposeAggregator->counts[field];
+
+}
+
+
+
+/**
+ ** Returns the smallest value of a field (0 if it has no values)
+ **/
+double tposeIOAggregatorMin(
+	TposeAggregator* tposeAggregator
+	,unsigned int field
+) {
+
+	if(tposeAggregator->counts[field] == 0)
+		return 0;
+
+	return (tposeAggregator->stats & TPOSE_IO_STATS_FLOAT32) ? tposeAggregator->floatMins[field] : tposeAggregator->mins[field];
+
+}
+
+
+
+/**
+ ** Returns the largest value of a field (0 if it has no values)
+ **/
+double tposeIOAggregatorMax(
+	TposeAggregator* tposeAggregator
+	,unsigned int field
+) {
+
+	if(tposeAggregator->counts[field] == 0)
+		return 0;
+
+	return (tposeAggregator->stats & TPOSE_IO_STATS_FLOAT32) ? tposeAggregator->floatMaxs[field] : tposeAggregator->maxs[field];
+
+}
+
+
+
+/**
+ ** Returns the sample variance of a field (0 if it has fewer than two values)
+ **/
+double tposeIOAggregatorVariance(
+	TposeAggregator* tposeAggregator
+	,unsigned int field
+) {
+
+	if(tposeAggregator->counts[field] < 2)
+		return 0;
+
+	// Welford's m2s depend on the order partitions are merged in
+	if(tposeAggregator->stats & TPOSE_IO_STATS_EXACT)
+		return tposeExactVariance(&(tposeAggregator->exactSums[field]), &(tposeAggregator->exactSquares[field]), tposeAggregator->counts[field]);
+
+	return tposeAggregator->m2s[field] / (tposeAggregator->counts[field] - 1);
+
+}
+
+
+
+/**
+ ** Returns the TPOSE_IO_STATS_* arrays an aggregation type needs
+ **/
+unsigned int tposeIOAggregateStats(
+	unsigned int aggregateType
+) {
+
+	switch(aggregateType) {
+		case TPOSE_IO_AGGREGATION_SUM:
+		case TPOSE_IO_AGGREGATION_AVG:
+			return TPOSE_IO_STATS_SUM;
+		case TPOSE_IO_AGGREGATION_MIN:
+		case TPOSE_IO_AGGREGATION_MAX:
+			return TPOSE_IO_STATS_MINMAX;
+		case TPOSE_IO_AGGREGATION_VAR:
+		case TPOSE_IO_AGGREGATION_STDDEV:
+			return TPOSE_IO_STATS_VARIANCE;
+		case TPOSE_IO_AGGREGATION_DISTINCT:
+			return TPOSE_IO_STATS_DISTINCT;
+		case TPOSE_IO_AGGREGATION_QUANTILE:
+			return TPOSE_IO_STATS_QUANTILE;
+		default:
+			return 0;
+	}
+
+}
+
+
+
+/**
+ ** Names of the aggregation types (indexed by TPOSE_IO_AGGREGATION_*)
+ **/
+static const char* tposeIOAggregateNames[] = {"sum", "count", "avg", "min", "max", "var", "stddev", "distinct"};
+
+
+
+/**
+ ** Reads a comma-separated list of aggregation types (e.g. "sum,count,p95").
+ ** Quantiles are given as pNN (a percentage, e.g. p50 or p99.9) or median
+ ** Returns the number of types, or -1 if one is not known (or there are too many)
+ **/
+int tposeIOParseAggregateTypes(
+	const char* aggregateArg
+	,unsigned int* aggregateTypes
+	,double* aggregateQuantiles
+) {
+
+	char* list = tposeIOLowerCase(strdup(aggregateArg));
+	char* typeSavePtr;
+	char* typetok;
+	char* endPtr;
+	double percentage;
+	unsigned int type;
+	int numTypes = 0;
+
+	for(typetok = strtok_r(list, ",", &typeSavePtr); typetok != NULL; typetok = strtok_r(NULL, ",", &typeSavePtr)) {
+		if(numTypes == TPOSE_IO_MAX_AGGREGATES) {
+			numTypes = -1;
+			break;
+		}
+		aggregateQuantiles[numTypes] = 0;
+
+		for(type = 0; type <= TPOSE_IO_AGGREGATION_DISTINCT; type++) {
+			if(!strcmp(typetok, tposeIOAggregateNames[type]))
+				break;
+		}
+		if(type > TPOSE_IO_AGGREGATION_DISTINCT) {
+			if(!strcmp(typetok, "median"))
+				percentage = 50;
+			else if(typetok[0] != 'p' || !isdigit((unsigned char) typetok[1])
+				|| (percentage = strtod(typetok + 1, &endPtr)) > 100 || *endPtr != '\0') {
+				numTypes = -1;
+				break;
+			}
+			type = TPOSE_IO_AGGREGATION_QUANTILE;
+			aggregateQuantiles[numTypes] = percentage / 100;
+		}
+		aggregateTypes[numTypes++] = type;
+	}
+
+	free(list);
+	return numTypes ? numTypes : -1;
+
+}
+
+
+
+/** 
+ ** Allocates memory for the transpose parameters
+ ** Note: Matches field names
+ **/
+TposeQuery* tposeIOQueryAlloc(
+	TposeInputFile** inputFiles
+	,unsigned int numInputFiles
+	,TposeOutputFile* outputFile
+	,char* idVar
+	,char* groupVar
+	,char* numericVar
+	,char* aggregateType
+) {
+
+	TposeInputFile* inputFile = inputFiles[0]; // All input files share the same header
+	int numAggregateTypes;
+	unsigned int ctr;
+	int numericVars[TPOSE_IO_MAX_NUMERICS];
+	unsigned int numNumericVars = 0;
+	char* numericList;
+	char* numerictok;
+	char* numericSavePtr;
+
+	// Check parameters passed
+	if((idVar != NULL) && (tposeIOGetFieldIndex(inputFile->fileHeader, idVar) == -1)) return NULL;
+	if((groupVar != NULL) && (tposeIOGetFieldIndex(inputFile->fileHeader, groupVar) == -1)) return NULL;
+
+	// NUMERIC fields can be a comma-separated list
+	if(numericVar != NULL) {
+		numericList = strdup(numericVar);
+		for(numerictok = strtok_r(numericList, ",", &numericSavePtr); numerictok != NULL; numerictok = strtok_r(NULL, ",", &numericSavePtr)) {
+			if(numNumericVars == TPOSE_IO_MAX_NUMERICS || (numericVars[numNumericVars++] = tposeIOGetFieldIndex(inputFile->fileHeader, numerictok)) == -1) {
+				free(numericList);
+				return NULL;
+			}
+		}
+		free(numericList);
+		if(numNumericVars == 0)
+			return NULL;
+	}
+
+	TposeQuery* tposeQuery;
+
+	// Allocate memory for the query parameters
+	if((tposeQuery = (TposeQuery*) malloc(sizeof(TposeQuery))) == NULL ) {
+		fprintf(stderr, "Error: Cannot allocate memory for query\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	tposeQuery->inputFile = inputFile;
+	tposeQuery->inputFiles = inputFiles;
+	tposeQuery->numInputFiles = numInputFiles;
+	tposeQuery->outputFile = outputFile;
+	tposeQuery->aggregator = NULL;
+	tposeQuery->id = -1;
+	tposeQuery->group = -1;
+	tposeQuery->numeric = -1;
+	tposeQuery->aggregateStats = 0;
+	tposeQuery->groupHash = NULL;
+	tposeQuery->groupOrder = NULL;
+	tposeQuery->numNumerics = 0;
+	if(idVar != NULL) tposeQuery->id = tposeIOGetFieldIndex(inputFile->fileHeader, idVar);
+	if(groupVar != NULL) tposeQuery->group = tposeIOGetFieldIndex(inputFile->fileHeader, groupVar);
+	for(ctr = 0; ctr < numNumericVars; ctr++)
+		tposeQuery->numerics[tposeQuery->numNumerics++] = numericVars[ctr];
+	if(tposeQuery->numNumerics) tposeQuery->numeric = tposeQuery->numerics[0];
+	if(aggregateType == NULL || (numAggregateTypes = tposeIOParseAggregateTypes(aggregateType, tposeQuery->aggregateTypes, tposeQuery->aggregateQuantiles)) < 1) {
+		tposeQuery->aggregateTypes[0] = TPOSE_IO_AGGREGATION_SUM; // Default (lists are checked by the caller)
+		numAggregateTypes = 1;
+	}
+	tposeQuery->numAggregateTypes = numAggregateTypes;
+	for(ctr = 0; ctr < tposeQuery->numAggregateTypes; ctr++)
+		tposeQuery->aggregateStats |= tposeIOAggregateStats(tposeQuery->aggregateTypes[ctr]);
+	if(decimalsGlobal == TPOSE_IO_DECIMALS_AUTO && tposeQuery->numNumerics)
+		tposeIODetectDecimals(tposeQuery);
+	if(decimalsGlobal >= 0)
+		tposeQuery->aggregateStats |= TPOSE_IO_STATS_FIXED;
+	if(reproducibleGlobal)
+		tposeQuery->aggregateStats |= TPOSE_IO_STATS_EXACT;
+	if(tposeQuery->aggregateStats & (TPOSE_IO_STATS_FIXED | TPOSE_IO_STATS_EXACT))
+		tposeQuery->aggregateStats &= ~TPOSE_IO_STATS_SUM; // Sums and averages come from the exact sums
+	if(float32Global)
+		tposeQuery->aggregateStats |= TPOSE_IO_STATS_FLOAT32;
+
+	debug_print("tposeIOQueryAlloc(): id = %d\n", tposeQuery->id);
+	debug_print("tposeIOQueryAlloc(): group = %d\n", tposeQuery->group);
+	debug_print("tposeIOQueryAlloc(): numeric = %d\n", tposeQuery->numeric);
+	assert(tposeQuery->numAggregateTypes >= 1 && tposeQuery->numAggregateTypes <= TPOSE_IO_MAX_AGGREGATES);
+
+	return tposeQuery;
+	
+}
+
+
+
+/** 
+ ** Allocates memory for the transpose parameters
+ ** Note: Matches field indexes
+ **/
+TposeQuery* tposeIOQueryIndexedAlloc(
+	TposeInputFile** inputFiles
+	,unsigned int numInputFiles
+	,TposeOutputFile* outputFile
+	,int idVar
+	,int groupVar
+	,int* numericVars
+	,unsigned int numNumericVars
+	,char* aggregateType
+) {
+
+	TposeInputFile* inputFile = inputFiles[0]; // All input files share the same header
+	int numAggregateTypes;
+	unsigned int ctr;
+
+	// Correct field indexes so they're zero-based
+	if(idVar != -1) --idVar;
+	if(groupVar != -1) --groupVar;
+
+	int minIndex = 0;
+	int maxIndex;
+	if(!((inputFile->fileHeader)->numFields))
+		maxIndex = (inputFile->fileHeader)->maxFields - 1;
+	else
+		maxIndex = (inputFile->fileHeader)->numFields - 1;
+
+	debug_print("tposeIOQueryIndexedAlloc(): idArg = %d\n", idVar);
+	debug_print("tposeIOQueryIndexedAlloc(): groupArg = %d\n", idVar);
+	debug_print("tposeIOQueryIndexedAlloc(): numericArg = %d\n", idVar);
+
+	// Check parameters passed
+	if( (idVar != -1) && ((idVar < minIndex) || (idVar > maxIndex) )) return NULL;
+	if( (groupVar != -1) && ((groupVar < minIndex) || (groupVar > maxIndex) )) return NULL;
+	if(numNumericVars > TPOSE_IO_MAX_NUMERICS) return NULL;
+	for(ctr = 0; ctr < numNumericVars; ctr++) {
+		if((numericVars[ctr] - 1 < minIndex) || (numericVars[ctr] - 1 > maxIndex)) return NULL;
+	}
+
+	// Allocate memory for the query parameters
+	TposeQuery* tposeQuery;
+	if((tposeQuery = (TposeQuery*) malloc(sizeof(TposeQuery))) == NULL ) {
+		fprintf(stderr, "Error: Cannot allocate memory for query\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	tposeQuery->inputFile = inputFile;
+	tposeQuery->inputFiles = inputFiles;
+	tposeQuery->numInputFiles = numInputFiles;
+	tposeQuery->outputFile = outputFile;
+	tposeQuery->aggregator = NULL;
+	tposeQuery->id = -1;
+	tposeQuery->group = -1;
+	tposeQuery->numeric = -1;
+	tposeQuery->aggregateStats = 0;
+	tposeQuery->groupHash = NULL;
+	tposeQuery->groupOrder = NULL;
+	tposeQuery->numNumerics = 0;
+	if(idVar != -1) tposeQuery->id = idVar;
+	if(groupVar != -1) tposeQuery->group = groupVar;
+	for(ctr = 0; ctr < numNumericVars; ctr++)
+		tposeQuery->numerics[tposeQuery->numNumerics++] = numericVars[ctr] - 1;
+	if(tposeQuery->numNumerics) tposeQuery->numeric = tposeQuery->numerics[0];
+	if(aggregateType == NULL || (numAggregateTypes = tposeIOParseAggregateTypes(aggregateType, tposeQuery->aggregateTypes, tposeQuery->aggregateQuantiles)) < 1) {
+		tposeQuery->aggregateTypes[0] = TPOSE_IO_AGGREGATION_SUM; // Default (lists are checked by the caller)
+		numAggregateTypes = 1;
+	}
+	tposeQuery->numAggregateTypes = numAggregateTypes;
+	for(ctr = 0; ctr < tposeQuery->numAggregateTypes; ctr++)
+		tposeQuery->aggregateStats |= tposeIOAggregateStats(tposeQuery->aggregateTypes[ctr]);
+	if(decimalsGlobal == TPOSE_IO_DECIMALS_AUTO && tposeQuery->numNumerics)
+		tposeIODetectDecimals(tposeQuery);
+	if(decimalsGlobal >= 0)
+		tposeQuery->aggregateStats |= TPOSE_IO_STATS_FIXED;
+	if(reproducibleGlobal)
+		tposeQuery->aggregateStats |= TPOSE_IO_STATS_EXACT;
+	if(tposeQuery->aggregateStats & (TPOSE_IO_STATS_FIXED | TPOSE_IO_STATS_EXACT))
+		tposeQuery->aggregateStats &= ~TPOSE_IO_STATS_SUM; // Sums and averages come from the exact sums
+	if(float32Global)
+		tposeQuery->aggregateStats |= TPOSE_IO_STATS_FLOAT32;
+	assert(tposeQuery->numAggregateTypes >= 1 && tposeQuery->numAggregateTypes <= TPOSE_IO_MAX_AGGREGATES);
+
+	return tposeQuery;
+	
+}
+
+
+
+/** 
+ ** Free memory for a TposeQuery 
+ **/
+void tposeIOQueryFree(
+    TposeQuery** tposeQueryPtr
+) {
+
+	if((*tposeQueryPtr)->aggregator != NULL) tposeIOAggregatorFree( &((*tposeQueryPtr)->aggregator) );
+	tposePerfectHashFree(&((*tposeQueryPtr)->groupHash));
+	free((*tposeQueryPtr)->groupOrder);
+    
+	// No need to free the inputFile/outputFile,
+	// as this is done in the tposeIOCloseFile() call
+   if(*tposeQueryPtr != NULL) { 
+       free(*tposeQueryPtr);
+       *tposeQueryPtr = NULL;
+   }
+
+   assert(*tposeQueryPtr == NULL);
+
+}
+
+
+
+/** 
+ ** Open input file
+ **/
+TposeInputFile* tposeIOOpenInputFile(
+	char* filePath
+	,unsigned char fieldDelimiter
+	,unsigned int mutateHeader
+) {
+
+	int fd;
+	char* fileAddr;
+	char* inflateAddr;
+	off_t fileSize;
+	off_t mapSize;
+	unsigned int compression;
+	struct stat statBuffer;
+
+	if((fd = open(filePath, O_RDONLY)) < 0) {
+		fprintf(stderr, "Error: Can not open input file %s\n", filePath);
+		return NULL;
+	}
+
+	if(fstat(fd, &statBuffer) < 0) {
+		fprintf(stderr, "Error: Can not stat input file %s\n", filePath);
+		return NULL;
+	}
+
+	if((fileSize = statBuffer.st_size) == 0) {
+		fprintf(stderr, "Error: No data found in input file %s\n", filePath);
+		return NULL;
+	}
+	
+
+	if((fileAddr = mmap(0, statBuffer.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)) == MAP_FAILED ) {
+		fprintf(stderr, "Error: Can not map input file %s\n", filePath);
+		return NULL;
+	}
+
+	// Might speed-up via aggressive read-ahead caching
+	if(madvise(fileAddr, fileSize, MADV_SEQUENTIAL) == -1) {
+		fprintf(stderr, "Warning: Cannot advise kernel on file %s\n", filePath);
+	}
+
+	// Compressed input is decompressed into memory, and scanned as if mapped from disk
+	mapSize = fileSize;
+	if((compression = tposeCompressDetect(fileAddr, fileSize)) != TPOSE_COMPRESS_NONE) {
+
+		if((inflateAddr = tposeCompressInflate(compression, fileAddr, fileSize, &fileSize, &mapSize)) == NULL) {
+			fprintf(stderr, "Error: Can not decompress %s input file %s\n", tposeCompressName(compression), filePath);
+			return NULL;
+		}
+
+		munmap(fileAddr, statBuffer.st_size);
+		fileAddr = inflateAddr;
+
+		if(fileSize == 0) {
+			fprintf(stderr, "Error: No data found in input file %s\n", filePath);
+			return NULL;
+		}
+	}
+
+	TposeInputFile* inputFile = tposeIOInputFileAlloc(fd, fileAddr, fileSize, fieldDelimiter); // Creates the file handle 
+	inputFile->mapSize = mapSize;
+	inputFile->compression = compression;
+	inputFile->filePath = strdup(filePath);
+	inputFile->fileStat = statBuffer;
+
+	// Columnar caches (see --convert option) are read in place
+	if(tposeColumnarDetect(fileAddr, fileSize)) {
+		if(tposeColumnarOpen(inputFile) == -1)
+			return NULL;
+		inputFile->fieldDelimiter = ((inputFile->columnar)->header)->delimiter;
+	}
+
+	inputFile->fileHeader = tposeIOReadInputHeader(inputFile, mutateHeader); // Opening a file also creates the TposeHeader struct
+
+	return inputFile;
+
+}
+
+
+
+/**
+ ** Maps any data appended to an input file since it was opened (see --follow option)
+ ** Returns 1 if the file has grown, 0 if not, -1 if it can not be remapped
+ **/
+int tposeIORemapInputFile(
+	TposeInputFile* inputFile
+) {
+
+	char* fileAddr;
+	off_t dataOffset = inputFile->dataAddr - inputFile->fileAddr;
+	struct stat statBuffer;
+
+	if(inputFile->compression != TPOSE_COMPRESS_NONE || inputFile->columnar != NULL) {
+		fprintf(stderr, "Error: Can not follow compressed or columnar input file %s\n", inputFile->filePath);
+		return -1;
+	}
+
+	if(fstat(inputFile->fd, &statBuffer) < 0) {
+		fprintf(stderr, "Error: Can not stat input file %s\n", inputFile->filePath);
+		return -1;
+	}
+
+	if(statBuffer.st_size < inputFile->fileSize) {
+		fprintf(stderr, "Error: Input file %s has been truncated\n", inputFile->filePath);
+		return -1;
+	}
+
+	if(statBuffer.st_size == inputFile->fileSize)
+		return 0;
+
+	if((fileAddr = mmap(0, statBuffer.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, inputFile->fd, 0)) == MAP_FAILED) {
+		fprintf(stderr, "Error: Can not map input file %s\n", inputFile->filePath);
+		return -1;
+	}
+	munmap(inputFile->fileAddr, inputFile->mapSize);
+
+	inputFile->fileAddr = fileAddr;
+	inputFile->fileSize = statBuffer.st_size;
+	inputFile->mapSize = statBuffer.st_size;
+	inputFile->fileStat = statBuffer;
+
+	// The header row was already read, so data starts at the same offset
+	inputFile->dataAddr = fileAddr + dataOffset;
+	inputFile->dataSize = inputFile->fileSize - dataOffset;
+
+	return 1;
+
+}
+
+
+
+/** 
+ ** Close an input file and unmap any memory
+ **/
+int tposeIOCloseInputFile(
+	TposeInputFile* inputFile
+) {
+
+	tposeColumnarClose(inputFile); // Before unmapping (the columnar header is in the mapping)
+
+   if((munmap(inputFile->fileAddr, inputFile->mapSize)) < 0) {
+       fprintf(stderr, "Error: can not unmap input file\n");
+       return -1;
+   }
+
+	if(inputFile->index != NULL) {
+		munmap((inputFile->index)->mapAddr, (inputFile->index)->mapSize);
+		free(inputFile->index);
+	}
+
+   if(close(inputFile->fd) < 0) {
+       fprintf(stderr, "Error: can not close input file\n");
+       return -1;
+   }
+
+	tposeIOInputFileFree(&inputFile);
+
+	return 0;
+
+}
+
+
+
+/** 
+ ** Open output file
+ **/
+TposeOutputFile* tposeIOOpenOutputFile(
+	char* filePath
+	,const char* mode
+	,unsigned char fieldDelimiter
+) {
+
+	FILE* fd;
+	if(strcmp(filePath, "stdout")) {
+		if((fd = fopen(filePath, mode)) == NULL) {
+			fprintf(stderr, "Error: Can not open output file %s\n", filePath);
+			return NULL;
+		}
+	}
+	else
+		fd = stdout; // If no output file is passed, print to std output
+
+	return tposeIOOutputFileAlloc(fd, fieldDelimiter); // Creates the file handle 
+
+}
+
+
+
+/** 
+ ** Close an output file
+ **/
+int tposeIOCloseOutputFile(
+	TposeOutputFile* outputFile
+) {
+	
+	// Close if not standard output
+	if(outputFile->fd != stdout) {  
+		if(ferror(outputFile->fd))
+			fprintf(stderr, "Error: Output file closed with errors - check data (Error number = %d - %s)\n", errno, strerror(errno));
+		fclose(outputFile->fd);
+	}
+
+	// Free TposeOutputFile memory
+	tposeIOOutputFileFree(&outputFile);
+
+	return 0;
+
+}
+
+
+
+/**
+ ** Reads the first line (header) of an input file
+ ** tpose only accepts data files with column headers on first line
+ **/
+TposeHeader* tposeIOReadInputHeader(
+	TposeInputFile* inputFile
+	,unsigned int mutateHeader
+) {
+
+	char* rowtok;
+	char* fieldtok;
+	char* fieldSavePtr;
+
+	char* tempString;
+	char fieldDelimiters[2]; // strtok_r expects a NULL-terminated set of delimiters
+
+	unsigned int fieldCount = 0;
+	off_t length = 0;
+	char* headerAddr;
+	off_t headerSize;
+
+	// Test if we have a good TposeInputFile*
 	if(!inputFile) return NULL;
 
-	// Count number of fields
-	while( *(inputFile->fileAddr+length) != rowDelimiter) {
-		if( *(inputFile->fileAddr+length) == (inputFile->fieldDelimiter))
-			fieldCount++; length++;
+	fieldDelimiters[0] = inputFile->fieldDelimiter;
+	fieldDelimiters[1] = '\0';
+
+	// Columnar files keep the header row of their source file
+	if(inputFile->columnar != NULL) {
+		headerAddr = inputFile->fileAddr + ((inputFile->columnar)->header)->headerOffset;
+		headerSize = ((inputFile->columnar)->header)->headerLength;
+	}
+	else {
+		headerAddr = inputFile->fileAddr;
+		headerSize = inputFile->fileSize;
+	}
+
+	// Count number of fields
+	while(length < headerSize && *(headerAddr+length) != rowDelimiter) {
+		if( *(headerAddr+length) == (inputFile->fieldDelimiter))
+			fieldCount++; length++;
+	}
+
+	if(fieldCount > 0)
+		fieldCount++; // Quick hack to get real number of fields
+
+	if(inputFile->columnar != NULL) {
+		// Rows are addressed by number (see tposeColumnarReadRow)
+		inputFile->dataAddr = inputFile->fileAddr;
+		inputFile->dataSize = ((inputFile->columnar)->header)->numRows;
+	}
+	else {
+		// Data starts on the line after the header
+		inputFile->dataAddr = inputFile->fileAddr + length;
+		if(length < inputFile->fileSize)
+			inputFile->dataAddr+=1; // Make sure we're not pointing at the row delimiter
+		inputFile->dataSize = inputFile->fileSize - (inputFile->dataAddr - inputFile->fileAddr);
+	}
+
+	TposeHeader* header = tposeIOHeaderAlloc(fieldCount, mutateHeader); // Allocate the needed memory
+
+	if(mutateHeader) {
+
+		// Create a NULL terminated copy of the header row (as strsep/strtok_r modifies this)
+		rowtok = strndup(headerAddr, length);
+
+		// Read header fields
+		fieldtok = strtok_r(rowtok, fieldDelimiters, &fieldSavePtr);
+		if(fieldtok == NULL) return NULL;
+		tempString = tposeArenaStrndup(header->arena, fieldtok, strlen(fieldtok));
+		*(header->fields) = tposeIOLowerCase(tempString);
+		for(fieldCount = 1; (fieldtok = strtok_r(NULL, fieldDelimiters, &fieldSavePtr)) != NULL; ) {
+			tempString = tposeArenaStrndup(header->arena, fieldtok, strlen(fieldtok));
+			*(header->fields+(fieldCount++)) = tposeIOLowerCase(tempString);
+		}
+
+		// Clean-up
+		free(rowtok);
+	}
+
+	return header;
+
+}
+
+
+
+/**
+ ** Checks that two input files have the same header row (ignoring case)
+ ** Returns 0 if they match, -1 otherwise
+ **/
+int tposeIOCompareInputHeaders(
+	TposeInputFile* inputFile
+	,TposeInputFile* otherInputFile
+) {
+
+	off_t headerLength = inputFile->dataAddr - inputFile->fileAddr;
+
+	if(headerLength != (otherInputFile->dataAddr - otherInputFile->fileAddr))
+		return -1;
+
+	if(strncasecmp(inputFile->fileAddr, otherInputFile->fileAddr, headerLength))
+		return -1;
+
+	return 0;
+
+}
+
+
+
+/**
+ ** Multiplies two 64-bit values, folding the 128-bit product into 64 bits
+ **/
+static inline uint64_t tposeIOHashMultiply(
+	uint64_t first
+	,uint64_t second
+) {
+
+	__uint128_t product = (__uint128_t) first * second;
+
+	return (uint64_t) product ^ (uint64_t) (product >> 64);
+
+}
+
+
+
+/**
+ ** Adds 8 bytes of a field value to its hash (the last bytes are zero-padded)
+ **/
+static inline uint64_t tposeIOHashWord(
+	uint64_t hashValue
+	,uint64_t word
+) {
+
+	return tposeIOHashMultiply(word ^ TPOSE_IO_HASH_SECRET0, hashValue ^ TPOSE_IO_HASH_SECRET1);
+
+}
+
+
+
+/**
+ ** Finishes the hash of a field value (the length tells zero padding from zero bytes)
+ **/
+static inline off_t tposeIOHashFinal(
+	uint64_t hashValue
+	,unsigned int length
+) {
+
+	return (off_t) tposeIOHashMultiply(hashValue ^ TPOSE_IO_HASH_SECRET2, length ^ TPOSE_IO_HASH_SECRET1);
+
+}
+
+
+
+/**
+ ** Returns the hash of a field value (used as btree key)
+ ** Values are hashed 8 bytes at a time, with one 64x64-bit multiply per word
+ ** (see tposeIOScanField, which must give the same hash)
+ **/
+off_t tposeIOHash(
+	const char* field
+	,unsigned int length
+) {
+
+	uint64_t hashValue = 0;
+	uint64_t word;
+	unsigned int remaining;
+
+	for(remaining = length; remaining >= 8; remaining -= 8, field += 8) {
+		memcpy(&word, field, 8);
+		hashValue = tposeIOHashWord(hashValue, word);
+	}
+	if(remaining) {
+		word = 0;
+		memcpy(&word, field, remaining);
+		hashValue = tposeIOHashWord(hashValue, word);
+	}
+
+	return tposeIOHashFinal(hashValue, length);
+
+}
+
+
+
+/**
+ ** Finds the end of the field starting at fieldPtr, hashing it on the way
+ ** (same hash as tposeIOHash). Reads 8 bytes at a time, looking for the
+ ** delimiters in all of them at once, so each byte is only loaded once
+ ** Returns a pointer to the delimiter (or endPtr) ending the field
+ **/
+static char* tposeIOScanField(
+	char* fieldPtr
+	,char* endPtr
+	,unsigned char fieldDelimiter
+	,off_t* hash
+) {
+
+	char* scanPtr = fieldPtr;
+	char* tailPtr;
+	uint64_t hashValue = 0;
+	uint64_t word;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	const uint64_t ones = 0x0101010101010101ULL;
+	const uint64_t highs = 0x8080808080808080ULL;
+	uint64_t fieldDelimiters = ones * fieldDelimiter;
+	uint64_t rowDelimiters = ones * rowDelimiter;
+	uint64_t fieldMatches;
+	uint64_t rowMatches;
+	unsigned int length;
+
+	while(endPtr - scanPtr >= 8) {
+		memcpy(&word, scanPtr, 8);
+
+		// High bit of the first byte equal to a delimiter is set (later ones may be wrong)
+		fieldMatches = word ^ fieldDelimiters;
+		rowMatches = word ^ rowDelimiters;
+		fieldMatches = ((fieldMatches - ones) & ~fieldMatches) | ((rowMatches - ones) & ~rowMatches);
+		if((fieldMatches &= highs) != 0) {
+			length = __builtin_ctzll(fieldMatches) >> 3;
+			scanPtr += length;
+			if(length)
+				hashValue = tposeIOHashWord(hashValue, word & ((1ULL << (length * 8)) - 1));
+			*hash = tposeIOHashFinal(hashValue, scanPtr - fieldPtr);
+			return scanPtr;
+		}
+
+		hashValue = tposeIOHashWord(hashValue, word);
+		scanPtr += 8;
+	}
+#endif
+
+	// Last bytes (fewer than 8 are left in the input on little-endian machines)
+	tailPtr = scanPtr;
+	while(scanPtr < endPtr && *scanPtr != fieldDelimiter && *scanPtr != rowDelimiter)
+		++scanPtr;
+	for(; scanPtr - tailPtr >= 8; tailPtr += 8) {
+		memcpy(&word, tailPtr, 8);
+		hashValue = tposeIOHashWord(hashValue, word);
+	}
+	if(scanPtr > tailPtr) {
+		word = 0;
+		memcpy(&word, tailPtr, scanPtr - tailPtr);
+		hashValue = tposeIOHashWord(hashValue, word);
+	}
+	*hash = tposeIOHashFinal(hashValue, scanPtr - fieldPtr);
+
+	return scanPtr;
+
+}
+
+
+
+/**
+ ** Converts a numeric field value (not NULL-terminated) to a double
+ **/
+double tposeIOParseNumeric(
+	const char* field
+	,unsigned int length
+) {
+
+	char numericTempString[TPOSE_IO_MAX_NUMERIC_WIDTH];
+
+	if(length >= TPOSE_IO_MAX_NUMERIC_WIDTH)
+		length = TPOSE_IO_MAX_NUMERIC_WIDTH - 1;
+
+	memcpy(numericTempString, field, length);
+	numericTempString[length] = '\0'; // Null-terminate string
+
+	return atof(numericTempString);
+
+}
+
+
+
+/**
+ ** Converts a numeric field value (not NULL-terminated) to units of 10^-decimals,
+ ** reading the digits straight into an integer (further decimals are rounded half
+ ** away from zero). Other forms (e.g. 1e6) are converted through a double
+ **/
+int64_t tposeIOParseFixed(
+	const char* field
+	,unsigned int length
+	,unsigned int decimals
+) {
+
+	const char* fieldPtr = field;
+	const char* endPtr = field + length;
+	uint64_t units = 0;
+	unsigned int numDecimals = 0;
+	unsigned int numDigits = 0;
+	unsigned int negative = 0;
+	unsigned int point = 0;
+	unsigned int roundUp = 0;
+	double value;
+
+	if(fieldPtr < endPtr && (*fieldPtr == '-' || *fieldPtr == '+'))
+		negative = *(fieldPtr++) == '-';
+
+	for(; fieldPtr < endPtr; ++fieldPtr) {
+		if((unsigned char) (*fieldPtr - '0') <= 9) {
+			if(!point || numDecimals < decimals) {
+				if(units > (uint64_t) INT64_MAX / 10 - 1)
+					goto convert;
+				units = units * 10 + (*fieldPtr - '0');
+				numDecimals += point;
+			}
+			else if(numDecimals++ == decimals) {
+				roundUp = *fieldPtr >= '5';
+			}
+			++numDigits;
+		}
+		else if(*fieldPtr == '.' && !point) {
+			point = 1;
+		}
+		else {
+			goto convert;
+		}
+	}
+	if(numDigits == 0)
+		goto convert;
+
+	for(; numDecimals < decimals; ++numDecimals) {
+		if(units > (uint64_t) INT64_MAX / 10 - 1)
+			goto convert;
+		units *= 10;
+	}
+	units += roundUp;
+
+	return negative ? -(int64_t) units : (int64_t) units;
+
+convert:
+	value = tposeIOParseNumeric(field, length) * tposeIOFixedScales[decimals];
+	if(!(fabs(value) < 9e18)) {
+		fprintf(stderr, "Error: NUMERIC value %.*s is too large for --decimals=%u\n", (int) length, field, decimals);
+		exit(EXIT_FAILURE);
+	}
+	return llround(value);
+
+}
+
+
+
+/**
+ ** Returns the hash of the GROUP value of a row
+ **/
+off_t tposeIORowGroupHash(
+	TposeRow* row
+) {
+
+	if(row->groupHashed)
+		return row->groupHash;
+
+	return tposeIOHash(row->group, row->groupLength);
+
+}
+
+
+
+/**
+ ** Returns a NUMERIC value of a row (numericCtr is its position in --numeric)
+ **/
+double tposeIORowNumeric(
+	TposeRow* row
+	,unsigned int numericCtr
+) {
+
+	if(row->numericsParsed & (1u << numericCtr))
+		return row->numericValues[numericCtr];
+
+	return tposeIOParseNumeric(row->numerics[numericCtr], row->numericLengths[numericCtr]);
+
+}
+
+
+
+/**
+ ** Returns a NUMERIC value of a row in units of 10^-decimals (see tposeIOParseFixed)
+ **/
+int64_t tposeIORowFixed(
+	TposeRow* row
+	,unsigned int numericCtr
+	,unsigned int decimals
+) {
+
+	if(row->numericsParsed & (1u << numericCtr))
+		return llround(row->numericValues[numericCtr] * tposeIOFixedScales[decimals]);
+
+	return tposeIOParseFixed(row->numerics[numericCtr], row->numericLengths[numericCtr], decimals);
+
+}
+
+
+
+/**
+ ** Sets --decimals=auto to the most digits after the decimal point found in the
+ ** NUMERIC values of the first TPOSE_IO_DECIMALS_SAMPLE rows. Exact sums are turned
+ ** off if one of them is not a plain decimal number (e.g. 1e6), or if there are none
+ **/
+void tposeIODetectDecimals(
+	TposeQuery* tposeQuery
+) {
+
+	TposeInputFile* inputFile = tposeQuery->inputFile;
+	char* rowPtr = inputFile->dataAddr;
+	char* endPtr = inputFile->dataAddr + inputFile->dataSize;
+	const char* fieldPtr;
+	const char* fieldEndPtr;
+	const char* pointPtr;
+	TposeRow row;
+	unsigned int numRows;
+	unsigned int numValues = 0;
+	unsigned int numericCtr;
+	int decimals = 0;
+
+	row.indexRow = -1;
+
+	for(numRows = 0; numRows < TPOSE_IO_DECIMALS_SAMPLE && rowPtr < endPtr; ++numRows) {
+		rowPtr = tposeIOReadRow(tposeQuery, inputFile, rowPtr, endPtr, &row);
+		for(numericCtr = 0; numericCtr < tposeQuery->numNumerics; numericCtr++) {
+			if(row.numerics[numericCtr] == NULL || (row.numericsParsed & (1u << numericCtr)))
+				continue;
+
+			fieldPtr = row.numerics[numericCtr];
+			fieldEndPtr = fieldPtr + row.numericLengths[numericCtr];
+			pointPtr = NULL;
+			if(*fieldPtr == '-' || *fieldPtr == '+')
+				++fieldPtr;
+			for(; fieldPtr < fieldEndPtr && (isdigit((unsigned char) *fieldPtr) || (*fieldPtr == '.' && pointPtr == NULL)); ++fieldPtr) {
+				if(*fieldPtr == '.')
+					pointPtr = fieldPtr;
+			}
+			if(fieldPtr < fieldEndPtr) {
+				decimalsGlobal = TPOSE_IO_DECIMALS_OFF;
+				return;
+			}
+			if(pointPtr != NULL && fieldEndPtr - pointPtr - 1 > decimals)
+				decimals = fieldEndPtr - pointPtr - 1;
+			++numValues;
+		}
+	}
+
+	decimalsGlobal = (numValues && decimals <= TPOSE_IO_MAX_DECIMALS) ? decimals : TPOSE_IO_DECIMALS_OFF;
+
+}
+
+
+
+/**
+ ** Clears the fields of a row before it is read
+ **/
+void tposeIORowReset(
+	TposeQuery* tposeQuery
+	,TposeRow* row
+) {
+
+	unsigned int numericCtr;
+
+	row->id = NULL;
+	row->group = NULL;
+	row->idLength = 0;
+	row->groupLength = 0;
+	row->groupHashed = 0;
+	row->numNumerics = 0;
+	row->numericsParsed = 0;
+	for(numericCtr = 0; numericCtr < tposeQuery->numNumerics; numericCtr++) {
+		row->numerics[numericCtr] = NULL;
+		row->numericLengths[numericCtr] = 0;
+	}
+
+}
+
+
+
+/**
+ ** Empties a hot GROUP cache
+ **/
+void tposeIOGroupCacheReset(
+	TposeGroupCache* cache
+) {
+
+	unsigned int ctr;
+
+	for(ctr = 0; ctr < (1u << TPOSE_IO_GROUP_CACHE_BITS); ctr++)
+		cache->entries[ctr].group = TPOSE_IO_GROUP_CACHE_EMPTY;
+
+}
+
+
+
+/**
+ ** Returns the entry of a hot GROUP cache a hash is kept in
+ ** (the hash is mixed first, as similar GROUP values have close hashes)
+ **/
+static unsigned int tposeIOGroupCacheSlot(
+	off_t hash
+) {
+
+	return (unsigned int) (((uint64_t) hash * 0x9E3779B97F4A7C15ULL) >> (64 - TPOSE_IO_GROUP_CACHE_BITS));
+
+}
+
+
+
+/**
+ ** Returns the group index of a GROUP hash, from the hot cache or else from the
+ ** btree (which must not change while the cache is used)
+ ** Returns TPOSE_IO_GROUP_CACHE_EMPTY if the hash is not in the btree
+ **/
+unsigned int tposeIOGroupCacheFind(
+	TposeGroupCache* cache
+	,BTree* btree
+	,off_t hash
+) {
+
+	unsigned int slot = tposeIOGroupCacheSlot(hash);
+	BTreeKey* resultKey;
+
+	if(cache->entries[slot].group != TPOSE_IO_GROUP_CACHE_EMPTY && cache->entries[slot].hash == hash)
+		return cache->entries[slot].group;
+
+	if((resultKey = (BTreeKey*) btreeSearch(btree, btree->root, hash)) == NULL)
+		return TPOSE_IO_GROUP_CACHE_EMPTY;
+
+	cache->entries[slot].hash = hash;
+	cache->entries[slot].group = resultKey->dataOffset;
+
+	return resultKey->dataOffset;
+
+}
+
+
+
+/**
+ ** Builds the perfect hash of the GROUP values in the btree (once
+ ** tposeIOUniqueGroups has found them all), so the aggregation pass finds
+ ** each group with one hash and one compare instead of a btree search
+ ** Leaves tposeQuery->groupHash NULL if it cannot be built (the btree is used)
+ **/
+void tposeIOGroupHashBuild(
+	TposeQuery* tposeQuery
+	,BTree* btree
+) {
+
+	BTreeIterator iterator;
+	BTreeKey* key;
+	off_t* keys;
+	unsigned int* values;
+	unsigned int numKeys = 0;
+
+	tposePerfectHashFree(&(tposeQuery->groupHash));
+
+	if((keys = (off_t*) malloc((btree->numKeys + 1) * sizeof(off_t))) == NULL
+		|| (values = (unsigned int*) malloc((btree->numKeys + 1) * sizeof(unsigned int))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate memory for GROUP hash\n");
+		exit(EXIT_FAILURE);
 	}
-	
-	if(fieldCount > 0)
-		fieldCount++; // Quick hack to get real number of fields
 
-	TposeHeader* header = tposeIOHeaderAlloc(fieldCount, mutateHeader); // Allocate the needed memory
+	btreeIteratorStart(btree, &iterator);
+	while((key = btreeIteratorNext(&iterator)) != NULL) {
+		keys[numKeys] = key->keyValue;
+		values[numKeys++] = key->dataOffset;
+	}
 
-	if(mutateHeader) {
-		// Find index of first row delimiter
-		inputFile->dataAddr = strchr(inputFile->fileAddr, rowDelimiter);
-		*inputFile->dataAddr = '\0';
-		inputFile->dataAddr+=1; // Make sure we're not pointing at the NULL 
-
-		// Create a copy of the NULL terminated string (as strsep/strtok_r modifies this)
-		rowtok = strdup(inputFile->fileAddr);
-		
-		// Read header fields
-		fieldtok = strtok_r(rowtok, &(inputFile->fieldDelimiter), &fieldSavePtr);
-		if(fieldtok == NULL) return NULL;
-		tempString = malloc(strlen(fieldtok) * sizeof(char));
-		strcpy(tempString, fieldtok);
-		*(header->fields) = tposeIOLowerCase(tempString);
-		for(fieldCount = 1; (fieldtok = strtok_r(NULL, &(inputFile->fieldDelimiter), &fieldSavePtr)) != NULL; ) {
-			tempString = malloc(strlen(fieldtok) * sizeof(char));
-			strcpy(tempString, fieldtok);
-			*(header->fields+(fieldCount++)) = tposeIOLowerCase(tempString);
+	tposeQuery->groupHash = tposePerfectHashBuild(keys, values, numKeys);
+
+	free(keys);
+	free(values);
+
+}
+
+
+
+/**
+ ** Orders group indexes by GROUP value, for qsort() (see tposeIOGroupOrderBuild)
+ **/
+static char** tposeIOGroupOrderFields;
+
+static int tposeIOCompareGroups(
+	const void* first
+	,const void* second
+) {
+
+	return strcmp(tposeIOGroupOrderFields[*(const unsigned int*) first], tposeIOGroupOrderFields[*(const unsigned int*) second]);
+
+}
+
+
+
+/**
+ ** Works out the order GROUP columns are printed in: sorted by value (byte order)
+ ** with --sort-groups, or else the order the values were found in (groupOrder NULL)
+ ** Must be called once all groups are known, before output is printed
+ **/
+void tposeIOGroupOrderBuild(
+	TposeQuery* tposeQuery
+) {
+
+	TposeHeader* header = (tposeQuery->outputFile)->fileGroupHeader;
+	unsigned int groupCtr;
+
+	free(tposeQuery->groupOrder);
+	tposeQuery->groupOrder = NULL;
+
+	if(!sortGroupsGlobal || header == NULL)
+		return;
+
+	if((tposeQuery->groupOrder = (unsigned int*) malloc((header->numFields + 1) * sizeof(unsigned int))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate memory for GROUP order\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for(groupCtr = 0; groupCtr < header->numFields; groupCtr++)
+		tposeQuery->groupOrder[groupCtr] = groupCtr;
+
+	tposeIOGroupOrderFields = header->fields;
+	qsort(tposeQuery->groupOrder, header->numFields, sizeof(unsigned int), tposeIOCompareGroups);
+
+}
+
+
+
+/**
+ ** Returns the group index of a GROUP hash, from the hot cache or else from the
+ ** perfect hash if it was built (the btree otherwise)
+ ** Returns TPOSE_IO_GROUP_CACHE_EMPTY if the hash is not a known GROUP value
+ **/
+unsigned int tposeIOGroupFind(
+	TposeQuery* tposeQuery
+	,TposeGroupCache* cache
+	,BTree* btree
+	,off_t hash
+) {
+
+	unsigned int slot;
+	unsigned int group;
+
+	if(tposeQuery->groupHash == NULL)
+		return tposeIOGroupCacheFind(cache, btree, hash);
+
+	slot = tposeIOGroupCacheSlot(hash);
+	if(cache->entries[slot].group != TPOSE_IO_GROUP_CACHE_EMPTY && cache->entries[slot].hash == hash)
+		return cache->entries[slot].group;
+
+	if((group = tposePerfectHashFind(tposeQuery->groupHash, hash)) == TPOSE_PHASH_EMPTY)
+		return TPOSE_IO_GROUP_CACHE_EMPTY;
+
+	cache->entries[slot].hash = hash;
+	cache->entries[slot].group = group;
+
+	return group;
+
+}
+
+
+
+/**
+ ** Reads the ID, GROUP and NUMERIC fields of the row starting at rowPtr
+ ** Fields are returned as views into the input (NULL if missing or empty)
+ ** Returns a pointer to the start of the next row
+ **/
+char* tposeIOReadRow(
+	TposeQuery* tposeQuery
+	,TposeInputFile* inputFile
+	,char* rowPtr
+	,char* endPtr
+	,TposeRow* row
+) {
+
+	unsigned char fieldDelimiter = inputFile->fieldDelimiter;
+	int lastField = tposeQuery->id;
+	int fieldCount = 0;
+	unsigned int numericCtr;
+	char* fieldPtr;
+	char* nextRowPtr;
+	off_t groupHash;
+
+	// Columnar files store fields by column (see --convert)
+	if(inputFile->columnar != NULL)
+		return tposeColumnarReadRow(tposeQuery, inputFile, rowPtr, endPtr, row);
+
+	// Fields can be read straight from the row index (see --build-index)
+	if(inputFile->index != NULL && (inputFile->index)->fieldsIndexed
+		&& (nextRowPtr = tposeIOReadRowIndexed(tposeQuery, inputFile, rowPtr, endPtr, row)) != NULL)
+		return nextRowPtr;
+
+	if(tposeQuery->group > lastField) lastField = tposeQuery->group;
+	for(numericCtr = 0; numericCtr < tposeQuery->numNumerics; numericCtr++) {
+		if(tposeQuery->numerics[numericCtr] > lastField) lastField = tposeQuery->numerics[numericCtr];
+	}
+
+	tposeIORowReset(tposeQuery, row);
+
+	while(rowPtr < endPtr) {
+
+		// Skip the rest of the row once all fields of interest are read
+		if(fieldCount > lastField) {
+			if((rowPtr = memchr(rowPtr, rowDelimiter, endPtr - rowPtr)) == NULL)
+				return endPtr;
+			return rowPtr + 1;
 		}
-		
-		// Clean-up
-		free(rowtok);
+
+		// The GROUP field is hashed as it is scanned
+		fieldPtr = rowPtr;
+		if(fieldCount == tposeQuery->group) {
+			rowPtr = tposeIOScanField(rowPtr, endPtr, fieldDelimiter, &groupHash);
+		}
+		else {
+			while(rowPtr < endPtr && *rowPtr != fieldDelimiter && *rowPtr != rowDelimiter)
+				++rowPtr;
+		}
+
+		// Empty fields are ignored
+		if(rowPtr > fieldPtr) {
+			if(fieldCount == tposeQuery->group) {
+				row->group = fieldPtr;
+				row->groupLength = rowPtr - fieldPtr;
+				row->groupHash = groupHash;
+				row->groupHashed = 1;
+			}
+			for(numericCtr = 0; numericCtr < tposeQuery->numNumerics; numericCtr++) {
+				if(fieldCount == tposeQuery->numerics[numericCtr]) {
+					row->numerics[numericCtr] = fieldPtr;
+					row->numericLengths[numericCtr] = rowPtr - fieldPtr;
+					row->numNumerics++;
+				}
+			}
+			if(fieldCount == tposeQuery->id) {
+				row->id = fieldPtr;
+				row->idLength = rowPtr - fieldPtr;
+			}
+		}
+
+		// FIELD DELIMITER / ROW DELIMITER
+		if(rowPtr == endPtr || *(rowPtr++) == rowDelimiter)
+			break;
+
+		++fieldCount;
 	}
 
-	return header;
+	return rowPtr;
 
 }
 
 
 
-/** 
- ** Returns a unique list of GROUP variable values 
+/**
+ ** Reads the ID, GROUP and NUMERIC fields of the row starting at rowPtr
+ ** using the field offsets stored in the row index
+ ** Returns a pointer to the start of the next row (NULL if not indexed)
+ **/
+char* tposeIOReadRowIndexed(
+	TposeQuery* tposeQuery
+	,TposeInputFile* inputFile
+	,char* rowPtr
+	,char* endPtr
+	,TposeRow* row
+) {
+
+	TposeIndex* index = inputFile->index;
+	unsigned char fieldDelimiter = inputFile->fieldDelimiter;
+	off_t rowOffset = rowPtr - inputFile->dataAddr;
+	off_t indexRow = row->indexRow + 1;
+	uint32_t* fieldOffsets;
+	char* nextRowPtr;
+	char* fieldPtr;
+	char* fieldEnd;
+	char** fieldValue;
+	unsigned int* fieldLength;
+	int slots[2 + TPOSE_IO_MAX_NUMERICS];
+	int numSlots = 2 + tposeQuery->numNumerics;
+	int slotCtr;
+
+	// Rows are usually read in order, so try the record after the last one first
+	if(indexRow >= index->numRows || *((uint64_t*) (index->records + indexRow * index->recordSize)) != rowOffset) {
+		if((indexRow = tposeIOIndexFindRow(index, rowOffset)) == -1)
+			return NULL;
+	}
+
+	fieldOffsets = (uint32_t*) (index->records + indexRow * index->recordSize + sizeof(uint64_t));
+
+	if(indexRow + 1 < index->numRows)
+		nextRowPtr = inputFile->dataAddr + *((uint64_t*) (index->records + (indexRow + 1) * index->recordSize));
+	else
+		nextRowPtr = inputFile->dataAddr + inputFile->dataSize;
+	if(nextRowPtr > endPtr)
+		nextRowPtr = endPtr;
+
+	tposeIORowReset(tposeQuery, row);
+	row->indexRow = indexRow;
+
+	slots[0] = (tposeQuery->id != -1) ? index->idSlot : -1;
+	slots[1] = (tposeQuery->group != -1) ? index->groupSlot : -1;
+	for(slotCtr = 2; slotCtr < numSlots; slotCtr++)
+		slots[slotCtr] = index->numericSlots[slotCtr - 2];
+
+	for(slotCtr = 0; slotCtr < numSlots; slotCtr++) {
+
+		if(slots[slotCtr] == -1 || fieldOffsets[slots[slotCtr]] == TPOSE_IO_INDEX_MISSING)
+			continue;
+
+		fieldValue = (slotCtr == 0) ? &(row->id) : (slotCtr == 1) ? &(row->group) : &(row->numerics[slotCtr - 2]);
+		fieldLength = (slotCtr == 0) ? &(row->idLength) : (slotCtr == 1) ? &(row->groupLength) : &(row->numericLengths[slotCtr - 2]);
+
+		fieldPtr = rowPtr + fieldOffsets[slots[slotCtr]];
+		for(fieldEnd = fieldPtr; fieldEnd < nextRowPtr && *fieldEnd != fieldDelimiter && *fieldEnd != rowDelimiter; ++fieldEnd);
+
+		// Empty fields are ignored
+		if(fieldEnd > fieldPtr) {
+			*fieldValue = fieldPtr;
+			*fieldLength = fieldEnd - fieldPtr;
+			if(slotCtr >= 2)
+				row->numNumerics++;
+		}
+	}
+
+	return nextRowPtr;
+
+}
+
+
+
+/**
+ ** Returns the index record of the row starting at offset (-1 if not found)
+ **/
+off_t tposeIOIndexFindRow(
+	TposeIndex* index
+	,off_t offset
+) {
+
+	off_t low = 0;
+	off_t high = (off_t) index->numRows - 1;
+	off_t middle;
+	uint64_t rowOffset;
+
+	if(index->recordSize == 0)
+		return -1;
+
+	while(low <= high) {
+		middle = low + (high - low) / 2;
+		rowOffset = *((uint64_t*) (index->records + middle * index->recordSize));
+
+		if(rowOffset == (uint64_t) offset)
+			return middle;
+
+		if(rowOffset < (uint64_t) offset)
+			low = middle + 1;
+		else
+			high = middle - 1;
+	}
+
+	return -1;
+
+}
+
+
+
+/**
+ ** Returns the offset of a row starting at or after offset,
+ ** rounded up to the next index sample (no scanning needed)
+ **/
+off_t tposeIOIndexAlign(
+	TposeInputFile* inputFile
+	,off_t offset
+) {
+
+	TposeIndex* index = inputFile->index;
+	uint64_t sample = (offset + index->sampleInterval - 1) / index->sampleInterval;
+
+	if(sample >= index->numSamples)
+		return inputFile->dataSize;
+
+	return (off_t) index->samples[sample];
+
+}
+
+
+
+/**
+ ** Returns a unique list of GROUP variable values
  **/
 void tposeIOUniqueGroups(
 	TposeQuery* tposeQuery
@@ -687,138 +2426,97 @@ void tposeIOUniqueGroups(
 
 	// Flags & static vars
 	unsigned int mutateHeader = 1; // Allow for header row to be modified
-	unsigned char fieldDelimiter = (tposeQuery->inputFile)->fieldDelimiter;
-	
+	TposePartition partition;
+	unsigned int fileCtr;
+
 	// Temp allocs
 	TposeHeader* header = tposeIOHeaderAlloc(TPOSE_IO_MAX_FIELDS, mutateHeader); // Allocate the needed memory
-	BTreeKey* key = btreeKeyAlloc();
-	BTreeKey* resultKey;
-	char tempString[TPOSE_IO_MAX_FIELD_WIDTH];
-	char* allocString;
-	char* fieldSavePtr; // Points at start of each field after every loop
 
-	// Counters & limits
-	off_t rowCount = 2; // For debugging only
-	unsigned int fieldCount = 0; // Already pointing at the first field when loop starts 
-	off_t uniqueGroupCount = 0; // Used to index array of header ptrs
-	off_t groupCharCount = 0; 
-	off_t hashCharCount = 0; 
-	off_t totalCharCount = 0; // Needed to stop reading at EOF (mmap files are page aligned, so we end-up reading garbage after file data ends)
-	off_t hashValue = 0; 
-	off_t fileSize = (tposeQuery->inputFile)->fileSize; 
-	off_t rFileSize = fileSize; // Remaining file size
-	unsigned int chunks = 1; // Number of file chunks
+	tposeIOPrefetchStartFiles(tposeQuery);
 
+	// Scan each input file in turn
+	for(fileCtr = 0; fileCtr < tposeQuery->numInputFiles; fileCtr++) {
+		partition.inputFile = tposeQuery->inputFiles[fileCtr];
+		partition.start = 0;
+		partition.end = (partition.inputFile)->dataSize;
+		tposeIOUniqueGroupsScan(tposeQuery, btree, header, &partition, fileCtr);
+	}
 
-	fieldSavePtr = (tposeQuery->inputFile)->dataAddr; // Init with ptr to second row (where data starts)
+	tposeIOPrefetchStop();
 
+	// Assign groups to output file header
+	(tposeQuery->outputFile)->fileGroupHeader = header;
 
-	// Calculate file chunks
-	while(rFileSize >= TPOSE_IO_CHUNK_SIZE){
-		++chunks;
-		rFileSize -= TPOSE_IO_CHUNK_SIZE;
-	}
+}
 
 
-	// Split large files into chunks
-	int chunkCtr;
-	off_t iFileSize;
-	for(chunkCtr = 1; chunkCtr <= chunks; chunkCtr++) {
-		
-		// Set file size limit for current chunk
-		if(chunkCtr == chunks)
-			iFileSize = rFileSize;
-		else
-			iFileSize = TPOSE_IO_CHUNK_SIZE;
 
-		// Reset vars for each chunk
-		totalCharCount = 0;
-			
-		// Process each chunk
-		while(totalCharCount <= iFileSize) {
+/**
+ ** Adds the unique GROUP values found between rowPtr and endPtr
+ ** to the btree and header (in order of discovery)
+ **/
+void tposeIOUniqueGroupsScan(
+	TposeQuery* tposeQuery
+	,BTree* btree
+	,TposeHeader* header
+	,TposePartition* partition
+	,unsigned int rangeId
+) {
 
-			// FIELD DELIMITER
-			if(*fieldSavePtr == fieldDelimiter) {
-				++fieldCount;
-				++fieldSavePtr;
-				if(++totalCharCount == iFileSize) break;
-				continue;
-			}
+	BTreeKey key;
+	TposeInputFile* inputFile = partition->inputFile;
+	char* rowPtr = inputFile->dataAddr + partition->start;
+	char* endPtr = inputFile->dataAddr + partition->end;
+	TposeRow row;
+	off_t hashValue = 0;
+	char* publishPtr = rowPtr;
+	TposeGroupCache groupCache;
 
-			// ROW DELIMITER
-			if(*fieldSavePtr == rowDelimiter) {
-				fieldCount = 0;
-				++rowCount;
-				++fieldSavePtr;
-				if(++totalCharCount == iFileSize) break;
-				continue;
-			}
-			
-			// GROUP FIELD
-			if(fieldCount == (tposeQuery->group))  { // if group value is empty string we ignore
-
-				// Copy field value
-				while(*fieldSavePtr != fieldDelimiter && *fieldSavePtr != rowDelimiter) {
-					tempString[groupCharCount++] = *fieldSavePtr++;
-					if(++totalCharCount == fileSize) break;
-				}
-				tempString[groupCharCount] = '\0'; // Null-terminate string
+	row.indexRow = -1;
+	tposeIOGroupCacheReset(&groupCache);
 
-				// Convert char array to hash
-				for(hashCharCount = 0; hashCharCount <= groupCharCount-1; ++hashCharCount)
-					hashValue = TPOSE_IO_HASH_MULT * hashValue + (unsigned char) tempString[hashCharCount];
+	while(rowPtr < endPtr) {
 
-				// Insert into btree
-				if( (resultKey = (BTreeKey*) btreeSearch(btree, btree->root, hashValue)) == NULL) {
+		// Let the prefetcher know how far we've got
+		if(rowPtr >= publishPtr) {
+			tposeIOPrefetchPublish(rangeId, rowPtr);
+			publishPtr = rowPtr + TPOSE_IO_PREFETCH_STEP;
+		}
 
-					// Check for collisions - print only when we add a unique group
-					debug_print("tposeIOgetUniqueGroups(): New group value found = '");
-					debug_print("tposeIOgetUniqueGroups(): row %u = %s\t%ld\t%u\n", rowCount, tempString, hashValue, uniqueGroupCount);
+		rowPtr = tposeIOReadRow(tposeQuery, inputFile, rowPtr, endPtr, &row);
+		if(row.group == NULL)
+			continue;
 
-					btreeSetKeyValue(key, hashValue, uniqueGroupCount, 0);
-					if(btreeInsert(btree, key) == -1)
-						fprintf(stderr, "Error: Cannot insert value into btree\n");
+		// Convert group value to hash
+		hashValue = tposeIORowGroupHash(&row);
 
-					// Insert into TposeHeader object
-					allocString = malloc(strlen(tempString) * sizeof(char));
-					strcpy(allocString, tempString);
-					*(header->fields+(uniqueGroupCount++)) = allocString;
-					header->numFields = uniqueGroupCount; // Update number of fields in header
-				}
+		// Insert into btree (new keys are cached the next time they are found)
+		if(tposeIOGroupCacheFind(&groupCache, btree, hashValue) == TPOSE_IO_GROUP_CACHE_EMPTY) {
 
-				// Reset variables (
-				groupCharCount = 0;
-				hashValue = 0;
-				
-				if(*fieldSavePtr == fieldDelimiter) {
-					--fieldSavePtr;
-					--totalCharCount;
-				}
+			debug_print("tposeIOUniqueGroupsScan(): New group value found = '%.*s'\thash=%ld\tuniqueGroupCount=%u\n", row.groupLength, row.group, hashValue, header->numFields);
 
-				if(*fieldSavePtr == rowDelimiter) {
-					--fieldSavePtr;
-					--totalCharCount;
-				}
+			if(header->numFields == header->maxFields) {
+				fprintf(stderr, "Error: Too many unique GROUP values (maximum is %u)\n", header->maxFields);
+				exit(EXIT_FAILURE);
 			}
 
-			// If not a delimiter or group field, then ++
-			++fieldSavePtr;
-			if(++totalCharCount == iFileSize) break;
+			btreeSetKeyValue(&key, hashValue, header->numFields, 0);
+			key.isUnlinked = 0;
+			if(btreeInsert(btree, &key) == -1)
+				fprintf(stderr, "Error: Cannot insert value into btree\n");
 
+			// Insert into TposeHeader object
+			header->fields[header->numFields++] = tposeArenaStrndup(header->arena, row.group, row.groupLength);
 		}
+	}
 
-	} // End for-loop over chunks 
-
-	btreeKeyFree(&key);
+	tposeIOPrefetchPublish(rangeId, NULL);
 
-	// Assign groups to output file header 
-	(tposeQuery->outputFile)->fileGroupHeader = header; 
-	
 }
 
 
 
-/** 
+/**
  ** "Simple" tranpose of rows-to-columns (naive algorithm)
  **/
 void tposeIOTransposeSimple(
@@ -828,93 +2526,82 @@ void tposeIOTransposeSimple(
 	// Flags & static vars
 	unsigned char fieldDelimiter = (tposeQuery->inputFile)->fieldDelimiter;
 	off_t numFields = ((tposeQuery->inputFile)->fileHeader)->maxFields;
-	off_t fileSize = (tposeQuery->inputFile)->fileSize; 
+	TposeInputFile* inputFile;
 
 	// Temp allocs
-	char fieldTempString[TPOSE_IO_MAX_FIELD_WIDTH];
-	char* fieldSavePtr; 
+	char* fieldSavePtr;
+	char* fieldPtr;
+	char* fieldValue;
+	char* endPtr;
 
 	// Counters & limits
-	unsigned int fieldCount = 0; // points at first field when loop starts 
-	unsigned int fieldCharCount = 0; 
+	unsigned int fieldCount = 0; // points at first field when loop starts
+	unsigned int fieldLength = 0;
 	unsigned int currentField = 0;
-	off_t totalCharCount = 0; // mmap files are page aligned, so we end-up reading garbage after file data ends
+	unsigned int fileCtr;
 
+	// Columnar files store fields by column already (see --convert)
+	if((tposeQuery->inputFile)->columnar != NULL) {
+		tposeColumnarTransposeSimple(tposeQuery, tposeQuery->inputFile);
+		return;
+	}
 
 	// Process each field at a time
 	for(currentField = 0; currentField < numFields; ++currentField) {
 
-		fieldSavePtr = (tposeQuery->inputFile)->fileAddr; // Re-initialise pointer to data 
-		totalCharCount = 0;
+		// Scan each input file (the header row is only output once)
+		for(fileCtr = 0; fileCtr < tposeQuery->numInputFiles; fileCtr++) {
 
-		// Scan the file
-		while(totalCharCount <= (tposeQuery->inputFile)->fileSize) {
+			inputFile = tposeQuery->inputFiles[fileCtr];
+			fieldSavePtr = (fileCtr == 0) ? inputFile->fileAddr : inputFile->dataAddr;
+			endPtr = inputFile->fileAddr + inputFile->fileSize;
 
-			// FIELD DELIMITER
-			if(*fieldSavePtr == fieldDelimiter) {
-				++fieldCount;
-				++fieldSavePtr;
-				if(++totalCharCount == fileSize) break;
-				continue;
-			}
+			fieldCount = 0;
+			fieldValue = NULL;
+			fieldLength = 0;
+
+			while(fieldSavePtr < endPtr) {
+
+				fieldPtr = fieldSavePtr;
+				while(fieldSavePtr < endPtr && *fieldSavePtr != fieldDelimiter && *fieldSavePtr != rowDelimiter)
+					++fieldSavePtr;
 
-			// ROW DELIMITER
-			if(*fieldSavePtr == rowDelimiter) {
-				if((fieldCount != 0) && (fieldCount == numFields - 1)) {
-					// Print output
-					fprintf((tposeQuery->outputFile)->fd, "%s%c", fieldTempString, fieldDelimiter);
-					fflush((tposeQuery->outputFile)->fd); 
+				// CURRENT FIELD BEING PROCESSED
+				if(fieldCount == currentField) {
+					fieldValue = fieldPtr;
+					fieldLength = fieldSavePtr - fieldPtr;
+				}
+
+				// FIELD DELIMITER
+				if(fieldSavePtr < endPtr && *fieldSavePtr == fieldDelimiter) {
+					++fieldCount;
+					++fieldSavePtr;
+					continue;
 				}
-					
+
+				// ROW DELIMITER (or end of file) - rows with a different number of fields are skipped
+				if((fieldCount != 0) && (fieldCount == numFields - 1))
+					fprintf((tposeQuery->outputFile)->fd, "%.*s%c", fieldLength, fieldValue, fieldDelimiter);
+
 				// Reset flags for next row
 				fieldCount = 0;
+				fieldValue = NULL;
+				fieldLength = 0;
 
 				++fieldSavePtr;
-				if(++totalCharCount == fileSize) break;
-				continue;
-			}
-			
-			// CURRENT FIELD BEING PROCESSED
-			if((totalCharCount != (tposeQuery->inputFile)->fileSize) && (fieldCount == currentField))  { // if group value is empty string we ignore
-
-				// Get current field value
-				while((*fieldSavePtr != fieldDelimiter) && (*fieldSavePtr != rowDelimiter)) {
-					fieldTempString[fieldCharCount++] = *fieldSavePtr++;
-					if(++totalCharCount == fileSize) break;
-				}
-				fieldTempString[fieldCharCount] = '\0'; // Null-terminate string
-
-				// Reset variables
-				fieldCharCount = 0;
-				
-				if(*fieldSavePtr == fieldDelimiter) {
-					--fieldSavePtr;
-					--totalCharCount;
-				}
-
-				if(*fieldSavePtr == rowDelimiter) {
-					--fieldSavePtr;
-					--totalCharCount;
-				}
 			}
-			
-			// If not a delimiter or the counted field, then ++
-			++fieldSavePtr;
-			if(++totalCharCount == fileSize) break;
-
-		} // End while-loop
+		}
 
 		fprintf((tposeQuery->outputFile)->fd, "%c", rowDelimiter); // Output a new line after each iteration
 		fflush((tposeQuery->outputFile)->fd);
-		
-	
+
 	} // End for-loop
 
 }
 
 
 
-/** 
+/**
  ** Transposes numeric values for each unique group value
  **/
 void tposeIOTransposeGroup(
@@ -922,845 +2609,637 @@ void tposeIOTransposeGroup(
 	,BTree* btree
 ) {
 
-
-	// Flags & static vars
-	unsigned char fieldDelimiter = (tposeQuery->inputFile)->fieldDelimiter;
-	unsigned int groupFoundFlag = 0; // 1 when we find the group field, 0 otherwise (0 if there is no group value)
-	unsigned int numericFoundFlag = 0; // 1 when we find the numeric field, 0 otherwise (0 if there is no numeric value)
+	TposePartition partition;
+	unsigned int fileCtr;
 
 	// Temp allocs
-	tposeQuery->aggregator = tposeIOAggregatorAlloc(((tposeQuery->outputFile)->fileGroupHeader)->numFields);
-	BTreeKey* resultKey;
-	char groupTempString[TPOSE_IO_MAX_FIELD_WIDTH];
-	char numericTempString[TPOSE_IO_MAX_FIELD_WIDTH];
-	char* fieldSavePtr;
-	
-	// Counters & limits
-	unsigned int fieldCount = 0; // Already pointing at the first field when loop starts 
-	unsigned int fieldCharCount = 0;
-	unsigned int hashCharCount = 0; 
-	off_t hashValue = 0; 
-	off_t totalCharCount = 0; // mmap files are page aligned, so we end-up reading garbage after file data ends
-	off_t groupFieldIndex = 0; // Holds index of group field in TposeHeader struct
-	off_t fileSize = (tposeQuery->inputFile)->fileSize;
-	off_t rFileSize = fileSize;
-	unsigned int chunks = 1; // Number of file chunks
+	tposeQuery->aggregator = tposeIOAggregatorAlloc(((tposeQuery->outputFile)->fileGroupHeader)->numFields * tposeQuery->numNumerics, tposeQuery->aggregateStats);
+	tposeIOGroupHashBuild(tposeQuery, btree);
+	tposeIOGroupOrderBuild(tposeQuery);
+
+	tposeIOPrefetchStartFiles(tposeQuery);
+
+	// Scan each input file in turn
+	for(fileCtr = 0; fileCtr < tposeQuery->numInputFiles; fileCtr++) {
+		partition.inputFile = tposeQuery->inputFiles[fileCtr];
+		partition.start = 0;
+		partition.end = (partition.inputFile)->dataSize;
+		tposeIOTransposeGroupScan(tposeQuery, btree, tposeQuery->aggregator, &partition, fileCtr);
+	}
 
+	tposeIOPrefetchStop();
 
-	fieldSavePtr = (tposeQuery->inputFile)->dataAddr; // Init with ptr to second row (where data starts)
+	tposeIOPrintOutput(tposeQuery);
 
+}
 
-	// Calculate file chunks
-	while(rFileSize >= TPOSE_IO_CHUNK_SIZE){
-		++chunks;
-		rFileSize -= TPOSE_IO_CHUNK_SIZE;
-	}
 
 
-	// Split large files into chunks
-	int chunkCtr;
-	off_t iFileSize;
-	for(chunkCtr = 1; chunkCtr <= chunks; chunkCtr++) {
-		
-		// Set file size limit for current chunk
-		if(chunkCtr == chunks)
-			iFileSize = rFileSize;
-		else
-			iFileSize = TPOSE_IO_CHUNK_SIZE;
+/**
+ ** Aggregates the NUMERIC values of each GROUP between rowPtr and endPtr
+ **/
+void tposeIOTransposeGroupScan(
+	TposeQuery* tposeQuery
+	,BTree* btree
+	,TposeAggregator* aggregator
+	,TposePartition* partition
+	,unsigned int rangeId
+) {
 
-		totalCharCount = 0; // Reset count
+	TposeInputFile* inputFile = partition->inputFile;
+	char* rowPtr = inputFile->dataAddr + partition->start;
+	char* endPtr = inputFile->dataAddr + partition->end;
+	TposeRow row;
+	char* publishPtr = rowPtr;
+	unsigned int numNumerics = tposeQuery->numNumerics;
+	unsigned int numericCtr;
+	TposeBatch batch;
+	TposeGroupCache groupCache;
+	unsigned int group;
+
+	row.indexRow = -1;
+	batch.numValues = 0;
+	tposeIOGroupCacheReset(&groupCache);
+
+	while(rowPtr < endPtr) {
+
+		// Let the prefetcher know how far we've got
+		if(rowPtr >= publishPtr) {
+			tposeIOPrefetchPublish(rangeId, rowPtr);
+			publishPtr = rowPtr + TPOSE_IO_PREFETCH_STEP;
+		}
 
-		// Process each chunk
-		while(totalCharCount <= iFileSize) {
+		rowPtr = tposeIOReadRow(tposeQuery, inputFile, rowPtr, endPtr, &row);
+		if(row.group == NULL || row.numNumerics == 0)
+			continue;
 
-			// FIELD DELIMITER
-			if(*fieldSavePtr == fieldDelimiter) {
-				++fieldCount;
-				++fieldSavePtr;
-				if(++totalCharCount == iFileSize) break;
-				continue;
+		// Aggregate values for each group (the NUMERIC fields of a group are next to each other)
+		if((group = tposeIOGroupFind(tposeQuery, &groupCache, btree, tposeIORowGroupHash(&row))) != TPOSE_IO_GROUP_CACHE_EMPTY) {
+			for(numericCtr = 0; numericCtr < numNumerics; numericCtr++) {
+				if(row.numerics[numericCtr] != NULL)
+					tposeIOBatchAdd(aggregator, &batch, group * numNumerics + numericCtr, &row, numericCtr);
 			}
+		}
+	}
 
-			// ROW DELIMITER
-			if(*fieldSavePtr == rowDelimiter) {
+	tposeIOAggregatorUpdateBatch(aggregator, &batch);
+	tposeIOPrefetchPublish(rangeId, NULL);
 
-				// Aggregate value for each group
-				if((groupFoundFlag == 1) && (numericFoundFlag == 1)) {
-					(tposeQuery->aggregator)->aggregates[groupFieldIndex] += atof(numericTempString);
-					(tposeQuery->aggregator)->counts[groupFieldIndex]++;
-				}
-					
-				// Reset flags for next row
-				groupFoundFlag = 0;
-				numericFoundFlag = 0;
+}
 
-				fieldCount = 0;
-				++fieldSavePtr;
-				if(++totalCharCount == iFileSize) break;
-				continue;
 
-			}
 
-			// GROUP FIELD
-			if(fieldCount == (tposeQuery->group))  { // if group value is empty string we ignore
+/**
+ ** Transposes numeric values for each unique group and id value
+ **/
+void tposeIOTransposeGroupId(
+	TposeQuery* tposeQuery
+	,BTree* btree
+) {
 
-				// Get group field value
-				while(*fieldSavePtr != fieldDelimiter && *fieldSavePtr != rowDelimiter) {
-					groupTempString[fieldCharCount++] = *fieldSavePtr++;
-					if(++totalCharCount == iFileSize) break;
-				}
-				groupTempString[fieldCharCount] = '\0'; // Null-terminate string
+	TposePartition partition;
+	TposeIdRun idRun;
+	unsigned int fileCtr;
 
-				// Convert char array to hash
-				for(hashCharCount = 0; hashCharCount <= fieldCharCount-1; ++hashCharCount)
-					hashValue = TPOSE_IO_HASH_MULT * hashValue + (unsigned char) groupTempString[hashCharCount];
+	// Temp allocs
+	tposeQuery->aggregator = tposeIOAggregatorAlloc(((tposeQuery->outputFile)->fileGroupHeader)->numFields * tposeQuery->numNumerics, tposeQuery->aggregateStats); // Aggregates values
+	tposeIOGroupHashBuild(tposeQuery, btree);
+	tposeIOGroupOrderBuild(tposeQuery);
 
-				// Insert into btree
-				if( (resultKey = (BTreeKey*) btreeSearch(btree, btree->root, hashValue)) != NULL) {
-					groupFoundFlag = 1; // Flag group field as found
-					groupFieldIndex = resultKey->dataOffset;
-				}
+	// Print output header
+	tposeIOPrintGroupIdHeader(tposeQuery, tposeQuery->outputFile);
+
+	tposeIOPrefetchStartFiles(tposeQuery);
+
+	// Scan each input file in turn (ids are expected to be sorted, and the
+	// last ID of a file carries on into the next one)
+	idRun.started = 0;
+	for(fileCtr = 0; fileCtr < tposeQuery->numInputFiles; fileCtr++) {
+		partition.inputFile = tposeQuery->inputFiles[fileCtr];
+		partition.start = 0;
+		partition.end = (partition.inputFile)->dataSize;
+		tposeIOTransposeGroupIdScan(tposeQuery, btree, tposeQuery->outputFile, tposeQuery->aggregator, &partition, &idRun, fileCtr);
+	}
+	tposeIOTransposeGroupIdFlush(tposeQuery, tposeQuery->outputFile, tposeQuery->aggregator, &idRun);
 
-				// Reset variables
-				fieldCharCount = 0;
-				hashValue = 0;
-				
-				if(*fieldSavePtr == fieldDelimiter) {
-					--fieldSavePtr;
-					--totalCharCount;
-				}
+	tposeIOPrefetchStop();
 
-				if(*fieldSavePtr == rowDelimiter) {
-					--fieldSavePtr;
-					--totalCharCount;
-				}
-			}
-			
-			// NUMERIC FIELD
-			if(fieldCount == (tposeQuery->numeric))  { // if group value is empty string we ignore
-
-				numericFoundFlag = 1; // Flag numeric field as found
-				
-				// Copy field value
-				while(*fieldSavePtr != fieldDelimiter && *fieldSavePtr != rowDelimiter) {
-					numericTempString[fieldCharCount++] = *fieldSavePtr++;
-					if(++totalCharCount == iFileSize) break;
-				}
-				numericTempString[fieldCharCount] = '\0'; // Null-terminate string
+}
+
+
+
+/**
+ ** Aggregates the NUMERIC values of each GROUP for each run of rows with
+ ** the same ID in a partition, printing a line per ID. The last ID is left
+ ** in idRun (see tposeIOTransposeGroupIdFlush), as it may carry on in the next range
+ **/
+void tposeIOTransposeGroupIdScan(
+	TposeQuery* tposeQuery
+	,BTree* btree
+	,TposeOutputFile* outputFile
+	,TposeAggregator* aggregator
+	,TposePartition* partition
+	,TposeIdRun* idRun
+	,unsigned int rangeId
+) {
+
+	TposeInputFile* inputFile = partition->inputFile;
+	char* rowPtr = inputFile->dataAddr + partition->start;
+	char* endPtr = inputFile->dataAddr + partition->end;
+	TposeRow row;
+	char* publishPtr = rowPtr;
+	unsigned int numNumerics = tposeQuery->numNumerics;
+	unsigned int numericCtr;
+	TposeBatch batch;
+	TposeGroupCache groupCache;
+	unsigned int group;
+
+	row.indexRow = -1;
+	batch.numValues = 0;
+	tposeIOGroupCacheReset(&groupCache);
+
+	while(rowPtr < endPtr) {
+
+		// Let the prefetcher know how far we've got
+		if(rowPtr >= publishPtr) {
+			tposeIOPrefetchPublish(rangeId, rowPtr);
+			publishPtr = rowPtr + TPOSE_IO_PREFETCH_STEP;
+		}
 
-				// Reset vars
-				fieldCharCount = 0;
+		rowPtr = tposeIOReadRow(tposeQuery, inputFile, rowPtr, endPtr, &row);
+		if(row.id == NULL || row.group == NULL || row.numNumerics == 0)
+			continue;
 
-				if(*fieldSavePtr == fieldDelimiter) {
-					--totalCharCount;
-					--fieldSavePtr;
-				}
+		if((group = tposeIOGroupFind(tposeQuery, &groupCache, btree, tposeIORowGroupHash(&row))) == TPOSE_IO_GROUP_CACHE_EMPTY)
+			continue;
 
-				if(*fieldSavePtr == rowDelimiter) {
-					--fieldSavePtr;
-					--totalCharCount;
-				}
-			}
+		if(!idRun->started || row.idLength != idRun->idLength || memcmp(row.id, idRun->id, idRun->idLength)) {
 
-			// If not a delimiter or group field, then ++
-			++fieldSavePtr;
-			if(++totalCharCount == iFileSize) break;
+			// 0 Add up the batch
+			tposeIOAggregatorUpdateBatch(aggregator, &batch);
+			// 1 Print out current aggregates for id (and reset them)
+			tposeIOTransposeGroupIdFlush(tposeQuery, outputFile, aggregator, idRun);
 
+			// 2 Set new string as current id
+			if(row.idLength >= TPOSE_IO_MAX_FIELD_WIDTH) {
+				fprintf(stderr, "Error: ID value too wide (maximum is %d characters)\n", TPOSE_IO_MAX_FIELD_WIDTH - 1);
+				exit(EXIT_FAILURE);
+			}
+			memcpy(idRun->id, row.id, row.idLength);
+			idRun->id[row.idLength] = '\0';
+			idRun->idLength = row.idLength;
+			idRun->started = 1;
 		}
 
-	} // End for-loop
-	
-	// Calculate averges
-	int ctr;
-	for(ctr = 0; ctr < ((tposeQuery->outputFile)->fileGroupHeader)->numFields; ++ctr)
-		(tposeQuery->aggregator)->avgs[ctr] = (tposeQuery->aggregator)->aggregates[ctr] / (tposeQuery->aggregator)->counts[ctr];
+		// Aggregate values for each group (the NUMERIC fields of a group are next to each other)
+		for(numericCtr = 0; numericCtr < numNumerics; numericCtr++) {
+			if(row.numerics[numericCtr] != NULL)
+				tposeIOBatchAdd(aggregator, &batch, group * numNumerics + numericCtr, &row, numericCtr);
+		}
+	}
 
-	tposeIOPrintOutput(tposeQuery);
+	// The last ID is printed by the caller
+	tposeIOAggregatorUpdateBatch(aggregator, &batch);
+	tposeIOPrefetchPublish(rangeId, NULL);
 
 }
 
 
 
-/** 
- ** Transposes numeric values for each unique group and id value
+/**
+ ** Prints the aggregates of the ID in idRun (if any), and resets them for the next ID
  **/
-void tposeIOTransposeGroupId(
+void tposeIOTransposeGroupIdFlush(
 	TposeQuery* tposeQuery
-	,BTree* btree
+	,TposeOutputFile* outputFile
+	,TposeAggregator* aggregator
+	,TposeIdRun* idRun
 ) {
 
-	// Flags & static vars
-	unsigned char fieldDelimiter = (tposeQuery->inputFile)->fieldDelimiter;
+	if(!idRun->started)
+		return;
 
-	// Temp allocs
-	tposeQuery->aggregator = tposeIOAggregatorAlloc(((tposeQuery->outputFile)->fileGroupHeader)->numFields); // Aggregates values
-	BTreeKey* resultKey; // Used for searching the btree
-	char idCurrentString[TPOSE_IO_MAX_FIELD_WIDTH]; // Holds current id value being aggregated
-	char idTempString[TPOSE_IO_MAX_FIELD_WIDTH]; // Holds id value for each row
-	char groupTempString[TPOSE_IO_MAX_FIELD_WIDTH];
-	char numericTempString[TPOSE_IO_MAX_FIELD_WIDTH];
-	char* fieldSavePtr;
+	tposeIOPrintGroupIdData(idRun->id, tposeQuery, outputFile, aggregator);
+	tposeIOAggregatorReset(aggregator);
+	idRun->started = 0;
 
-	// Counters & limits
-	unsigned int fieldCount = 0; // Already pointing at the first field when loop starts 
-	unsigned int fieldCharCount = 0;
-	unsigned int firstId = 1;
-	unsigned int idFoundFlag = 0; // 1 when we find the numeric field, 0 otherwise (0 if there is no numeric value)
-	unsigned int groupFoundFlag = 0; // 1 when we find the group field, 0 otherwise (0 if there is no group value)
-	unsigned int numericFoundFlag = 0; // 1 when we find the numeric field, 0 otherwise (0 if there is no numeric value)
-	int ctr; // Iterates over group fields to calculate average values
-	off_t groupFieldIndex = 0; // Holds index of group field in TposeHeader struct
-	off_t totalCharCount = 0; // Needed to stop reading at EOF (mmap files are page aligned, so we end-up reading garbage after file data ends)
-	off_t hashCharCount = 0; 
-	off_t hashValue = 0; 
-	off_t fileSize = (tposeQuery->inputFile)->fileSize;
-	off_t rFileSize = fileSize;
-	unsigned int chunks = 1; // Number of file chunks
+}
 
-	// Print output header
-	tposeIOPrintGroupIdHeader(tposeQuery); 
 
 
-	// Calculate file chunks
-	while(rFileSize >= TPOSE_IO_CHUNK_SIZE){
-		++chunks;
-		rFileSize -= TPOSE_IO_CHUNK_SIZE;
-	}
+/**
+ ** Paritions input files into *correct* chunks for parallel-processing
+ ** Multi-threaded only
+ **/
+int tposeIOBuildPartitions(
+	TposeQuery* tposeQuery
+	,unsigned int mode
+) {
 
-	fieldSavePtr = (tposeQuery->inputFile)->dataAddr; // Init with ptr to second row (where data starts)
+	TposeInputFile* inputFile;
+	TposeInputFile* lastInputFile = NULL; // Last file with rows
+	TposeRow lastRow;
+	unsigned int fileCtr;
+	off_t partitionStart;
+	off_t partitionEnd;
+	off_t chunkSize;
+	off_t balancedChunkSize;
+	off_t totalDataSize = 0;
+	off_t lastRowOffset;
+	long numCpus;
+	char* rowPtr;
+
+	if(mode != TPOSE_IO_PARTITION_GROUP && mode != TPOSE_IO_PARTITION_ID)
+		return -1;
 
+	fileChunks = 0;
+
+	// Input is split evenly across CPUs (in row-aligned chunks)
+	for(fileCtr = 0; fileCtr < tposeQuery->numInputFiles; fileCtr++)
+		totalDataSize += (tposeQuery->inputFiles[fileCtr])->dataSize;
+	if((numCpus = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+		numCpus = 1;
+	balancedChunkSize = (totalDataSize + numCpus - 1) / numCpus;
+	if(balancedChunkSize > TPOSE_IO_CHUNK_SIZE)
+		balancedChunkSize = TPOSE_IO_CHUNK_SIZE;
+
+	// Split each file into chunks (files are never merged into one partition)
+	for(fileCtr = 0; fileCtr < tposeQuery->numInputFiles; fileCtr++) {
+
+		inputFile = tposeQuery->inputFiles[fileCtr];
+
+		// The first rows of a file that carry on the last ID of the file before
+		// are aggregated with it (see tposeIOTransposeGroupIdMap)
+		inputFile->idLeadEnd = 0;
+		if(mode == TPOSE_IO_PARTITION_ID && lastInputFile != NULL && inputFile->dataSize > 0) {
+			lastRow.indexRow = -1;
+			lastRowOffset = tposeIOLastRowOffset(lastInputFile);
+			(void) tposeIOReadRow(tposeQuery, lastInputFile, lastInputFile->dataAddr + lastRowOffset, lastInputFile->dataAddr + lastInputFile->dataSize, &lastRow);
+			inputFile->idLeadEnd = tposeIOSkipId(tposeQuery, inputFile, 0, &lastRow);
+		}
+		if(inputFile->dataSize > 0)
+			lastInputFile = inputFile;
+
+		// Text files are only split into chunks worth a thread each (indexed
+		// files can be split anywhere, as their row boundaries are already known)
+		chunkSize = balancedChunkSize;
+		if(inputFile->index == NULL && chunkSize < TPOSE_IO_MIN_CHUNK_SIZE)
+			chunkSize = TPOSE_IO_MIN_CHUNK_SIZE;
+
+		// Columnar files are sized in rows, and split on row groups
+		if(inputFile->columnar != NULL) {
+			chunkSize = (inputFile->dataSize + numCpus - 1) / numCpus;
+			chunkSize = ((chunkSize + TPOSE_COLUMNAR_ROW_GROUP - 1) / TPOSE_COLUMNAR_ROW_GROUP) * TPOSE_COLUMNAR_ROW_GROUP;
+		}
 
-	// Split large files into chunks
-	int chunkCtr;
-	off_t iFileSize;
-	for(chunkCtr = 1; chunkCtr <= chunks; chunkCtr++) {
-		
-		// Set file size limit for current chunk
-		if(chunkCtr == chunks)
-			iFileSize = rFileSize;
-		else
-			iFileSize = TPOSE_IO_CHUNK_SIZE;
+		for(partitionStart = 0; partitionStart < inputFile->dataSize; partitionStart = partitionEnd) {
 
-		totalCharCount = 0; // Reset count
+			partitionEnd = partitionStart + chunkSize;
 
-		// Process each chunk
-		while(totalCharCount <= iFileSize) {
+			if(partitionEnd >= inputFile->dataSize) {
+				partitionEnd = inputFile->dataSize;
+			}
+			else {
+				// Correct partitions to start after new lines
+				if(inputFile->columnar != NULL)
+					; // Every row offset is a row boundary
+				else if(inputFile->index != NULL)
+					partitionEnd = tposeIOIndexAlign(inputFile, partitionEnd);
+				else if((rowPtr = memchr(inputFile->dataAddr + partitionEnd, rowDelimiter, inputFile->dataSize - partitionEnd)) == NULL)
+					partitionEnd = inputFile->dataSize;
+				else
+					partitionEnd = (rowPtr + 1) - inputFile->dataAddr;
+
+				// Partition file into chunks with mutually excluse set
+				// of IDs (avoids more complex post-processing 'shuffle')
+				// when transposing over id and group fields
+				if(mode == TPOSE_IO_PARTITION_ID)
+					partitionEnd = tposeIOAlignPartitionId(tposeQuery, inputFile, partitionEnd);
+			}
 
-			// FIELD DELIMITER
-			if(*fieldSavePtr == fieldDelimiter) {
-				++fieldCount;
-				++fieldSavePtr;
-				if(++totalCharCount == iFileSize) break;
-				continue;
+			if(fileChunks == TPOSE_IO_MAX_PARTITIONS) {
+				fprintf(stderr, "Error: Too many file partitions (maximum is %d)\n", TPOSE_IO_MAX_PARTITIONS);
+				return -1;
 			}
 
-			// ROW DELIMITER
-			if(*fieldSavePtr == rowDelimiter) {
+			partitions[fileChunks].inputFile = inputFile;
+			partitions[fileChunks].start = partitionStart;
+			partitions[fileChunks].end = partitionEnd;
+			++fileChunks;
+		}
+	}
 
-				if((idFoundFlag == 1) && (groupFoundFlag == 1) && (numericFoundFlag == 1)) {
+	// Print updated partitions for debugging
+	/*debug_print("File chunks = %d\n", fileChunks);
+	debug_print("Final file partitions...\n");
+	for(fileCtr=0; fileCtr<fileChunks; fileCtr++) {
+		debug_print("partitions[%u] = %lu - %lu\n", fileCtr, partitions[fileCtr].start, partitions[fileCtr].end);
+	}*/
 
-					if(!strcmp(idCurrentString, idTempString)) {
-						// Aggregate value for each group
-						(tposeQuery->aggregator)->aggregates[groupFieldIndex] += atof(numericTempString);
-						(tposeQuery->aggregator)->counts[groupFieldIndex]++;
-					}
-					else {
-						// 0 Compute averages
-						for(ctr = 0; ctr < ((tposeQuery->outputFile)->fileGroupHeader)->numFields; ++ctr)
-							(tposeQuery->aggregator)->avgs[ctr] = (tposeQuery->aggregator)->aggregates[ctr] / (tposeQuery->aggregator)->counts[ctr];
-						
-						// 1 Print out current aggregates for id
-						tposeIOPrintGroupIdData(idCurrentString, tposeQuery);
-						// 2 Set new string as current id
-						strcpy(idCurrentString, idTempString); // Set current id to aggregate values for
-						// 3 Reset aggregates
-						memset((tposeQuery->aggregator)->aggregates, 0, ((tposeQuery->outputFile)->fileGroupHeader)->numFields * sizeof(double));
-						memset((tposeQuery->aggregator)->counts, 0, ((tposeQuery->outputFile)->fileGroupHeader)->numFields * sizeof(double));
-						memset((tposeQuery->aggregator)->avgs, 0, ((tposeQuery->outputFile)->fileGroupHeader)->numFields * sizeof(double));
-						// 4 Aggregate value for new id 
-						(tposeQuery->aggregator)->aggregates[groupFieldIndex] += atof(numericTempString);
-						(tposeQuery->aggregator)->counts[groupFieldIndex]++;
+	return fileChunks ? 0 : -1;
 
-					}
+}
 
-				}
-					
-				// Reset flags for next row
-				idFoundFlag = 0;
-				groupFoundFlag = 0;
-				numericFoundFlag = 0;
 
-				fieldCount = 0;
-				++fieldSavePtr;
-				if(++totalCharCount == iFileSize) break;
-				continue;
-			}
-			
-			// GROUP FIELD
-			if(fieldCount == (tposeQuery->group))  { // if group value is empty string we ignore
-
-				// Get group field value
-				while(*fieldSavePtr != fieldDelimiter && *fieldSavePtr != rowDelimiter) {
-					groupTempString[fieldCharCount++] = *fieldSavePtr++;
-					if(++totalCharCount == iFileSize) break;
-				}
-				groupTempString[fieldCharCount] = '\0'; // Null-terminate string
 
-				// Convert char array to hash
-				for(hashCharCount = 0; hashCharCount <= fieldCharCount-1; ++hashCharCount)
-					hashValue = TPOSE_IO_HASH_MULT * hashValue + (unsigned char) groupTempString[hashCharCount];
+/**
+ ** Moves a row-aligned partition offset forward to the first row
+ ** with a different ID (so that an ID never spans two partitions)
+ **/
+off_t tposeIOAlignPartitionId(
+	TposeQuery* tposeQuery
+	,TposeInputFile* inputFile
+	,off_t offset
+) {
 
-				// Insert into btree
-				if( (resultKey = (BTreeKey*) btreeSearch(btree, btree->root, hashValue)) != NULL) {
-					groupFoundFlag = 1; // Flag group field as found
-					groupFieldIndex = resultKey->dataOffset; // Is used to correctly order aggregates
-				}
+	char* endPtr = inputFile->dataAddr + inputFile->dataSize;
+	char* nextRowPtr;
+	TposeRow firstRow;
 
-				// Reset variables
-				fieldCharCount = 0;
-				hashValue = 0;
-				
-				if(*fieldSavePtr == fieldDelimiter) {
-					--fieldSavePtr;
-					--totalCharCount;
-				}
+	firstRow.indexRow = -1;
+	nextRowPtr = tposeIOReadRow(tposeQuery, inputFile, inputFile->dataAddr + offset, endPtr, &firstRow);
 
-				if(*fieldSavePtr == rowDelimiter) {
-					--fieldSavePtr;
-					--totalCharCount;
-				}
-			}
-			
-			
-			// NUMERIC FIELD
-			if(fieldCount == (tposeQuery->numeric))  { // if group value is empty string we ignore
-
-				numericFoundFlag = 1; // Flag numeric field as found
-				
-				// Copy field value
-				while(*fieldSavePtr != fieldDelimiter && *fieldSavePtr != rowDelimiter) {
-					numericTempString[fieldCharCount++] = *fieldSavePtr++;
-					if(++totalCharCount == iFileSize) break;
-				}
-				numericTempString[fieldCharCount] = '\0'; // Null-terminate string
+	return tposeIOSkipId(tposeQuery, inputFile, nextRowPtr - inputFile->dataAddr, &firstRow);
 
-				// Reset variables
-				fieldCharCount = 0;
+}
 
-				if(*fieldSavePtr == fieldDelimiter) {
-					--totalCharCount;
-					--fieldSavePtr;
-				}
 
-				if(*fieldSavePtr == rowDelimiter) {
-					--fieldSavePtr;
-					--totalCharCount;
-				}
-			}
-			
-			// ID FIELD
-			if(fieldCount == (tposeQuery->id))  { // if group value is empty string we ignore
-
-				idFoundFlag = 1; // Flag numeric field as found
-				
-				// Copy field value
-				while(*fieldSavePtr != fieldDelimiter && *fieldSavePtr != rowDelimiter) {
-					idTempString[fieldCharCount++] = *fieldSavePtr++;
-					if(++totalCharCount == iFileSize) break;
-				}
-				idTempString[fieldCharCount] = '\0'; // Null-terminate string
 
-				if(firstId) {
-					strcpy(idCurrentString, idTempString); // Set current id to aggregate values for
-					firstId = 0;
-				}
-					
-				// Reset variables
-				fieldCharCount = 0;
+/**
+ ** Moves a row-aligned offset forward past the rows with the same ID as idRow
+ ** (which can be a row of another file), to the first row with a different ID
+ **/
+off_t tposeIOSkipId(
+	TposeQuery* tposeQuery
+	,TposeInputFile* inputFile
+	,off_t offset
+	,TposeRow* idRow
+) {
 
-				if(*fieldSavePtr == fieldDelimiter) {
-					--totalCharCount;
-					--fieldSavePtr;
-				}
+	char* endPtr = inputFile->dataAddr + inputFile->dataSize;
+	char* rowPtr;
+	char* nextRowPtr = inputFile->dataAddr + offset;
+	TposeRow row;
 
-				if(*fieldSavePtr == rowDelimiter) {
-					--fieldSavePtr;
-					--totalCharCount;
-				}
-			}
+	row.indexRow = -1;
 
-			// If not a delimiter or the group field, then ++
-			++fieldSavePtr;
-			if(++totalCharCount == iFileSize) break;
+	while(nextRowPtr < endPtr) {
+		rowPtr = nextRowPtr;
+		nextRowPtr = tposeIOReadRow(tposeQuery, inputFile, rowPtr, endPtr, &row);
 
+		if(row.idLength != idRow->idLength || (row.idLength && memcmp(row.id, idRow->id, row.idLength))) {
+			debug_print("tposeIOSkipId(): NOT EQUAL... breaking! currentId = %.*s | tempId = %.*s\n", idRow->idLength, idRow->id, row.idLength, row.id);
+			return rowPtr - inputFile->dataAddr; // Include the row in the next partition
 		}
+	}
 
-	} // End for-loop
-
-	for(ctr = 0; ctr < ((tposeQuery->outputFile)->fileGroupHeader)->numFields; ++ctr)
-		(tposeQuery->aggregator)->avgs[ctr] = (tposeQuery->aggregator)->aggregates[ctr] / (tposeQuery->aggregator)->counts[ctr];
-
-	// Print last line
-	tposeIOPrintGroupIdData(idCurrentString, tposeQuery);
+	return inputFile->dataSize;
 
 }
 
 
 
-/** 
- ** Paritions file into *correct* chunks for parallel-processing
- ** Multi-threaded only
+/**
+ ** Returns the offset of the last row of an input file (0 if it has no rows)
  **/
-int tposeIOBuildPartitions(
-	TposeQuery* tposeQuery
-	,unsigned int mode
+off_t tposeIOLastRowOffset(
+	TposeInputFile* inputFile
 ) {
 
-	extern unsigned int fileChunks; // Number of file chunks
-	unsigned char fieldDelimiter = (tposeQuery->inputFile)->fieldDelimiter;
-	char* fieldSavePtr; // Points at start of each field after every loop
-	off_t fileSize = (tposeQuery->inputFile)->fileSize;
-	off_t rFileSize = fileSize; // Remaining file size
-
-	fieldSavePtr = (tposeQuery->inputFile)->dataAddr; // Init with ptr to second row (where data starts)
+	off_t offset;
 
-	// Calculate file chunks
-	off_t prepartitions[1000];
-	int threadCtr = 0;
-	int reverseCtr = 0;
-	prepartitions[0] = fileSize;
+	if(inputFile->dataSize == 0)
+		return 0;
 
-	while(rFileSize >= TPOSE_IO_CHUNK_SIZE){
-		rFileSize -= TPOSE_IO_CHUNK_SIZE;
-		prepartitions[++fileChunks] = rFileSize;
-	}
-	prepartitions[++fileChunks] = 0; // First partition starts at byte 0
-	
-	// Reverse partitions to ease processing
-	for(threadCtr=fileChunks; threadCtr>=0; threadCtr--) {
-		partitions[reverseCtr++]=prepartitions[threadCtr];
-	}
+	// Columnar offsets are row numbers
+	if(inputFile->columnar != NULL)
+		return inputFile->dataSize - 1;
 
-	// Correct partitions to start after new lines
-	// when transposing over a group field only
-	char* partSavePtr;
-	off_t offset;
-	if(mode == TPOSE_IO_PARTITION_GROUP) {
-
-		// Don't need to modify first partition (0)
-		for(threadCtr=1; threadCtr<fileChunks; threadCtr++) { 
-			offset = 0;
-			partSavePtr = fieldSavePtr + partitions[threadCtr];
-			while(*(partSavePtr++) != '\n') {
-				++offset;
-			}
-			++offset;
-			partitions[threadCtr] += offset;
-		}
+	// The last row may or may not end with a row delimiter
+	for(offset = inputFile->dataSize - 1; offset > 0 && inputFile->dataAddr[offset - 1] != rowDelimiter; offset--);
 
-	}
-	// Partition file into chunks with mutually excluse set
-	// of IDs (avoids more complex post-processing 'shuffle')
-	// when transposing over id and group fields
-	else if(mode == TPOSE_IO_PARTITION_ID) { 
-
-		off_t partitionStart;
-		off_t partitionEnd;
-		off_t partitionCharLimit;
-		unsigned int idFoundFlag = 0; 
-		unsigned int fieldCount = 0; 
-		off_t fieldCharCount = 0; 
-		off_t totalCharCount = 0; 
-		char currentId[TPOSE_IO_MAX_FIELD_WIDTH];
-		char tempString[TPOSE_IO_MAX_FIELD_WIDTH];
-		unsigned int iterationCtr = 0;
-
-		// Don't need to modify first partition (0)
-		for(threadCtr=1; threadCtr<fileChunks; threadCtr++) { 
-			offset = 0;
-			totalCharCount = 0;
-			idFoundFlag = 0; 
-			iterationCtr = 0;
-
-			// Starting point
-			partSavePtr = fieldSavePtr + partitions[threadCtr];
-
-			// Correct to point at start of line
-			while(*(partSavePtr++) != '\n') {
-				++offset;
-			}
-			++offset;
-			partitions[threadCtr] += offset;
-			offset = 0;
+	return offset;
 
-			// Set partition params
-			partitionStart = partitions[threadCtr];
-			partitionEnd = partitions[threadCtr+1];
-			partitionCharLimit = partitionEnd - partitionStart;
-			
-			// Corrected starting point
-			partSavePtr = fieldSavePtr + partitions[threadCtr];
+}
 
 
-			// Loop over file partition
-			while(!idFoundFlag) {
 
-				// FIELD DELIMITER
-				if(*partSavePtr == fieldDelimiter) {
-					++offset;
-					++fieldCount;
-					++partSavePtr;
-					if(++totalCharCount == partitionCharLimit) break;
-					continue;
-				}
+/**
+ ** Returns the number of worker threads to share the partitions between
+ ** (one per CPU, but no more than there are partitions), and resets
+ ** tposeIONextPartition so the workers start from the first partition
+ **/
+unsigned int tposeIONumWorkers(
+	void
+) {
 
-				// ROW DELIMITER
-				if(*partSavePtr == rowDelimiter) {
-					++offset;
-					++partSavePtr;
-					fieldCount = 0;
-					if(++totalCharCount == partitionCharLimit) break;
-					continue;
-				}
-				
-				// ID FIELD
-				if(fieldCount == (tposeQuery->id))  { 
-
-					// Copy field value
-					while(*partSavePtr != fieldDelimiter && *partSavePtr != rowDelimiter) {
-						++offset;
-						tempString[fieldCharCount++] = *partSavePtr++;
-						if(++totalCharCount == partitionCharLimit) break;
-					}
-					tempString[fieldCharCount] = '\0'; // Null-terminate string
-					
-					// Reset variables (
-					fieldCharCount = 0;
-
-					// First iteration only - set first id as current
-					if(iterationCtr == 0) {
-						strcpy(currentId, tempString); 
-						iterationCtr++;
-					}
+	long numCpus;
 
-					if(!strcmp(currentId, tempString)) {
-						debug_print("%u : EQUAL... continuing! currentId = %s | tempId = %s\n", threadCtr, currentId, tempString);
-						continue;
-					}
-					else {
-						debug_print("%u : NOT EQUAL... breaking! currentId = %s | tempId = %s\n", threadCtr, currentId, tempString);
-						idFoundFlag = 1;
-						strcpy(currentId, tempString); 
-
-						// Go back to start of current line
-						// to include it in partition
-						while(*(partSavePtr--) != '\n') {
-							--offset;
-						}
-						++offset;
-						break;
-					}
-					
-					if(*partSavePtr == fieldDelimiter) {
-						--offset;
-						--partSavePtr;
-						--totalCharCount;
-					}
+	if((numCpus = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+		numCpus = 1;
 
-					if(*partSavePtr == rowDelimiter) {
-						--offset;
-						--partSavePtr;
-						--totalCharCount;
-					}
+	__atomic_store_n(&nextPartition, 0, __ATOMIC_RELAXED);
 
-				}
+	return (numCpus < fileChunks) ? (unsigned int) numCpus : fileChunks;
 
-				// If not a delimiter or group field, then ++
-				++partSavePtr;
-				++offset;
-				if(++totalCharCount == partitionCharLimit) break;
+}
 
-			} // End of while-loop
 
-			// Record new offset
-			partitions[threadCtr] += offset;
-		}
 
-	}
-	else {
-		return -1;
-	}
+/**
+ ** Returns the next partition for a worker to scan (fileChunks once all are taken)
+ ** Partitions are handed out in order, so each worker scans its partitions in order
+ **/
+unsigned int tposeIONextPartition(
+	void
+) {
 
-	// Print updated partitions for debugging
-	/*debug_print("File chunks = %d\n", fileChunks);
-	debug_print("Final file partitions...\n");
-	for(reverseCtr=0; reverseCtr<=fileChunks; reverseCtr++) {
-		debug_print("partitions[%u] = %lu\n", reverseCtr, partitions[reverseCtr]);
-	}*/
+	unsigned int partitionId = __atomic_fetch_add(&nextPartition, 1, __ATOMIC_RELAXED);
 
-	return 0;
+	return (partitionId < fileChunks) ? partitionId : fileChunks;
 
 }
 
 
 
-/** 
- ** Returns a unique list of GROUP variable values 
+/**
+ ** Returns a unique list of GROUP variable values
  ** Coordinator for multi-threaded version
  **/
 void tposeIOUniqueGroupsParallel(
 	TposeQuery* tposeQuery
 ) {
 
-	extern unsigned int fileChunks; // Number of file chunks
-
 	unsigned int threadsCtr = 0;
-	pthread_t threads[fileChunks]; // Thread array
+	pthread_t* threads;
+
+	numWorkers = tposeIONumWorkers();
 
-	// Allocate memory for threadDataArray (one for each file chunk)
-	if((threadDataArray = (TposeThreadData**) calloc(1, fileChunks * sizeof(TposeThreadData*))) == NULL ) {
+	// Allocate memory for threadDataArray (one for each worker)
+	if((threadDataArray = (TposeThreadData**) calloc(1, numWorkers * sizeof(TposeThreadData*))) == NULL
+		|| (threads = (pthread_t*) calloc(numWorkers, sizeof(pthread_t))) == NULL) {
 		fprintf(stderr, "Error: Cannot allocate aggregator memory\n");
 		exit(EXIT_FAILURE);
 	}
 
+	tposeIOPrefetchStart(partitions, fileChunks);
+
 	// Create threads
-	for(threadsCtr = 0; threadsCtr < fileChunks; threadsCtr++) {
+	for(threadsCtr = 0; threadsCtr < numWorkers; threadsCtr++) {
 
-		if((threadData = (TposeThreadData*) calloc(1, sizeof(TposeThreadData))) == NULL ) {
+		if((threadData = (TposeThreadData*) calloc(1, sizeof(TposeThreadData))) == NULL
+			|| (threadData->firstPartitions = (unsigned int*) malloc(TPOSE_IO_MAX_FIELDS * sizeof(unsigned int))) == NULL) {
 			fprintf(stderr, "Error: Cannot allocate aggregator memory\n");
 			exit(EXIT_FAILURE);
 		}
-		
+
 		// Assign thread arguments
 		threadData->threadId = threadsCtr;
-		threadData->query = tposeQuery; 
+		threadData->query = tposeQuery;
 		threadData->header = (TposeHeader*) tposeIOHeaderAlloc(TPOSE_IO_MAX_FIELDS, TPOSE_IO_MODIFY_HEADER); // Allocate the needed memory
-		threadDataArray[threadsCtr] = threadData; 
+		threadDataArray[threadsCtr] = threadData;
 
 		if(pthread_create(&threads[threadsCtr], NULL, tposeIOUniqueGroupsMap, (void *) threadDataArray[threadsCtr])) {
 			fprintf(stderr, "Error: Cannot create thread - attempt to run tpose in single-threaded mode\n");
 			exit(EXIT_FAILURE);
 		}
 	}
-	
+
 	// Sync threads
-	for(threadsCtr = 0; threadsCtr < fileChunks; threadsCtr++)
+	for(threadsCtr = 0; threadsCtr < numWorkers; threadsCtr++)
 		(void) pthread_join(threads[threadsCtr], NULL);
 
+	tposeIOPrefetchStop();
+
 	// Reduce output header
 	tposeIOUniqueGroupsReduce(tposeQuery);
 
 	// Clean-up
-	for(threadsCtr = 0; threadsCtr < fileChunks; threadsCtr++) {
+	for(threadsCtr = 0; threadsCtr < numWorkers; threadsCtr++) {
+		tposeIOHeaderFree(&(threadDataArray[threadsCtr]->header));
+		free(threadDataArray[threadsCtr]->firstPartitions);
 		free(threadDataArray[threadsCtr]);
 	}
 	free(threadDataArray);
+	free(threads);
 
 }
 
 
 
-/** 
- ** Returns a unique list of GROUP variable values 
- ** Maps file chunks to each thread
+/**
+ ** Returns a unique list of GROUP variable values
+ ** Maps file chunks to each thread (each worker scans partitions until none are left)
  **/
 void* tposeIOUniqueGroupsMap(
 	void* threadArg
 ) {
-	
+
 	// Flags & static vars
 	TposeThreadData* threadData = (TposeThreadData*) threadArg;
 
 	TposeQuery* tposeQuery = (TposeQuery*) threadData->query;
 	TposeHeader* header = (TposeHeader*) threadData->header;
-	unsigned int threadId = (unsigned int) threadData->threadId;
-	unsigned char fieldDelimiter = (tposeQuery->inputFile)->fieldDelimiter;
-	off_t partitionStart = partitions[threadId];
-	off_t partitionEnd = partitions[threadId+1];
-	off_t partitionCharLimit = partitionEnd - partitionStart;
+	unsigned int partitionId;
+	unsigned int fieldCtr;
 
 	// Temp allocs
-	BTree* btree = btreeAlloc(); // Needs to persist between computing unique groups, and aggregating values
-	BTreeKey* key = btreeKeyAlloc();
-	BTreeKey* resultKey;
-	char tempString[TPOSE_IO_MAX_FIELD_WIDTH];
-	char* allocString;
-	char* fieldSavePtr; // Points at start of each field after every loop
-
-	// Counters & limits
-	off_t rowCount = 2; // For debugging only
-	unsigned int fieldCount = 0; // Already pointing at the first field when loop starts 
-	off_t uniqueGroupCount = 0; // Used to index array of header ptrs
-	off_t groupCharCount = 0; 
-	off_t hashCharCount = 0; 
-	off_t totalCharCount = 0; // Needed to stop reading at EOF (mmap files are page aligned, so we end-up reading garbage after file data ends)
-	off_t hashValue = 0; 
-
-
-	// Init with ptr to second row (where data starts)
-	fieldSavePtr = ((tposeQuery->inputFile)->dataAddr) + partitionStart; 
-
-
-		// Loop over file partition
-		while(totalCharCount <= partitionCharLimit) {
-
-			// FIELD DELIMITER
-			if(*fieldSavePtr == fieldDelimiter) {
-				++fieldCount;
-				++fieldSavePtr;
-				if(++totalCharCount == partitionCharLimit) break;
-				continue;
-			}
-
-			// ROW DELIMITER
-			if(*fieldSavePtr == rowDelimiter) {
-				fieldCount = 0;
-				++rowCount;
-				++fieldSavePtr;
-				if(++totalCharCount == partitionCharLimit) break;
-				continue;
-			}
-			
-			// GROUP FIELD
-			if(fieldCount == (tposeQuery->group))  { // if group value is empty string we ignore
-
-				// Copy field value
-				while(*fieldSavePtr != fieldDelimiter && *fieldSavePtr != rowDelimiter) {
-					tempString[groupCharCount++] = *fieldSavePtr++;
-					if(++totalCharCount == partitionCharLimit) break;
-				}
-				tempString[groupCharCount] = '\0';
-
-				// Convert char array to hash
-				for(hashCharCount = 0; hashCharCount <= groupCharCount-1; ++hashCharCount)
-					hashValue = TPOSE_IO_HASH_MULT * hashValue + (unsigned char) tempString[hashCharCount];
-
-				// Insert into btree
-				if( (resultKey = (BTreeKey*) btreeSearch(btree, btree->root, hashValue)) == NULL) {
-
-					// Check for collisions - print only when we add a unique group
-					debug_print("tposeIOgetUniqueGroups(): New group found = '");
-					debug_print("tposeIOgetUniqueGroups(): row=%u / field=%u = %s\thash=%ld\tuniqueGroupCount=%u\n", rowCount, fieldCount, tempString, hashValue, uniqueGroupCount);
-
-					btreeSetKeyValue(key, hashValue, uniqueGroupCount, 0);
-					if(btreeInsert(btree, key) == -1) {
-						fprintf(stderr, "Error: Cannot insert value into btree\n");
-					}
-
-					// Insert into header
-					allocString = malloc(strlen(tempString) * sizeof(char));
-					strcpy(allocString, tempString);
-					*(header->fields+(uniqueGroupCount++)) = allocString;
-				}
-
-				// Reset variables
-				groupCharCount = 0;
-				hashValue = 0;
-				
-				if(*fieldSavePtr == fieldDelimiter) {
-					--fieldSavePtr;
-					--totalCharCount;
-				}
-
-				if(*fieldSavePtr == rowDelimiter) {
-					--fieldSavePtr;
-					--totalCharCount;
-				}
-			}
-
-			// If not a delimiter or group field, then ++
-			++fieldSavePtr;
-			if(++totalCharCount == partitionCharLimit) break;
+	BTree* btree = btreeAlloc(); // Thread-local set of unique groups
+
+	// Loop over file partitions (groups found in each are tagged with it)
+	while((partitionId = tposeIONextPartition()) < fileChunks) {
+		fieldCtr = header->numFields;
+		tposeIOUniqueGroupsScan(tposeQuery, btree, header, &partitions[partitionId], partitionId);
+		for(; fieldCtr < header->numFields; fieldCtr++)
+			threadData->firstPartitions[fieldCtr] = partitionId;
+	}
 
-		}
+	// Clean-up
+	btreeFree(&btree);
 
-		// Write output header for partition
-		header->numFields = uniqueGroupCount;
+	return NULL;
 
-		// Clean-up
-		btreeFree(&btree);
-	
 }
 
 
 
-/** 
- ** Returns a unique list of GROUP variable values 
+/**
+ ** Returns a unique list of GROUP variable values
  ** Reduces thread results into final output
  **/
 void tposeIOUniqueGroupsReduce(
 	TposeQuery* tposeQuery
 ) {
-	
+
 	// Counters & limits
 	unsigned int mutateHeader = 1; // Allow for header row to be modified
 	off_t uniqueGroupCount = 0; // Used to index array of header ptrs
-	off_t groupCharCount = 0; 
-	off_t hashCharCount = 0; 
-	off_t totalCharCount = 0; // Needed to stop reading at EOF (mmap files are page aligned, so we end-up reading garbage after file data ends)
-	off_t hashValue = 0; 
+	off_t hashValue = 0;
 
 	// Temp allocs
-	BTreeKey* key = btreeKeyAlloc();
-	BTreeKey* resultKey;
-	char tempString[TPOSE_IO_MAX_FIELD_WIDTH];
-	char* allocString;
-	char* charSavePtr; // Points at start of each field after every loop
+	BTreeKey key;
+	char* groupString;
+	TposeHeader* threadHeader;
+	unsigned int* fieldCtrs;
 
 
 	// Reduced output header
 	TposeHeader* header = tposeIOHeaderAlloc(TPOSE_IO_MAX_FIELDS, mutateHeader); // Allocate the needed memory*/
 
+	if((fieldCtrs = (unsigned int*) calloc(numWorkers, sizeof(unsigned int))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate aggregator memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Reduce parallel headers to single output header (in partition order, each
+	// partition's groups coming from the one worker that scanned it)
+	unsigned int partitionCtr, threadCtr;
+	for(partitionCtr = 0; partitionCtr < fileChunks; partitionCtr++) {
 
-	// Reduce parallel headers to single output header
-	int threadCtr, fieldCtr;
-	for(threadCtr = 0; threadCtr < fileChunks; threadCtr++) {
+		for(threadCtr = 0; threadCtr < numWorkers; threadCtr++) {
 
-		for(fieldCtr = 0; fieldCtr < (threadDataArray[threadCtr]->header)->numFields; fieldCtr++) {
+			threadHeader = threadDataArray[threadCtr]->header;
+			for(; fieldCtrs[threadCtr] < threadHeader->numFields && threadDataArray[threadCtr]->firstPartitions[fieldCtrs[threadCtr]] == partitionCtr; fieldCtrs[threadCtr]++) {
 
-				charSavePtr = (threadDataArray[threadCtr]->header)->fields[fieldCtr];
-				
-				// Copy field value
-				while(*charSavePtr != '\0') {
-					tempString[groupCharCount++] = *charSavePtr++;
-				}
-				tempString[groupCharCount] = '\0';
+				groupString = threadHeader->fields[fieldCtrs[threadCtr]];
 
 				// Convert char array to hash
-				for(hashCharCount = 0; hashCharCount <= groupCharCount-1; ++hashCharCount)
-					hashValue = TPOSE_IO_HASH_MULT * hashValue + (unsigned char) tempString[hashCharCount];
+				hashValue = tposeIOHash(groupString, strlen(groupString));
 
 				// Insert into btree
-				if( (resultKey = (BTreeKey*) btreeSearch(btreeGlobal, btreeGlobal->root, hashValue)) == NULL) {
+				if(btreeSearch(btreeGlobal, btreeGlobal->root, hashValue) == NULL) {
+
+					if(uniqueGroupCount == header->maxFields) {
+						fprintf(stderr, "Error: Too many unique GROUP values (maximum is %u)\n", header->maxFields);
+						exit(EXIT_FAILURE);
+					}
 
-					btreeSetKeyValue(key, hashValue, uniqueGroupCount, 0);
-					if(btreeInsert(btreeGlobal, key) == -1) {
+					btreeSetKeyValue(&key, hashValue, uniqueGroupCount, 0);
+					key.isUnlinked = 0;
+					if(btreeInsert(btreeGlobal, &key) == -1) {
 						fprintf(stderr, "Error: Cannot insert value into btree\n");
 					}
 
 					// Insert into TposeHeader object
-					allocString = malloc(strlen(tempString) * sizeof(char));
-					strcpy(allocString, tempString);
-					*(header->fields+(uniqueGroupCount++)) = allocString;
+					*(header->fields+(uniqueGroupCount++)) = tposeArenaStrndup(header->arena, groupString, strlen(groupString));
 				}
-
-				// Reset variables (
-				groupCharCount = 0;
-				hashValue = 0;
+			}
 		}
 	}
 
+	free(fieldCtrs);
+
 	// Update count of unique groups
 	header->numFields = uniqueGroupCount;
 
 	// Return header
-	(tposeQuery->outputFile)->fileGroupHeader = header; 
+	(tposeQuery->outputFile)->fileGroupHeader = header;
 
 }
 
 
 
-/** 
+/**
  ** Transposes numeric values for each unique group value
  ** Coordinator for multi-threaded version
  **/
@@ -1768,200 +3247,98 @@ void tposeIOTransposeGroupParallel(
 	TposeQuery* tposeQuery
 ) {
 
-	extern unsigned int fileChunks; // Number of file chunks
-
-	pthread_t threads[fileChunks]; // Thread array
+	pthread_t* threads;
+	unsigned int partitionCtr;
 	int threadCtr = 0;
 
-	// Allocate memory for threadAggregatorArray (one for each file chunk)
-	if((threadAggregatorArray = (TposeThreadAggregator**) calloc(1, fileChunks * sizeof(TposeThreadAggregator*))) == NULL ) {
+	numWorkers = tposeIONumWorkers();
+
+	// Allocate memory for threadAggregatorArray (one for each partition, so
+	// partial sums are added up in partition order whichever worker took them)
+	if((threadAggregatorArray = (TposeThreadAggregator**) calloc(1, fileChunks * sizeof(TposeThreadAggregator*))) == NULL
+		|| (threads = (pthread_t*) calloc(numWorkers, sizeof(pthread_t))) == NULL) {
 		fprintf(stderr, "Error: Cannot allocate aggregator memory\n");
 		exit(EXIT_FAILURE);
 	}
 
-	// Create threads
-	for(threadCtr = 0; threadCtr < fileChunks; threadCtr++) {
+	tposeIOGroupHashBuild(tposeQuery, btreeGlobal);
+	tposeIOGroupOrderBuild(tposeQuery);
+	tposeIOPrefetchStart(partitions, fileChunks);
+
+	for(partitionCtr = 0; partitionCtr < fileChunks; partitionCtr++) {
 
 		if((threadAggregator = (TposeThreadAggregator*) calloc(1, sizeof(TposeThreadAggregator))) == NULL ) {
 			fprintf(stderr, "Error: Cannot allocate aggregator memory\n");
 			exit(EXIT_FAILURE);
 		}
 
-		// Assign arguments to current thread
-		threadAggregator->threadId = threadCtr;
-		threadAggregator->query = tposeQuery; 
-		threadAggregator->aggregator = tposeIOAggregatorAlloc(((tposeQuery->outputFile)->fileGroupHeader)->numFields);
-		threadAggregatorArray[threadCtr] = threadAggregator; 
+		// The aggregator is allocated by the worker that takes the partition
+		threadAggregator->threadId = partitionCtr;
+		threadAggregator->query = tposeQuery;
+		threadAggregator->aggregator = NULL;
+		threadAggregatorArray[partitionCtr] = threadAggregator;
+	}
+
+	// Create threads
+	for(threadCtr = 0; threadCtr < numWorkers; threadCtr++) {
 
 		// Map input to threads
-		if(pthread_create(&threads[threadCtr], NULL, tposeIOTransposeGroupMap, (void *) threadAggregatorArray[threadCtr])) {
+		if(pthread_create(&threads[threadCtr], NULL, tposeIOTransposeGroupMap, (void *) tposeQuery)) {
 			fprintf(stderr, "Error: cannot create thread - attempt to run tpose in single-threaded mode\n");
 			exit(EXIT_FAILURE);
 		}
 
 	}
-	
-	// Sync threads
-	for(threadCtr=0; threadCtr<fileChunks; threadCtr++)
-		(void) pthread_join(threads[threadCtr], NULL);
-
-	// Reduce output header
-	tposeIOTransposeGroupReduce(tposeQuery);
-
-	// Clean-up
-	for(threadCtr=0; threadCtr<fileChunks; threadCtr++) {
-		tposeIOAggregatorFree(&(threadAggregatorArray[threadCtr]->aggregator));
-	}
-	free(threadAggregatorArray);
-
-}
-
-
-
-/** 
- ** Transposes numeric values for each unique group value
- ** Maps file chunks to each thread
- **/
-void* tposeIOTransposeGroupMap(
-	void* threadArg
-) {
 
-	// Flags and static vars
-	TposeThreadAggregator* threadAggregator = (TposeThreadAggregator*) threadArg;
-
-	TposeQuery* tposeQuery = (TposeQuery*) threadAggregator->query;
-	TposeAggregator* aggregator = (TposeAggregator*) threadAggregator->aggregator;
-	unsigned int threadId = (unsigned int) threadAggregator->threadId;
-	unsigned char fieldDelimiter = (tposeQuery->inputFile)->fieldDelimiter;
-	unsigned int groupFoundFlag = 0; // 1 when we find the group field, 0 otherwise (0 if there is no group value)
-	unsigned int numericFoundFlag = 0; // 1 when we find the numeric field, 0 otherwise (0 if there is no numeric value)
-	off_t partitionStart = partitions[threadId];
-	off_t partitionEnd = partitions[threadId+1];
-	off_t partitionCharLimit = partitionEnd - partitionStart;
-
-	// Temp allocs
-	BTreeKey* key = btreeKeyAlloc();
-	BTreeKey* resultKey;
-	char* allocString;
-	char* fieldSavePtr; // Points at start of each field after every loop
-	char groupTempString[TPOSE_IO_MAX_FIELD_WIDTH];
-	char numericTempString[TPOSE_IO_MAX_FIELD_WIDTH];
-
-	// Counters & limits
-	off_t rowCount = 2; // For debugging only
-	unsigned int fieldCount = 0; // Already pointing at the first field when loop starts 
-	unsigned int fieldCharCount = 0;
-	off_t hashCharCount = 0; 
-	off_t totalCharCount = 0; // Needed to stop reading at EOF (mmap files are page aligned, so we end-up reading garbage after file data ends)
-	off_t hashValue = 0; 
-	off_t groupFieldIndex = 0; // Holds index of group field in TposeHeader struct
-
-
-	fieldSavePtr = ((tposeQuery->inputFile)->dataAddr) + partitionStart; // Init with ptr to second row (where data starts)
-
-
-		/* Process each file chunk */
-		while(totalCharCount <= partitionCharLimit) {
-
-			// FIELD DELIMITER
-			if(*fieldSavePtr == fieldDelimiter) {
-				++fieldCount;
-				++fieldSavePtr;
-				if(++totalCharCount == partitionCharLimit) break;
-				continue;
-			}
-
-			// ROW DELIMITER
-			if(*fieldSavePtr == rowDelimiter) {
-				// Aggregate value for each group
-				if((groupFoundFlag == 1) && (numericFoundFlag == 1)) {
-					aggregator->aggregates[groupFieldIndex] += atof(numericTempString);
-					aggregator->counts[groupFieldIndex]++;
-				}
-					
-				// Reset flags for next row
-				groupFoundFlag = 0;
-				numericFoundFlag = 0;
-
-				fieldCount = 0;
-				++fieldSavePtr;
-				if(++totalCharCount == partitionCharLimit) break;
-				continue;
-
-			}
-
-			// GROUP FIELD
-			if(fieldCount == (tposeQuery->group))  { // if group value is empty string we ignore
-
-				// Get group field value
-				while(*fieldSavePtr != fieldDelimiter && *fieldSavePtr != rowDelimiter) {
-					groupTempString[fieldCharCount++] = *fieldSavePtr++;
-					++totalCharCount;
-				}
-				groupTempString[fieldCharCount] = '\0'; // Null-terminate string
+	// Sync threads
+	for(threadCtr=0; threadCtr<numWorkers; threadCtr++)
+		(void) pthread_join(threads[threadCtr], NULL);
 
-				// Convert char array to hash
-				for(hashCharCount = 0; hashCharCount <= fieldCharCount-1; ++hashCharCount)
-					hashValue = TPOSE_IO_HASH_MULT * hashValue + (unsigned char) groupTempString[hashCharCount];
+	tposeIOPrefetchStop();
 
-				// Insert into btree
-				if( (resultKey = (BTreeKey*) btreeSearch(btreeGlobal, btreeGlobal->root, hashValue)) != NULL) {
-					groupFoundFlag = 1; // Flag group field as found
-					groupFieldIndex = resultKey->dataOffset;
-				}
+	// Reduce output header
+	tposeIOTransposeGroupReduce(tposeQuery);
 
-				// Reset variables
-				fieldCharCount = 0;
-				hashValue = 0;
-				
-				if(*fieldSavePtr == fieldDelimiter) {
-					--fieldSavePtr;
-					--totalCharCount;
-				}
+	// Clean-up
+	for(partitionCtr = 0; partitionCtr < fileChunks; partitionCtr++) {
+		tposeIOAggregatorFree(&(threadAggregatorArray[partitionCtr]->aggregator));
+		free(threadAggregatorArray[partitionCtr]);
+	}
+	free(threadAggregatorArray);
+	free(threads);
 
-				if(*fieldSavePtr == rowDelimiter) {
-					--fieldSavePtr;
-					--totalCharCount;
-				}
-			}
-			
-			// NUMERIC FIELD
-			if(fieldCount == (tposeQuery->numeric))  { // if group value is empty string we ignore
-
-				numericFoundFlag = 1; // Flag numeric field as found
-				
-				// Copy field value
-				while(*fieldSavePtr != fieldDelimiter && *fieldSavePtr != rowDelimiter) {
-					numericTempString[fieldCharCount++] = *fieldSavePtr++;
-					if(++totalCharCount == partitionCharLimit) break;
-				}
-				numericTempString[fieldCharCount] = '\0'; // Null-terminate string
+}
 
-				// Reset vars
-				fieldCharCount = 0;
 
-				if(*fieldSavePtr == fieldDelimiter) {
-					--totalCharCount;
-					--fieldSavePtr;
-				}
 
-				if(*fieldSavePtr == rowDelimiter) {
-					--fieldSavePtr;
-					--totalCharCount;
-				}
-			}
+/**
+ ** Transposes numeric values for each unique group value
+ ** Maps file chunks to each thread (each worker aggregates the partitions
+ ** it takes, one aggregator per partition, until none are left)
+ **/
+void* tposeIOTransposeGroupMap(
+	void* queryArg
+) {
 
-			// If not a delimiter or group field, then ++
-			++fieldSavePtr;
-			if(++totalCharCount == partitionCharLimit) break;
+	// Flags and static vars
+	TposeQuery* tposeQuery = (TposeQuery*) queryArg;
+	TposeThreadAggregator* partitionAggregator;
+	unsigned int partitionId;
+
+	/* Process each file chunk */
+	while((partitionId = tposeIONextPartition()) < fileChunks) {
+		partitionAggregator = threadAggregatorArray[partitionId];
+		partitionAggregator->aggregator = tposeIOAggregatorAlloc(((tposeQuery->outputFile)->fileGroupHeader)->numFields * tposeQuery->numNumerics, tposeQuery->aggregateStats);
+		tposeIOTransposeGroupScan(tposeQuery, btreeGlobal, partitionAggregator->aggregator, &partitions[partitionId], partitionId);
+	}
 
-		}
+	return NULL;
 
 }
 
 
 
-/** 
+/**
  ** Transposes numeric values for each unique group value
  ** Reduces thread results into final output
  **/
@@ -1970,32 +3347,27 @@ void tposeIOTransposeGroupReduce(
 ){
 
 	// Aggregate thread results
-	tposeQuery->aggregator = tposeIOAggregatorAlloc(((tposeQuery->outputFile)->fileGroupHeader)->numFields);
+	tposeQuery->aggregator = tposeIOAggregatorAlloc(((tposeQuery->outputFile)->fileGroupHeader)->numFields * tposeQuery->numNumerics, tposeQuery->aggregateStats);
 
+	// In partition order (see tposeIOTransposeGroupParallel)
 	unsigned int threadCtr, fieldCtr;
 	for(threadCtr=0; threadCtr < fileChunks; threadCtr++) {
 		for(fieldCtr=0; fieldCtr < (threadAggregatorArray[threadCtr]->aggregator)->numFields; fieldCtr++) {
-			(tposeQuery->aggregator)->aggregates[fieldCtr] += (threadAggregatorArray[threadCtr]->aggregator)->aggregates[fieldCtr];
-			(tposeQuery->aggregator)->counts[fieldCtr] += (threadAggregatorArray[threadCtr]->aggregator)->counts[fieldCtr];
+			tposeIOAggregatorMerge(tposeQuery->aggregator, fieldCtr, threadAggregatorArray[threadCtr]->aggregator, fieldCtr);
 		}
 	}
 
-	// Calculate averages
-	int ctr;
-	for(ctr = 0; ctr < ((tposeQuery->outputFile)->fileGroupHeader)->numFields; ++ctr)
-		(tposeQuery->aggregator)->avgs[ctr] = (tposeQuery->aggregator)->aggregates[ctr] / (tposeQuery->aggregator)->counts[ctr];
-
 	// Print aggregates to final output
 	tposeIOPrintOutput(tposeQuery);
 
 	// Clean-up
 	tposeIOAggregatorFree(&(tposeQuery->aggregator));
-	
+
 }
 
 
 
-/** 
+/**
  ** Transposes numeric values for each unique group and id value
  ** Coordinator for multi-threaded version
  **/
@@ -2003,27 +3375,36 @@ void tposeIOTransposeGroupIdParallel(
 	TposeQuery* tposeQuery
 ) {
 
-	extern unsigned int fileChunks; // Number of file chunks
-
-	pthread_t threads[fileChunks]; // Thread array
-	char tempFilePath[100][15]; // Array of output filepaths
+	pthread_t* threads;
+	char tempFilePath[TPOSE_IO_MAX_PARTITIONS][32]; // Array of output filepaths
+	unsigned int partitionCtr;
 	int threadCtr = 0;
 
-	// Allocate memory for threadAggregatorArray (one for each file chunk)
-	if((threadAggregatorArray = (TposeThreadAggregator**) calloc(1, fileChunks * sizeof(TposeThreadAggregator*))) == NULL ) {
+	numWorkers = tposeIONumWorkers();
+
+	// Allocate memory for threadAggregatorArray (one for each worker)
+	if((threadAggregatorArray = (TposeThreadAggregator**) calloc(1, numWorkers * sizeof(TposeThreadAggregator*))) == NULL
+		|| (threads = (pthread_t*) calloc(numWorkers, sizeof(pthread_t))) == NULL) {
 		fprintf(stderr, "Error: Cannot allocate aggregator memory\n");
 		exit(EXIT_FAILURE);
 	}
 
-	// Create threads
-	for(threadCtr = 0; threadCtr < fileChunks; threadCtr++) {
+	tposeIOGroupHashBuild(tposeQuery, btreeGlobal);
+	tposeIOGroupOrderBuild(tposeQuery);
+	tposeIOPrefetchStart(partitions, fileChunks);
 
-		sprintf(tempFilePath[threadCtr], "temp%u.txt", threadCtr);	
-		debug_print("%u : temp file = %s\n", threadCtr, tempFilePath[threadCtr]);
-		if((tempFileArray[threadCtr] = tposeIOOpenOutputFile(tempFilePath[threadCtr], "w+",(tposeQuery->inputFile)->fieldDelimiter)) == NULL) {
+	// One temp file for each partition (concatenated in partition order)
+	for(partitionCtr = 0; partitionCtr < fileChunks; partitionCtr++) {
+		sprintf(tempFilePath[partitionCtr], "temp%u.txt", partitionCtr);
+		debug_print("%u : temp file = %s\n", partitionCtr, tempFilePath[partitionCtr]);
+		if((tempFileArray[partitionCtr] = tposeIOOpenOutputFile(tempFilePath[partitionCtr], "w+",(tposeQuery->inputFile)->fieldDelimiter)) == NULL) {
 			fprintf(stderr, "Error: Cannot open temp file\n");
 			exit(EXIT_FAILURE);
 		}
+	}
+
+	// Create threads
+	for(threadCtr = 0; threadCtr < numWorkers; threadCtr++) {
 
 		if((threadAggregator = (TposeThreadAggregator*) calloc(1, sizeof(TposeThreadAggregator))) == NULL ) {
 			fprintf(stderr, "Error: Cannot allocate aggregator memory\n");
@@ -2032,9 +3413,9 @@ void tposeIOTransposeGroupIdParallel(
 
 		// Assign arguments to current thread
 		threadAggregator->threadId = threadCtr;
-		threadAggregator->query = tposeQuery; 
-		threadAggregator->aggregator = tposeIOAggregatorAlloc(((tposeQuery->outputFile)->fileGroupHeader)->numFields);
-		threadAggregatorArray[threadCtr] = threadAggregator; 
+		threadAggregator->query = tposeQuery;
+		threadAggregator->aggregator = tposeIOAggregatorAlloc(((tposeQuery->outputFile)->fileGroupHeader)->numFields * tposeQuery->numNumerics, tposeQuery->aggregateStats);
+		threadAggregatorArray[threadCtr] = threadAggregator;
 
 		// Map input to threads
 		if(pthread_create(&threads[threadCtr], NULL, tposeIOTransposeGroupIdMap, (void *) threadAggregatorArray[threadCtr])) {
@@ -2042,30 +3423,37 @@ void tposeIOTransposeGroupIdParallel(
 			exit(EXIT_FAILURE);
 		}
 	}
-	
+
 	// Sync threads
-	for(threadCtr=0; threadCtr<fileChunks; threadCtr++)
+	for(threadCtr=0; threadCtr<numWorkers; threadCtr++)
 		(void) pthread_join(threads[threadCtr], NULL);
 
-	
+	tposeIOPrefetchStop();
+
+
 	// Reduce output header
 	tposeIOTransposeGroupIdReduce(tposeQuery);
 
 	// Clean-up
-	for(threadCtr=0; threadCtr<fileChunks; threadCtr++) {
+	for(threadCtr=0; threadCtr<numWorkers; threadCtr++) {
 		tposeIOAggregatorFree(&(threadAggregatorArray[threadCtr]->aggregator));
-		tposeIOCloseOutputFile(tempFileArray[threadCtr]);
-		remove(tempFilePath[threadCtr]);
+		free(threadAggregatorArray[threadCtr]);
+	}
+	for(partitionCtr = 0; partitionCtr < fileChunks; partitionCtr++) {
+		tposeIOCloseOutputFile(tempFileArray[partitionCtr]);
+		remove(tempFilePath[partitionCtr]);
 	}
 	free(threadAggregatorArray);
+	free(threads);
 
 }
 
 
 
-/** 
+/**
  ** Transposes numeric values for each unique group and id value
- ** Maps file chunks to each thread
+ ** Maps file chunks to each thread (each worker writes the IDs of a partition
+ ** to its temp file, reusing one aggregator, until none are left)
  **/
 void* tposeIOTransposeGroupIdMap(
 	void* threadArg
@@ -2076,236 +3464,267 @@ void* tposeIOTransposeGroupIdMap(
 
 	TposeQuery* tposeQuery = (TposeQuery*) threadAggregator->query;
 	TposeAggregator* aggregator = (TposeAggregator*) threadAggregator->aggregator;
-	unsigned int threadId = (unsigned int) threadAggregator->threadId;
-	unsigned char fieldDelimiter = (tposeQuery->inputFile)->fieldDelimiter;
-	unsigned int idFoundFlag = 0; // 1 when we find the numeric field, 0 otherwise (0 if there is no numeric value)
-	unsigned int groupFoundFlag = 0; // 1 when we find the group field, 0 otherwise (0 if there is no group value)
-	unsigned int numericFoundFlag = 0; // 1 when we find the numeric field, 0 otherwise (0 if there is no numeric value)
-	off_t partitionStart = partitions[threadId];
-	off_t partitionEnd = partitions[threadId+1];
-	off_t partitionCharLimit = partitionEnd - partitionStart;
+	TposePartition partition;
+	TposeIdRun idRun;
+	unsigned int partitionId;
+	unsigned int nextId;
+
+	// Process each chunk
+	while((partitionId = tposeIONextPartition()) < fileChunks) {
+
+		// Print output header to first temp file
+		if(partitionId == 0)
+			tposeIOPrintGroupIdHeader(tposeQuery, tempFileArray[partitionId]);
+
+		// The first rows of a file that carry on the last ID of the file
+		// before are left to the partition that ends that file
+		partition = partitions[partitionId];
+		if(partition.start < (partition.inputFile)->idLeadEnd)
+			partition.start = ((partition.inputFile)->idLeadEnd < partition.end) ? (partition.inputFile)->idLeadEnd : partition.end;
+
+		idRun.started = 0;
+		tposeIOTransposeGroupIdScan(tposeQuery, btreeGlobal, tempFileArray[partitionId], aggregator, &partition, &idRun, partitionId);
+
+		// Carry the last ID on into the first rows of the next files (these are not prefetched)
+		for(nextId = partitionId + 1; partition.start < partition.end && partition.end == (partition.inputFile)->dataSize && nextId < fileChunks; nextId++) {
+			partition = partitions[nextId];
+			if(partition.start != 0 || (partition.inputFile)->idLeadEnd == 0)
+				break;
+			partition.end = (partition.inputFile)->idLeadEnd;
+			tposeIOTransposeGroupIdScan(tposeQuery, btreeGlobal, tempFileArray[partitionId], aggregator, &partition, &idRun, fileChunks);
+		}
 
-	// Temp allocs
-	BTreeKey* key = btreeKeyAlloc();
-	BTreeKey* resultKey;
-	char idCurrentString[TPOSE_IO_MAX_FIELD_WIDTH]; // Holds current id value being aggregated
-	char idTempString[TPOSE_IO_MAX_FIELD_WIDTH]; // Holds id value for each row
-	char groupTempString[TPOSE_IO_MAX_FIELD_WIDTH];
-	char numericTempString[TPOSE_IO_MAX_FIELD_WIDTH];
-	char* allocString;
-	char* fieldSavePtr; // Points at start of each field after every loop
+		tposeIOTransposeGroupIdFlush(tposeQuery, tempFileArray[partitionId], aggregator, &idRun);
+	}
 
-	// Counters & limits
-	off_t rowCount = 2; // For debugging only
-	unsigned int fieldCount = 0; // Already pointing at the first field when loop starts 
-	unsigned int fieldCharCount = 0;
-	unsigned int firstId = 1;
-	int ctr; // Iterates over group fields to calculate average values
-	off_t groupFieldIndex = 0; // Holds index of group field in TposeHeader struct
-	off_t totalCharCount = 0; // Needed to stop reading at EOF (mmap files are page aligned, so we end-up reading garbage after file data ends)
-	off_t hashCharCount = 0; 
-	off_t hashValue = 0; 
+	return NULL;
 
+}
 
-	// Init with ptr to second row (where data starts)
-	fieldSavePtr = ((tposeQuery->inputFile)->dataAddr) + partitionStart; 
 
-	
-	// Print output header to first temp file
-	if(threadId == 0)
-		tposeIOPrintGroupIdHeaderParallel(tposeQuery, threadId); 
 
-		// Process each chunk
-		while(totalCharCount <= partitionCharLimit) {
+/**
+ ** Transposes numeric values for each unique group and id value
+ ** Reduces thread results into final output
+ **/
+void tposeIOTransposeGroupIdReduce(
+	TposeQuery* tposeQuery
+) {
+
+	FILE* fdSrc;
+	FILE* fdDest = (tposeQuery->outputFile)->fd;
+	int c;
+	unsigned int threadCtr;
 
-			// FIELD DELIMITER
-			if(*fieldSavePtr == fieldDelimiter) {
-				++fieldCount;
-				++fieldSavePtr;
-				if(++totalCharCount == partitionCharLimit) break;
-				continue;
-			}
+	// Write temp files to final output file
+	for(threadCtr=0; threadCtr < fileChunks; threadCtr++) {
+		fdSrc = tempFileArray[threadCtr]->fd;
+		fseek(fdSrc, 0, SEEK_SET);
+		clearerr(fdSrc);
+		while((c = getc(fdSrc)) != EOF) {
+			putc(c, fdDest);
+		}
+	}
 
-			// ROW DELIMITER
-			if(*fieldSavePtr == rowDelimiter) {
+}
 
-				if((idFoundFlag == 1) && (groupFoundFlag == 1) && (numericFoundFlag == 1)) {
-					if(!strcmp(idCurrentString, idTempString)) {
-						// Aggregate value for each group
-						aggregator->aggregates[groupFieldIndex] += atof(numericTempString);
-						aggregator->counts[groupFieldIndex]++;
-					}
-					else {
-
-						// 0 Compute averages
-						for(ctr = 0; ctr < ((tposeQuery->outputFile)->fileGroupHeader)->numFields; ++ctr)
-							aggregator->avgs[ctr] = aggregator->aggregates[ctr] / aggregator->counts[ctr];
-
-						// 1 Print out current aggregates for id
-						tposeIOPrintGroupIdDataParallel(idCurrentString, tposeQuery, aggregator, threadId);
-						// 2 Set new string as current id
-						strcpy(idCurrentString, idTempString); // Set current id to aggregate values for
-						// 3 Reset aggregates
-						memset(aggregator->aggregates, 0, ((tposeQuery->outputFile)->fileGroupHeader)->numFields * sizeof(double));
-						memset(aggregator->counts, 0, ((tposeQuery->outputFile)->fileGroupHeader)->numFields * sizeof(double));
-						memset(aggregator->avgs, 0, ((tposeQuery->outputFile)->fileGroupHeader)->numFields * sizeof(double));
-						// 4 Aggregate value for new id 
-						aggregator->aggregates[groupFieldIndex] += atof(numericTempString);
-						aggregator->counts[groupFieldIndex]++;
 
-					}
 
-				}
-					
-				// Reset flags for next row
-				idFoundFlag = 0;
-				groupFoundFlag = 0;
-				numericFoundFlag = 0;
+/**
+ ** Starts the prefetcher thread over a set of ranges
+ ** Does nothing if prefetching is disabled (see --prefetch option)
+ **/
+void tposeIOPrefetchStart(
+	TposePartition* ranges
+	,unsigned int numRanges
+) {
 
-				fieldCount = 0;
-				++fieldSavePtr;
-				if(++totalCharCount == partitionCharLimit) break;
-				continue;
-			}
-			
-			// GROUP FIELD
-			if(fieldCount == (tposeQuery->group))  { // if group value is empty string we ignore
-
-				// Get group field value
-				while(*fieldSavePtr != fieldDelimiter && *fieldSavePtr != rowDelimiter) {
-					groupTempString[fieldCharCount++] = *fieldSavePtr++;
-					if(++totalCharCount == partitionCharLimit) break;
-				}
-				groupTempString[fieldCharCount] = '\0'; // Null-terminate string
+	TposePrefetcher* prefetcher;
+	unsigned int rangeCtr;
 
-				// Convert char array to hash
-				for(hashCharCount = 0; hashCharCount <= fieldCharCount-1; ++hashCharCount)
-					hashValue = TPOSE_IO_HASH_MULT * hashValue + (unsigned char) groupTempString[hashCharCount];
+	if(prefetchWindow <= 0 || numRanges == 0)
+		return;
 
-				// Insert into btreeGlobal
-				if( (resultKey = (BTreeKey*) btreeSearch(btreeGlobal, btreeGlobal->root, hashValue)) != NULL) {
-					groupFoundFlag = 1; // Flag group field as found
-					groupFieldIndex = resultKey->dataOffset; // Is used to correctly order aggregates
-				}
+	// Compressed input is already in memory (and columnar scans are not sequential)
+	for(rangeCtr = 0; rangeCtr < numRanges; rangeCtr++) {
+		if((ranges[rangeCtr].inputFile)->compression != TPOSE_COMPRESS_NONE || (ranges[rangeCtr].inputFile)->columnar != NULL)
+			return;
+	}
 
-				// Reset variables
-				fieldCharCount = 0;
-				hashValue = 0;
-				
-				if(*fieldSavePtr == fieldDelimiter) {
-					--fieldSavePtr;
-					--totalCharCount;
-				}
+	if((prefetcher = (TposePrefetcher*) calloc(1, sizeof(TposePrefetcher))) == NULL
+		|| (prefetcher->ranges = (TposePartition*) calloc(numRanges, sizeof(TposePartition))) == NULL
+		|| (prefetcher->progress = (char**) calloc(numRanges, sizeof(char*))) == NULL
+		|| (prefetcher->prefetched = (char**) calloc(numRanges, sizeof(char*))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate prefetcher memory\n");
+		exit(EXIT_FAILURE);
+	}
 
-				if(*fieldSavePtr == rowDelimiter) {
-					--fieldSavePtr;
-					--totalCharCount;
-				}
-			}
-			
-			
-			// NUMERIC FIELD
-			if(fieldCount == (tposeQuery->numeric))  { // if group value is empty string we ignore
-
-				numericFoundFlag = 1; // Flag numeric field as found
-				
-				// Copy field value
-				while(*fieldSavePtr != fieldDelimiter && *fieldSavePtr != rowDelimiter) {
-					numericTempString[fieldCharCount++] = *fieldSavePtr++;
-					if(++totalCharCount == partitionCharLimit) break;
-				}
-				numericTempString[fieldCharCount] = '\0'; // Null-terminate string
+	memcpy(prefetcher->ranges, ranges, numRanges * sizeof(TposePartition));
+	prefetcher->numRanges = numRanges;
+	prefetcher->window = prefetchWindow;
+	prefetcher->stop = 0;
+
+	if(pthread_create(&(prefetcher->thread), NULL, tposeIOPrefetchRun, (void *) prefetcher)) {
+		fprintf(stderr, "Warning: Cannot create prefetch thread\n");
+		free(prefetcher->ranges);
+		free(prefetcher->progress);
+		free(prefetcher->prefetched);
+		free(prefetcher);
+		return;
+	}
 
-				// Reset variables
-				fieldCharCount = 0;
+	prefetcherGlobal = prefetcher;
 
-				if(*fieldSavePtr == fieldDelimiter) {
-					--totalCharCount;
-					--fieldSavePtr;
-				}
+}
 
-				if(*fieldSavePtr == rowDelimiter) {
-					--fieldSavePtr;
-					--totalCharCount;
-				}
-			}
-			
-			// ID FIELD
-			if(fieldCount == (tposeQuery->id))  { // if group value is empty string we ignore
-
-				idFoundFlag = 1; // Flag numeric field as found
-				
-				// Copy field value
-				while(*fieldSavePtr != fieldDelimiter && *fieldSavePtr != rowDelimiter) {
-					idTempString[fieldCharCount++] = *fieldSavePtr++;
-					if(++totalCharCount == partitionCharLimit) break;
-				}
-				idTempString[fieldCharCount] = '\0'; // Null-terminate string
 
-				if(firstId) {
-					strcpy(idCurrentString, idTempString); // Set current id to aggregate values for
-					firstId = 0;
-				}
-					
-				// Reset variables
-				fieldCharCount = 0;
 
-				if(*fieldSavePtr == fieldDelimiter) {
-					--totalCharCount;
-					--fieldSavePtr;
-				}
+/**
+ ** Starts the prefetcher thread with one range per input file
+ ** Used by the single-threaded scans
+ **/
+void tposeIOPrefetchStartFiles(
+	TposeQuery* tposeQuery
+) {
 
-				if(*fieldSavePtr == rowDelimiter) {
-					--fieldSavePtr;
-					--totalCharCount;
-				}
-			}
+	TposePartition ranges[TPOSE_IO_MAX_INPUT_FILES];
+	unsigned int fileCtr;
 
-			// If not a delimiter or the group field, then ++
-			++fieldSavePtr;
-			if(++totalCharCount == partitionCharLimit) break;
+	for(fileCtr = 0; fileCtr < tposeQuery->numInputFiles; fileCtr++) {
+		ranges[fileCtr].inputFile = tposeQuery->inputFiles[fileCtr];
+		ranges[fileCtr].start = 0;
+		ranges[fileCtr].end = (tposeQuery->inputFiles[fileCtr])->dataSize;
+	}
 
-		}
+	tposeIOPrefetchStart(ranges, tposeQuery->numInputFiles);
+
+}
+
+
+
+/**
+ ** Publishes the scan position of a range to the prefetcher
+ ** NULL marks the range as finished (rangeIds past the last range are not tracked)
+ **/
+void tposeIOPrefetchPublish(
+	unsigned int rangeId
+	,char* scanPtr
+) {
 
-	// Compute averages
-	for(ctr = 0; ctr < ((tposeQuery->outputFile)->fileGroupHeader)->numFields; ++ctr)
-		aggregator->avgs[ctr] = aggregator->aggregates[ctr] / aggregator->counts[ctr];
+	if(prefetcherGlobal == NULL || rangeId >= prefetcherGlobal->numRanges)
+		return;
 
-	// Print last line
-	tposeIOPrintGroupIdDataParallel(idCurrentString, tposeQuery, aggregator, threadId);
+	__atomic_store_n(&(prefetcherGlobal->progress[rangeId]), scanPtr, __ATOMIC_RELEASE);
 
 }
 
 
 
-/** 
- ** Transposes numeric values for each unique group and id value
- ** Reduces thread results into final output
+/**
+ ** Prefetcher thread
+ ** Advises the kernel to read the next window of each range being
+ ** scanned, starting with the range that is furthest behind
  **/
-void tposeIOTransposeGroupIdReduce(
-	TposeQuery* tposeQuery
+void* tposeIOPrefetchRun(
+	void* prefetcherArg
 ) {
 
-	FILE* fdSrc; 
-	FILE* fdDest = (tposeQuery->outputFile)->fd;
-	char c;
-	unsigned int threadCtr, fieldCtr;
+	TposePrefetcher* prefetcher = (TposePrefetcher*) prefetcherArg;
+	TposePartition* range;
+	struct timespec sleepTime = {0, TPOSE_IO_PREFETCH_SLEEP};
+	uintptr_t pageMask = ~((uintptr_t) sysconf(_SC_PAGESIZE) - 1);
+	unsigned int rangeCtr;
+	unsigned int slowestRange;
+	unsigned int issued;
+	off_t slowestOffset;
+	char* scanPtr;
+	char* prefetchStart;
+	char* prefetchEnd;
+	char* rangeEnd;
+
+	while(!__atomic_load_n(&(prefetcher->stop), __ATOMIC_ACQUIRE)) {
+
+		// Find the slowest scan (least data read)
+		slowestRange = prefetcher->numRanges;
+		slowestOffset = 0;
+		for(rangeCtr = 0; rangeCtr < prefetcher->numRanges; rangeCtr++) {
+			if((scanPtr = __atomic_load_n(&(prefetcher->progress[rangeCtr]), __ATOMIC_ACQUIRE)) == NULL)
+				continue;
+			range = &(prefetcher->ranges[rangeCtr]);
+			if(slowestRange == prefetcher->numRanges || (scanPtr - ((range->inputFile)->dataAddr + range->start)) < slowestOffset) {
+				slowestRange = rangeCtr;
+				slowestOffset = scanPtr - ((range->inputFile)->dataAddr + range->start);
+			}
+		}
 
-	// Write temp files to final output file
-	for(threadCtr=0; threadCtr < fileChunks; threadCtr++) {
-		fdSrc = tempFileArray[threadCtr]->fd;
-		fseek(fdSrc, 0, SEEK_SET);
-		clearerr(fdSrc);
-		while((c = getc(fdSrc)) != EOF) {
-			putc(c, fdDest);
+		// Prefetch the window ahead of each scan (slowest first)
+		issued = 0;
+		for(rangeCtr = 0; slowestRange < prefetcher->numRanges && rangeCtr < prefetcher->numRanges; rangeCtr++) {
+
+			unsigned int rangeId = (slowestRange + rangeCtr) % prefetcher->numRanges;
+			if((scanPtr = __atomic_load_n(&(prefetcher->progress[rangeId]), __ATOMIC_ACQUIRE)) == NULL)
+				continue;
+
+			range = &(prefetcher->ranges[rangeId]);
+			rangeEnd = (range->inputFile)->dataAddr + range->end;
+
+			prefetchStart = prefetcher->prefetched[rangeId];
+			if(prefetchStart < scanPtr)
+				prefetchStart = scanPtr;
+
+			prefetchEnd = scanPtr + prefetcher->window;
+			if(prefetchEnd > rangeEnd)
+				prefetchEnd = rangeEnd;
+
+			if(prefetchStart >= prefetchEnd)
+				continue;
+
+			// madvise() expects a page-aligned address
+			char* alignedStart = (char*) ((uintptr_t) prefetchStart & pageMask);
+			if(madvise(alignedStart, prefetchEnd - alignedStart, MADV_WILLNEED) == -1)
+				debug_print("tposeIOPrefetchRun(): madvise failed on range %u\n", rangeId);
+
+			prefetcher->prefetched[rangeId] = prefetchEnd;
+			issued = 1;
 		}
+
+		if(!issued)
+			nanosleep(&sleepTime, NULL);
 	}
 
+	return NULL;
+
 }
 
 
 
-/** 
+/**
+ ** Stops the prefetcher thread (if running)
+ **/
+void tposeIOPrefetchStop(
+	void
+) {
+
+	TposePrefetcher* prefetcher = prefetcherGlobal;
+
+	if(prefetcher == NULL)
+		return;
+
+	__atomic_store_n(&(prefetcher->stop), 1, __ATOMIC_RELEASE);
+	(void) pthread_join(prefetcher->thread, NULL);
+
+	prefetcherGlobal = NULL;
+
+	free(prefetcher->ranges);
+	free(prefetcher->progress);
+	free(prefetcher->prefetched);
+	free(prefetcher);
+
+}
+
+
+
+/**
  ** Iterates through unique groups and aggregates and formats output
  ** Used to output results from tposeIOTransposeGroup()
  **/
@@ -2313,208 +3732,230 @@ void tposeIOPrintOutput(
 	TposeQuery* tposeQuery
 ) {
 
-	unsigned char fieldDelimiter = (tposeQuery->outputFile)->fieldDelimiter;
-
-	int i; // counter
-
 	// Group Header
-	for(i = 0; i < ((tposeQuery->outputFile)->fileGroupHeader)->numFields ; ++i) {
-		if(i == (((tposeQuery->outputFile)->fileGroupHeader)->numFields - 1))
-			fprintf((tposeQuery->outputFile)->fd, "%s%c", ((tposeQuery->outputFile)->fileGroupHeader)->fields[i], rowDelimiter);
-		else
-			fprintf((tposeQuery->outputFile)->fd, "%s%c", ((tposeQuery->outputFile)->fileGroupHeader)->fields[i], fieldDelimiter);
-	}
-
+	tposeIOPrintGroupNames(tposeQuery, (tposeQuery->outputFile)->fd, 0);
 
 	// Aggregates
-	if(tposeQuery->aggregateType == TPOSE_IO_AGGREGATION_SUM) {
-		for(i = 0; i < ((tposeQuery->outputFile)->fileGroupHeader)->numFields ; ++i) {
-			if(i == ((tposeQuery->outputFile)->fileGroupHeader)->numFields - 1)
-				fprintf((tposeQuery->outputFile)->fd, "%.2f%c", (tposeQuery->aggregator)->aggregates[i], rowDelimiter);
-			else
-				fprintf((tposeQuery->outputFile)->fd, "%.2f%c", (tposeQuery->aggregator)->aggregates[i], fieldDelimiter);
-		}
+	tposeIOPrintAggregates(tposeQuery, (tposeQuery->outputFile)->fd, tposeQuery->aggregator);
 
-		fflush((tposeQuery->outputFile)->fd);
-	}
-	if(tposeQuery->aggregateType == TPOSE_IO_AGGREGATION_COUNT) {
-		for(i = 0; i < ((tposeQuery->outputFile)->fileGroupHeader)->numFields ; ++i) {
-			if(i == ((tposeQuery->outputFile)->fileGroupHeader)->numFields - 1)
-				fprintf((tposeQuery->outputFile)->fd, "%lld%c", (long long) (tposeQuery->aggregator)->counts[i], rowDelimiter);
-			else
-				fprintf((tposeQuery->outputFile)->fd, "%lld%c", (long long) (tposeQuery->aggregator)->counts[i], fieldDelimiter);
-		}
+}
 
-		fflush((tposeQuery->outputFile)->fd);
-	}
-	if(tposeQuery->aggregateType == TPOSE_IO_AGGREGATION_AVG) {
-		for(i = 0; i < ((tposeQuery->outputFile)->fileGroupHeader)->numFields ; ++i) {
-			if(i == ((tposeQuery->outputFile)->fileGroupHeader)->numFields - 1)
-				fprintf((tposeQuery->outputFile)->fd, "%.2f%c", (tposeQuery->aggregator)->avgs[i], rowDelimiter);
-			else
-				fprintf((tposeQuery->outputFile)->fd, "%.2f%c", (tposeQuery->aggregator)->avgs[i], fieldDelimiter);
-		}
 
-		fflush((tposeQuery->outputFile)->fd);
+
+/**
+ ** Prints the output column names as one row: each GROUP value, followed by the
+ ** NUMERIC field if --numeric lists more than one, and the aggregation type if
+ ** --aggregate lists more than one (e.g. rev_A_amount_sum)
+ **/
+void tposeIOPrintGroupNames(
+	TposeQuery* tposeQuery
+	,FILE* fd
+	,unsigned int affixes
+) {
+
+	unsigned char fieldDelimiter = (tposeQuery->outputFile)->fieldDelimiter;
+	TposeHeader* groupHeader = (tposeQuery->outputFile)->fileGroupHeader;
+	unsigned int numNumerics = tposeQuery->numNumerics;
+	unsigned int numCells = groupHeader->numFields * numNumerics;
+	unsigned int numAggregateTypes = tposeQuery->numAggregateTypes;
+	unsigned int i;
+	unsigned int group;
+	unsigned int aggregateCtr;
+
+	for(i = 0; i < numCells; ++i) for(aggregateCtr = 0; aggregateCtr < numAggregateTypes; ++aggregateCtr) {
+		group = (tposeQuery->groupOrder != NULL) ? tposeQuery->groupOrder[i / numNumerics] : i / numNumerics;
+		tposeIOPrintCellName(tposeQuery, fd, affixes, groupHeader->fields[group], i % numNumerics, aggregateCtr
+			,(i == numCells - 1 && aggregateCtr == numAggregateTypes - 1) ? rowDelimiter : fieldDelimiter);
 	}
 
 }
 
 
 
-/** 
- ** Prints output header
+/**
+ ** Prints the column name of one --aggregate of a GROUP value and NUMERIC field
+ ** (see tposeIOPrintGroupNames), followed by delimiter
  **/
-void tposeIOPrintGroupIdHeader(
+void tposeIOPrintCellName(
 	TposeQuery* tposeQuery
+	,FILE* fd
+	,unsigned int affixes
+	,char* group
+	,unsigned int numericCtr
+	,unsigned int aggregateCtr
+	,unsigned char delimiter
 ) {
 
-	unsigned char fieldDelimiter = (tposeQuery->outputFile)->fieldDelimiter;
-	
-	// Id Header
-	fprintf((tposeQuery->outputFile)->fd, "%s%c", ((tposeQuery->inputFile)->fileHeader)->fields[tposeQuery->id], fieldDelimiter);
+	unsigned int numAggregateTypes = tposeQuery->numAggregateTypes;
 
-	int i;
-	// Group Header
-	for(i = 0; i < ((tposeQuery->outputFile)->fileGroupHeader)->numFields ; ++i) {
-		if(i == (((tposeQuery->outputFile)->fileGroupHeader)->numFields - 1))
-			fprintf((tposeQuery->outputFile)->fd, "%s%s%s%c", prefixGlobal, ((tposeQuery->outputFile)->fileGroupHeader)->fields[i], suffixGlobal, rowDelimiter);
-		else
-			fprintf((tposeQuery->outputFile)->fd, "%s%s%s%c", prefixGlobal, ((tposeQuery->outputFile)->fileGroupHeader)->fields[i], suffixGlobal, fieldDelimiter);
-	}
+	fprintf(fd, "%s%s", affixes ? prefixGlobal : "", group);
+	if(tposeQuery->numNumerics > 1)
+		fprintf(fd, "_%s", ((tposeQuery->inputFile)->fileHeader)->fields[tposeQuery->numerics[numericCtr]]);
+	if(numAggregateTypes > 1 && tposeQuery->aggregateTypes[aggregateCtr] == TPOSE_IO_AGGREGATION_QUANTILE)
+		fprintf(fd, "_p%g", tposeQuery->aggregateQuantiles[aggregateCtr] * 100);
+	else if(numAggregateTypes > 1)
+		fprintf(fd, "_%s", tposeIOAggregateNames[tposeQuery->aggregateTypes[aggregateCtr]]);
+	fprintf(fd, "%s%c", affixes ? suffixGlobal : "", delimiter);
 
 }
 
 
 
-/** 
- ** Prints current line to output
+/**
+ ** Prints an exact sum of units of 10^-decimals, followed by delimiter
  **/
-void tposeIOPrintGroupIdData(
-	char* id
-	,TposeQuery* tposeQuery
+static void tposeIOPrintFixed(
+	FILE* fd
+	,int64_t value
+	,unsigned int decimals
+	,unsigned char delimiter
 ) {
 
-	unsigned char fieldDelimiter = (tposeQuery->outputFile)->fieldDelimiter;
+	uint64_t magnitude = (value < 0) ? -(uint64_t) value : (uint64_t) value;
+	uint64_t scale = tposeIOFixedScales[decimals];
 
-	int i; // Counter
+	if(decimals == 0)
+		fprintf(fd, "%s%llu%c", (value < 0) ? "-" : "", (unsigned long long) magnitude, delimiter);
+	else
+		fprintf(fd, "%s%llu.%0*llu%c", (value < 0) ? "-" : "", (unsigned long long) (magnitude / scale), (int) decimals, (unsigned long long) (magnitude % scale), delimiter);
 
-	// Id
-	fprintf((tposeQuery->outputFile)->fd, "%s%c", id, fieldDelimiter);
+}
 
-	// Aggregates
-	if(tposeQuery->aggregateType == TPOSE_IO_AGGREGATION_SUM) {
-		for(i = 0; i < ((tposeQuery->outputFile)->fileGroupHeader)->numFields ; ++i) {
-			if(i == ((tposeQuery->outputFile)->fileGroupHeader)->numFields - 1)
-				fprintf((tposeQuery->outputFile)->fd, "%.2f%c", (tposeQuery->aggregator)->aggregates[i], rowDelimiter);
-			else
-				fprintf((tposeQuery->outputFile)->fd, "%.2f%c", (tposeQuery->aggregator)->aggregates[i], fieldDelimiter);
-		}
 
-		fflush((tposeQuery->outputFile)->fd);
-	}
-	if(tposeQuery->aggregateType == TPOSE_IO_AGGREGATION_COUNT) {
-		for(i = 0; i < ((tposeQuery->outputFile)->fileGroupHeader)->numFields ; ++i) {
-			if(i == ((tposeQuery->outputFile)->fileGroupHeader)->numFields - 1)
-				fprintf((tposeQuery->outputFile)->fd, "%lld%c", (long long) (tposeQuery->aggregator)->counts[i], rowDelimiter);
-			else
-				fprintf((tposeQuery->outputFile)->fd, "%lld%c", (long long) (tposeQuery->aggregator)->counts[i], fieldDelimiter);
-		}
 
-		fflush((tposeQuery->outputFile)->fd);
+/**
+ ** Prints the --aggregate values of each GROUP (and NUMERIC field) as one row
+ **/
+void tposeIOPrintAggregates(
+	TposeQuery* tposeQuery
+	,FILE* fd
+	,TposeAggregator* aggregator
+) {
+
+	unsigned char fieldDelimiter = (tposeQuery->outputFile)->fieldDelimiter;
+	unsigned int numCells = ((tposeQuery->outputFile)->fileGroupHeader)->numFields * tposeQuery->numNumerics; // GROUP x NUMERIC
+	unsigned int numNumerics = tposeQuery->numNumerics;
+	unsigned int numAggregateTypes = tposeQuery->numAggregateTypes;
+	unsigned int i;
+	unsigned int cell;
+	unsigned int aggregateCtr;
+
+	for(i = 0; i < numCells; ++i) for(aggregateCtr = 0; aggregateCtr < numAggregateTypes; ++aggregateCtr) {
+		cell = (tposeQuery->groupOrder != NULL) ? tposeQuery->groupOrder[i / numNumerics] * numNumerics + i % numNumerics : i;
+		tposeIOPrintCellValue(tposeQuery, fd, aggregator, cell, aggregateCtr
+			,(i == numCells - 1 && aggregateCtr == numAggregateTypes - 1) ? rowDelimiter : fieldDelimiter);
 	}
-	if(tposeQuery->aggregateType == TPOSE_IO_AGGREGATION_AVG) {
-		for(i = 0; i < ((tposeQuery->outputFile)->fileGroupHeader)->numFields ; ++i) {
-			if(i == ((tposeQuery->outputFile)->fileGroupHeader)->numFields - 1)
-				fprintf((tposeQuery->outputFile)->fd, "%.2f%c", (tposeQuery->aggregator)->avgs[i], rowDelimiter);
-			else
-				fprintf((tposeQuery->outputFile)->fd, "%.2f%c", (tposeQuery->aggregator)->avgs[i], fieldDelimiter);
-		}
 
-		fflush((tposeQuery->outputFile)->fd);
+	fflush(fd);
+
+}
+
+
+
+/**
+ ** Prints one --aggregate of a field of a TposeAggregator (see tposeIOPrintAggregates),
+ ** followed by delimiter
+ **/
+void tposeIOPrintCellValue(
+	TposeQuery* tposeQuery
+	,FILE* fd
+	,TposeAggregator* aggregator
+	,unsigned int cell
+	,unsigned int aggregateCtr
+	,unsigned char delimiter
+) {
+
+	double value;
+
+	switch(tposeQuery->aggregateTypes[aggregateCtr]) {
+		case TPOSE_IO_AGGREGATION_COUNT:
+			fprintf(fd, "%lld%c", (long long) aggregator->counts[cell], delimiter);
+			return;
+		case TPOSE_IO_AGGREGATION_DISTINCT:
+			fprintf(fd, "%.0f%c", tposeSketchHllEstimate(&(aggregator->sketches[cell]), aggregator->precision), delimiter);
+			return;
+		case TPOSE_IO_AGGREGATION_SUM:
+			if(aggregator->stats & TPOSE_IO_STATS_FIXED) {
+				tposeIOPrintFixed(fd, aggregator->fixedSums[cell], aggregator->decimals, delimiter);
+				return;
+			}
+			value = tposeIOAggregatorSum(aggregator, cell);
+			break;
+		case TPOSE_IO_AGGREGATION_AVG:
+			value = tposeIOAggregatorAverage(aggregator, cell);
+			break;
+		case TPOSE_IO_AGGREGATION_MIN:
+			value = tposeIOAggregatorMin(aggregator, cell);
+			if(aggregator->stats & TPOSE_IO_STATS_FIXED) {
+				tposeIOPrintFixed(fd, llround(value * tposeIOFixedScales[aggregator->decimals]), aggregator->decimals, delimiter);
+				return;
+			}
+			break;
+		case TPOSE_IO_AGGREGATION_MAX:
+			value = tposeIOAggregatorMax(aggregator, cell);
+			if(aggregator->stats & TPOSE_IO_STATS_FIXED) {
+				tposeIOPrintFixed(fd, llround(value * tposeIOFixedScales[aggregator->decimals]), aggregator->decimals, delimiter);
+				return;
+			}
+			break;
+		case TPOSE_IO_AGGREGATION_VAR:
+			value = tposeIOAggregatorVariance(aggregator, cell);
+			break;
+		case TPOSE_IO_AGGREGATION_STDDEV:
+			value = sqrt(tposeIOAggregatorVariance(aggregator, cell));
+			break;
+		case TPOSE_IO_AGGREGATION_QUANTILE:
+			value = tposeSketchQuantileValue(&(aggregator->quantiles[cell]), tposeQuery->aggregateQuantiles[aggregateCtr]);
+			break;
+		default:
+			value = tposeIOAggregatorSum(aggregator, cell);
+			break;
 	}
+
+	fprintf(fd, "%.2f%c", value, delimiter);
+
 }
 
 
 
-/** 
+/**
  ** Prints output header
- ** Multi-threaded version
  **/
-void tposeIOPrintGroupIdHeaderParallel(
+void tposeIOPrintGroupIdHeader(
 	TposeQuery* tposeQuery
-	,unsigned int threadId
+	,TposeOutputFile* outputFile
 ) {
 
 	unsigned char fieldDelimiter = (tposeQuery->outputFile)->fieldDelimiter;
-	FILE* fd = tempFileArray[threadId]->fd;
-	
+	FILE* fd = outputFile->fd;
+
 	// Id Header
 	fprintf(fd, "%s%c", ((tposeQuery->inputFile)->fileHeader)->fields[tposeQuery->id], fieldDelimiter);
 
-	int i;
 	// Group Header
-	for(i = 0; i < ((tposeQuery->outputFile)->fileGroupHeader)->numFields ; ++i) {
-		if(i == (((tposeQuery->outputFile)->fileGroupHeader)->numFields - 1))
-			fprintf(fd, "%s%s%s%c", prefixGlobal, ((tposeQuery->outputFile)->fileGroupHeader)->fields[i], suffixGlobal, rowDelimiter);
-		else
-			fprintf(fd, "%s%s%s%c", prefixGlobal, ((tposeQuery->outputFile)->fileGroupHeader)->fields[i], suffixGlobal, fieldDelimiter);
-	}
-
+	tposeIOPrintGroupNames(tposeQuery, fd, 1);
 
 }
 
 
 
-/** 
+/**
  ** Prints current line to output
- ** Multi-threaded version
  **/
-void tposeIOPrintGroupIdDataParallel(
+void tposeIOPrintGroupIdData(
 	char* id
 	,TposeQuery* tposeQuery
+	,TposeOutputFile* outputFile
 	,TposeAggregator* aggregator
-	,unsigned int threadId
 ) {
 
 	unsigned char fieldDelimiter = (tposeQuery->outputFile)->fieldDelimiter;
-	FILE* fd = tempFileArray[threadId]->fd;
-
-	int i; // Counter
+	FILE* fd = outputFile->fd;
 
 	// Id
 	fprintf(fd, "%s%c", id, fieldDelimiter);
-	
-	// Aggregates
-	if(tposeQuery->aggregateType == TPOSE_IO_AGGREGATION_SUM) {
-		for(i = 0; i < ((tposeQuery->outputFile)->fileGroupHeader)->numFields ; ++i) {
-			if(i == ((tposeQuery->outputFile)->fileGroupHeader)->numFields - 1)
-				fprintf(fd, "%.2f%c", aggregator->aggregates[i], rowDelimiter);
-			else
-				fprintf(fd, "%.2f%c", aggregator->aggregates[i], fieldDelimiter);
-		}
 
-		fflush(fd);
-	}
-	if(tposeQuery->aggregateType == TPOSE_IO_AGGREGATION_COUNT) {
-		for(i = 0; i < ((tposeQuery->outputFile)->fileGroupHeader)->numFields ; ++i) {
-			if(i == ((tposeQuery->outputFile)->fileGroupHeader)->numFields - 1)
-				fprintf(fd, "%lld%c", (long long) aggregator->counts[i], rowDelimiter);
-			else
-				fprintf(fd, "%lld%c", (long long) aggregator->counts[i], fieldDelimiter);
-		}
-
-		fflush(fd);
-	}
-	if(tposeQuery->aggregateType == TPOSE_IO_AGGREGATION_AVG) {
-		for(i = 0; i < ((tposeQuery->outputFile)->fileGroupHeader)->numFields ; ++i) {
-			if(i == ((tposeQuery->outputFile)->fileGroupHeader)->numFields - 1)
-				fprintf(fd, "%.2f%c", aggregator->avgs[i], rowDelimiter);
-			else
-				fprintf(fd, "%.2f%c", aggregator->avgs[i], fieldDelimiter);
-		}
-
-		fflush(fd);
-	}
+	// Aggregates
+	tposeIOPrintAggregates(tposeQuery, fd, aggregator);
 
 }
@@ -24,9 +24,18 @@
 	#include <sys/mman.h>
 	#include <sys/stat.h>
 	#include <ctype.h>
+	#include <math.h>
+	#include <stdint.h>
+	#include <strings.h>
+	#include <time.h>
 
 	#include "system.h"
 	#include "btree.h"
+	#include "tpose_compress.h"
+	#include "tpose_sketch.h"
+	#include "tpose_exact.h"
+	#include "tpose_phash.h"
+	#include "tpose_arena.h"
 
 
 	/**
@@ -37,14 +46,53 @@
 	#define TPOSE_IO_MAX_LINE 1048576
 	#define TPOSE_IO_MAX_FIELDS 5000
 	#define TPOSE_IO_MAX_FIELD_WIDTH 5000
+	#define TPOSE_IO_MAX_NUMERIC_WIDTH 128
+	#define TPOSE_IO_MAX_NUMERICS 8 // NUMERIC fields in one --numeric list
+	#define TPOSE_IO_MAX_INPUT_FILES 1000
+	#define TPOSE_IO_MAX_PARTITIONS 1000
 	
-	#define TPOSE_IO_HASH_MULT 37
+	#define TPOSE_IO_HASH_SECRET0 0xA0761D6478BD642FULL // Odd 64-bit constants of the field hash (as in wyhash)
+	#define TPOSE_IO_HASH_SECRET1 0xE7037ED1A0B428DBULL
+	#define TPOSE_IO_HASH_SECRET2 0x8EBC6AF09C88C6E3ULL
 
-	#define TPOSE_IO_CHUNK_SIZE 1073741824
+	#define TPOSE_IO_CHUNK_SIZE 1073741824 // Largest partition of an input file (see tposeIOBuildPartitions)
+	#define TPOSE_IO_MIN_CHUNK_SIZE 1048576 // Smallest partition of a text file (smaller input is not split)
+
+	#define TPOSE_IO_INDEX_MISSING 0xFFFFFFFF // Field offset of a missing field (see TposeIndex)
+
+	#define TPOSE_IO_GROUP_CACHE_BITS 6 // Hot GROUP cache of each scanner has 2^BITS entries (see TposeGroupCache)
+	#define TPOSE_IO_GROUP_CACHE_EMPTY 0xFFFFFFFF // Group index of an unused entry
+
+	#define TPOSE_IO_BATCH_SIZE 2048 // NUMERIC values a scanner parses before adding them up (see TposeBatch)
+
+	#define TPOSE_IO_PREFETCH_STEP 1048576 // Scanners publish their position every STEP bytes
+	#define TPOSE_IO_PREFETCH_SLEEP 1000000 // Nanoseconds the prefetcher waits when it is ahead of all scanners
 
 	#define TPOSE_IO_AGGREGATION_SUM 0
 	#define TPOSE_IO_AGGREGATION_COUNT 1
 	#define TPOSE_IO_AGGREGATION_AVG 2
+	#define TPOSE_IO_AGGREGATION_MIN 3
+	#define TPOSE_IO_AGGREGATION_MAX 4
+	#define TPOSE_IO_AGGREGATION_VAR 5 // Sample variance
+	#define TPOSE_IO_AGGREGATION_STDDEV 6 // Sample standard deviation
+	#define TPOSE_IO_AGGREGATION_DISTINCT 7 // Approximate number of distinct values (HyperLogLog)
+	#define TPOSE_IO_AGGREGATION_QUANTILE 8 // Approximate quantile, e.g. p95 (see TposeSketchQuantile)
+
+	#define TPOSE_IO_MAX_AGGREGATES 8 // Aggregation types in one --aggregate list
+
+	#define TPOSE_IO_STATS_MINMAX 1 // Aggregator keeps mins and maxs
+	#define TPOSE_IO_STATS_VARIANCE 2 // Aggregator keeps means and m2s (Welford's algorithm)
+	#define TPOSE_IO_STATS_DISTINCT 4 // Aggregator keeps a HyperLogLog sketch per field
+	#define TPOSE_IO_STATS_QUANTILE 8 // Aggregator keeps a quantile sketch per field
+	#define TPOSE_IO_STATS_FIXED 16 // Aggregator keeps exact sums in units of 10^-decimals (see --decimals)
+	#define TPOSE_IO_STATS_EXACT 32 // Aggregator keeps order-independent sums (see --reproducible)
+	#define TPOSE_IO_STATS_SUM 64 // Aggregator keeps double sums (not needed with exact sums)
+	#define TPOSE_IO_STATS_FLOAT32 128 // Sums, mins and maxs are kept as floats (see --float32)
+
+	#define TPOSE_IO_DECIMALS_OFF -1 // NUMERIC values are summed as doubles
+	#define TPOSE_IO_DECIMALS_AUTO -2 // Decimals are taken from the first values (see tposeIODetectDecimals)
+	#define TPOSE_IO_MAX_DECIMALS 15
+	#define TPOSE_IO_DECIMALS_SAMPLE 10000 // Rows checked by --decimals=auto
 
 	#define TPOSE_IO_MODIFY_HEADER 1
 	#define TPOSE_IO_NO_MODIFY_HEADER 0
@@ -57,6 +105,10 @@
 	extern unsigned char rowDelimiter; // Defines row delimiter
 	extern char* prefixGlobal;
 	extern char* suffixGlobal;
+	extern int decimalsGlobal; // Digits kept after the decimal point of exact sums (or TPOSE_IO_DECIMALS_*)
+	extern unsigned int reproducibleGlobal; // Sums do not depend on how rows are split (see TPOSE_IO_STATS_EXACT)
+	extern unsigned int sortGroupsGlobal; // GROUP columns are printed in sorted order (see tposeIOGroupOrderBuild)
+	extern unsigned int float32Global; // Aggregators keep floats instead of doubles (see TPOSE_IO_STATS_FLOAT32)
 
 
 
@@ -67,6 +119,7 @@
 		char** fields;
 		unsigned int numFields; // Number of actual fields
 		unsigned int maxFields; // Number of total fields allocated (used to free memory)
+		TposeArena* arena; // Holds the field strings (NULL if the header cannot be modified)
 	} TposeHeader;
 
 
@@ -74,13 +127,49 @@
 	 ** TposeAggregator
 	 **/
 	typedef struct {
-		double* aggregates;
-		double* counts;
-		double* avgs;
+		int64_t* counts;
+		double* aggregates; // Only allocated with TPOSE_IO_STATS_SUM
+		double* mins; // Only allocated with TPOSE_IO_STATS_MINMAX
+		double* maxs;
+		float* floatAggregates; // Instead of aggregates, mins and maxs with TPOSE_IO_STATS_FLOAT32
+		float* floatMins;
+		float* floatMaxs;
+		double* means; // Only allocated with TPOSE_IO_STATS_VARIANCE
+		double* m2s; // Sum of squared differences from the mean
+		TposeSketchHll* sketches; // Only allocated with TPOSE_IO_STATS_DISTINCT
+		unsigned int precision; // Of the sketches
+		TposeSketchQuantile* quantiles; // Only allocated with TPOSE_IO_STATS_QUANTILE
+		int64_t* fixedSums; // Only allocated with TPOSE_IO_STATS_FIXED
+		unsigned int decimals; // Of the fixed sums
+		TposeExactSum* exactSums; // Only allocated with TPOSE_IO_STATS_EXACT
+		TposeExactSum* exactSquares; // Only allocated with TPOSE_IO_STATS_EXACT and TPOSE_IO_STATS_VARIANCE
 		unsigned int numFields;
+		unsigned int stats; // TPOSE_IO_STATS_* arrays allocated
 	} TposeAggregator;
 
 
+	/**
+	 ** TposeIndex
+	 ** Row index of an input file, mapped from its .tpidx sidecar (see tpose_cache.h)
+	 **/
+	typedef struct {
+		char* mapAddr;
+		off_t mapSize;
+		uint64_t* samples; // Offset of the first row starting at or after each sampleInterval bytes
+		uint64_t numSamples;
+		uint64_t sampleInterval;
+		char* records; // Per-row offset (uint64_t), followed by the offsets of each indexed field (uint32_t)
+		uint64_t numRows;
+		uint64_t recordSize; // 0 if no fields were indexed
+		unsigned int numColumns;
+		uint32_t* columns; // Indexed fields
+		int idSlot; // Position of the query fields in each record (-1 if not indexed)
+		int groupSlot;
+		int numericSlots[TPOSE_IO_MAX_NUMERICS];
+		unsigned int fieldsIndexed; // 1 if all query fields are indexed
+	} TposeIndex;
+
+
 	/**
 	 ** TposeInputFile
 	 **/
@@ -89,8 +178,16 @@
 		char* fileAddr;
 		char* dataAddr;
 		off_t fileSize;
+		off_t dataSize; // Number of bytes after the header row
+		off_t mapSize; // Size of the mapping at fileAddr (differs from fileSize for compressed input)
+		unsigned int compression; // TPOSE_COMPRESS_* format of the file on disk
+		char* filePath;
+		struct stat fileStat; // Identifies the file on disk (see tpose_cache.h)
+		TposeIndex* index; // NULL if there is no usable .tpidx sidecar
+		struct TposeColumnar* columnar; // NULL unless the file is a .tpcol cache (see tpose_columnar.h)
 		unsigned char fieldDelimiter;
 		TposeHeader* fileHeader;
+		off_t idLeadEnd; // End of the first rows that carry on the last ID of the previous file (see tposeIOBuildPartitions)
 	} TposeInputFile;
 
 	/**
@@ -107,24 +204,103 @@
 	 ** TposeQuery
 	 **/
 	typedef struct {
-		TposeInputFile* inputFile;
+		TposeInputFile* inputFile; // First input file (defines the header)
+		TposeInputFile** inputFiles; // All input files, processed as one dataset
+		unsigned int numInputFiles;
 		TposeOutputFile* outputFile;
 		TposeAggregator* aggregator;
 		int id;
 		int group;
-		int numeric;
-		unsigned int aggregateType;
+		int numeric; // First NUMERIC field
+		int numerics[TPOSE_IO_MAX_NUMERICS]; // All NUMERIC fields (in --numeric order)
+		unsigned int numNumerics;
+		unsigned int aggregateTypes[TPOSE_IO_MAX_AGGREGATES]; // Output for each GROUP (in --aggregate order)
+		double aggregateQuantiles[TPOSE_IO_MAX_AGGREGATES]; // 0 to 1, for TPOSE_IO_AGGREGATION_QUANTILE types
+		unsigned int numAggregateTypes;
+		unsigned int aggregateStats; // TPOSE_IO_STATS_* needed by aggregateTypes
+		TposePerfectHash* groupHash; // GROUP hash to group index, once all groups are known (NULL to search the btree)
+		unsigned int* groupOrder; // Group index printed in each position (NULL to print groups in order of discovery)
 	} TposeQuery;
 
+	/**
+	 ** TposeRow
+	 ** ID, GROUP and NUMERIC field values of a row (not NULL-terminated)
+	 **/
+	typedef struct {
+		char* id;
+		char* group;
+		char* numerics[TPOSE_IO_MAX_NUMERICS]; // One per query NUMERIC field
+		unsigned int idLength;
+		unsigned int groupLength;
+		unsigned int numericLengths[TPOSE_IO_MAX_NUMERICS];
+		unsigned int numNumerics; // NUMERIC values found (0 if all are missing or empty)
+		off_t indexRow; // Index record of the last row read (-1 if none)
+		off_t groupHash; // Set by readers that know the hash already (see groupHashed)
+		double numericValues[TPOSE_IO_MAX_NUMERICS]; // Set by readers that store numbers in binary (see numericsParsed)
+		unsigned int groupHashed;
+		unsigned int numericsParsed; // Bit n is set if numericValues[n] is set
+		char idBuffer[TPOSE_IO_MAX_NUMERIC_WIDTH]; // Text of binary ID/GROUP values (columnar input)
+		char groupBuffer[TPOSE_IO_MAX_NUMERIC_WIDTH];
+		char numericBuffers[TPOSE_IO_MAX_NUMERICS][TPOSE_IO_MAX_NUMERIC_WIDTH]; // Text of binary NUMERIC values (only for --aggregate=distinct)
+	} TposeRow;
+
+	/**
+	 ** TposeGroupCache
+	 ** Direct-mapped cache of the GROUP hashes a scanner found last, and their
+	 ** group index, checked before the btree (1 KiB, so it stays in L1). With
+	 ** skewed GROUP columns most rows then skip the btree descent
+	 **/
+	typedef struct {
+		struct {
+			off_t hash;
+			unsigned int group; // dataOffset of the btree key (TPOSE_IO_GROUP_CACHE_EMPTY if unused)
+		} entries[1 << TPOSE_IO_GROUP_CACHE_BITS];
+	} TposeGroupCache;
+
+	/**
+	 ** TposeBatch
+	 ** NUMERIC values parsed by a scanner, waiting to be added to aggregator fields.
+	 ** Parsing a batch, then adding it up, keeps each loop tight and lets runs of
+	 ** rows of the same GROUP be summed in a register
+	 **/
+	typedef struct {
+		unsigned int fields[TPOSE_IO_BATCH_SIZE];
+		double values[TPOSE_IO_BATCH_SIZE];
+		unsigned int numValues;
+	} TposeBatch;
+
+	/**
+	 ** TposePartition
+	 ** Range of rows [start, end) of an input file (offsets from dataAddr)
+	 **/
+	typedef struct {
+		TposeInputFile* inputFile;
+		off_t start;
+		off_t end;
+	} TposePartition;
+
+	/**
+	 ** TposeIdRun
+	 ** ID whose rows are being aggregated, carried from one range of rows to
+	 ** the next (an ID can carry on from one input file into the next)
+	 **/
+	typedef struct {
+		char id[TPOSE_IO_MAX_FIELD_WIDTH];
+		unsigned int idLength;
+		unsigned int started; // 0 until a row of the ID is read
+	} TposeIdRun;
+
 
 	/* Input */
 	TposeInputFile* tposeIOOpenInputFile(char* filePath, unsigned char fieldDelimiter, unsigned int mutateHeader);
 	int tposeIOCloseInputFile(TposeInputFile* inputFile);
+	int tposeIORemapInputFile(TposeInputFile* inputFile);
 
 	TposeInputFile* tposeIOInputFileAlloc(int fd, char* fileAddr, off_t fileSize, unsigned char fieldDelimiter);
 	void tposeIOInputFileFree(TposeInputFile** intputFilePtr);
 
 	TposeHeader* tposeIOReadInputHeader(TposeInputFile* inputFile, unsigned int mutateHeader);
+	int tposeIOCompareInputHeaders(TposeInputFile* inputFile, TposeInputFile* otherInputFile);
 
 
 	/* Output */
@@ -139,24 +315,66 @@
 	TposeHeader* tposeIOHeaderAlloc(unsigned int maxFields, unsigned int mutateHeader);
 	void tposeIOHeaderFree(TposeHeader** tposeHeaderPtr);
 
-	TposeAggregator* tposeIOAggregatorAlloc(unsigned int numFields);
+	TposeAggregator* tposeIOAggregatorAlloc(unsigned int numFields, unsigned int stats);
 	void tposeIOAggregatorFree(TposeAggregator** tposeAggregatorPtr);
-
-	TposeQuery* tposeIOQueryAlloc(TposeInputFile* inputFile, TposeOutputFile* outputFile, char* idVar, char* groupVar, char* numericVar, char* aggregateType);
-	TposeQuery* tposeIOQueryIndexedAlloc(TposeInputFile* inputFile, TposeOutputFile* outputFile, int idVar, int groupVar, int numericVar, char* aggregateType);
+	void tposeIOAggregatorGrow(TposeAggregator* tposeAggregator, unsigned int numFields);
+	size_t tposeIOAggregatorFieldSize(unsigned int stats);
+	void tposeIOAggregatorReset(TposeAggregator* tposeAggregator);
+	void tposeIOAggregatorUpdate(TposeAggregator* tposeAggregator, unsigned int field, double value);
+	void tposeIOAggregatorUpdateRow(TposeAggregator* tposeAggregator, unsigned int field, TposeRow* row, unsigned int numericCtr);
+	void tposeIOGroupCacheReset(TposeGroupCache* cache);
+	unsigned int tposeIOGroupCacheFind(TposeGroupCache* cache, BTree* btree, off_t hash);
+	void tposeIOGroupHashBuild(TposeQuery* tposeQuery, BTree* btree);
+	void tposeIOGroupOrderBuild(TposeQuery* tposeQuery);
+	unsigned int tposeIOGroupFind(TposeQuery* tposeQuery, TposeGroupCache* cache, BTree* btree, off_t hash);
+	void tposeIOAggregatorUpdateBatch(TposeAggregator* tposeAggregator, TposeBatch* batch);
+	void tposeIOBatchAdd(TposeAggregator* tposeAggregator, TposeBatch* batch, unsigned int field, TposeRow* row, unsigned int numericCtr);
+	void tposeIOAggregatorMerge(TposeAggregator* tposeAggregator, unsigned int field, TposeAggregator* otherAggregator, unsigned int otherField);
+	void tposeIOAggregatorCopy(TposeAggregator* tposeAggregator, TposeAggregator* otherAggregator);
+	double tposeIOAggregatorSum(TposeAggregator* tposeAggregator, unsigned int field);
+	double tposeIOAggregatorAverage(TposeAggregator* tposeAggregator, unsigned int field);
+	double tposeIOAggregatorMin(TposeAggregator* tposeAggregator, unsigned int field);
+	double tposeIOAggregatorMax(TposeAggregator* tposeAggregator, unsigned int field);
+	double tposeIOAggregatorVariance(TposeAggregator* tposeAggregator, unsigned int field);
+	unsigned int tposeIOAggregateStats(unsigned int aggregateType);
+	int tposeIOParseAggregateTypes(const char* aggregateArg, unsigned int* aggregateTypes, double* aggregateQuantiles);
+
+	TposeQuery* tposeIOQueryAlloc(TposeInputFile** inputFiles, unsigned int numInputFiles, TposeOutputFile* outputFile, char* idVar, char* groupVar, char* numericVar, char* aggregateType);
+	TposeQuery* tposeIOQueryIndexedAlloc(TposeInputFile** inputFiles, unsigned int numInputFiles, TposeOutputFile* outputFile, int idVar, int groupVar, int* numericVars, unsigned int numNumericVars, char* aggregateType);
 	void tposeIOQueryFree(TposeQuery** tposeQueryPtr);
 
 
 	/* Util */
+	off_t tposeIOHash(const char* field, unsigned int length);
+	double tposeIOParseNumeric(const char* field, unsigned int length);
+	int64_t tposeIOParseFixed(const char* field, unsigned int length, unsigned int decimals);
+	off_t tposeIORowGroupHash(TposeRow* row);
+	double tposeIORowNumeric(TposeRow* row, unsigned int numericCtr);
+	int64_t tposeIORowFixed(TposeRow* row, unsigned int numericCtr, unsigned int decimals);
+	void tposeIODetectDecimals(TposeQuery* tposeQuery);
+	void tposeIORowReset(TposeQuery* tposeQuery, TposeRow* row);
+	char* tposeIOReadRow(TposeQuery* tposeQuery, TposeInputFile* inputFile, char* rowPtr, char* endPtr, TposeRow* row);
+	char* tposeIOReadRowIndexed(TposeQuery* tposeQuery, TposeInputFile* inputFile, char* rowPtr, char* endPtr, TposeRow* row);
+	off_t tposeIOIndexFindRow(TposeIndex* index, off_t offset);
+	off_t tposeIOIndexAlign(TposeInputFile* inputFile, off_t offset);
+
 	void tposeIOTransposeSimple(TposeQuery* tposeQuery);
 
 	void tposeIOUniqueGroups(TposeQuery* tposeQuery, BTree* btree);
+	void tposeIOUniqueGroupsScan(TposeQuery* tposeQuery, BTree* btree, TposeHeader* header, TposePartition* partition, unsigned int rangeId);
 	void tposeIOTransposeGroup(TposeQuery* tposeQuery, BTree* btree);
+	void tposeIOTransposeGroupScan(TposeQuery* tposeQuery, BTree* btree, TposeAggregator* aggregator, TposePartition* partition, unsigned int rangeId);
 	void tposeIOPrintOutput(TposeQuery* tposeQuery);
+	void tposeIOPrintGroupNames(TposeQuery* tposeQuery, FILE* fd, unsigned int affixes);
+	void tposeIOPrintCellName(TposeQuery* tposeQuery, FILE* fd, unsigned int affixes, char* group, unsigned int numericCtr, unsigned int aggregateCtr, unsigned char delimiter);
+	void tposeIOPrintAggregates(TposeQuery* tposeQuery, FILE* fd, TposeAggregator* aggregator);
+	void tposeIOPrintCellValue(TposeQuery* tposeQuery, FILE* fd, TposeAggregator* aggregator, unsigned int cell, unsigned int aggregateCtr, unsigned char delimiter);
 
 	void tposeIOTransposeGroupId(TposeQuery* tposeQuery, BTree* btree);
-	void tposeIOPrintGroupIdHeader(TposeQuery* tposeQuery);
-	void tposeIOPrintGroupIdData(char* id, TposeQuery* tposeQuery);
+	void tposeIOTransposeGroupIdScan(TposeQuery* tposeQuery, BTree* btree, TposeOutputFile* outputFile, TposeAggregator* aggregator, TposePartition* partition, TposeIdRun* idRun, unsigned int rangeId);
+	void tposeIOTransposeGroupIdFlush(TposeQuery* tposeQuery, TposeOutputFile* outputFile, TposeAggregator* aggregator, TposeIdRun* idRun);
+	void tposeIOPrintGroupIdHeader(TposeQuery* tposeQuery, TposeOutputFile* outputFile);
+	void tposeIOPrintGroupIdData(char* id, TposeQuery* tposeQuery, TposeOutputFile* outputFile, TposeAggregator* aggregator);
 	int tposeIOGetFieldIndex(TposeHeader* tposeHeader, char* field); 
 	char* tposeIOLowerCase(char* string);
 
@@ -166,16 +384,17 @@
 	#define TPOSE_IO_PARTITION_GROUP 0
 	#define TPOSE_IO_PARTITION_ID 1
 
-	BTree* btreeGlobal; // Needs to persist between computing unique groups, and aggregating values
+	extern BTree* btreeGlobal; // Needs to persist between computing unique groups, and aggregating values
 
 	typedef struct {
 		unsigned int threadId;
 		TposeQuery* query;
 		TposeHeader* header;
+		unsigned int* firstPartitions; // Partition each header field was found in (fields are in partition order)
 	} TposeThreadData;
 
-	TposeThreadData** threadDataArray;
-	TposeThreadData* threadData;
+	extern TposeThreadData** threadDataArray;
+	extern TposeThreadData* threadData;
 
 	typedef struct {
 		unsigned int threadId;
@@ -183,32 +402,59 @@
 		TposeAggregator* aggregator;
 	} TposeThreadAggregator;
 
-	TposeThreadAggregator** threadAggregatorArray;
-	TposeThreadAggregator* threadAggregator;
+	extern TposeThreadAggregator** threadAggregatorArray;
+	extern TposeThreadAggregator* threadAggregator;
 
-	unsigned int fileChunks; // Number of file chunks
-	off_t partitions[1000];
+	extern unsigned int fileChunks; // Number of file chunks
+	extern TposePartition partitions[TPOSE_IO_MAX_PARTITIONS];
+	extern unsigned int numWorkers; // Threads the partitions are shared between (see tposeIONumWorkers)
+	extern unsigned int nextPartition; // Next partition a worker takes (see tposeIONextPartition)
 	
-	TposeOutputFile* tempFileArray[1000];
+	extern TposeOutputFile* tempFileArray[TPOSE_IO_MAX_PARTITIONS];
+
+	/**
+	 ** TposePrefetcher
+	 ** Background thread advising the kernel to read ahead of each scan
+	 **/
+	typedef struct {
+		TposePartition* ranges; // Ranges being scanned (one per file, or per partition)
+		char** progress; // Current scan position of each range (NULL if not being scanned)
+		char** prefetched; // End of the prefetched data of each range
+		unsigned int numRanges;
+		off_t window; // Number of bytes to prefetch ahead of each scan
+		int stop;
+		pthread_t thread;
+	} TposePrefetcher;
+
+	extern off_t prefetchWindow; // 0 if prefetching is disabled
+	extern TposePrefetcher* prefetcherGlobal;
 
 
 	// functions
 	int tposeIOBuildPartitions(TposeQuery* tposeQuery, unsigned int mode);
+	off_t tposeIOAlignPartitionId(TposeQuery* tposeQuery, TposeInputFile* inputFile, off_t offset);
+	off_t tposeIOSkipId(TposeQuery* tposeQuery, TposeInputFile* inputFile, off_t offset, TposeRow* idRow);
+	off_t tposeIOLastRowOffset(TposeInputFile* inputFile);
+	unsigned int tposeIONumWorkers(void);
+	unsigned int tposeIONextPartition(void);
 
 	void tposeIOUniqueGroupsParallel(TposeQuery* tposeQuery);
 	void* tposeIOUniqueGroupsMap(void* threadArg);
 	void tposeIOUniqueGroupsReduce(TposeQuery* tposeQuery);
 
 	void tposeIOTransposeGroupParallel(TposeQuery* tposeQuery);
-	void* tposeIOTransposeGroupMap(void* threadArg);
+	void* tposeIOTransposeGroupMap(void* queryArg);
 	void tposeIOTransposeGroupReduce(TposeQuery* tposeQuery);
 
 	void tposeIOTransposeGroupIdParallel(TposeQuery* tposeQuery);
 	void* tposeIOTransposeGroupIdMap(void* threadArg);
 	void tposeIOTransposeGroupIdReduce(TposeQuery* tposeQuery);
 
-	void tposeIOPrintGroupIdHeaderParallel(TposeQuery* tposeQuery, unsigned int threadId);
-	void tposeIOPrintGroupIdDataParallel(char* id, TposeQuery* tposeQuery, TposeAggregator* aggregator, unsigned int threadId);
+	void tposeIOPrefetchStart(TposePartition* ranges, unsigned int numRanges);
+	void tposeIOPrefetchStartFiles(TposeQuery* tposeQuery);
+	void tposeIOPrefetchPublish(unsigned int rangeId, char* scanPtr);
+	void* tposeIOPrefetchRun(void* prefetcherArg);
+	void tposeIOPrefetchStop(void);
 /* parallel test end */
 
 
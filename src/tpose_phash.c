@@ -0,0 +1,278 @@
+/* tpose_phash.c -- minimal perfect hash implementation.
+
+   Copyright 2015 Jonathan Sacramento.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tpose_phash.h"
+
+
+
+/**
+ ** Mixes the bits of a key (keys are field hashes, whose low bits depend
+ ** mostly on the last few characters)
+ **/
+static uint64_t tposePerfectHashMix(
+	uint64_t key
+) {
+
+	key ^= key >> 30;
+	key *= 0xBF58476D1CE4E5B9ULL;
+	key ^= key >> 27;
+	key *= 0x94D049BB133111EBULL;
+	key ^= key >> 31;
+
+	return key;
+
+}
+
+
+
+/**
+ ** Returns the bucket of a key
+ **/
+static unsigned int tposePerfectHashBucket(
+	const TposePerfectHash* phash
+	,off_t key
+) {
+
+	return (unsigned int) (((tposePerfectHashMix((uint64_t) key) >> 32) * phash->numBuckets) >> 32);
+
+}
+
+
+
+/**
+ ** Returns the slot a seed puts a key in
+ **/
+static unsigned int tposePerfectHashSlot(
+	const TposePerfectHash* phash
+	,off_t key
+	,uint32_t seed
+) {
+
+	uint64_t mixed = tposePerfectHashMix((uint64_t) key ^ (seed * 0x9E3779B97F4A7C15ULL));
+
+	return (unsigned int) (((mixed & 0xFFFFFFFF) * phash->numKeys) >> 32);
+
+}
+
+
+
+/**
+ ** Orders buckets by decreasing size (size << 32 | bucket), for qsort()
+ **/
+static int tposePerfectHashCompareBuckets(
+	const void* first
+	,const void* second
+) {
+
+	uint64_t firstBucket = *(const uint64_t*) first;
+	uint64_t secondBucket = *(const uint64_t*) second;
+
+	return (firstBucket < secondBucket) - (firstBucket > secondBucket);
+
+}
+
+
+
+/**
+ ** Builds a minimal perfect hash of numKeys distinct keys, mapping each to its value
+ ** Returns NULL if there are no keys, keys are repeated, or a bucket cannot be placed
+ **/
+TposePerfectHash* tposePerfectHashBuild(
+	const off_t* keys
+	,const unsigned int* values
+	,unsigned int numKeys
+) {
+
+	TposePerfectHash* phash = NULL;
+	unsigned int* bucketStarts = NULL; // Position in bucketKeys of the first key of each bucket
+	unsigned int* bucketKeys = NULL; // Keys (as indexes) sorted by bucket
+	uint64_t* buckets = NULL; // size << 32 | bucket, largest first
+	unsigned int* slots = NULL; // Slots of the keys of the bucket being placed
+	unsigned char* used = NULL;
+	unsigned int bucket;
+	unsigned int bucketSize;
+	unsigned int maxBucketSize = 0;
+	unsigned int keyCtr;
+	unsigned int bucketCtr;
+	unsigned int otherCtr;
+	unsigned int freeSlot = 0;
+	uint32_t seed;
+
+	if(numKeys == 0)
+		return NULL;
+
+	if((phash = (TposePerfectHash*) calloc(1, sizeof(TposePerfectHash))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate memory for perfect hash\n");
+		exit(EXIT_FAILURE);
+	}
+	phash->numKeys = numKeys;
+	phash->numBuckets = numKeys / TPOSE_PHASH_BUCKET_SIZE + 1;
+
+	if((phash->displacements = (int32_t*) calloc(phash->numBuckets, sizeof(int32_t))) == NULL
+		|| (phash->entries = (TposePerfectHashEntry*) malloc(numKeys * sizeof(TposePerfectHashEntry))) == NULL
+		|| (bucketStarts = (unsigned int*) calloc(phash->numBuckets + 1, sizeof(unsigned int))) == NULL
+		|| (bucketKeys = (unsigned int*) malloc(numKeys * sizeof(unsigned int))) == NULL
+		|| (buckets = (uint64_t*) malloc(phash->numBuckets * sizeof(uint64_t))) == NULL
+		|| (slots = (unsigned int*) malloc(numKeys * sizeof(unsigned int))) == NULL
+		|| (used = (unsigned char*) calloc(numKeys, sizeof(unsigned char))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate memory for perfect hash\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Sort keys by bucket (counting sort)
+	for(keyCtr = 0; keyCtr < numKeys; keyCtr++)
+		bucketStarts[tposePerfectHashBucket(phash, keys[keyCtr]) + 1]++;
+	for(bucketCtr = 0; bucketCtr < phash->numBuckets; bucketCtr++) {
+		bucketSize = bucketStarts[bucketCtr + 1];
+		buckets[bucketCtr] = (uint64_t) bucketSize << 32 | bucketCtr;
+		if(bucketSize > maxBucketSize)
+			maxBucketSize = bucketSize;
+		bucketStarts[bucketCtr + 1] += bucketStarts[bucketCtr];
+	}
+	for(keyCtr = 0; keyCtr < numKeys; keyCtr++)
+		bucketKeys[bucketStarts[tposePerfectHashBucket(phash, keys[keyCtr])]++] = keyCtr;
+	for(bucketCtr = phash->numBuckets; bucketCtr > 0; bucketCtr--)
+		bucketStarts[bucketCtr] = bucketStarts[bucketCtr - 1];
+	bucketStarts[0] = 0;
+
+	// Place the largest buckets first, while most slots are free
+	qsort(buckets, phash->numBuckets, sizeof(uint64_t), tposePerfectHashCompareBuckets);
+
+	for(bucketCtr = 0; bucketCtr < phash->numBuckets; bucketCtr++) {
+		bucket = (unsigned int) (buckets[bucketCtr] & 0xFFFFFFFF);
+		bucketSize = (unsigned int) (buckets[bucketCtr] >> 32);
+		unsigned int* bucketKey = bucketKeys + bucketStarts[bucket];
+
+		if(bucketSize == 0)
+			break;
+
+		// A single key goes in the next free slot
+		if(bucketSize == 1) {
+			while(used[freeSlot])
+				freeSlot++;
+			used[freeSlot] = 1;
+			phash->displacements[bucket] = -(int32_t) freeSlot - 1;
+			phash->entries[freeSlot].key = keys[bucketKey[0]];
+			phash->entries[freeSlot].value = values[bucketKey[0]];
+			continue;
+		}
+
+		// Otherwise find a seed that puts every key of the bucket in a different free slot
+		for(seed = 0; seed < TPOSE_PHASH_MAX_SEEDS; seed++) {
+			for(keyCtr = 0; keyCtr < bucketSize; keyCtr++) {
+				slots[keyCtr] = tposePerfectHashSlot(phash, keys[bucketKey[keyCtr]], seed);
+				if(used[slots[keyCtr]])
+					break;
+				for(otherCtr = 0; otherCtr < keyCtr; otherCtr++) {
+					if(slots[otherCtr] == slots[keyCtr])
+						break;
+				}
+				if(otherCtr < keyCtr)
+					break;
+			}
+			if(keyCtr == bucketSize)
+				break;
+
+			// Repeated keys never go in different slots
+			if(seed == 0) {
+				for(keyCtr = 0; keyCtr < bucketSize; keyCtr++) {
+					for(otherCtr = 0; otherCtr < keyCtr; otherCtr++) {
+						if(keys[bucketKey[otherCtr]] == keys[bucketKey[keyCtr]])
+							goto fail;
+					}
+				}
+			}
+		}
+		if(seed == TPOSE_PHASH_MAX_SEEDS)
+			goto fail;
+
+		phash->displacements[bucket] = (int32_t) seed;
+		for(keyCtr = 0; keyCtr < bucketSize; keyCtr++) {
+			used[slots[keyCtr]] = 1;
+			phash->entries[slots[keyCtr]].key = keys[bucketKey[keyCtr]];
+			phash->entries[slots[keyCtr]].value = values[bucketKey[keyCtr]];
+		}
+	}
+
+	debug_print("tposePerfectHashBuild(): %u keys in %u buckets (largest has %u keys)\n", numKeys, phash->numBuckets, maxBucketSize);
+
+	free(bucketStarts);
+	free(bucketKeys);
+	free(buckets);
+	free(slots);
+	free(used);
+
+	return phash;
+
+fail:
+	debug_print("tposePerfectHashBuild(): cannot place %u keys\n", numKeys);
+
+	free(bucketStarts);
+	free(bucketKeys);
+	free(buckets);
+	free(slots);
+	free(used);
+	tposePerfectHashFree(&phash);
+
+	return NULL;
+
+}
+
+
+
+/**
+ ** Returns the value of a key, or TPOSE_PHASH_EMPTY if the key is not in the table
+ **/
+unsigned int tposePerfectHashFind(
+	const TposePerfectHash* phash
+	,off_t key
+) {
+
+	int32_t displacement = phash->displacements[tposePerfectHashBucket(phash, key)];
+	unsigned int slot;
+
+	if(displacement < 0)
+		slot = (unsigned int) (-(displacement + 1));
+	else
+		slot = tposePerfectHashSlot(phash, key, (uint32_t) displacement);
+
+	if(phash->entries[slot].key != key)
+		return TPOSE_PHASH_EMPTY;
+
+	return phash->entries[slot].value;
+
+}
+
+
+
+/**
+ ** Frees a perfect hash
+ **/
+void tposePerfectHashFree(
+	TposePerfectHash** phashPtr
+) {
+
+	if(*phashPtr == NULL)
+		return;
+
+	free((*phashPtr)->displacements);
+	free((*phashPtr)->entries);
+	free(*phashPtr);
+	*phashPtr = NULL;
+
+}
@@ -0,0 +1,64 @@
+/* tpose_phash.h: minimal perfect hash interface;
+
+   Copyright 2015 Jonathan Sacramento.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TPOSE_PHASH_H_
+#define _TPOSE_PHASH_H_
+
+	#include <stdint.h>
+	#include <sys/types.h>
+
+	#include "system.h"
+
+
+	/**
+	 ** Implementation defs & limits
+	 **/
+	#define TPOSE_PHASH_BUCKET_SIZE 4 // Average keys per bucket
+	#define TPOSE_PHASH_MAX_SEEDS (1 << 20) // Seeds tried for a bucket before giving up
+	#define TPOSE_PHASH_EMPTY 0xFFFFFFFF // Returned for keys not in the table
+
+
+	/**
+	 ** TposePerfectHashEntry
+	 ** Key and value of a slot (kept together, so a lookup reads one cache line)
+	 **/
+	typedef struct {
+		off_t key;
+		unsigned int value;
+	} TposePerfectHashEntry;
+
+	/**
+	 ** TposePerfectHash
+	 ** Minimal perfect hash of a fixed set of 64-bit keys (hash and displace,
+	 ** as in CHD): keys are split into buckets, and each bucket gets the seed
+	 ** that puts all of its keys in free slots. A bucket of one key stores its
+	 ** slot instead (as -slot - 1). The table has one slot per key
+	 **/
+	typedef struct {
+		unsigned int numKeys;
+		unsigned int numBuckets;
+		int32_t* displacements; // Seed (or -slot - 1) of each bucket
+		TposePerfectHashEntry* entries;
+	} TposePerfectHash;
+
+
+	TposePerfectHash* tposePerfectHashBuild(const off_t* keys, const unsigned int* values, unsigned int numKeys);
+	unsigned int tposePerfectHashFind(const TposePerfectHash* phash, off_t key);
+	void tposePerfectHashFree(TposePerfectHash** phashPtr);
+
+#endif /* TPOSE_PHASH_H */
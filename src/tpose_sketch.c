@@ -0,0 +1,667 @@
+/* tpose_sketch.c -- approximate aggregate (sketch) implementation.
+
+   Copyright 2015 Jonathan Sacramento.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tpose_sketch.h"
+
+
+unsigned int hllPrecisionGlobal = TPOSE_SKETCH_HLL_PRECISION;
+
+
+
+/**
+ ** Returns a 64-bit hash of a value (all bits are well mixed, as
+ ** HyperLogLog takes the register from the top bits and the rank from the rest)
+ **/
+uint64_t tposeSketchHash(
+	const char* value
+	,unsigned int length
+) {
+
+	uint64_t hash = 0x9E3779B97F4A7C15ULL ^ length;
+	uint64_t word;
+
+	// Eight bytes at a time, then the tail
+	for(; length >= 8; length -= 8, value += 8) {
+		memcpy(&word, value, 8);
+		hash = (hash ^ (word * 0xFF51AFD7ED558CCDULL)) * 0xC4CEB9FE1A85EC53ULL;
+		hash ^= hash >> 31;
+	}
+	if(length) {
+		word = 0;
+		memcpy(&word, value, length);
+		hash = (hash ^ (word * 0xFF51AFD7ED558CCDULL)) * 0xC4CEB9FE1A85EC53ULL;
+	}
+
+	// Final avalanche (MurmurHash3 fmix64)
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDULL;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ULL;
+	hash ^= hash >> 33;
+
+	return hash;
+
+}
+
+
+
+/**
+ ** Frees the data of a HyperLogLog sketch (the sketch is left empty)
+ **/
+void tposeSketchHllFree(
+	TposeSketchHll* sketch
+) {
+
+	free(sketch->data);
+	memset(sketch, 0, sizeof(TposeSketchHll));
+
+}
+
+
+
+/**
+ ** Empties a HyperLogLog sketch (its memory is kept for reuse)
+ **/
+void tposeSketchHllReset(
+	TposeSketchHll* sketch
+) {
+
+	sketch->numEntries = 0;
+	sketch->dense = 0;
+
+}
+
+
+
+/**
+ ** Makes room for maxEntries sparse entries (or maxEntries * 4 registers)
+ **/
+static void tposeSketchHllReserve(
+	TposeSketchHll* sketch
+	,uint32_t maxEntries
+) {
+
+	if(sketch->maxEntries >= maxEntries)
+		return;
+
+	if((sketch->data = realloc(sketch->data, (size_t) maxEntries * sizeof(uint32_t))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate sketch memory\n");
+		exit(EXIT_FAILURE);
+	}
+	sketch->maxEntries = maxEntries;
+
+}
+
+
+
+/**
+ ** Turns a sparse HyperLogLog sketch into registers
+ **/
+static void tposeSketchHllDensify(
+	TposeSketchHll* sketch
+	,unsigned int precision
+) {
+
+	uint32_t* entries = (uint32_t*) sketch->data;
+	uint8_t* registers;
+	uint32_t ctr;
+
+	if((registers = (uint8_t*) calloc((size_t) 1 << precision, 1)) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate sketch memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for(ctr = 0; ctr < sketch->numEntries; ctr++)
+		registers[entries[ctr] >> 8] = entries[ctr] & 0xFF;
+
+	free(sketch->data);
+	sketch->data = registers;
+	sketch->maxEntries = (1u << precision) / sizeof(uint32_t);
+	sketch->numEntries = 0;
+	sketch->dense = 1;
+
+}
+
+
+
+/**
+ ** Raises a register of a HyperLogLog sketch to rank (if lower)
+ **/
+static void tposeSketchHllSet(
+	TposeSketchHll* sketch
+	,unsigned int precision
+	,uint32_t index
+	,uint32_t rank
+) {
+
+	uint32_t* entries = (uint32_t*) sketch->data;
+	uint32_t maxSparse = (1u << precision) / sizeof(uint32_t);
+	uint32_t low = 0;
+	uint32_t high = sketch->numEntries;
+	uint32_t middle;
+
+	if(sketch->dense) {
+		if(rank > ((uint8_t*) sketch->data)[index])
+			((uint8_t*) sketch->data)[index] = rank;
+		return;
+	}
+
+	// Binary search for the register's entry (entries are sorted by index)
+	while(low < high) {
+		middle = (low + high) / 2;
+		if((entries[middle] >> 8) < index)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	if(low < sketch->numEntries && (entries[low] >> 8) == index) {
+		if(rank > (entries[low] & 0xFF))
+			entries[low] = (index << 8) | rank;
+		return;
+	}
+
+	// Registers take no more room than a full list of entries
+	if(sketch->numEntries == maxSparse) {
+		tposeSketchHllDensify(sketch, precision);
+		((uint8_t*) sketch->data)[index] = rank;
+		return;
+	}
+
+	if(sketch->numEntries == sketch->maxEntries) {
+		tposeSketchHllReserve(sketch, (sketch->maxEntries * 2 > maxSparse) ? maxSparse
+			: (sketch->maxEntries ? sketch->maxEntries * 2 : TPOSE_SKETCH_HLL_SPARSE_MIN));
+		entries = (uint32_t*) sketch->data;
+	}
+
+	memmove(entries + low + 1, entries + low, (sketch->numEntries - low) * sizeof(uint32_t));
+	entries[low] = (index << 8) | rank;
+	sketch->numEntries++;
+
+}
+
+
+
+/**
+ ** Adds a hashed value to a HyperLogLog sketch of 2^precision registers
+ **/
+void tposeSketchHllAdd(
+	TposeSketchHll* sketch
+	,unsigned int precision
+	,uint64_t hash
+) {
+
+	uint64_t rest = (hash << precision) | (1ULL << (precision - 1)); // Guard bit caps the rank
+
+	tposeSketchHllSet(sketch, precision, hash >> (64 - precision), __builtin_clzll(rest) + 1);
+
+}
+
+
+
+/**
+ ** Adds another HyperLogLog sketch (of the same precision) to a sketch
+ **/
+void tposeSketchHllMerge(
+	TposeSketchHll* sketch
+	,TposeSketchHll* otherSketch
+	,unsigned int precision
+) {
+
+	uint8_t* registers;
+	uint8_t* otherRegisters = (uint8_t*) otherSketch->data;
+	uint32_t* otherEntries = (uint32_t*) otherSketch->data;
+	size_t numRegisters = (size_t) 1 << precision;
+	size_t ctr;
+
+	if(!otherSketch->dense) {
+		for(ctr = 0; ctr < otherSketch->numEntries; ctr++)
+			tposeSketchHllSet(sketch, precision, otherEntries[ctr] >> 8, otherEntries[ctr] & 0xFF);
+		return;
+	}
+
+	if(!sketch->dense)
+		tposeSketchHllDensify(sketch, precision);
+
+	registers = (uint8_t*) sketch->data;
+	for(ctr = 0; ctr < numRegisters; ctr++)
+		registers[ctr] = (otherRegisters[ctr] > registers[ctr]) ? otherRegisters[ctr] : registers[ctr];
+
+}
+
+
+
+/**
+ ** Copies another HyperLogLog sketch (of the same precision) over a sketch
+ **/
+void tposeSketchHllCopy(
+	TposeSketchHll* sketch
+	,TposeSketchHll* otherSketch
+	,unsigned int precision
+) {
+
+	if(otherSketch->dense) {
+		tposeSketchHllReserve(sketch, (1u << precision) / sizeof(uint32_t));
+		memcpy(sketch->data, otherSketch->data, (size_t) 1 << precision);
+	}
+	else if(otherSketch->numEntries) {
+		tposeSketchHllReserve(sketch, otherSketch->numEntries);
+		memcpy(sketch->data, otherSketch->data, otherSketch->numEntries * sizeof(uint32_t));
+	}
+
+	sketch->numEntries = otherSketch->numEntries;
+	sketch->dense = otherSketch->dense;
+
+}
+
+
+
+/**
+ ** Returns the estimated number of distinct values added to a HyperLogLog sketch
+ ** (linear counting is used while many registers are empty). Registers are
+ ** counted by rank first, so sparse and dense sketches give the same estimate
+ **/
+double tposeSketchHllEstimate(
+	TposeSketchHll* sketch
+	,unsigned int precision
+) {
+
+	size_t numRegisters = (size_t) 1 << precision;
+	double m = (double) numRegisters;
+	double alpha;
+	double sum = 0;
+	double estimate;
+	uint32_t* entries = (uint32_t*) sketch->data;
+	uint8_t* registers = (uint8_t*) sketch->data;
+	size_t ranks[65] = {0};
+	size_t ctr;
+
+	if(sketch->dense) {
+		for(ctr = 0; ctr < numRegisters; ctr++)
+			ranks[registers[ctr]]++;
+	}
+	else {
+		ranks[0] = numRegisters - sketch->numEntries;
+		for(ctr = 0; ctr < sketch->numEntries; ctr++)
+			ranks[entries[ctr] & 0xFF]++;
+	}
+
+	if(ranks[0] == numRegisters)
+		return 0;
+
+	switch(precision) {
+		case 4: alpha = 0.673; break;
+		case 5: alpha = 0.697; break;
+		case 6: alpha = 0.709; break;
+		default: alpha = 0.7213 / (1 + 1.079 / m);
+	}
+
+	for(ctr = 0; ctr < 65; ctr++)
+		sum += ldexp((double) ranks[ctr], -(int) ctr);
+
+	estimate = alpha * m * m / sum;
+	if(estimate <= 2.5 * m && ranks[0])
+		estimate = m * log(m / ranks[0]);
+
+	return estimate;
+
+}
+
+
+
+/**
+ ** Writes a HyperLogLog sketch to a file
+ ** Returns 0 if OK, non-zero on error
+ **/
+int tposeSketchHllWrite(
+	FILE* fd
+	,TposeSketchHll* sketch
+	,unsigned int precision
+) {
+
+	int writeError = 0;
+
+	writeError |= fwrite(&(sketch->dense), sizeof(uint32_t), 1, fd) != 1;
+	writeError |= fwrite(&(sketch->numEntries), sizeof(uint32_t), 1, fd) != 1;
+	if(sketch->dense)
+		writeError |= fwrite(sketch->data, (size_t) 1 << precision, 1, fd) != 1;
+	else if(sketch->numEntries)
+		writeError |= fwrite(sketch->data, sizeof(uint32_t), sketch->numEntries, fd) != sketch->numEntries;
+
+	return writeError;
+
+}
+
+
+
+/**
+ ** Reads a HyperLogLog sketch written by tposeSketchHllWrite
+ ** Returns 0 if OK, -1 if the sketch is not valid
+ **/
+int tposeSketchHllRead(
+	FILE* fd
+	,TposeSketchHll* sketch
+	,unsigned int precision
+) {
+
+	uint32_t maxSparse = (1u << precision) / sizeof(uint32_t);
+	uint32_t* entries;
+	uint32_t dense;
+	uint32_t numEntries;
+	uint32_t ctr;
+
+	if(fread(&dense, sizeof(dense), 1, fd) != 1 || fread(&numEntries, sizeof(numEntries), 1, fd) != 1
+		|| dense > 1 || numEntries > maxSparse || (dense && numEntries))
+		return -1;
+
+	tposeSketchHllReserve(sketch, dense ? maxSparse : numEntries);
+	sketch->dense = dense;
+	sketch->numEntries = numEntries;
+
+	if(dense)
+		return (fread(sketch->data, (size_t) 1 << precision, 1, fd) != 1) ? -1 : 0;
+
+	if(numEntries && fread(sketch->data, sizeof(uint32_t), numEntries, fd) != numEntries)
+		return -1;
+
+	// Entries must be sorted registers
+	entries = (uint32_t*) sketch->data;
+	for(ctr = 0; ctr < numEntries; ctr++) {
+		if((entries[ctr] >> 8) >= (1u << precision) || (ctr && (entries[ctr] >> 8) <= (entries[ctr - 1] >> 8)))
+			return -1;
+	}
+
+	return 0;
+
+}
+
+
+
+/**
+ ** Frees the bins of a quantile sketch (the sketch is left empty)
+ **/
+void tposeSketchQuantileFree(
+	TposeSketchQuantile* sketch
+) {
+
+	free(sketch->bins);
+	memset(sketch, 0, sizeof(TposeSketchQuantile));
+
+}
+
+
+
+/**
+ ** Empties a quantile sketch (its memory is kept for reuse)
+ **/
+void tposeSketchQuantileReset(
+	TposeSketchQuantile* sketch
+) {
+
+	sketch->numBins = 0;
+	sketch->count = 0;
+
+}
+
+
+
+/**
+ ** Makes room for maxBins bins in a quantile sketch
+ **/
+static void tposeSketchQuantileReserve(
+	TposeSketchQuantile* sketch
+	,uint32_t maxBins
+) {
+
+	if(sketch->maxBins >= maxBins)
+		return;
+
+	if((sketch->bins = (TposeSketchBin*) realloc(sketch->bins, maxBins * sizeof(TposeSketchBin))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate sketch memory\n");
+		exit(EXIT_FAILURE);
+	}
+	sketch->maxBins = maxBins;
+
+}
+
+
+
+/**
+ ** Returns the key of the bucket a value is counted in. Bucket k holds the
+ ** magnitudes in (gamma^(k-1), gamma^k], negative values get negative keys
+ **/
+static int64_t tposeSketchQuantileKey(
+	double value
+) {
+
+	double magnitude = fabs(value);
+	int64_t key;
+
+	if(!(magnitude >= TPOSE_SKETCH_QUANTILE_MIN_VALUE)) // Also NaN
+		return 0;
+	if(magnitude > DBL_MAX)
+		magnitude = DBL_MAX;
+
+	key = (int64_t) ceil(log(magnitude) / TPOSE_SKETCH_QUANTILE_LOG_GAMMA) + TPOSE_SKETCH_QUANTILE_KEY_OFFSET;
+
+	return (value < 0) ? -key : key;
+
+}
+
+
+
+/**
+ ** Returns the value a bucket stands for (within ACCURACY of all its values)
+ **/
+static double tposeSketchQuantileKeyValue(
+	int64_t key
+) {
+
+	double gamma = exp(TPOSE_SKETCH_QUANTILE_LOG_GAMMA);
+	double value;
+
+	if(key == 0)
+		return 0;
+
+	value = 2 * exp((double) (llabs(key) - TPOSE_SKETCH_QUANTILE_KEY_OFFSET) * TPOSE_SKETCH_QUANTILE_LOG_GAMMA) / (gamma + 1);
+
+	return (key < 0) ? -value : value;
+
+}
+
+
+
+/**
+ ** Adds count values to a bucket of a quantile sketch
+ **/
+static void tposeSketchQuantileAddBin(
+	TposeSketchQuantile* sketch
+	,int64_t key
+	,uint64_t count
+) {
+
+	uint32_t low = 0;
+	uint32_t high = sketch->numBins;
+	uint32_t middle;
+
+	sketch->count += count;
+
+	// Binary search for the bucket (bins are sorted by key)
+	while(low < high) {
+		middle = (low + high) / 2;
+		if(sketch->bins[middle].key < key)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	if(low < sketch->numBins && sketch->bins[low].key == key) {
+		sketch->bins[low].count += count;
+		return;
+	}
+
+	// Never more than MAX_BINS + 1 bins (the extra one is collapsed right away)
+	if(sketch->numBins == sketch->maxBins)
+		tposeSketchQuantileReserve(sketch, (sketch->maxBins * 2 > TPOSE_SKETCH_QUANTILE_MAX_BINS + 1) ? TPOSE_SKETCH_QUANTILE_MAX_BINS + 1
+			: (sketch->maxBins ? sketch->maxBins * 2 : TPOSE_SKETCH_QUANTILE_MIN_BINS));
+
+	memmove(sketch->bins + low + 1, sketch->bins + low, (sketch->numBins - low) * sizeof(TposeSketchBin));
+	sketch->bins[low].key = key;
+	sketch->bins[low].count = count;
+	sketch->numBins++;
+
+	// Bound the memory by collapsing the lowest two buckets
+	if(sketch->numBins > TPOSE_SKETCH_QUANTILE_MAX_BINS) {
+		sketch->bins[1].count += sketch->bins[0].count;
+		memmove(sketch->bins, sketch->bins + 1, --sketch->numBins * sizeof(TposeSketchBin));
+	}
+
+}
+
+
+
+/**
+ ** Adds a value to a quantile sketch
+ **/
+void tposeSketchQuantileAdd(
+	TposeSketchQuantile* sketch
+	,double value
+) {
+
+	tposeSketchQuantileAddBin(sketch, tposeSketchQuantileKey(value), 1);
+
+}
+
+
+
+/**
+ ** Adds another quantile sketch to a sketch
+ **/
+void tposeSketchQuantileMerge(
+	TposeSketchQuantile* sketch
+	,TposeSketchQuantile* otherSketch
+) {
+
+	uint32_t ctr;
+
+	for(ctr = 0; ctr < otherSketch->numBins; ctr++)
+		tposeSketchQuantileAddBin(sketch, otherSketch->bins[ctr].key, otherSketch->bins[ctr].count);
+
+}
+
+
+
+/**
+ ** Copies another quantile sketch over a sketch
+ **/
+void tposeSketchQuantileCopy(
+	TposeSketchQuantile* sketch
+	,TposeSketchQuantile* otherSketch
+) {
+
+	tposeSketchQuantileReserve(sketch, otherSketch->numBins);
+	if(otherSketch->numBins)
+		memcpy(sketch->bins, otherSketch->bins, otherSketch->numBins * sizeof(TposeSketchBin));
+
+	sketch->numBins = otherSketch->numBins;
+	sketch->count = otherSketch->count;
+
+}
+
+
+
+/**
+ ** Returns the value at a quantile (0 to 1) of the values added to a sketch
+ ** (0 if there are none)
+ **/
+double tposeSketchQuantileValue(
+	TposeSketchQuantile* sketch
+	,double quantile
+) {
+
+	double rank = quantile * (sketch->count - 1);
+	uint64_t seen = 0;
+	uint32_t ctr;
+
+	if(sketch->count == 0)
+		return 0;
+
+	for(ctr = 0; ctr < sketch->numBins; ctr++) {
+		seen += sketch->bins[ctr].count;
+		if(seen > rank)
+			break;
+	}
+
+	return tposeSketchQuantileKeyValue(sketch->bins[(ctr < sketch->numBins) ? ctr : sketch->numBins - 1].key);
+
+}
+
+
+
+/**
+ ** Writes a quantile sketch to a file
+ ** Returns 0 if OK, non-zero on error
+ **/
+int tposeSketchQuantileWrite(
+	FILE* fd
+	,TposeSketchQuantile* sketch
+) {
+
+	int writeError = 0;
+
+	writeError |= fwrite(&(sketch->numBins), sizeof(uint32_t), 1, fd) != 1;
+	if(sketch->numBins)
+		writeError |= fwrite(sketch->bins, sizeof(TposeSketchBin), sketch->numBins, fd) != sketch->numBins;
+
+	return writeError;
+
+}
+
+
+
+/**
+ ** Reads a quantile sketch written by tposeSketchQuantileWrite
+ ** Returns 0 if OK, -1 if the sketch is not valid
+ **/
+int tposeSketchQuantileRead(
+	FILE* fd
+	,TposeSketchQuantile* sketch
+) {
+
+	uint32_t numBins;
+	uint32_t ctr;
+
+	if(fread(&numBins, sizeof(numBins), 1, fd) != 1 || numBins > TPOSE_SKETCH_QUANTILE_MAX_BINS)
+		return -1;
+
+	tposeSketchQuantileReserve(sketch, numBins);
+	if(numBins && fread(sketch->bins, sizeof(TposeSketchBin), numBins, fd) != numBins)
+		return -1;
+
+	// Bins must be sorted, non-empty buckets
+	sketch->numBins = numBins;
+	sketch->count = 0;
+	for(ctr = 0; ctr < numBins; ctr++) {
+		if(sketch->bins[ctr].count == 0 || (ctr && sketch->bins[ctr].key <= sketch->bins[ctr - 1].key))
+			return -1;
+		sketch->count += sketch->bins[ctr].count;
+	}
+
+	return 0;
+
+}
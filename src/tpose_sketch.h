@@ -0,0 +1,108 @@
+/* tpose_sketch.h: approximate aggregate (sketch) interface;
+
+   Copyright 2015 Jonathan Sacramento.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TPOSE_SKETCH_H_
+#define _TPOSE_SKETCH_H_
+
+	#include <stdint.h>
+	#include <float.h>
+	#include <math.h>
+
+	#include "system.h"
+
+
+	/**
+	 ** Implementation defs & limits
+	 **/
+	#define TPOSE_SKETCH_HLL_PRECISION 12 // Default HyperLogLog precision (2^12 one-byte registers, ~1.6% error)
+	#define TPOSE_SKETCH_HLL_MIN_PRECISION 4
+	#define TPOSE_SKETCH_HLL_MAX_PRECISION 18
+	#define TPOSE_SKETCH_HLL_SPARSE_MIN 4 // Entries first allocated for a sparse sketch
+
+	#define TPOSE_SKETCH_QUANTILE_ACCURACY 0.01 // Relative error of quantiles
+	#define TPOSE_SKETCH_QUANTILE_LOG_GAMMA 0.020000666706669435 // log((1 + ACCURACY) / (1 - ACCURACY))
+	#define TPOSE_SKETCH_QUANTILE_MIN_VALUE 1e-9 // Smaller magnitudes are counted as 0
+	#define TPOSE_SKETCH_QUANTILE_KEY_OFFSET 65536 // Keeps the bucket keys of non-zero values away from 0
+	#define TPOSE_SKETCH_QUANTILE_MAX_BINS 2048 // The lowest bins are collapsed beyond this
+	#define TPOSE_SKETCH_QUANTILE_MIN_BINS 4 // Bins first allocated
+
+
+	/**
+	 ** Global vars
+	 **/
+	extern unsigned int hllPrecisionGlobal; // Registers of each distinct sketch = 2^hllPrecisionGlobal
+
+
+	/**
+	 ** TposeSketchHll
+	 ** HyperLogLog sketch. Starts sparse (the non-zero registers only, as
+	 ** sorted index << 8 | rank entries), and turns into 2^precision
+	 ** one-byte registers once the entries would take as much room
+	 **/
+	typedef struct {
+		void* data; // Sparse entries (uint32_t), or registers (uint8_t) if dense
+		uint32_t numEntries; // Sparse entries used
+		uint32_t maxEntries; // Sparse entries data has room for
+		uint32_t dense;
+	} TposeSketchHll;
+
+
+	/**
+	 ** TposeSketchBin
+	 ** Number of values in a bucket of a quantile sketch
+	 **/
+	typedef struct {
+		int64_t key;
+		uint64_t count;
+	} TposeSketchBin;
+
+	/**
+	 ** TposeSketchQuantile
+	 ** Mergeable quantile sketch (DDSketch): values are counted in logarithmic
+	 ** buckets, so any quantile is within ACCURACY of the true value. Merging
+	 ** adds up bucket counts, so the result does not depend on the merge order
+	 **/
+	typedef struct {
+		TposeSketchBin* bins; // Non-empty buckets, sorted by key (i.e. by value)
+		uint32_t numBins;
+		uint32_t maxBins; // Bins allocated
+		uint64_t count;
+	} TposeSketchQuantile;
+
+
+	uint64_t tposeSketchHash(const char* value, unsigned int length);
+
+	void tposeSketchHllFree(TposeSketchHll* sketch);
+	void tposeSketchHllReset(TposeSketchHll* sketch);
+	void tposeSketchHllAdd(TposeSketchHll* sketch, unsigned int precision, uint64_t hash);
+	void tposeSketchHllMerge(TposeSketchHll* sketch, TposeSketchHll* otherSketch, unsigned int precision);
+	void tposeSketchHllCopy(TposeSketchHll* sketch, TposeSketchHll* otherSketch, unsigned int precision);
+	double tposeSketchHllEstimate(TposeSketchHll* sketch, unsigned int precision);
+	int tposeSketchHllWrite(FILE* fd, TposeSketchHll* sketch, unsigned int precision);
+	int tposeSketchHllRead(FILE* fd, TposeSketchHll* sketch, unsigned int precision);
+
+	void tposeSketchQuantileFree(TposeSketchQuantile* sketch);
+	void tposeSketchQuantileReset(TposeSketchQuantile* sketch);
+	void tposeSketchQuantileAdd(TposeSketchQuantile* sketch, double value);
+	void tposeSketchQuantileMerge(TposeSketchQuantile* sketch, TposeSketchQuantile* otherSketch);
+	void tposeSketchQuantileCopy(TposeSketchQuantile* sketch, TposeSketchQuantile* otherSketch);
+	double tposeSketchQuantileValue(TposeSketchQuantile* sketch, double quantile);
+	int tposeSketchQuantileWrite(FILE* fd, TposeSketchQuantile* sketch);
+	int tposeSketchQuantileRead(FILE* fd, TposeSketchQuantile* sketch);
+
+#endif /* TPOSE_SKETCH_H */
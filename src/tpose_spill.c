@@ -0,0 +1,627 @@
+/* tpose_spill.c -- bounded-memory GROUP aggregation (see --max-memory).
+
+   Copyright 2015 Jonathan Sacramento.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tpose_spill.h"
+
+
+
+/**
+ ** Opens an unnamed temporary file in $TMPDIR (or /tmp), removed once closed
+ **/
+static FILE* tposeSpillTempFile(
+	void
+) {
+
+	const char* directory = getenv("TMPDIR");
+	char* path;
+	FILE* file;
+	int fd;
+
+	if(directory == NULL || *directory == '\0')
+		directory = "/tmp";
+
+	if((path = (char*) malloc(strlen(directory) + sizeof("/tpose-spill-XXXXXX"))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate spill memory\n");
+		exit(EXIT_FAILURE);
+	}
+	sprintf(path, "%s/tpose-spill-XXXXXX", directory);
+
+	if((fd = mkstemp(path)) == -1 || (file = fdopen(fd, "w+")) == NULL) {
+		fprintf(stderr, "Error: Cannot create spill file in %s (set TMPDIR to use another directory)\n", directory);
+		exit(EXIT_FAILURE);
+	}
+
+	unlink(path);
+	free(path);
+
+	return file;
+
+}
+
+
+
+/**
+ ** Writes to a spill file (there is no way to carry on without it)
+ **/
+static void tposeSpillWrite(
+	FILE* file
+	,const void* data
+	,size_t size
+) {
+
+	if(size && fwrite(data, 1, size, file) != size) {
+		fprintf(stderr, "Error: Cannot write spill file\n");
+		exit(EXIT_FAILURE);
+	}
+
+}
+
+
+
+/**
+ ** Maps the contents of a spill file (NULL if it is empty)
+ **/
+static char* tposeSpillMap(
+	FILE* file
+	,size_t* size
+) {
+
+	char* mapAddr;
+	off_t end;
+
+	if(fflush(file) != 0 || (end = lseek(fileno(file), 0, SEEK_END)) == -1) {
+		fprintf(stderr, "Error: Cannot write spill file\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if((*size = (size_t) end) == 0)
+		return NULL;
+
+	if((mapAddr = mmap(0, *size, PROT_READ, MAP_PRIVATE, fileno(file), 0)) == MAP_FAILED) {
+		fprintf(stderr, "Error: Cannot read spill file\n");
+		exit(EXIT_FAILURE);
+	}
+	madvise(mapAddr, *size, MADV_SEQUENTIAL);
+
+	return mapAddr;
+
+}
+
+
+
+/**
+ ** Allocates an empty dictionary
+ **/
+static TposeSpillDictionary* tposeSpillDictionaryAlloc(
+	TposeSpill* spill
+	,unsigned int depth
+) {
+
+	TposeSpillDictionary* dictionary;
+
+	if((dictionary = (TposeSpillDictionary*) calloc(1, sizeof(TposeSpillDictionary))) == NULL
+		|| (dictionary->firstRows = (uint64_t*) malloc(TPOSE_SPILL_MIN_GROUPS * sizeof(uint64_t))) == NULL
+		|| (dictionary->groups = tposeIOHeaderAlloc(TPOSE_SPILL_MIN_GROUPS, TPOSE_IO_MODIFY_HEADER)) == NULL
+		|| (dictionary->aggregator = tposeIOAggregatorAlloc(TPOSE_SPILL_MIN_GROUPS * (spill->tposeQuery)->numNumerics, (spill->tposeQuery)->aggregateStats)) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate spill memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	dictionary->groupTree = btreeAlloc();
+	dictionary->maxGroups = TPOSE_SPILL_MIN_GROUPS;
+	dictionary->depth = depth;
+
+	return dictionary;
+
+}
+
+
+
+/**
+ ** Frees a dictionary (its partitions are closed by tposeSpillFinish)
+ **/
+static void tposeSpillDictionaryFree(
+	TposeSpillDictionary** dictionaryPtr
+) {
+
+	TposeSpillDictionary* dictionary = *dictionaryPtr;
+
+	if(dictionary == NULL)
+		return;
+
+	if(dictionary->groups != NULL)
+		tposeIOHeaderFree(&(dictionary->groups));
+	if(dictionary->aggregator != NULL)
+		tposeIOAggregatorFree(&(dictionary->aggregator));
+	btreeFree(&(dictionary->groupTree));
+	free(dictionary->firstRows);
+	free(dictionary);
+	*dictionaryPtr = NULL;
+
+}
+
+
+
+/**
+ ** Adds a GROUP value to a dictionary, and returns its position
+ **/
+static unsigned int tposeSpillAddGroup(
+	TposeSpill* spill
+	,TposeSpillDictionary* dictionary
+	,TposeRow* row
+	,off_t hashValue
+	,uint64_t rowNumber
+) {
+
+	TposeHeader* groups = dictionary->groups;
+	BTreeKey key;
+
+	if(groups->numFields == dictionary->maxGroups) {
+		dictionary->maxGroups *= 2;
+		if((groups->fields = (char**) realloc(groups->fields, dictionary->maxGroups * sizeof(char*))) == NULL
+			|| (dictionary->firstRows = (uint64_t*) realloc(dictionary->firstRows, dictionary->maxGroups * sizeof(uint64_t))) == NULL) {
+			fprintf(stderr, "Error: Cannot allocate spill memory\n");
+			exit(EXIT_FAILURE);
+		}
+		groups->maxFields = dictionary->maxGroups;
+		tposeIOAggregatorGrow(dictionary->aggregator, dictionary->maxGroups * (spill->tposeQuery)->numNumerics);
+	}
+
+	btreeSetKeyValue(&key, hashValue, groups->numFields, 0);
+	key.isUnlinked = 0;
+	if(btreeInsert(dictionary->groupTree, &key) == -1)
+		fprintf(stderr, "Error: Cannot insert value into btree\n");
+
+	dictionary->firstRows[groups->numFields] = rowNumber;
+	dictionary->numBytes += row->groupLength + 1 + spill->groupBytes;
+	groups->fields[groups->numFields] = tposeArenaStrndup(groups->arena, row->group, row->groupLength);
+
+	return groups->numFields++;
+
+}
+
+
+
+/**
+ ** Writes a row to the partition of its GROUP value
+ **/
+static void tposeSpillWriteRow(
+	TposeSpill* spill
+	,TposeSpillDictionary* dictionary
+	,TposeRow* row
+	,off_t hashValue
+	,uint64_t rowNumber
+) {
+
+	unsigned int numNumerics = (spill->tposeQuery)->numNumerics;
+	uint32_t lengths[2 + TPOSE_IO_MAX_NUMERICS];
+	unsigned int partitionCtr;
+	unsigned int numericCtr;
+	FILE* partition;
+
+	if(dictionary->partitions[0] == NULL) {
+		for(partitionCtr = 0; partitionCtr < TPOSE_SPILL_FANOUT; partitionCtr++) {
+			dictionary->partitions[partitionCtr] = tposeSpillTempFile();
+			setvbuf(dictionary->partitions[partitionCtr], NULL, _IOFBF, TPOSE_SPILL_BUFFER_SIZE);
+		}
+		debug_print("tposeSpillWriteRow(): dictionary at depth %u is full (%u groups), spilling\n", dictionary->depth, (dictionary->groups)->numFields);
+	}
+
+	// Each level splits on the next bits of the hash (the levels above used the first ones)
+	partition = dictionary->partitions[((uint64_t) hashValue >> (64 - TPOSE_SPILL_FANOUT_BITS * (dictionary->depth + 1))) & (TPOSE_SPILL_FANOUT - 1)];
+
+	lengths[0] = row->groupLength;
+	for(numericCtr = 0; numericCtr < numNumerics; numericCtr++) {
+		if(row->numerics[numericCtr] == NULL)
+			lengths[1 + numericCtr] = TPOSE_SPILL_MISSING;
+		else if(row->numericsParsed & (1u << numericCtr))
+			lengths[1 + numericCtr] = TPOSE_SPILL_PARSED;
+		else
+			lengths[1 + numericCtr] = row->numericLengths[numericCtr];
+	}
+
+	tposeSpillWrite(partition, &rowNumber, sizeof(uint64_t));
+	tposeSpillWrite(partition, &hashValue, sizeof(off_t));
+	tposeSpillWrite(partition, lengths, (1 + numNumerics) * sizeof(uint32_t));
+	tposeSpillWrite(partition, row->group, row->groupLength);
+	for(numericCtr = 0; numericCtr < numNumerics; numericCtr++) {
+		if(lengths[1 + numericCtr] == TPOSE_SPILL_PARSED)
+			tposeSpillWrite(partition, &(row->numericValues[numericCtr]), sizeof(double));
+		else if(lengths[1 + numericCtr] != TPOSE_SPILL_MISSING)
+			tposeSpillWrite(partition, row->numerics[numericCtr], lengths[1 + numericCtr]);
+	}
+
+}
+
+
+
+/**
+ ** Aggregates the NUMERIC values of a row, or spills it if its GROUP value is
+ ** new and the dictionary is full (it always takes one group, so each level
+ ** has fewer groups left than the one above)
+ **/
+static void tposeSpillAddRow(
+	TposeSpill* spill
+	,TposeSpillDictionary* dictionary
+	,TposeRow* row
+	,uint64_t rowNumber
+) {
+
+	unsigned int numNumerics = (spill->tposeQuery)->numNumerics;
+	off_t hashValue = tposeIORowGroupHash(row);
+	BTreeKey* resultKey;
+	unsigned int group;
+	unsigned int numericCtr;
+
+	if((resultKey = btreeSearch(dictionary->groupTree, (dictionary->groupTree)->root, hashValue)) != NULL)
+		group = resultKey->dataOffset;
+	else if(dictionary->partitions[0] != NULL
+		|| ((dictionary->groups)->numFields > 0 && dictionary->depth < TPOSE_SPILL_MAX_DEPTH
+			&& dictionary->numBytes + row->groupLength + 1 + spill->groupBytes > spill->maxMemory)) {
+		tposeSpillWriteRow(spill, dictionary, row, hashValue, rowNumber);
+		return;
+	}
+	else
+		group = tposeSpillAddGroup(spill, dictionary, row, hashValue, rowNumber);
+
+	for(numericCtr = 0; numericCtr < numNumerics; numericCtr++) {
+		if(row->numerics[numericCtr] != NULL)
+			tposeIOAggregatorUpdateRow(dictionary->aggregator, group * numNumerics + numericCtr, row, numericCtr);
+	}
+
+}
+
+
+
+/**
+ ** Aggregates the rows of a partition file in a dictionary at depth
+ **/
+static void tposeSpillAggregatePartition(
+	TposeSpill* spill
+	,FILE* partition
+	,unsigned int depth
+);
+
+
+
+/**
+ ** Writes the names and aggregates of each group of a finished dictionary to the
+ ** results, frees it, then aggregates the rows it spilled (one partition at a time)
+ **/
+static void tposeSpillFinish(
+	TposeSpill* spill
+	,TposeSpillDictionary* dictionary
+) {
+
+	TposeQuery* tposeQuery = spill->tposeQuery;
+	TposeHeader* groups = dictionary->groups;
+	unsigned char fieldDelimiter = (tposeQuery->outputFile)->fieldDelimiter;
+	unsigned int numNumerics = tposeQuery->numNumerics;
+	FILE* partitions[TPOSE_SPILL_FANOUT];
+	uint32_t lengths[2];
+	unsigned int depth = dictionary->depth;
+	unsigned int group;
+	unsigned int numericCtr;
+	unsigned int aggregateCtr;
+	unsigned int partitionCtr;
+
+	// Record the segment of this dictionary
+	if(spill->numSegments + 1 >= spill->maxSegments) {
+		spill->maxSegments = spill->maxSegments ? spill->maxSegments * 2 : 64;
+		if((spill->segments = (off_t*) realloc(spill->segments, spill->maxSegments * sizeof(off_t))) == NULL) {
+			fprintf(stderr, "Error: Cannot allocate spill memory\n");
+			exit(EXIT_FAILURE);
+		}
+		if(spill->numSegments == 0)
+			spill->segments[0] = ftello(spill->results);
+	}
+
+	for(group = 0; group < groups->numFields; group++) {
+
+		rewind(spill->cellStream);
+		for(numericCtr = 0; numericCtr < numNumerics; numericCtr++) for(aggregateCtr = 0; aggregateCtr < tposeQuery->numAggregateTypes; aggregateCtr++)
+			tposeIOPrintCellName(tposeQuery, spill->cellStream, 0, groups->fields[group], numericCtr, aggregateCtr, fieldDelimiter);
+		lengths[0] = ftell(spill->cellStream);
+		for(numericCtr = 0; numericCtr < numNumerics; numericCtr++) for(aggregateCtr = 0; aggregateCtr < tposeQuery->numAggregateTypes; aggregateCtr++)
+			tposeIOPrintCellValue(tposeQuery, spill->cellStream, dictionary->aggregator, group * numNumerics + numericCtr, aggregateCtr, fieldDelimiter);
+		lengths[1] = ftell(spill->cellStream) - lengths[0];
+		fflush(spill->cellStream);
+
+		tposeSpillWrite(spill->results, &(dictionary->firstRows[group]), sizeof(uint64_t));
+		tposeSpillWrite(spill->results, lengths, sizeof(lengths));
+		tposeSpillWrite(spill->results, spill->cellBuffer, lengths[0] + lengths[1]);
+	}
+
+	spill->numGroups += groups->numFields;
+	spill->segments[++(spill->numSegments)] = ftello(spill->results);
+
+	// The memory of this dictionary is given back before the next level starts
+	memcpy(partitions, dictionary->partitions, sizeof(partitions));
+	tposeSpillDictionaryFree(&dictionary);
+
+	if(partitions[0] == NULL)
+		return;
+
+	for(partitionCtr = 0; partitionCtr < TPOSE_SPILL_FANOUT; partitionCtr++) {
+		tposeSpillAggregatePartition(spill, partitions[partitionCtr], depth + 1);
+		fclose(partitions[partitionCtr]);
+	}
+
+}
+
+
+
+static void tposeSpillAggregatePartition(
+	TposeSpill* spill
+	,FILE* partition
+	,unsigned int depth
+) {
+
+	unsigned int numNumerics = (spill->tposeQuery)->numNumerics;
+	TposeSpillDictionary* dictionary;
+	TposeRow row;
+	uint32_t lengths[2 + TPOSE_IO_MAX_NUMERICS];
+	uint64_t rowNumber;
+	unsigned int numericCtr;
+	size_t mapSize;
+	char* mapAddr;
+	char* rowPtr;
+	char* endPtr;
+
+	if((mapAddr = tposeSpillMap(partition, &mapSize)) == NULL)
+		return;
+
+	dictionary = tposeSpillDictionaryAlloc(spill, depth);
+	row.id = NULL;
+	row.idLength = 0;
+	row.indexRow = -1;
+	row.groupHashed = 1;
+
+	for(rowPtr = mapAddr, endPtr = mapAddr + mapSize; rowPtr < endPtr; ) {
+
+		memcpy(&rowNumber, rowPtr, sizeof(uint64_t));
+		memcpy(&(row.groupHash), rowPtr + sizeof(uint64_t), sizeof(off_t));
+		memcpy(lengths, rowPtr + sizeof(uint64_t) + sizeof(off_t), (1 + numNumerics) * sizeof(uint32_t));
+		rowPtr += sizeof(uint64_t) + sizeof(off_t) + (1 + numNumerics) * sizeof(uint32_t);
+
+		row.group = rowPtr;
+		row.groupLength = lengths[0];
+		rowPtr += lengths[0];
+
+		row.numNumerics = 0;
+		row.numericsParsed = 0;
+		for(numericCtr = 0; numericCtr < numNumerics; numericCtr++) {
+			if(lengths[1 + numericCtr] == TPOSE_SPILL_MISSING) {
+				row.numerics[numericCtr] = NULL;
+				continue;
+			}
+			row.numerics[numericCtr] = rowPtr;
+			if(lengths[1 + numericCtr] == TPOSE_SPILL_PARSED) {
+				memcpy(&(row.numericValues[numericCtr]), rowPtr, sizeof(double));
+				row.numericsParsed |= 1u << numericCtr;
+				row.numericLengths[numericCtr] = sizeof(double);
+			}
+			else
+				row.numericLengths[numericCtr] = lengths[1 + numericCtr];
+			rowPtr += row.numericLengths[numericCtr];
+			row.numNumerics++;
+		}
+
+		tposeSpillAddRow(spill, dictionary, &row, rowNumber);
+	}
+
+	munmap(mapAddr, mapSize);
+	tposeSpillFinish(spill, dictionary);
+
+}
+
+
+
+/**
+ ** Moves the segment at a position of a min-heap (ordered by the first row of the
+ ** next group in each segment) down to where it belongs
+ **/
+static void tposeSpillHeapDown(
+	unsigned int* heap
+	,unsigned int numHeap
+	,uint64_t* heads
+	,unsigned int position
+) {
+
+	unsigned int segment = heap[position];
+	unsigned int child;
+
+	while((child = 2 * position + 1) < numHeap) {
+		if(child + 1 < numHeap && heads[heap[child + 1]] < heads[heap[child]])
+			child++;
+		if(heads[segment] <= heads[heap[child]])
+			break;
+		heap[position] = heap[child];
+		position = child;
+	}
+
+	heap[position] = segment;
+
+}
+
+
+
+/**
+ ** Prints the column names (or the aggregates) of every group in the results as
+ ** one row, in the order the groups were found in the input. Each segment is
+ ** already in that order, so they are merged on the first row of their groups
+ **/
+static void tposeSpillPrintRow(
+	TposeSpill* spill
+	,char* mapAddr
+	,unsigned int values
+) {
+
+	FILE* fd = ((spill->tposeQuery)->outputFile)->fd;
+	unsigned char fieldDelimiter = ((spill->tposeQuery)->outputFile)->fieldDelimiter;
+	unsigned int numSegments = spill->numSegments;
+	unsigned int* heap;
+	uint64_t* heads;
+	off_t* cursors;
+	uint32_t lengths[2];
+	unsigned int numHeap = 0;
+	unsigned int segment;
+	uint64_t groupCtr;
+	char* recordPtr;
+	int position;
+
+	if((heap = (unsigned int*) malloc(numSegments * sizeof(unsigned int))) == NULL
+		|| (heads = (uint64_t*) malloc(numSegments * sizeof(uint64_t))) == NULL
+		|| (cursors = (off_t*) malloc(numSegments * sizeof(off_t))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate spill memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for(segment = 0; segment < numSegments; segment++) {
+		cursors[segment] = spill->segments[segment];
+		if(cursors[segment] < spill->segments[segment + 1]) {
+			memcpy(&(heads[segment]), mapAddr + cursors[segment], sizeof(uint64_t));
+			heap[numHeap++] = segment;
+		}
+	}
+	for(position = (int) numHeap / 2 - 1; position >= 0; position--)
+		tposeSpillHeapDown(heap, numHeap, heads, position);
+
+	for(groupCtr = 0; groupCtr < spill->numGroups; groupCtr++) {
+
+		segment = heap[0];
+		recordPtr = mapAddr + cursors[segment];
+		memcpy(lengths, recordPtr + sizeof(uint64_t), sizeof(lengths));
+		recordPtr += sizeof(uint64_t) + sizeof(lengths);
+
+		// Cells are stored followed by the field delimiter (the last one ends the row)
+		if(values)
+			fwrite(recordPtr + lengths[0], 1, lengths[1] - 1, fd);
+		else
+			fwrite(recordPtr, 1, lengths[0] - 1, fd);
+		fputc((groupCtr == spill->numGroups - 1) ? rowDelimiter : fieldDelimiter, fd);
+
+		cursors[segment] += sizeof(uint64_t) + sizeof(lengths) + lengths[0] + lengths[1];
+		if(cursors[segment] < spill->segments[segment + 1])
+			memcpy(&(heads[segment]), mapAddr + cursors[segment], sizeof(uint64_t));
+		else
+			heap[0] = heap[--numHeap];
+		tposeSpillHeapDown(heap, numHeap, heads, 0);
+	}
+
+	free(heap);
+	free(heads);
+	free(cursors);
+
+}
+
+
+
+/**
+ ** Transposes numeric values for each unique group value, in at most maxMemory
+ ** bytes (estimated) of GROUP values and aggregates. Groups found once that is
+ ** used up are spilled to temporary files by hash, and aggregated afterwards.
+ ** Rows are read in one pass, and there is no limit on the number of groups
+ **/
+void tposeSpillTransposeGroup(
+	TposeQuery* tposeQuery
+	,size_t maxMemory
+) {
+
+	TposeSpill spill;
+	TposeSpillDictionary* dictionary;
+	TposeInputFile* inputFile;
+	TposeRow row;
+	uint64_t rowNumber = 0;
+	unsigned int fileCtr;
+	size_t mapSize;
+	char* mapAddr;
+	char* rowPtr;
+	char* endPtr;
+	char* publishPtr;
+
+	memset(&spill, 0, sizeof(TposeSpill));
+	spill.tposeQuery = tposeQuery;
+	spill.maxMemory = maxMemory;
+	spill.groupBytes = TPOSE_SPILL_GROUP_BYTES + tposeQuery->numNumerics * tposeIOAggregatorFieldSize(tposeQuery->aggregateStats);
+
+	dictionary = tposeSpillDictionaryAlloc(&spill, 0);
+	row.indexRow = -1;
+
+	tposeIOPrefetchStartFiles(tposeQuery);
+
+	// Scan each input file in turn
+	for(fileCtr = 0; fileCtr < tposeQuery->numInputFiles; fileCtr++) {
+		inputFile = tposeQuery->inputFiles[fileCtr];
+		rowPtr = publishPtr = inputFile->dataAddr;
+		endPtr = inputFile->dataAddr + inputFile->dataSize;
+
+		while(rowPtr < endPtr) {
+
+			// Let the prefetcher know how far we've got
+			if(rowPtr >= publishPtr) {
+				tposeIOPrefetchPublish(fileCtr, rowPtr);
+				publishPtr = rowPtr + TPOSE_IO_PREFETCH_STEP;
+			}
+
+			rowPtr = tposeIOReadRow(tposeQuery, inputFile, rowPtr, endPtr, &row);
+			if(row.group == NULL || row.numNumerics == 0)
+				continue;
+
+			tposeSpillAddRow(&spill, dictionary, &row, rowNumber++);
+		}
+
+		tposeIOPrefetchPublish(fileCtr, NULL);
+	}
+
+	tposeIOPrefetchStop();
+
+	// Everything fit, so print as tposeIOTransposeGroup does
+	if(dictionary->partitions[0] == NULL) {
+		(tposeQuery->outputFile)->fileGroupHeader = dictionary->groups;
+		tposeQuery->aggregator = dictionary->aggregator;
+		dictionary->groups = NULL;
+		dictionary->aggregator = NULL;
+		tposeSpillDictionaryFree(&dictionary);
+		tposeIOPrintOutput(tposeQuery);
+		return;
+	}
+
+	if((spill.cellStream = open_memstream(&(spill.cellBuffer), &(spill.cellBufferSize))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate spill memory\n");
+		exit(EXIT_FAILURE);
+	}
+	spill.results = tposeSpillTempFile();
+	setvbuf(spill.results, NULL, _IOFBF, TPOSE_SPILL_BUFFER_SIZE);
+
+	tposeSpillFinish(&spill, dictionary);
+
+	debug_print("tposeSpillTransposeGroup(): %llu groups in %u segments\n", (unsigned long long) spill.numGroups, spill.numSegments);
+
+	mapAddr = tposeSpillMap(spill.results, &mapSize);
+	tposeSpillPrintRow(&spill, mapAddr, 0);
+	tposeSpillPrintRow(&spill, mapAddr, 1);
+	fflush((tposeQuery->outputFile)->fd);
+
+	munmap(mapAddr, mapSize);
+	fclose(spill.results);
+	fclose(spill.cellStream);
+	free(spill.cellBuffer);
+	free(spill.segments);
+
+}
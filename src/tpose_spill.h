@@ -0,0 +1,83 @@
+/* tpose_spill.h: bounded-memory GROUP aggregation interface;
+
+   Copyright 2015 Jonathan Sacramento.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TPOSE_SPILL_H_
+#define _TPOSE_SPILL_H_
+
+	#include <stdint.h>
+
+	#include "system.h"
+	#include "btree.h"
+	#include "tpose_io.h"
+
+
+	/**
+	 ** Implementation defs & limits
+	 **/
+	#define TPOSE_SPILL_FANOUT_BITS 4 // GROUP hash bits used to pick a partition at each level
+	#define TPOSE_SPILL_FANOUT (1 << TPOSE_SPILL_FANOUT_BITS) // Partitions the rows of new groups are spilled to, once a dictionary is full
+	#define TPOSE_SPILL_MAX_DEPTH (64 / TPOSE_SPILL_FANOUT_BITS - 1) // Deepest level (its groups share every hash bit, so it never spills)
+	#define TPOSE_SPILL_MIN_GROUPS 1024 // Groups a dictionary has room for at first
+	#define TPOSE_SPILL_GROUP_BYTES (sizeof(char*) + sizeof(BTreeKey) + sizeof(off_t) + sizeof(uint64_t)) // Memory of a group besides its value and aggregator fields
+	#define TPOSE_SPILL_BUFFER_SIZE 65536 // Write buffer of each partition file
+	#define TPOSE_SPILL_MISSING 0xFFFFFFFF // Length of a missing NUMERIC value in a spilled row
+	#define TPOSE_SPILL_PARSED 0xFFFFFFFE // Length of a NUMERIC value spilled as a double (see TposeRow numericsParsed)
+
+
+	/**
+	 ** TposeSpillDictionary
+	 ** GROUP values aggregated in memory at one level. Once it holds --max-memory,
+	 ** rows of new groups are written to partitions (by GROUP hash), each aggregated
+	 ** by a dictionary of its own at the next level
+	 **/
+	typedef struct {
+		TposeHeader* groups; // In order of discovery
+		BTree* groupTree; // Group hash -> position in groups
+		TposeAggregator* aggregator; // One field per GROUP and NUMERIC field
+		uint64_t* firstRows; // Input row each group was first found in
+		unsigned int maxGroups; // Groups there is room for in aggregator and firstRows
+		size_t numBytes; // Memory used by the groups (estimated)
+		FILE* partitions[TPOSE_SPILL_FANOUT]; // NULL until the dictionary is full
+		unsigned int depth;
+	} TposeSpillDictionary;
+
+	/**
+	 ** TposeSpill
+	 ** Output of every dictionary, written to a results file as it is done
+	 ** (one segment per dictionary, in the order of its groups). Each record
+	 ** is the first row of a group, the length of its column names and values,
+	 ** then the names and values (each followed by the field delimiter)
+	 **/
+	typedef struct {
+		TposeQuery* tposeQuery;
+		size_t maxMemory;
+		size_t groupBytes; // Memory of a group besides its value (see TPOSE_SPILL_GROUP_BYTES)
+		FILE* results;
+		off_t* segments; // Start of each segment (and the end of the last)
+		unsigned int numSegments;
+		unsigned int maxSegments;
+		uint64_t numGroups; // In all segments
+		FILE* cellStream; // Names and values of a group are printed here first
+		char* cellBuffer;
+		size_t cellBufferSize;
+	} TposeSpill;
+
+
+	void tposeSpillTransposeGroup(TposeQuery* tposeQuery, size_t maxMemory);
+
+#endif
@@ -0,0 +1,1633 @@
+/* tpose_state.c -- saved aggregate state (incremental runs) implementation.
+
+   Copyright 2015 Jonathan Sacramento.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tpose_state.h"
+
+
+
+/**
+ ** Allocates an empty state
+ **/
+TposeState* tposeStateAlloc(
+	void
+) {
+
+	TposeState* state;
+	unsigned int fieldCtr;
+
+	if((state = (TposeState*) calloc(1, sizeof(TposeState))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate state memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	state->groups = tposeIOHeaderAlloc(TPOSE_IO_MAX_FIELDS, TPOSE_IO_MODIFY_HEADER);
+	state->groupTree = btreeAlloc();
+	state->idTree = btreeAlloc();
+	state->idStrings = tposeArenaAlloc();
+	for(fieldCtr = 0; fieldCtr < 2 + TPOSE_IO_MAX_NUMERICS; fieldCtr++)
+		state->fields[fieldCtr] = -1;
+
+	return state;
+
+}
+
+
+
+/**
+ ** Frees a state
+ **/
+void tposeStateFree(
+	TposeState** statePtr
+) {
+
+	TposeState* state = *statePtr;
+	unsigned int ctr;
+
+	if(state == NULL)
+		return;
+
+	for(ctr = 0; ctr < state->numIds; ctr++) {
+		if(state->ids[ctr].aggregator != NULL)
+			tposeIOAggregatorFree(&(state->ids[ctr].aggregator));
+	}
+	for(ctr = 0; ctr < state->numFiles; ctr++)
+		free(state->files[ctr].filePath);
+	for(ctr = 0; ctr < 2 + TPOSE_IO_MAX_NUMERICS; ctr++)
+		free(state->fieldNames[ctr]);
+
+	if(state->groups != NULL)
+		tposeIOHeaderFree(&(state->groups));
+	btreeFree(&(state->groupTree));
+	btreeFree(&(state->idTree));
+	tposeArenaFree(&(state->idStrings));
+	free(state->ids);
+	free(state->files);
+	free(state);
+
+	*statePtr = NULL;
+
+}
+
+
+
+/**
+ ** Returns the path of the state file (sits next to the first input file)
+ **/
+char* tposeStatePath(
+	TposeQuery* tposeQuery
+) {
+
+	char* filePath = (tposeQuery->inputFile)->filePath;
+	char* statePath;
+
+	if((statePath = (char*) malloc(strlen(filePath) + strlen(TPOSE_STATE_EXT) + 1)) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate state path memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	strcpy(statePath, filePath);
+	strcat(statePath, TPOSE_STATE_EXT);
+
+	return statePath;
+
+}
+
+
+
+/**
+ ** Returns the position of a GROUP value in the state (added if new)
+ **/
+unsigned int tposeStateGroup(
+	TposeState* state
+	,char* group
+	,unsigned int groupLength
+	,off_t hashValue
+) {
+
+	BTreeKey key;
+	BTreeKey* resultKey;
+	TposeHeader* groups = state->groups;
+
+	if((resultKey = btreeSearch(state->groupTree, (state->groupTree)->root, hashValue)) != NULL)
+		return resultKey->dataOffset;
+
+	if(groups->numFields == groups->maxFields) {
+		fprintf(stderr, "Error: Too many unique GROUP values (maximum is %u)\n", groups->maxFields);
+		exit(EXIT_FAILURE);
+	}
+
+	btreeSetKeyValue(&key, hashValue, groups->numFields, 0);
+	key.isUnlinked = 0;
+	if(btreeInsert(state->groupTree, &key) == -1)
+		fprintf(stderr, "Error: Cannot insert value into btree\n");
+
+	groups->fields[groups->numFields] = tposeArenaStrndup(groups->arena, group, groupLength);
+
+	return groups->numFields++;
+
+}
+
+
+
+/**
+ ** Returns the aggregates of an ID value in the state (added if new)
+ **/
+TposeStateId* tposeStateId(
+	TposeState* state
+	,char* id
+	,unsigned int idLength
+) {
+
+	BTreeKey key;
+	BTreeKey* resultKey;
+	off_t hashValue = tposeIOHash(id, idLength);
+	TposeStateId* stateId;
+
+	if((resultKey = btreeSearch(state->idTree, (state->idTree)->root, hashValue)) != NULL)
+		return &(state->ids[resultKey->dataOffset]);
+
+	if(state->numIds == state->maxIds) {
+		state->maxIds = state->maxIds ? state->maxIds * 2 : 1024;
+		if((state->ids = (TposeStateId*) realloc(state->ids, state->maxIds * sizeof(TposeStateId))) == NULL) {
+			fprintf(stderr, "Error: Cannot allocate state memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	btreeSetKeyValue(&key, hashValue, state->numIds, 0);
+	key.isUnlinked = 0;
+	if(btreeInsert(state->idTree, &key) == -1)
+		fprintf(stderr, "Error: Cannot insert value into btree\n");
+
+	stateId = &(state->ids[state->numIds++]);
+	memset(stateId, 0, sizeof(TposeStateId));
+	stateId->id = tposeArenaStrndup(state->idStrings, id, idLength);
+	stateId->idLength = idLength;
+
+	return stateId;
+
+}
+
+
+
+/**
+ ** Makes room for the aggregates of every known GROUP value in an ID
+ **/
+static void tposeStateIdGroups(
+	TposeState* state
+	,TposeStateId* stateId
+) {
+
+	unsigned int numCells = (state->groups)->numFields * state->numNumerics;
+
+	if(stateId->aggregator == NULL) {
+		if((stateId->aggregator = tposeIOAggregatorAlloc(numCells, state->stats)) == NULL)
+			exit(EXIT_FAILURE);
+	}
+	else
+		tposeIOAggregatorGrow(stateId->aggregator, numCells);
+
+}
+
+
+
+/**
+ ** Returns the progress of an input file (added with no progress if new)
+ **/
+TposeStateFile* tposeStateFile(
+	TposeState* state
+	,TposeInputFile* inputFile
+) {
+
+	TposeStateFile* stateFile;
+	unsigned int fileCtr;
+
+	for(fileCtr = 0; fileCtr < state->numFiles; fileCtr++) {
+		if(!strcmp(state->files[fileCtr].filePath, inputFile->filePath))
+			return &(state->files[fileCtr]);
+	}
+
+	if(state->numFiles == state->maxFiles) {
+		state->maxFiles = state->maxFiles ? state->maxFiles * 2 : 16;
+		if((state->files = (TposeStateFile*) realloc(state->files, state->maxFiles * sizeof(TposeStateFile))) == NULL) {
+			fprintf(stderr, "Error: Cannot allocate state memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	stateFile = &(state->files[state->numFiles++]);
+	stateFile->filePath = strdup(inputFile->filePath);
+	stateFile->device = (uint64_t) (inputFile->fileStat).st_dev;
+	stateFile->inode = (uint64_t) (inputFile->fileStat).st_ino;
+	stateFile->offset = 0;
+
+	return stateFile;
+
+}
+
+
+
+/**
+ ** Aggregates the rows between start and end (offsets from dataAddr) into the state
+ ** Returns the offset after the last row aggregated
+ **/
+off_t tposeStateScan(
+	TposeQuery* tposeQuery
+	,TposeState* state
+	,TposeInputFile* inputFile
+	,off_t start
+	,off_t end
+) {
+
+	char* rowPtr = inputFile->dataAddr + start;
+	char* endPtr = inputFile->dataAddr + end;
+	TposeRow row;
+	TposeStateId* stateId = NULL;
+	unsigned int numNumerics = tposeQuery->numNumerics;
+	unsigned int numericCtr;
+	unsigned int cell;
+
+	state->stats = tposeQuery->aggregateStats;
+	state->precision = hllPrecisionGlobal;
+	state->decimals = (decimalsGlobal > 0) ? decimalsGlobal : 0;
+	state->numNumerics = numNumerics;
+	if(tposeQuery->id == -1)
+		stateId = tposeStateId(state, "", 0);
+
+	row.indexRow = -1;
+
+	while(rowPtr < endPtr) {
+
+		rowPtr = tposeIOReadRow(tposeQuery, inputFile, rowPtr, endPtr, &row);
+		if((tposeQuery->id != -1 && row.id == NULL) || row.group == NULL || row.numNumerics == 0)
+			continue;
+
+		// Rows for an ID tend to be together, so only look it up when it changes
+		if(tposeQuery->id != -1 && (stateId == NULL || row.idLength != stateId->idLength || memcmp(row.id, stateId->id, row.idLength)))
+			stateId = tposeStateId(state, row.id, row.idLength);
+
+		cell = tposeStateGroup(state, row.group, row.groupLength, tposeIORowGroupHash(&row)) * numNumerics;
+		if(stateId->aggregator == NULL || cell >= (stateId->aggregator)->numFields)
+			tposeStateIdGroups(state, stateId);
+
+		for(numericCtr = 0; numericCtr < numNumerics; numericCtr++) {
+			if(row.numerics[numericCtr] != NULL)
+				tposeIOAggregatorUpdateRow(stateId->aggregator, cell + numericCtr, &row, numericCtr);
+		}
+		stateId->changed = 1;
+	}
+
+	return endPtr - inputFile->dataAddr;
+
+}
+
+
+
+/**
+ ** Aggregates the data appended to each input file since the state was saved
+ ** Returns 0 if OK, -1 if an input file can not be continued from
+ **/
+int tposeStateUpdate(
+	TposeQuery* tposeQuery
+	,TposeState* state
+) {
+
+	TposeInputFile* inputFile;
+	TposeStateFile* stateFile;
+	unsigned int fileCtr;
+	char* endPtr;
+
+	for(fileCtr = 0; fileCtr < tposeQuery->numInputFiles; fileCtr++) {
+
+		inputFile = tposeQuery->inputFiles[fileCtr];
+		if(inputFile->compression != TPOSE_COMPRESS_NONE || inputFile->columnar != NULL) {
+			fprintf(stderr, "Error: Saved state needs uncompressed text input (%s)\n", inputFile->filePath);
+			return -1;
+		}
+
+		// Input files can only have grown since the last run
+		stateFile = tposeStateFile(state, inputFile);
+		if(stateFile->device != (uint64_t) (inputFile->fileStat).st_dev || stateFile->inode != (uint64_t) (inputFile->fileStat).st_ino
+			|| stateFile->offset > inputFile->dataSize) {
+			fprintf(stderr, "Error: %s has been replaced or truncated since the state was saved\n", inputFile->filePath);
+			return -1;
+		}
+
+		debug_print("tposeStateUpdate(): %s from offset %llu\n", inputFile->filePath, (unsigned long long) stateFile->offset);
+
+		// Only aggregate rows that have been completely written (the last row is left for a later run)
+		endPtr = inputFile->dataAddr + inputFile->dataSize;
+		while(endPtr > inputFile->dataAddr + stateFile->offset && *(endPtr - 1) != rowDelimiter)
+			--endPtr;
+
+		stateFile->offset = tposeStateScan(tposeQuery, state, inputFile, stateFile->offset, endPtr - inputFile->dataAddr);
+	}
+
+	return 0;
+
+}
+
+
+
+/**
+ ** Writes a length-prefixed string to a state file
+ **/
+static int tposeStateWriteString(
+	FILE* fd
+	,const char* string
+	,uint32_t length
+) {
+
+	return fwrite(&length, sizeof(length), 1, fd) != 1 || fwrite(string, 1, length, fd) != length;
+
+}
+
+
+
+/**
+ ** Reads a length-prefixed string from a state file
+ ** Returns a NULL-terminated copy (NULL on error)
+ **/
+static char* tposeStateReadString(
+	FILE* fd
+	,uint32_t* length
+) {
+
+	char* string;
+
+	if(fread(length, sizeof(*length), 1, fd) != 1 || *length >= TPOSE_IO_MAX_FIELD_WIDTH
+		|| (string = (char*) calloc(*length + 1, sizeof(char))) == NULL)
+		return NULL;
+
+	if(fread(string, 1, *length, fd) != *length) {
+		free(string);
+		return NULL;
+	}
+
+	return string;
+
+}
+
+
+
+/**
+ ** Writes the arrays of an ID's aggregator to a state file
+ **/
+static int tposeStateWriteAggregator(
+	FILE* fd
+	,TposeAggregator* aggregator
+) {
+
+	unsigned int numFields = aggregator->numFields;
+	unsigned int ctr;
+	int writeError = 0;
+
+	writeError |= fwrite(aggregator->counts, sizeof(int64_t), numFields, fd) != numFields;
+	if(aggregator->stats & TPOSE_IO_STATS_FLOAT32) {
+		if(aggregator->stats & TPOSE_IO_STATS_SUM)
+			writeError |= fwrite(aggregator->floatAggregates, sizeof(float), numFields, fd) != numFields;
+		if(aggregator->stats & TPOSE_IO_STATS_MINMAX) {
+			writeError |= fwrite(aggregator->floatMins, sizeof(float), numFields, fd) != numFields;
+			writeError |= fwrite(aggregator->floatMaxs, sizeof(float), numFields, fd) != numFields;
+		}
+	}
+	else {
+		if(aggregator->stats & TPOSE_IO_STATS_SUM)
+			writeError |= fwrite(aggregator->aggregates, sizeof(double), numFields, fd) != numFields;
+		if(aggregator->stats & TPOSE_IO_STATS_MINMAX) {
+			writeError |= fwrite(aggregator->mins, sizeof(double), numFields, fd) != numFields;
+			writeError |= fwrite(aggregator->maxs, sizeof(double), numFields, fd) != numFields;
+		}
+	}
+	if(aggregator->stats & TPOSE_IO_STATS_VARIANCE) {
+		writeError |= fwrite(aggregator->means, sizeof(double), numFields, fd) != numFields;
+		writeError |= fwrite(aggregator->m2s, sizeof(double), numFields, fd) != numFields;
+	}
+	if(aggregator->stats & TPOSE_IO_STATS_DISTINCT) {
+		for(ctr = 0; ctr < numFields; ctr++)
+			writeError |= tposeSketchHllWrite(fd, &(aggregator->sketches[ctr]), aggregator->precision);
+	}
+	if(aggregator->stats & TPOSE_IO_STATS_QUANTILE) {
+		for(ctr = 0; ctr < numFields; ctr++)
+			writeError |= tposeSketchQuantileWrite(fd, &(aggregator->quantiles[ctr]));
+	}
+	if(aggregator->stats & TPOSE_IO_STATS_FIXED)
+		writeError |= fwrite(aggregator->fixedSums, sizeof(int64_t), numFields, fd) != numFields;
+	if(aggregator->stats & TPOSE_IO_STATS_EXACT) {
+		writeError |= fwrite(aggregator->exactSums, sizeof(TposeExactSum), numFields, fd) != numFields;
+		if(aggregator->stats & TPOSE_IO_STATS_VARIANCE)
+			writeError |= fwrite(aggregator->exactSquares, sizeof(TposeExactSum), numFields, fd) != numFields;
+	}
+
+	return writeError;
+
+}
+
+
+
+/**
+ ** Reads the arrays of an ID's aggregator from a state file
+ **/
+static int tposeStateReadAggregator(
+	FILE* fd
+	,TposeAggregator* aggregator
+) {
+
+	unsigned int numFields = aggregator->numFields;
+	unsigned int ctr;
+	int readError = 0;
+
+	readError |= fread(aggregator->counts, sizeof(int64_t), numFields, fd) != numFields;
+	if(aggregator->stats & TPOSE_IO_STATS_FLOAT32) {
+		if(aggregator->stats & TPOSE_IO_STATS_SUM)
+			readError |= fread(aggregator->floatAggregates, sizeof(float), numFields, fd) != numFields;
+		if(aggregator->stats & TPOSE_IO_STATS_MINMAX) {
+			readError |= fread(aggregator->floatMins, sizeof(float), numFields, fd) != numFields;
+			readError |= fread(aggregator->floatMaxs, sizeof(float), numFields, fd) != numFields;
+		}
+	}
+	else {
+		if(aggregator->stats & TPOSE_IO_STATS_SUM)
+			readError |= fread(aggregator->aggregates, sizeof(double), numFields, fd) != numFields;
+		if(aggregator->stats & TPOSE_IO_STATS_MINMAX) {
+			readError |= fread(aggregator->mins, sizeof(double), numFields, fd) != numFields;
+			readError |= fread(aggregator->maxs, sizeof(double), numFields, fd) != numFields;
+		}
+	}
+	if(aggregator->stats & TPOSE_IO_STATS_VARIANCE) {
+		readError |= fread(aggregator->means, sizeof(double), numFields, fd) != numFields;
+		readError |= fread(aggregator->m2s, sizeof(double), numFields, fd) != numFields;
+	}
+	if(aggregator->stats & TPOSE_IO_STATS_DISTINCT) {
+		for(ctr = 0; ctr < numFields && !readError; ctr++)
+			readError |= tposeSketchHllRead(fd, &(aggregator->sketches[ctr]), aggregator->precision) != 0;
+	}
+	if(aggregator->stats & TPOSE_IO_STATS_QUANTILE) {
+		for(ctr = 0; ctr < numFields && !readError; ctr++)
+			readError |= tposeSketchQuantileRead(fd, &(aggregator->quantiles[ctr])) != 0;
+	}
+	if(aggregator->stats & TPOSE_IO_STATS_FIXED)
+		readError |= fread(aggregator->fixedSums, sizeof(int64_t), numFields, fd) != numFields;
+	if(aggregator->stats & TPOSE_IO_STATS_EXACT) {
+		readError |= fread(aggregator->exactSums, sizeof(TposeExactSum), numFields, fd) != numFields;
+		if(aggregator->stats & TPOSE_IO_STATS_VARIANCE)
+			readError |= fread(aggregator->exactSquares, sizeof(TposeExactSum), numFields, fd) != numFields;
+	}
+
+	return readError;
+
+}
+
+
+
+/**
+ ** Returns the name of a query field ("" if not used)
+ **/
+static char* tposeStateFieldName(
+	TposeQuery* tposeQuery
+	,int field
+) {
+
+	if(field == -1)
+		return "";
+
+	return ((tposeQuery->inputFile)->fileHeader)->fields[field];
+
+}
+
+
+
+/**
+ ** Fills queryFields with the ID, GROUP and NUMERIC fields of a query
+ ** Returns the number of fields
+ **/
+static unsigned int tposeStateQueryFields(
+	TposeQuery* tposeQuery
+	,int32_t* queryFields
+) {
+
+	unsigned int numericCtr;
+
+	queryFields[0] = tposeQuery->id;
+	queryFields[1] = tposeQuery->group;
+	for(numericCtr = 0; numericCtr < tposeQuery->numNumerics; numericCtr++)
+		queryFields[2 + numericCtr] = tposeQuery->numerics[numericCtr];
+
+	return 2 + tposeQuery->numNumerics;
+
+}
+
+
+
+/**
+ ** Loads a saved state (which must have been saved by the same query, if one is given)
+ ** Returns 0 if loaded, -1 if there is no saved state
+ **/
+int tposeStateRead(
+	TposeQuery* tposeQuery
+	,TposeState* state
+	,char* statePath
+) {
+
+	FILE* fd;
+	char magic[8];
+	char* string;
+	uint32_t version;
+	uint32_t length;
+	uint32_t count;
+	uint32_t numGroups;
+	uint32_t numCells;
+	uint32_t numNumerics;
+	uint32_t stats;
+	uint32_t precision;
+	uint32_t decimals;
+	int32_t field;
+	unsigned int ctr;
+	unsigned int fieldCtr;
+	TposeStateId* stateId;
+	TposeStateFile* stateFile;
+
+	if((fd = fopen(statePath, "rb")) == NULL)
+		return -1;
+
+	if(fread(magic, sizeof(magic), 1, fd) != 1 || memcmp(magic, TPOSE_STATE_MAGIC, sizeof(magic))
+		|| fread(&version, sizeof(version), 1, fd) != 1 || version != TPOSE_STATE_VERSION
+		|| fread(&(state->delimiter), sizeof(state->delimiter), 1, fd) != 1)
+		goto corrupt;
+
+	// Query the state was saved by
+	if(fread(&numNumerics, sizeof(numNumerics), 1, fd) != 1 || numNumerics == 0 || numNumerics > TPOSE_IO_MAX_NUMERICS)
+		goto corrupt;
+	state->numNumerics = numNumerics;
+	for(fieldCtr = 0; fieldCtr < 2 + numNumerics; fieldCtr++) {
+		if(fread(&field, sizeof(field), 1, fd) != 1 || field < -1 || field >= TPOSE_IO_MAX_FIELDS
+			|| (string = tposeStateReadString(fd, &length)) == NULL)
+			goto corrupt;
+		state->fields[fieldCtr] = field;
+		free(state->fieldNames[fieldCtr]);
+		state->fieldNames[fieldCtr] = string;
+	}
+	for(fieldCtr = 1; fieldCtr < 2 + numNumerics; fieldCtr++) {
+		if(state->fields[fieldCtr] == -1)
+			goto corrupt;
+	}
+	if(fread(&stats, sizeof(stats), 1, fd) != 1 || stats > (TPOSE_IO_STATS_MINMAX | TPOSE_IO_STATS_VARIANCE | TPOSE_IO_STATS_DISTINCT | TPOSE_IO_STATS_QUANTILE | TPOSE_IO_STATS_FIXED | TPOSE_IO_STATS_EXACT
+			| TPOSE_IO_STATS_SUM | TPOSE_IO_STATS_FLOAT32)
+		|| fread(&precision, sizeof(precision), 1, fd) != 1 || precision < TPOSE_SKETCH_HLL_MIN_PRECISION || precision > TPOSE_SKETCH_HLL_MAX_PRECISION
+		|| fread(&decimals, sizeof(decimals), 1, fd) != 1 || decimals > TPOSE_IO_MAX_DECIMALS)
+		goto corrupt;
+	state->stats = stats;
+	state->precision = precision;
+	state->decimals = decimals;
+	if(tposeQuery == NULL && (stats & TPOSE_IO_STATS_DISTINCT))
+		hllPrecisionGlobal = precision; // Sketches are loaded as saved
+	if(tposeQuery == NULL) {
+		decimalsGlobal = (stats & TPOSE_IO_STATS_FIXED) ? (int) decimals : TPOSE_IO_DECIMALS_OFF;
+		reproducibleGlobal = (stats & TPOSE_IO_STATS_EXACT) != 0; // Sums are kept as saved
+		float32Global = (stats & TPOSE_IO_STATS_FLOAT32) != 0;
+	}
+
+	if(tposeQuery != NULL) {
+		int32_t queryFields[2 + TPOSE_IO_MAX_NUMERICS];
+		if(tposeStateQueryFields(tposeQuery, queryFields) != 2 + numNumerics
+			|| state->delimiter != (tposeQuery->inputFile)->fieldDelimiter || state->stats != tposeQuery->aggregateStats
+			|| ((stats & TPOSE_IO_STATS_DISTINCT) && precision != hllPrecisionGlobal)
+			|| ((stats & TPOSE_IO_STATS_FIXED) && (int) decimals != decimalsGlobal))
+			goto mismatch;
+		for(fieldCtr = 0; fieldCtr < 2 + numNumerics; fieldCtr++) {
+			if(state->fields[fieldCtr] != queryFields[fieldCtr] || strcmp(state->fieldNames[fieldCtr], tposeStateFieldName(tposeQuery, queryFields[fieldCtr])))
+				goto mismatch;
+		}
+	}
+
+	// Input files
+	if(fread(&count, sizeof(count), 1, fd) != 1)
+		goto corrupt;
+	for(ctr = 0; ctr < count; ctr++) {
+		if(state->numFiles == state->maxFiles) {
+			state->maxFiles = state->maxFiles ? state->maxFiles * 2 : 16;
+			if((state->files = (TposeStateFile*) realloc(state->files, state->maxFiles * sizeof(TposeStateFile))) == NULL) {
+				fprintf(stderr, "Error: Cannot allocate state memory\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		stateFile = &(state->files[state->numFiles]);
+		if((stateFile->filePath = tposeStateReadString(fd, &length)) == NULL)
+			goto corrupt;
+		++state->numFiles;
+		if(fread(&(stateFile->device), sizeof(uint64_t), 1, fd) != 1
+			|| fread(&(stateFile->inode), sizeof(uint64_t), 1, fd) != 1
+			|| fread(&(stateFile->offset), sizeof(uint64_t), 1, fd) != 1)
+			goto corrupt;
+	}
+
+	// Groups (in order of discovery)
+	if(fread(&numGroups, sizeof(numGroups), 1, fd) != 1 || numGroups > TPOSE_IO_MAX_FIELDS)
+		goto corrupt;
+	for(ctr = 0; ctr < numGroups; ctr++) {
+		if((string = tposeStateReadString(fd, &length)) == NULL)
+			goto corrupt;
+		tposeStateGroup(state, string, length, tposeIOHash(string, length));
+		free(string);
+	}
+
+	// Aggregates of each ID
+	if(fread(&count, sizeof(count), 1, fd) != 1)
+		goto corrupt;
+	for(ctr = 0; ctr < count; ctr++) {
+		if((string = tposeStateReadString(fd, &length)) == NULL)
+			goto corrupt;
+		stateId = tposeStateId(state, string, length);
+		free(string);
+		if(fread(&numCells, sizeof(numCells), 1, fd) != 1 || numCells > (state->groups)->numFields * numNumerics)
+			goto corrupt;
+		if(numCells == 0)
+			continue;
+		if(stateId->aggregator != NULL // ID saved twice
+			|| (stateId->aggregator = tposeIOAggregatorAlloc(numCells, state->stats)) == NULL
+			|| tposeStateReadAggregator(fd, stateId->aggregator))
+			goto corrupt;
+	}
+
+	debug_print("tposeStateRead(): loaded %u groups and %u ids from %s\n", (state->groups)->numFields, state->numIds, statePath);
+
+	fclose(fd);
+	return 0;
+
+mismatch:
+	fprintf(stderr, "Error: State file %s was saved by a different query (remove it to start again)\n", statePath);
+	exit(EXIT_FAILURE);
+
+corrupt:
+	fprintf(stderr, "Error: State file %s is corrupt (remove it to start again)\n", statePath);
+	exit(EXIT_FAILURE);
+
+}
+
+
+
+/**
+ ** Writes a buffer to a file, via a temp file (readers never see a partial file)
+ ** Returns 0 if OK, -1 on error
+ **/
+int tposeStateWriteBuffer(
+	char* filePath
+	,char* buffer
+	,size_t size
+) {
+
+	FILE* fd;
+	char* tempPath;
+	int writeError = 0;
+
+	if((tempPath = (char*) malloc(strlen(filePath) + 5)) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate state path memory\n");
+		exit(EXIT_FAILURE);
+	}
+	sprintf(tempPath, "%s.tmp", filePath);
+
+	if((fd = fopen(tempPath, "wb")) == NULL) {
+		fprintf(stderr, "Error: Cannot write file %s\n", filePath);
+		free(tempPath);
+		return -1;
+	}
+
+	writeError |= fwrite(buffer, 1, size, fd) != size;
+	writeError |= fflush(fd) != 0;
+	writeError |= fsync(fileno(fd)) != 0; // Must survive the machine going down
+	writeError |= fclose(fd) != 0;
+
+	if(writeError || rename(tempPath, filePath) == -1) {
+		fprintf(stderr, "Error: Cannot write file %s\n", filePath);
+		remove(tempPath);
+		free(tempPath);
+		return -1;
+	}
+
+	free(tempPath);
+	return 0;
+
+}
+
+
+
+/**
+ ** Serialises the state into memory
+ ** Returns the buffer (to be freed by the caller) and its size
+ **/
+char* tposeStateSerialise(
+	TposeQuery* tposeQuery
+	,TposeState* state
+	,size_t* size
+) {
+
+	FILE* fd;
+	char* buffer = NULL;
+	char* fieldName;
+	uint32_t version = TPOSE_STATE_VERSION;
+	uint32_t count;
+	int32_t queryFields[2 + TPOSE_IO_MAX_NUMERICS];
+	unsigned int numQueryFields = tposeStateQueryFields(tposeQuery, queryFields);
+	unsigned char delimiter = (tposeQuery->inputFile)->fieldDelimiter;
+	unsigned int ctr;
+	int writeError = 0;
+	TposeStateId* stateId;
+	TposeStateFile* stateFile;
+
+	if((fd = open_memstream(&buffer, size)) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate state memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Query the state was built by
+	writeError |= fwrite(TPOSE_STATE_MAGIC, 8, 1, fd) != 1;
+	writeError |= fwrite(&version, sizeof(version), 1, fd) != 1;
+	writeError |= fwrite(&delimiter, sizeof(delimiter), 1, fd) != 1;
+	count = tposeQuery->numNumerics;
+	writeError |= fwrite(&count, sizeof(count), 1, fd) != 1;
+	for(ctr = 0; ctr < numQueryFields; ctr++) {
+		fieldName = tposeStateFieldName(tposeQuery, queryFields[ctr]);
+		writeError |= fwrite(&queryFields[ctr], sizeof(int32_t), 1, fd) != 1;
+		writeError |= tposeStateWriteString(fd, fieldName, strlen(fieldName));
+	}
+	count = tposeQuery->aggregateStats;
+	writeError |= fwrite(&count, sizeof(count), 1, fd) != 1;
+	count = hllPrecisionGlobal;
+	writeError |= fwrite(&count, sizeof(count), 1, fd) != 1;
+	count = (decimalsGlobal > 0) ? decimalsGlobal : 0;
+	writeError |= fwrite(&count, sizeof(count), 1, fd) != 1;
+
+	// Input files
+	count = state->numFiles;
+	writeError |= fwrite(&count, sizeof(count), 1, fd) != 1;
+	for(ctr = 0; ctr < state->numFiles; ctr++) {
+		stateFile = &(state->files[ctr]);
+		writeError |= tposeStateWriteString(fd, stateFile->filePath, strlen(stateFile->filePath));
+		writeError |= fwrite(&(stateFile->device), sizeof(uint64_t), 1, fd) != 1;
+		writeError |= fwrite(&(stateFile->inode), sizeof(uint64_t), 1, fd) != 1;
+		writeError |= fwrite(&(stateFile->offset), sizeof(uint64_t), 1, fd) != 1;
+	}
+
+	// Groups (in order of discovery)
+	count = (state->groups)->numFields;
+	writeError |= fwrite(&count, sizeof(count), 1, fd) != 1;
+	for(ctr = 0; ctr < count; ctr++)
+		writeError |= tposeStateWriteString(fd, (state->groups)->fields[ctr], strlen((state->groups)->fields[ctr]));
+
+	// Aggregates of each ID
+	count = state->numIds;
+	writeError |= fwrite(&count, sizeof(count), 1, fd) != 1;
+	for(ctr = 0; ctr < state->numIds; ctr++) {
+		stateId = &(state->ids[ctr]);
+		count = (stateId->aggregator != NULL) ? (stateId->aggregator)->numFields : 0;
+		writeError |= tposeStateWriteString(fd, stateId->id, stateId->idLength);
+		writeError |= fwrite(&count, sizeof(count), 1, fd) != 1;
+		if(count)
+			writeError |= tposeStateWriteAggregator(fd, stateId->aggregator);
+	}
+
+	if((fclose(fd) != 0) || writeError) {
+		fprintf(stderr, "Error: Cannot allocate state memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return buffer;
+
+}
+
+
+
+/**
+ ** Saves the state
+ **/
+int tposeStateWrite(
+	TposeQuery* tposeQuery
+	,TposeState* state
+	,char* statePath
+) {
+
+	size_t size;
+	char* buffer = tposeStateSerialise(tposeQuery, state, &size);
+	int result = tposeStateWriteBuffer(statePath, buffer, size);
+
+	free(buffer);
+	return result;
+
+}
+
+
+
+/**
+ ** Adds the aggregates of another state to a state
+ ** (GROUP and ID values new to the state are added in the order of the other state)
+ ** Returns 0 if OK, -1 if the states were saved by different queries
+ **/
+int tposeStateMerge(
+	TposeState* state
+	,TposeState* otherState
+) {
+
+	unsigned int groupMap[TPOSE_IO_MAX_FIELDS];
+	unsigned int groupCtr;
+	unsigned int numericCtr;
+	unsigned int numNumerics = otherState->numNumerics;
+	unsigned int idCtr;
+	char* group;
+	TposeStateId* stateId;
+	TposeStateId* otherId;
+
+	// Take on the query of the other state (when it was loaded from a file)
+	if(otherState->fieldNames[1] != NULL) {
+		if(state->fieldNames[1] == NULL) {
+			state->delimiter = otherState->delimiter;
+			for(groupCtr = 0; groupCtr < 2 + numNumerics; groupCtr++) {
+				state->fields[groupCtr] = otherState->fields[groupCtr];
+				state->fieldNames[groupCtr] = strdup(otherState->fieldNames[groupCtr]);
+			}
+		}
+		else if(state->delimiter != otherState->delimiter || state->numNumerics != numNumerics) {
+			return -1;
+		}
+		else {
+			for(groupCtr = 0; groupCtr < 2 + numNumerics; groupCtr++) {
+				if(state->fields[groupCtr] != otherState->fields[groupCtr] || strcmp(state->fieldNames[groupCtr], otherState->fieldNames[groupCtr]))
+					return -1;
+			}
+		}
+	}
+
+	// Both states must keep the same statistics for each ID
+	if(state->numIds == 0) {
+		state->stats = otherState->stats;
+		state->precision = otherState->precision;
+		state->decimals = otherState->decimals;
+		state->numNumerics = numNumerics;
+	}
+	else if(otherState->numIds != 0 && (state->stats != otherState->stats || state->numNumerics != numNumerics
+		|| ((state->stats & TPOSE_IO_STATS_DISTINCT) && state->precision != otherState->precision)
+		|| ((state->stats & TPOSE_IO_STATS_FIXED) && state->decimals != otherState->decimals)))
+		return -1;
+
+	for(groupCtr = 0; groupCtr < (otherState->groups)->numFields; groupCtr++) {
+		group = (otherState->groups)->fields[groupCtr];
+		groupMap[groupCtr] = tposeStateGroup(state, group, strlen(group), tposeIOHash(group, strlen(group)));
+	}
+
+	for(idCtr = 0; idCtr < otherState->numIds; idCtr++) {
+		otherId = &(otherState->ids[idCtr]);
+		stateId = tposeStateId(state, otherId->id, otherId->idLength);
+		stateId->changed |= otherId->changed;
+		if(otherId->aggregator == NULL)
+			continue;
+		tposeStateIdGroups(state, stateId);
+		for(groupCtr = 0; groupCtr < (otherId->aggregator)->numFields / numNumerics; groupCtr++) {
+			for(numericCtr = 0; numericCtr < numNumerics; numericCtr++)
+				tposeIOAggregatorMerge(stateId->aggregator, groupMap[groupCtr] * numNumerics + numericCtr, otherId->aggregator, groupCtr * numNumerics + numericCtr);
+		}
+	}
+
+	return 0;
+
+}
+
+
+
+/**
+ ** Allocates an input file with no data, whose header holds the fields
+ ** of the query a state was saved by (used to print merged states)
+ **/
+TposeInputFile* tposeStateInputFileAlloc(
+	TposeState* state
+) {
+
+	TposeInputFile* inputFile;
+	unsigned int numFields = 0;
+	unsigned int fieldCtr;
+
+	for(fieldCtr = 0; fieldCtr < 2 + state->numNumerics; fieldCtr++) {
+		if(state->fields[fieldCtr] + 1 > (int) numFields)
+			numFields = state->fields[fieldCtr] + 1;
+	}
+
+	if((inputFile = (TposeInputFile*) calloc(1, sizeof(TposeInputFile))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate input file memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	inputFile->fd = -1;
+	inputFile->fieldDelimiter = state->delimiter;
+	inputFile->fileHeader = tposeIOHeaderAlloc(numFields, TPOSE_IO_MODIFY_HEADER);
+	for(fieldCtr = 0; fieldCtr < 2 + state->numNumerics; fieldCtr++) {
+		if(state->fields[fieldCtr] != -1)
+			(inputFile->fileHeader)->fields[state->fields[fieldCtr]] = tposeArenaStrndup((inputFile->fileHeader)->arena, state->fieldNames[fieldCtr], strlen(state->fieldNames[fieldCtr]));
+	}
+	(inputFile->fileHeader)->numFields = numFields;
+
+	return inputFile;
+
+}
+
+
+
+/**
+ ** Converts a byte offset from the start of a file into the data offset
+ ** of the first row starting at or after it (as for partitions, a row
+ ** belongs to the range its first byte is in)
+ **/
+static off_t tposeStateAlignOffset(
+	TposeInputFile* inputFile
+	,off_t offset
+) {
+
+	off_t headerSize = inputFile->dataAddr - inputFile->fileAddr;
+	char* rowPtr;
+
+	if(offset <= headerSize)
+		return 0;
+
+	offset -= headerSize;
+	if(offset >= inputFile->dataSize)
+		return inputFile->dataSize;
+
+	if(*(inputFile->dataAddr + offset - 1) == rowDelimiter)
+		return offset;
+
+	if((rowPtr = memchr(inputFile->dataAddr + offset, rowDelimiter, inputFile->dataSize - offset)) == NULL)
+		return inputFile->dataSize;
+
+	return (rowPtr + 1) - inputFile->dataAddr;
+
+}
+
+
+
+/**
+ ** Aggregates the rows of the input files into the state
+ ** With a byte range (start >= 0), only the rows of the (single) input file
+ ** that start within [start, end) bytes from the start of the file are aggregated
+ ** Returns 0 if OK, -1 on error
+ **/
+int tposeStateScanRange(
+	TposeQuery* tposeQuery
+	,TposeState* state
+	,off_t start
+	,off_t end
+) {
+
+	TposeInputFile* inputFile;
+	unsigned int fileCtr;
+
+	if(start < 0) {
+		for(fileCtr = 0; fileCtr < tposeQuery->numInputFiles; fileCtr++) {
+			inputFile = tposeQuery->inputFiles[fileCtr];
+			tposeStateScan(tposeQuery, state, inputFile, 0, inputFile->dataSize);
+		}
+		return 0;
+	}
+
+	inputFile = tposeQuery->inputFile;
+	if(tposeQuery->numInputFiles > 1 || inputFile->columnar != NULL) {
+		fprintf(stderr, "Error: A byte range needs a single text input file\n");
+		return -1;
+	}
+
+	start = tposeStateAlignOffset(inputFile, start);
+	end = tposeStateAlignOffset(inputFile, end);
+
+	debug_print("tposeStateScanRange(): rows from %lld to %lld\n", (long long) start, (long long) end);
+
+	if(start < end)
+		tposeStateScan(tposeQuery, state, inputFile, start, end);
+
+	return 0;
+
+}
+
+
+
+/**
+ ** Prints the aggregates of the state, in the same layout as a full run
+ ** (only the IDs updated by this run if changedOnly is set)
+ **/
+void tposeStatePrint(
+	TposeQuery* tposeQuery
+	,TposeState* state
+	,unsigned int changedOnly
+) {
+
+	TposeOutputFile* outputFile = tposeQuery->outputFile;
+	TposeAggregator* aggregator;
+	TposeStateId* stateId;
+	unsigned int numGroups = (state->groups)->numFields;
+	unsigned int idCtr;
+
+	if(numGroups == 0)
+		return; // Nothing aggregated yet
+
+	aggregator = tposeIOAggregatorAlloc(numGroups * state->numNumerics, state->stats);
+	outputFile->fileGroupHeader = state->groups; // Borrowed for printing
+	tposeIOGroupOrderBuild(tposeQuery);
+
+	if(tposeQuery->id == -1) {
+		if(state->numIds && state->ids[0].aggregator != NULL)
+			tposeIOAggregatorCopy(aggregator, state->ids[0].aggregator);
+		tposeQuery->aggregator = aggregator;
+		tposeIOPrintOutput(tposeQuery);
+		tposeQuery->aggregator = NULL;
+	}
+	else {
+		tposeIOPrintGroupIdHeader(tposeQuery, outputFile);
+		for(idCtr = 0; idCtr < state->numIds; idCtr++) {
+
+			stateId = &(state->ids[idCtr]);
+			if(changedOnly && !stateId->changed)
+				continue;
+
+			tposeIOAggregatorReset(aggregator);
+			if(stateId->aggregator != NULL)
+				tposeIOAggregatorCopy(aggregator, stateId->aggregator);
+			tposeIOPrintGroupIdData(stateId->id, tposeQuery, outputFile, aggregator);
+		}
+	}
+
+	outputFile->fileGroupHeader = NULL;
+	tposeIOAggregatorFree(&aggregator);
+
+}
+
+
+
+/**
+ ** Stops --follow after the next snapshot (SIGINT/SIGTERM handler)
+ **/
+static volatile sig_atomic_t tposeStateFollowStopped = 0;
+
+static void tposeStateFollowStop(
+	int signalNumber
+) {
+
+	(void) signalNumber;
+	tposeStateFollowStopped = 1;
+
+}
+
+
+
+/**
+ ** Writes the output for the current state to a file, via a temp file
+ ** Returns 0 if OK, -1 on error
+ **/
+static int tposeStateSnapshot(
+	TposeQuery* tposeQuery
+	,TposeState* state
+	,char* outputPath
+) {
+
+	TposeOutputFile* queryOutputFile = tposeQuery->outputFile;
+	FILE* fd;
+	char* buffer = NULL;
+	size_t size = 0;
+	int result;
+
+	if((fd = open_memstream(&buffer, &size)) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate output memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	tposeQuery->outputFile = tposeIOOutputFileAlloc(fd, queryOutputFile->fieldDelimiter);
+	tposeStatePrint(tposeQuery, state, 0);
+	fclose(fd);
+	tposeIOOutputFileFree(&(tposeQuery->outputFile));
+	tposeQuery->outputFile = queryOutputFile;
+
+	result = tposeStateWriteBuffer(outputPath, buffer, size);
+	free(buffer);
+
+	return result;
+
+}
+
+
+
+/**
+ ** Keeps aggregating the rows appended to the input files, and rewrites the
+ ** output every interval seconds (if anything was added) until interrupted
+ ** Returns 0 if stopped by a signal, -1 on error
+ **/
+int tposeStateFollow(
+	TposeQuery* tposeQuery
+	,TposeState* state
+	,char* outputPath
+	,unsigned int interval
+) {
+
+	struct sigaction action;
+	unsigned int fileCtr;
+	uint64_t scanned;
+	uint64_t lastScanned = UINT64_MAX; // Always write the first snapshot
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = tposeStateFollowStop;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	for(;;) {
+
+		for(fileCtr = 0; fileCtr < tposeQuery->numInputFiles; fileCtr++) {
+			if(tposeIORemapInputFile(tposeQuery->inputFiles[fileCtr]) == -1)
+				return -1;
+		}
+
+		if(tposeStateUpdate(tposeQuery, state) == -1)
+			return -1;
+
+		for(scanned = 0, fileCtr = 0; fileCtr < state->numFiles; fileCtr++)
+			scanned += state->files[fileCtr].offset;
+
+		if(scanned != lastScanned) {
+			debug_print("tposeStateFollow(): snapshot at %llu bytes\n", (unsigned long long) scanned);
+			if(tposeStateSnapshot(tposeQuery, state, outputPath) == -1)
+				return -1;
+			lastScanned = scanned;
+		}
+
+		if(tposeStateFollowStopped)
+			return 0;
+
+		sleep(interval); // Cut short by SIGINT/SIGTERM (rows added since are picked up before stopping)
+	}
+
+}
+
+
+
+/**
+ ** Starts the checkpoint writer thread
+ **/
+TposeStateWriter* tposeStateWriterStart(
+	unsigned int numSlots
+) {
+
+	TposeStateWriter* writer;
+
+	if((writer = (TposeStateWriter*) calloc(1, sizeof(TposeStateWriter))) == NULL
+		|| (writer->paths = (char**) calloc(numSlots, sizeof(char*))) == NULL
+		|| (writer->buffers = (char**) calloc(numSlots, sizeof(char*))) == NULL
+		|| (writer->sizes = (size_t*) calloc(numSlots, sizeof(size_t))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate checkpoint memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	writer->numSlots = numSlots;
+	pthread_mutex_init(&(writer->lock), NULL);
+	pthread_cond_init(&(writer->wake), NULL);
+
+	if(pthread_create(&(writer->thread), NULL, tposeStateWriterRun, (void *) writer)) {
+		fprintf(stderr, "Error: Cannot create checkpoint thread\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return writer;
+
+}
+
+
+
+/**
+ ** Hands a serialised state to the writer thread (which frees it)
+ ** Replaces any older state of the same slot that has not been written yet
+ **/
+void tposeStateWriterQueue(
+	TposeStateWriter* writer
+	,unsigned int slot
+	,char* path
+	,char* buffer
+	,size_t size
+) {
+
+	pthread_mutex_lock(&(writer->lock));
+
+	free(writer->buffers[slot]);
+	writer->paths[slot] = path;
+	writer->buffers[slot] = buffer;
+	writer->sizes[slot] = size;
+
+	pthread_cond_signal(&(writer->wake));
+	pthread_mutex_unlock(&(writer->lock));
+
+}
+
+
+
+/**
+ ** Checkpoint writer thread
+ ** Writes queued states until stopped (and nothing is left to write)
+ **/
+void* tposeStateWriterRun(
+	void* writerArg
+) {
+
+	TposeStateWriter* writer = (TposeStateWriter*) writerArg;
+	unsigned int slot;
+	char* path;
+	char* buffer;
+	size_t size;
+
+	pthread_mutex_lock(&(writer->lock));
+
+	while(1) {
+
+		for(slot = 0; slot < writer->numSlots && writer->buffers[slot] == NULL; slot++);
+
+		if(slot == writer->numSlots) {
+			if(writer->stop)
+				break;
+			pthread_cond_wait(&(writer->wake), &(writer->lock));
+			continue;
+		}
+
+		path = writer->paths[slot];
+		buffer = writer->buffers[slot];
+		size = writer->sizes[slot];
+		writer->buffers[slot] = NULL;
+
+		// Scanners can carry on queueing while this is written
+		pthread_mutex_unlock(&(writer->lock));
+		if(tposeStateWriteBuffer(path, buffer, size) == -1)
+			writer->writeError = 1;
+		free(buffer);
+		pthread_mutex_lock(&(writer->lock));
+	}
+
+	pthread_mutex_unlock(&(writer->lock));
+
+	return NULL;
+
+}
+
+
+
+/**
+ ** Stops the checkpoint writer thread, once all queued states are written
+ ** Returns 0 if every checkpoint was written, -1 otherwise
+ **/
+int tposeStateWriterStop(
+	TposeStateWriter* writer
+) {
+
+	int writeError;
+
+	pthread_mutex_lock(&(writer->lock));
+	writer->stop = 1;
+	pthread_cond_signal(&(writer->wake));
+	pthread_mutex_unlock(&(writer->lock));
+
+	(void) pthread_join(writer->thread, NULL);
+
+	writeError = writer->writeError;
+
+	pthread_mutex_destroy(&(writer->lock));
+	pthread_cond_destroy(&(writer->wake));
+	free(writer->paths);
+	free(writer->buffers);
+	free(writer->sizes);
+	free(writer);
+
+	return writeError ? -1 : 0;
+
+}
+
+
+
+/**
+ ** Returns the path of a file in the checkpoint directory
+ **/
+static char* tposeStateCheckpointPath(
+	char* checkpointDir
+	,char* fileName
+) {
+
+	char* checkpointPath;
+
+	if((checkpointPath = (char*) malloc(strlen(checkpointDir) + strlen(fileName) + 2)) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate checkpoint path memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	sprintf(checkpointPath, "%s/%s", checkpointDir, fileName);
+
+	return checkpointPath;
+
+}
+
+
+
+/**
+ ** Saves the partitions of a checkpointed run (and the input files they belong to)
+ **/
+static int tposeStateWriteManifest(
+	TposeQuery* tposeQuery
+	,char* manifestPath
+) {
+
+	FILE* fd;
+	char* buffer = NULL;
+	size_t size;
+	uint32_t version = TPOSE_STATE_CHECKPOINT_VERSION;
+	uint32_t count;
+	uint32_t fileIndex;
+	uint64_t offset;
+	unsigned int ctr;
+	int result;
+	TposeCacheFingerprint fingerprint;
+
+	if((fd = open_memstream(&buffer, &size)) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate checkpoint memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	fwrite(TPOSE_STATE_CHECKPOINT_MAGIC, 8, 1, fd);
+	fwrite(&version, sizeof(version), 1, fd);
+
+	count = tposeQuery->numInputFiles;
+	fwrite(&count, sizeof(count), 1, fd);
+	for(ctr = 0; ctr < tposeQuery->numInputFiles; ctr++) {
+		tposeCacheFingerprint(tposeQuery->inputFiles[ctr], &fingerprint);
+		fwrite(&fingerprint, sizeof(fingerprint), 1, fd);
+	}
+
+	count = fileChunks;
+	fwrite(&count, sizeof(count), 1, fd);
+	for(ctr = 0; ctr < fileChunks; ctr++) {
+		for(fileIndex = 0; tposeQuery->inputFiles[fileIndex] != partitions[ctr].inputFile; fileIndex++);
+		fwrite(&fileIndex, sizeof(fileIndex), 1, fd);
+		offset = partitions[ctr].start;
+		fwrite(&offset, sizeof(offset), 1, fd);
+		offset = partitions[ctr].end;
+		fwrite(&offset, sizeof(offset), 1, fd);
+	}
+
+	if(fclose(fd) != 0) {
+		fprintf(stderr, "Error: Cannot allocate checkpoint memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	result = tposeStateWriteBuffer(manifestPath, buffer, size);
+	free(buffer);
+
+	return result;
+
+}
+
+
+
+/**
+ ** Loads the partitions of a checkpointed run
+ ** Returns 0 if loaded, -1 if there is no checkpoint
+ **/
+static int tposeStateReadManifest(
+	TposeQuery* tposeQuery
+	,char* manifestPath
+) {
+
+	FILE* fd;
+	char magic[8];
+	uint32_t version;
+	uint32_t count;
+	uint32_t fileIndex;
+	uint64_t start;
+	uint64_t end;
+	unsigned int ctr;
+	TposeCacheFingerprint fingerprint;
+	TposeCacheFingerprint savedFingerprint;
+
+	if((fd = fopen(manifestPath, "rb")) == NULL)
+		return -1;
+
+	if(fread(magic, sizeof(magic), 1, fd) != 1 || memcmp(magic, TPOSE_STATE_CHECKPOINT_MAGIC, sizeof(magic))
+		|| fread(&version, sizeof(version), 1, fd) != 1 || version != TPOSE_STATE_CHECKPOINT_VERSION
+		|| fread(&count, sizeof(count), 1, fd) != 1)
+		goto corrupt;
+
+	// Input files must not have changed
+	if(count != tposeQuery->numInputFiles)
+		goto changed;
+	for(ctr = 0; ctr < count; ctr++) {
+		tposeCacheFingerprint(tposeQuery->inputFiles[ctr], &fingerprint);
+		if(fread(&savedFingerprint, sizeof(savedFingerprint), 1, fd) != 1)
+			goto corrupt;
+		if(memcmp(&fingerprint, &savedFingerprint, sizeof(fingerprint)))
+			goto changed;
+	}
+
+	if(fread(&count, sizeof(count), 1, fd) != 1 || count == 0 || count > TPOSE_IO_MAX_PARTITIONS)
+		goto corrupt;
+	for(ctr = 0; ctr < count; ctr++) {
+		if(fread(&fileIndex, sizeof(fileIndex), 1, fd) != 1 || fileIndex >= tposeQuery->numInputFiles
+			|| fread(&start, sizeof(start), 1, fd) != 1 || fread(&end, sizeof(end), 1, fd) != 1
+			|| start > end || end > (tposeQuery->inputFiles[fileIndex])->dataSize)
+			goto corrupt;
+		partitions[ctr].inputFile = tposeQuery->inputFiles[fileIndex];
+		partitions[ctr].start = start;
+		partitions[ctr].end = end;
+	}
+	fileChunks = count;
+
+	fclose(fd);
+	return 0;
+
+changed:
+	fprintf(stderr, "Error: Input files have changed since checkpoint %s was written (remove it to start again)\n", manifestPath);
+	exit(EXIT_FAILURE);
+
+corrupt:
+	fprintf(stderr, "Error: Checkpoint %s is corrupt (remove it to start again)\n", manifestPath);
+	exit(EXIT_FAILURE);
+
+}
+
+
+
+/**
+ ** Aggregates every partition, saving the progress and partial aggregates
+ ** of each partition to checkpointDir as it goes. With resume, partitions
+ ** carry on from their last checkpoint (finished partitions are not scanned)
+ ** Returns 0 if OK (aggregates are added to state), -1 on error
+ **/
+int tposeStateCheckpoint(
+	TposeQuery* tposeQuery
+	,TposeState* state
+	,char* checkpointDir
+	,unsigned int resume
+	,unsigned int parallel
+) {
+
+	char* manifestPath;
+	char partName[32];
+	TposeStateTask* tasks;
+	TposeStateWriter* writer;
+	TposeStateFile* stateFile;
+	pthread_t* threads;
+	unsigned int taskCtr;
+	unsigned int threadCtr;
+
+	if(mkdir(checkpointDir, 0777) == -1 && errno != EEXIST) {
+		fprintf(stderr, "Error: Cannot create checkpoint directory %s\n", checkpointDir);
+		return -1;
+	}
+
+	manifestPath = tposeStateCheckpointPath(checkpointDir, TPOSE_STATE_CHECKPOINT_MANIFEST);
+
+	// Partitions are kept between runs (resumed partitions must cover the same rows)
+	if(!resume || tposeStateReadManifest(tposeQuery, manifestPath) == -1) {
+		resume = 0;
+		if(tposeIOBuildPartitions(tposeQuery, TPOSE_IO_PARTITION_GROUP) == -1) {
+			free(manifestPath);
+			return -1;
+		}
+		if(tposeStateWriteManifest(tposeQuery, manifestPath) == -1) {
+			free(manifestPath);
+			return -1;
+		}
+	}
+	free(manifestPath);
+
+	if((tasks = (TposeStateTask*) calloc(fileChunks, sizeof(TposeStateTask))) == NULL
+		|| (threads = (pthread_t*) calloc(fileChunks, sizeof(pthread_t))) == NULL) {
+		fprintf(stderr, "Error: Cannot allocate checkpoint memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for(taskCtr = 0; taskCtr < fileChunks; taskCtr++) {
+
+		sprintf(partName, "part-%04u%s", taskCtr, TPOSE_STATE_EXT);
+		tasks[taskCtr].query = tposeQuery;
+		tasks[taskCtr].state = tposeStateAlloc();
+		tasks[taskCtr].partition = &partitions[taskCtr];
+		tasks[taskCtr].partitionId = taskCtr;
+		tasks[taskCtr].statePath = tposeStateCheckpointPath(checkpointDir, partName);
+
+		// Carry on from the last checkpoint (if any)
+		if(resume)
+			tposeStateRead(tposeQuery, tasks[taskCtr].state, tasks[taskCtr].statePath);
+		stateFile = tposeStateFile(tasks[taskCtr].state, partitions[taskCtr].inputFile);
+		if(stateFile->offset < partitions[taskCtr].start || stateFile->offset > partitions[taskCtr].end)
+			stateFile->offset = partitions[taskCtr].start;
+
+		debug_print("tposeStateCheckpoint(): partition %u from %llu to %llu\n", taskCtr, (unsigned long long) stateFile->offset, (unsigned long long) partitions[taskCtr].end);
+	}
+
+	writer = tposeStateWriterStart(fileChunks);
+	for(taskCtr = 0; taskCtr < fileChunks; taskCtr++)
+		tasks[taskCtr].writer = writer;
+
+	// Partitions are shared between one worker per CPU
+	numWorkers = parallel ? tposeIONumWorkers() : 0;
+	for(threadCtr = 0; threadCtr < numWorkers; threadCtr++) {
+		if(pthread_create(&threads[threadCtr], NULL, tposeStateCheckpointWorker, (void *) tasks)) {
+			fprintf(stderr, "Error: cannot create thread - attempt to run tpose in single-threaded mode\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	for(threadCtr = 0; threadCtr < numWorkers; threadCtr++)
+		(void) pthread_join(threads[threadCtr], NULL);
+
+	if(!parallel) {
+		for(taskCtr = 0; taskCtr < fileChunks; taskCtr++)
+			tposeStateCheckpointRun((void *) &tasks[taskCtr]);
+	}
+
+	if(tposeStateWriterStop(writer) == -1)
+		fprintf(stderr, "Warning: Not all checkpoints could be written to %s\n", checkpointDir);
+
+	// Reduce partitions (in order, so GROUP and ID values keep the order of the input)
+	for(taskCtr = 0; taskCtr < fileChunks; taskCtr++) {
+		tposeStateMerge(state, tasks[taskCtr].state);
+		tposeStateFree(&(tasks[taskCtr].state));
+		free(tasks[taskCtr].statePath);
+	}
+
+	free(tasks);
+	free(threads);
+
+	return 0;
+
+}
+
+
+
+/**
+ ** Runs the checkpointed tasks of partitions (see tposeIONextPartition) until none are left
+ **/
+void* tposeStateCheckpointWorker(
+	void* tasksArg
+) {
+
+	TposeStateTask* tasks = (TposeStateTask*) tasksArg;
+	unsigned int taskCtr;
+
+	while((taskCtr = tposeIONextPartition()) < fileChunks)
+		tposeStateCheckpointRun((void *) &tasks[taskCtr]);
+
+	return NULL;
+
+}
+
+
+
+/**
+ ** Aggregates a partition, queueing a checkpoint every TPOSE_STATE_CHECKPOINT_STEP bytes
+ **/
+void* tposeStateCheckpointRun(
+	void* taskArg
+) {
+
+	TposeStateTask* task = (TposeStateTask*) taskArg;
+	TposePartition* partition = task->partition;
+	TposeInputFile* inputFile = partition->inputFile;
+	TposeStateFile* stateFile = tposeStateFile(task->state, inputFile);
+	off_t offset = stateFile->offset;
+	off_t stepEnd;
+	char* rowPtr;
+	char* buffer;
+	size_t size;
+
+	while(offset < partition->end) {
+
+		// Checkpoints are taken on row boundaries
+		stepEnd = offset + TPOSE_STATE_CHECKPOINT_STEP;
+		if(stepEnd >= partition->end)
+			stepEnd = partition->end;
+		else if(inputFile->columnar == NULL) {
+			if((rowPtr = memchr(inputFile->dataAddr + stepEnd, rowDelimiter, partition->end - stepEnd)) == NULL)
+				stepEnd = partition->end;
+			else
+				stepEnd = (rowPtr + 1) - inputFile->dataAddr;
+		}
+
+		offset = tposeStateScan(task->query, task->state, inputFile, offset, stepEnd);
+		stateFile->offset = offset;
+
+		buffer = tposeStateSerialise(task->query, task->state, &size);
+		tposeStateWriterQueue(task->writer, task->partitionId, task->statePath, buffer, size);
+	}
+
+	return NULL;
+
+}
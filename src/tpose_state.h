@@ -0,0 +1,153 @@
+/* tpose_state.h: saved aggregate state (incremental runs) interface;
+
+   Copyright 2015 Jonathan Sacramento.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TPOSE_STATE_H_
+#define _TPOSE_STATE_H_
+
+	#include <stdint.h>
+	#include <signal.h>
+	#include <sys/stat.h>
+
+	#include "system.h"
+	#include "btree.h"
+	#include "tpose_io.h"
+	#include "tpose_cache.h"
+
+
+	/**
+	 ** Implementation defs & limits
+	 **/
+	#define TPOSE_STATE_MAGIC "TPSTATE\0"
+	#define TPOSE_STATE_VERSION 8
+	#define TPOSE_STATE_EXT ".tpstate"
+
+	#define TPOSE_STATE_CHECKPOINT_MAGIC "TPCKPT\0\0"
+	#define TPOSE_STATE_CHECKPOINT_VERSION 1
+	#define TPOSE_STATE_CHECKPOINT_MANIFEST "manifest"
+	#define TPOSE_STATE_CHECKPOINT_STEP 268435456 // Bytes scanned by a partition between checkpoints
+
+	#define TPOSE_STATE_FOLLOW_INTERVAL 60 // Default seconds between --follow snapshots
+
+
+	/**
+	 ** TposeStateId
+	 ** Aggregates of one ID (a single ID with no value when there is no --id)
+	 **/
+	typedef struct {
+		char* id;
+		unsigned int idLength;
+		TposeAggregator* aggregator; // One field per GROUP and NUMERIC field seen with the ID (later groups are empty), NULL if none
+		unsigned int changed; // 1 if updated by this run
+	} TposeStateId;
+
+	/**
+	 ** TposeStateFile
+	 ** How much of an input file has been aggregated
+	 **/
+	typedef struct {
+		char* filePath;
+		uint64_t device;
+		uint64_t inode;
+		uint64_t offset; // Bytes of data (after the header row) aggregated so far
+	} TposeStateFile;
+
+	/**
+	 ** TposeState
+	 ** Everything needed to carry on aggregating from where a previous run stopped
+	 **/
+	typedef struct {
+		TposeHeader* groups; // In order of discovery
+		BTree* groupTree; // Group hash -> position in groups
+		TposeStateId* ids; // In order of discovery
+		unsigned int numIds;
+		unsigned int maxIds;
+		BTree* idTree; // ID hash -> position in ids
+		TposeArena* idStrings; // Holds the id of each TposeStateId
+		TposeStateFile* files;
+		unsigned int numFiles;
+		unsigned int maxFiles;
+		unsigned char delimiter; // Query the state was saved by (only set when loaded)
+		int fields[2 + TPOSE_IO_MAX_NUMERICS]; // ID, GROUP and NUMERIC field indexes (-1 if not used)
+		char* fieldNames[2 + TPOSE_IO_MAX_NUMERICS];
+		unsigned int numNumerics; // Each GROUP has one aggregator field per NUMERIC field
+		unsigned int stats; // TPOSE_IO_STATS_* kept for each ID (see tposeIOAggregatorAlloc)
+		unsigned int precision; // Of the distinct sketches (see tpose_sketch.h)
+		unsigned int decimals; // Of the exact sums (see --decimals)
+	} TposeState;
+
+	/**
+	 ** TposeStateWriter
+	 ** Background thread writing checkpoints (only the latest of each partition is kept)
+	 **/
+	typedef struct {
+		pthread_mutex_t lock;
+		pthread_cond_t wake;
+		char** paths;
+		char** buffers; // Serialised state waiting to be written (NULL if none)
+		size_t* sizes;
+		unsigned int numSlots;
+		int stop;
+		int writeError;
+		pthread_t thread;
+	} TposeStateWriter;
+
+	/**
+	 ** TposeStateTask
+	 ** Checkpointed aggregation of one partition
+	 **/
+	typedef struct {
+		TposeQuery* query;
+		TposeState* state;
+		TposePartition* partition;
+		unsigned int partitionId;
+		char* statePath;
+		TposeStateWriter* writer;
+	} TposeStateTask;
+
+
+	TposeState* tposeStateAlloc(void);
+	void tposeStateFree(TposeState** statePtr);
+	char* tposeStatePath(TposeQuery* tposeQuery);
+
+	int tposeStateRead(TposeQuery* tposeQuery, TposeState* state, char* statePath);
+	int tposeStateWrite(TposeQuery* tposeQuery, TposeState* state, char* statePath);
+	int tposeStateWriteBuffer(char* filePath, char* buffer, size_t size);
+	char* tposeStateSerialise(TposeQuery* tposeQuery, TposeState* state, size_t* size);
+	int tposeStateMerge(TposeState* state, TposeState* otherState);
+	TposeInputFile* tposeStateInputFileAlloc(TposeState* state);
+
+	unsigned int tposeStateGroup(TposeState* state, char* group, unsigned int groupLength, off_t hashValue);
+	TposeStateId* tposeStateId(TposeState* state, char* id, unsigned int idLength);
+	TposeStateFile* tposeStateFile(TposeState* state, TposeInputFile* inputFile);
+
+	off_t tposeStateScan(TposeQuery* tposeQuery, TposeState* state, TposeInputFile* inputFile, off_t start, off_t end);
+	int tposeStateScanRange(TposeQuery* tposeQuery, TposeState* state, off_t start, off_t end);
+	int tposeStateUpdate(TposeQuery* tposeQuery, TposeState* state);
+	void tposeStatePrint(TposeQuery* tposeQuery, TposeState* state, unsigned int changedOnly);
+	int tposeStateFollow(TposeQuery* tposeQuery, TposeState* state, char* outputPath, unsigned int interval);
+
+	TposeStateWriter* tposeStateWriterStart(unsigned int numSlots);
+	void tposeStateWriterQueue(TposeStateWriter* writer, unsigned int slot, char* path, char* buffer, size_t size);
+	void* tposeStateWriterRun(void* writerArg);
+	int tposeStateWriterStop(TposeStateWriter* writer);
+
+	int tposeStateCheckpoint(TposeQuery* tposeQuery, TposeState* state, char* checkpointDir, unsigned int resume, unsigned int parallel);
+	void* tposeStateCheckpointWorker(void* tasksArg);
+	void* tposeStateCheckpointRun(void* taskArg);
+
+#endif /* TPOSE_STATE_H */